@@ -14,7 +14,19 @@
 #include "elf.h"
 #include "ram.h"
 #include "control_unit.h"
+#include "machine.h"
+#include "journal.h"
+#include "timeline.h"
+#include "syscalls.h"
+#include "profile.h"
+#include "pipeline.h"
+#include "cache.h"
+#include "predictor.h"
+#include "trace.h"
+#include "debugger.h"
+#include "executor.h"
 #include "assembler_with_logs.h"
+#include "program_loader.h"
 
 
 #endif /* Aste-RISC_Bridging_Header_h */
@@ -60,6 +60,9 @@ struct ALU {
 			case 0x73: // ECALL
 				return .skip
 				
+			case 0x63: // B-Type, the zero flag of rs1 - rs2
+				return .sub
+				
 			case 0x33, 0x13, 0x67: // R-type, I-type ALU, JALR
 				break
         
@@ -30,9 +30,6 @@ class CPU: ObservableObject {
 	/// All frame pointer address
 	private var framePointers: [UInt32] = []
 	
-	/// Cronology for old stacks frames
-	var historyStack: [StateChange] = []
-	
 	/// Flag for reset all values on CPU
 	var resetFlag: Bool
 	
@@ -40,6 +37,78 @@ class CPU: ObservableObject {
 	/// this is nil because this is init late.
 	var ram: RAM? = nil
 	
+	/// Native execution engine, it shares `ram` and runs
+	/// instructions in batches without crossing the bridge
+	/// for every single instruction.
+	var machine: MACHINE? = nil
+	
+	/// Thread running the debugger commands, the interface
+	/// stays responsive while the program runs
+	private var executor: EXECUTOR? = nil
+	
+	/// True while the engine thread runs a command, the
+	/// machine and the ram belong to it until it stops
+	@Published
+	private(set) var isRunning: Bool = false
+	
+	/// Simulators attached to the engine. The profile counts
+	/// batches with a small overhead and is on from the start,
+	/// the others are off until the user turns them on
+	@Published
+	private(set) var simulators: Set<Simulator> = [.profile]
+	
+	/// Instructions with a breakpoint, they are set again
+	/// on the engine of the next runs
+	@Published
+	private(set) var breakpoints: Set<UInt32> = []
+	
+	/// Furthest step the program reached, the end of the timeline
+	@Published
+	private(set) var furthestStep: UInt64 = 0
+	
+	/// Samples the engine thread while it runs
+	private var sampler: AnyCancellable?
+	
+	/// Last snapshot published by the engine thread
+	private var snapshot = executor_snapshot_t()
+	
+	/// Registers as handed to the engine, the engine reports
+	/// which ones it changed so unchanged batches publish nothing
+	private var engineRegisters = [UInt32](repeating: 0, count: 32)
+	
+	/// Snapshots are sampled at display rate
+	static private let samplePeriod: TimeInterval = 1.0 / 60.0
+	
+	/// Memory cap of the undo journal, about 5.5M steps
+	static private let journalMaxBytes = 64 << 20
+	
+	/// Instructions between two timeline checkpoints,
+	/// a seek re-executes at most this many instructions
+	static private let checkpointInterval: UInt64 = 1_000_000
+	
+	/// Number of instructions retired by the native engine
+	var currentStep: UInt64 {
+		guard let machine = self.idleMachine else { return self.snapshot.instret }
+		return machine.pointee.instret
+	}
+	
+	/// First step a seek can reach, nil without a timeline
+	var timelineStart: UInt64? {
+		guard let timeline = self.idleMachine?.pointee.timeline, timeline.pointee.count > 0 else { return nil }
+		return timeline.pointee.checkpoints[0].instret
+	}
+	
+	/// True when there is at least one step to undo
+	var canStepBack: Bool {
+		guard let machine = self.idleMachine else { return false }
+		return journal_steps(machine.pointee.journal) > 0
+	}
+	
+	/// The engine, nil while its thread runs a command
+	private var idleMachine: MACHINE? {
+		return self.isRunning ? nil : self.machine
+	}
+	
 	init() {
 		self.programCounter = 0
 		self.resetFlag 		= false
@@ -49,31 +118,519 @@ class CPU: ObservableObject {
 	
 	/// Destroy struct, free RAM structure and set self nil
 	deinit {
+		self.stopExecutor()
+		if destroy_machine(self.machine) { self.machine = nil }
 		if destroy_ram(self.ram) { self.ram = nil }
 	}
 	
 	/// Reset all CPU status
 	func resetCpu() {
+		self.stopExecutor()
+		
 		self.stackStores 	= [:]
 		self.registers 		= [Int](repeating: 0, count: 32)
 		self.programCounter = 0
 		self.framePointers  = []
-		self.historyStack   = []
 		self.resetFlag	    = true
+		
+		// The machine points at the ram, destroy it first
+		if destroy_machine(self.machine) { self.machine = nil }
+		if destroy_ram(self.ram) { self.ram = nil }
+	}
+	
+	/// Replace the program ram, the previous one and the
+	/// machine pointing at it are released
+	func loadRam(_ ram: RAM?) {
+		self.stopExecutor()
+		
+		if destroy_machine(self.machine) { self.machine = nil }
+		if destroy_ram(self.ram) { self.ram = nil }
+		
+		self.ram = ram
+	}
+	
+	/// End the engine thread, the command it runs is dropped
+	private func stopExecutor() {
+		self.sampler?.cancel()
+		self.sampler = nil
+		
+		if destroy_executor(self.executor) { self.executor = nil }
+		if self.isRunning { self.isRunning = false }
+	}
+	
+	/// Bind the native engine to the loaded ram and predecode
+	/// the text section, call it after the program is loaded
+	func attachMachine(optionsSource: options_t) {
+		self.stopExecutor()
+		if destroy_machine(self.machine) { self.machine = nil }
+		
+		guard let ram = self.ram else { return }
+		self.machine = new_machine(ram, self.programCounter)
+		
+		guard let machine = self.machine else { return }
+		self.pushState(to: machine)
+		
+		_ = load_decoded_text(
+			self.machine,
+			optionsSource.text_data,
+			optionsSource.text_size,
+			optionsSource.text_vaddr
+		)
+		
+		// Ecalls are serviced in C, the guest output reaches the
+		// terminal a batch of lines at a time
+		_ = enable_syscalls(self.machine, AssemblerBridge.cCallback)
+		
+		// Steps and batches are recorded, so they can be undone
+		_ = enable_journal(self.machine, Self.journalMaxBytes)
+		
+		// The profile and the simulators the user turned on, the
+		// first checkpoint of the timeline is the freshly loaded program
+		self.furthestStep = 0
+		for simulator in self.simulators {
+			self.attach(simulator, enabled: true, to: machine)
+		}
+		
+		// Breakpoints and watchpoints, only checked by the debugger commands
+		_ = enable_debugger(self.machine)
+		
+		// Addresses left outside the new text section are dropped
+		for address in self.breakpoints where !set_breakpoint(machine, address, true) {
+			self.breakpoints.remove(address)
+		}
+		
+		// The run commands execute on their own thread
+		self.executor = new_executor(self.machine)
+	}
+	
+	/// Turn a simulator on or off, the choice is kept for the
+	/// next runs and applied at once when the engine is idle
+	func setSimulator(_ simulator: Simulator, enabled: Bool) {
+		if self.isRunning { return }
+		
+		if enabled {
+			self.simulators.insert(simulator)
+		} else {
+			self.simulators.remove(simulator)
+		}
+		
+		guard let machine = self.machine else { return }
+		self.attach(simulator, enabled: enabled, to: machine)
+	}
+	
+	/// Attach a simulator to the engine or release it
+	private func attach(_ simulator: Simulator, enabled: Bool, to machine: MACHINE) {
+		switch simulator {
+			// The first checkpoint is the current state
+			case .timeline:
+				if enabled {
+					_ = enable_timeline(machine, Self.checkpointInterval)
+				} else {
+					disable_timeline(machine)
+				}
+				
+			// Counting starts at the current step
+			case .profile:
+				if enabled {
+					_ = enable_profile(machine)
+				} else {
+					disable_profile(machine)
+				}
+				
+			// The default shape, five stages with forwarding
+			case .pipeline:
+				if enabled {
+					_ = enable_pipeline(machine, nil)
+				} else {
+					disable_pipeline(machine)
+				}
+				
+			// The default geometry for both of them, 4-way LRU
+			// with 64-byte lines, the data cache writes back
+			case .cache:
+				if enabled {
+					var instruction = cache_default_config()
+					var data 		= cache_default_config()
+					_ = enable_cache(machine, &instruction, &data)
+				} else {
+					disable_cache(machine)
+				}
+				
+			// The default bimodal table, without a BTB
+			case .predictor:
+				if enabled {
+					_ = enable_predictor(machine, nil)
+				} else {
+					disable_predictor(machine)
+				}
+		}
+	}
+	
+	/// Copy the current state into the engine
+	private func pushState(to machine: MACHINE) {
+		machine.pointee.pc = self.programCounter
+		for index in 0 ..< 32 {
+			self.engineRegisters[index] = UInt32(truncatingIfNeeded: self.registers[index])
+		}
+		
+		withUnsafeMutableBytes(of: &machine.pointee.registers) { buffer in
+			let registers = buffer.bindMemory(to: UInt32.self)
+			for index in 0 ..< 32 {
+				registers[index] = self.engineRegisters[index]
+			}
+		}
+	}
+	
+	/// Copy the engine state out, at most one publish for each
+	/// property and none when the batch left it unchanged
+	private func pullState(from machine: MACHINE) {
+		let changed = machine_sync_registers(machine, &self.engineRegisters)
+		self.publish(changed: changed, pc: machine.pointee.pc)
+		
+		if machine.pointee.instret > self.furthestStep {
+			self.furthestStep = machine.pointee.instret
+		}
+	}
+	
+	/// Publish the registers of `engineRegisters` set in `changed`,
+	/// and the pc when it moved
+	private func publish(changed: UInt32, pc: UInt32) {
+		if changed != 0 {
+			var newRegisters = self.registers
+			for index in 0 ..< 32 where changed & (1 << index) != 0 {
+				newRegisters[index] = Int(Int32(bitPattern: self.engineRegisters[index]))
+			}
+			
+			self.registers = newRegisters
+		}
+		
+		if self.programCounter != pc {
+			self.programCounter = pc
+		}
+	}
+	
+	/// Run up to `maxInstructions` instructions on the native engine.
+	///
+	/// The registers are copied in before the batch and copied out
+	/// once at the end, so observers are notified once per batch
+	/// instead of once per instruction.
+	func runBatch(maxInstructions: UInt64) -> ExecutionStatus {
+		return self.runNative { machine in cpu_run(machine, maxInstructions) }
+	}
+	
+	/// Run until a breakpoint or a watchpoint stops the program,
+	/// the breakpoint under the current pc is passed
+	func continueExecution() {
+		self.start(EXECUTOR_RUN)
+	}
+	
+	/// Execute the next instruction, a call runs at full speed
+	/// until it returns
+	func stepOver() {
+		self.start(EXECUTOR_STEP_OVER)
+	}
+	
+	/// Run until the current function returns to its caller
+	func stepOut() {
+		self.start(EXECUTOR_STEP_OUT)
+	}
+	
+	/// Run until `address` is reached, the instruction there
+	/// is not executed
+	func runToCursor(address: UInt32) {
+		self.start(EXECUTOR_RUN_TO, address: address)
+	}
+	
+	/// Stop the running command, the state is published
+	/// once the engine thread let go of the machine
+	func pause() {
+		guard let executor = self.executor, self.isRunning else { return }
+		
+		_ = executor_post(executor, EXECUTOR_PAUSE, 0)
+	}
+	
+	/// Hand a command to the engine thread, its snapshots are
+	/// sampled at display rate until it stops
+	private func start(_ command: executor_command_t, address: UInt32 = 0) {
+		guard let machine = self.idleMachine, let executor = self.executor else { return }
+		
+		self.pushState(to: machine)
+		guard executor_post(executor, command, address) else { return }
+		
+		self.isRunning = true
+		self.sampler   = Timer.publish(every: Self.samplePeriod, on: .main, in: .common)
+			.autoconnect()
+			.sink { [weak self] _ in self?.sample() }
+	}
+	
+	/// Publish the last snapshot, once the command stopped the
+	/// machine is read back and the reason it stopped reported
+	private func sample() {
+		guard let executor = self.executor, let machine = self.machine else { return }
+		
+		// Read before the snapshot, once the thread is idle
+		// the snapshot sampled next is its final state
+		let isBusy = executor_busy(executor)
+		
+		var snapshot = executor_snapshot_t()
+		executor_sample(executor, &snapshot)
+		
+		if snapshot.publications != self.snapshot.publications {
+			self.snapshot = snapshot
+			
+			var changed: UInt32 = 0
+			withUnsafeBytes(of: snapshot.registers) { buffer in
+				let registers = buffer.bindMemory(to: UInt32.self)
+				for index in 0 ..< 32 where self.engineRegisters[index] != registers[index] {
+					self.engineRegisters[index] = registers[index]
+					changed |= 1 << index
+				}
+			}
+			
+			self.publish(changed: changed, pc: snapshot.pc)
+		}
+		
+		if isBusy { return }
+		
+		self.sampler?.cancel()
+		self.sampler   = nil
+		self.isRunning = false
+		
+		self.pullState(from: machine)
+		
+		let result = self.executionStatus(of: snapshot.status)
+		if result != .success { print(result.rawValue) }
+	}
+	
+	/// Set or clear the breakpoint on an instruction
+	///
+	/// - Returns: true when a breakpoint is set on it afterwards
+	@discardableResult
+	func toggleBreakpoint(address: UInt32) -> Bool {
+		guard let machine = self.idleMachine else { return false }
+		
+		let enabled = !has_breakpoint(machine, address)
+		guard set_breakpoint(machine, address, enabled) else { return false }
+		
+		if enabled {
+			self.breakpoints.insert(address)
+		} else {
+			self.breakpoints.remove(address)
+		}
+		
+		return enabled
+	}
+	
+	/// Forget every breakpoint, when another program is opened
+	func clearBreakpoints() {
+		if let machine = self.idleMachine {
+			for address in self.breakpoints { _ = set_breakpoint(machine, address, false) }
+		}
+		
+		self.breakpoints.removeAll()
+	}
+	
+	/// Stop the debugger commands after a store into `size` bytes
+	func watch(address: UInt32, size: UInt32 = 4) -> Bool {
+		guard let machine = self.idleMachine else { return false }
+		
+		return add_watchpoint(machine, address, size)
+	}
+	
+	/// Stop watching a range added with `watch`
+	func unwatch(address: UInt32, size: UInt32 = 4) -> Bool {
+		guard let machine = self.idleMachine else { return false }
+		
+		return remove_watchpoint(machine, address, size)
+	}
+	
+	/// Copy the state in, run the engine and copy it out once,
+	/// the guest output is flushed to the terminal afterwards
+	private func runNative(_ run: (MACHINE) -> cpu_status_t) -> ExecutionStatus {
+		guard let machine = self.idleMachine else { return .instructionFetchFailed }
+		
+		self.pushState(to: machine)
+		let status = run(machine)
+		self.pullState(from: machine)
+		
+		syscall_flush(machine.pointee.syscalls)
+		
+		return self.executionStatus(of: status)
+	}
+	
+	/// Move to the state after `step` retired instructions, the nearest
+	/// checkpoint is restored and the program runs forward from it
+	func seek(toStep step: UInt64) -> ExecutionStatus {
+		guard let machine = self.idleMachine else { return .instructionFetchFailed }
+		
+		self.pushState(to: machine)
+		let status = timeline_seek(machine, step)
+		self.pullState(from: machine)
+		
+		return self.executionStatus(of: status)
+	}
+	
+	/// Opcode, ALU and memory histograms of the batches run so far
+	func profileSnapshot() -> profile_snapshot_t? {
+		guard let machine = self.idleMachine else { return nil }
+		
+		var snapshot = profile_snapshot_t()
+		return profile_snapshot(machine, &snapshot) ? snapshot : nil
+	}
+	
+	/// The `limit` most executed instructions, hottest first
+	func hotInstructions(limit: Int) -> [profile_entry_t] {
+		guard let machine = self.idleMachine, limit > 0 else { return [] }
+		
+		var entries = [profile_entry_t](repeating: profile_entry_t(), count: limit)
+		let count   = profile_hot(machine, &entries, UInt32(limit))
+		
+		return Array(entries.prefix(Int(count)))
+	}
+	
+	/// Cycles, CPI and stall breakdown of the batches run so far
+	func pipelineStats() -> pipeline_stats_t? {
+		guard let machine = self.idleMachine else { return nil }
+		
+		var stats = pipeline_stats_t()
+		return pipeline_stats(machine, &stats) ? stats : nil
+	}
+	
+	/// Hits, misses and evictions of a cache, in total and by region
+	func cacheStats(kind: cache_kind_t) -> cache_stats_t? {
+		guard let machine = self.idleMachine else { return nil }
+		
+		var stats = cache_stats_t()
+		return cache_stats(machine, kind, &stats) ? stats : nil
+	}
+	
+	/// Branches, mispredictions and accuracy of the batches run so far
+	func predictorStats() -> predictor_stats_t? {
+		guard let machine = self.idleMachine else { return nil }
+		
+		var stats = predictor_stats_t()
+		return predictor_stats(machine, &stats) ? stats : nil
+	}
+	
+	/// Most mispredicted branches, worst first
+	func mispredictedBranches(limit: Int) -> [predictor_entry_t] {
+		guard let machine = self.idleMachine, limit > 0 else { return [] }
+		
+		var entries = [predictor_entry_t](repeating: predictor_entry_t(), count: limit)
+		let count   = predictor_branches(machine, &entries, UInt32(limit))
+		
+		return Array(entries.prefix(Int(count)))
+	}
+	
+	/// Record every instruction retired from now on to a trace file,
+	/// it is written in the background while the program runs
+	func startTrace(path: String) -> Bool {
+		guard let machine = self.idleMachine else { return false }
+		
+		return enable_trace(machine, path)
+	}
+	
+	/// Complete the trace file, nil when nothing was traced or it could
+	/// not be written
+	func stopTrace() -> trace_stats_t? {
+		guard let machine = self.idleMachine else { return nil }
+		
+		var stats = trace_stats_t()
+		return disable_trace(machine, &stats) ? stats : nil
+	}
+	
+	/// Map the reason the native engine stopped to the UI status
+	private func executionStatus(of status: cpu_status_t) -> ExecutionStatus {
+		switch status {
+			case CPU_STATUS_OUT_OF_TEXT, CPU_STATUS_BUDGET_EXHAUSTED:
+				return .success
+				
+			case CPU_STATUS_ECALL, CPU_STATUS_EBREAK:
+				return .environmentCall
+				
+			case CPU_STATUS_EXIT:
+				if let syscalls = self.machine?.pointee.syscalls {
+					print("Exit code: \(syscalls.pointee.exit_code)")
+				}
+				
+				return .programExited
+				
+			case CPU_STATUS_FETCH_FAULT:
+				return .instructionFetchFailed
+				
+			// The end of a step over, a step out or a run to cursor
+			// is not reported
+			case CPU_STATUS_BREAKPOINT:
+				let stop = self.machine?.pointee.debugger?.pointee.stop
+				return stop == DEBUGGER_STOP_STEP ? .success : .breakpointReached
+				
+			case CPU_STATUS_WATCHPOINT:
+				return .watchpointReached
+				
+			case CPU_STATUS_LOAD_FAULT, CPU_STATUS_STORE_FAULT:
+				guard let machine = self.machine else { return .invalidOperation }
+				
+				let access  = machine.pointee.fault_access
+				let address = machine.pointee.fault_address
+				let region  = ram_find_region(machine.pointee.ram, address)
+				let name    = region.map { String(cString: $0.pointee.name) } ?? "no region"
+				
+				print("Fault at 0x\(String(format: "%08x", address)) (\(name)): \(String(cString: ram_access_description(access)))")
+				
+				if access == RAM_ACCESS_PROTECTION || access == RAM_ACCESS_UNMAPPED {
+					return .memoryProtectionFault
+				}
+				
+				return status == CPU_STATUS_LOAD_FAULT ? .ramReadFailed : .ramStoreFailed
+				
+			default:
+				return .invalidOperation
+		}
 	}
 		
 	/// Run single instruction on assembly progrma,
 	/// the run ekecution is step by step
 	func runStep(optionsSource: options_t) -> ExecutionStatus {
+		// The engine thread owns the machine until its command stops
+		if self.isRunning { return .success }
+		
 		if programCounter >= optionsSource.text_vaddr &&
 			programCounter < optionsSource.text_vaddr + UInt32(optionsSource.text_size) {
 			
+			// The native engine counts the step, so the
+			// timeline and the journal stay in sync
+			if self.machine != nil {
+				self.trackStackStore()
+				return self.runBatch(maxInstructions: 1)
+			}
+			
 			return executeSingleInstruction(optionsSource: optionsSource)
 		}
 		
 		return .success
 	}
 	
+	/// Remember which register a store into the stack frame saves,
+	/// the instruction is peeked before the native engine runs it
+	private func trackStackStore() {
+		guard let ram = self.ram else { return }
+		
+		var rawInstruction: UInt32 = 0
+		if ram_load32(ram, self.programCounter, &rawInstruction) != RAM_ACCESS_OK { return }
+		
+		let decodedInstruction = decode(Int(Int32(bitPattern: rawInstruction)))
+		
+		if decodedInstruction.operationCode != 0x23 { return }
+		
+		let base = getValueRegister(Int(decodedInstruction.registerSource1))
+		let memoryAddress = UInt32(truncatingIfNeeded: base + decodedInstruction.immediate)
+		let sp = UInt32(truncatingIfNeeded: registers[2])
+		
+		if memoryAddress >= sp && memoryAddress < sp + 512 {
+			stackStores[memoryAddress] = Int(decodedInstruction.registerSource2)
+		}
+	}
+	
 	/// Execute single instruction
 	private func executeSingleInstruction(
 		optionsSource: options_t
@@ -87,11 +644,11 @@ class CPU: ObservableObject {
 		// Calc and save next program counter
 		var nextProgramCounter = self.programCounter + 4
 		
-		let rawInstruction = fetch(optionsSource: optionsSource)
-				
-		if rawInstruction == -1 { return .instructionFetchFailed }
+		guard let rawInstruction = fetch(optionsSource: optionsSource) else {
+			return .instructionFetchFailed
+		}
 		
-		let decodedInstruction = decode(Int(rawInstruction))
+		let decodedInstruction = decode(Int(Int32(bitPattern: rawInstruction)))
 		
 		// MARK: - Fetch signal & ALU
 		
@@ -107,6 +664,13 @@ class CPU: ObservableObject {
 		
 		if aluOperation == .unknown { return .invalidOperation }
 		
+		// Every change of this step is recorded for undo, it begins
+		// once the instruction is decoded and closes on every return,
+		// a load or store fault included
+		let journal = self.machine?.pointee.journal
+		journal_begin_step(journal, oldPC)
+		defer { journal_end_step(journal) }
+		
 		var firstOperand  = 0
 		var secondOperand = 0
 		
@@ -116,6 +680,9 @@ class CPU: ObservableObject {
             firstOperand = if controlUnitState.operation == 0x17 {
                 Int(programCounter)
 				
+			} else if controlUnitState.operation == 0x37 {
+				0 // LUI
+				
 			} else {
                 getValueRegister(Int(decodedInstruction.registerSource1))
 			}
@@ -160,10 +727,13 @@ class CPU: ObservableObject {
 				
 			case I_SAVE_TYPE:
                             
-				let valueRamRead = read_ram32bit(ram, UInt32(resultAlu.result))
-				if valueRamRead == -1 { return .ramReadFailed }
+				guard let valueRamRead = performLoad(
+					address: UInt32(truncatingIfNeeded: resultAlu.result),
+					funct3 : decodedInstruction.funz3
+					
+				) else { return .ramReadFailed }
 				
-				valueToWriteBack = Int(valueRamRead)
+				valueToWriteBack = Int(Int32(bitPattern: valueRamRead))
 				break
 				
 			case S_TYPE:
@@ -180,14 +750,11 @@ class CPU: ObservableObject {
 					stackStores[memoryAddress] = registerSource2
 				}
 				
-				let originalValue = read_ram32bit(ram, memoryAddress)
-				historyStack.append(
-					StateChange(
-						oldProgramCounter: oldPC,
-						target: .memory(address: memoryAddress),
-						oldValue: Int(originalValue)
-					)
-				)
+				// Byte and halfword stores are undone on the whole word
+				let wordAddress   = memoryAddress & ~0x3
+				var originalValue: UInt32 = 0
+				_ = ram_load32(ram, wordAddress, &originalValue)
+				journal_record_memory(journal, wordAddress, originalValue)
 			   
 				// Perform store based on funct3
 				if !performStore(
@@ -212,8 +779,31 @@ class CPU: ObservableObject {
 				nextProgramCounter = UInt32(jumpTarget & ~1)
 				break
 				
+			case B_TYPE:
+				// Registers hold sign-extended or zero-extended words,
+				// compare their low 32 bits
+				let first  = UInt32(truncatingIfNeeded: firstOperand)
+				let second = UInt32(truncatingIfNeeded: secondOperand)
+				
+				var taken = false
+				
+				switch decodedInstruction.funz3 {
+					case 0x0: taken = resultAlu.zero  // BEQ
+					case 0x1: taken = !resultAlu.zero // BNE
+					case 0x4: taken = Int32(bitPattern: first) <  Int32(bitPattern: second) // BLT
+					case 0x5: taken = Int32(bitPattern: first) >= Int32(bitPattern: second) // BGE
+					case 0x6: taken = first <  second // BLTU
+					case 0x7: taken = first >= second // BGEU
+					default:  return .invalidOperation
+				}
+				
+				if taken {
+					nextProgramCounter = UInt32(truncatingIfNeeded: Int(programCounter) + decodedInstruction.immediate)
+				}
+				break
+				
 			case ECALL:
-				valueToWriteBack = decodedInstruction.immediate
+				// Syscalls are serviced by the native engine
 				break
 				
 			default:
@@ -226,12 +816,10 @@ class CPU: ObservableObject {
 			}
 				
 			let destIndex = Int(decodedInstruction.registerDestination)
-			historyStack.append(
-				StateChange(
-					oldProgramCounter: oldPC,
-					target: .register(index: destIndex),
-					oldValue: registers[destIndex]
-				)
+			journal_record_register(
+				journal,
+				UInt32(truncatingIfNeeded: destIndex),
+				UInt32(truncatingIfNeeded: registers[destIndex])
 			)
 			
 			if !writeRegister(value: value, destination: destIndex) {
@@ -243,41 +831,33 @@ class CPU: ObservableObject {
 		return .success
 	}
 	
-	func backwardExecute() {
-		
-		guard let lastChange = historyStack.popLast() else {
+	/// Undo the last `steps` steps, batches included
+	func backwardExecute(steps: UInt64 = 1) {
+		guard let machine = self.idleMachine, self.canStepBack else {
 			print("Cronology is empty. Not possible execute backward instruction.")
 			return
 		}
 		
-		self.programCounter = lastChange.oldProgramCounter
-		
-		switch lastChange.target {
-			case .register(index: let index):
-				_ = writeRegister(value: lastChange.oldValue, destination: index)
-				
-			case .memory(address: let address):
-				write_ram32bit(ram, address, UInt32(lastChange.oldValue))
-			
-			case .none:
-				break
-		}		
+		self.pushState(to: machine)
+		_ = journal_rewind(machine, steps)
+		self.pullState(from: machine)
 	}
 	
 	/// Fetch instruction in ram
-	private func fetch(optionsSource: options_t) -> Int32 {
+	private func fetch(optionsSource: options_t) -> UInt32? {
 		
 		if programCounter < optionsSource.text_vaddr || programCounter >= Int(optionsSource.text_vaddr) + optionsSource.text_size {
 			print("Invalid program counter, outside the text section");
-			return -1;
+			return nil;
 		}
 
-		if ((programCounter % 4) != 0) {
+		var instruction: UInt32 = 0
+		if ram_load32(ram!, UInt32(programCounter), &instruction) != RAM_ACCESS_OK {
 			print("Program counter must be aligned to 4 bytes for RISC-V instructions");
-			return -1;
+			return nil;
 		}
 
-		return read_ram32bit(ram!, UInt32(programCounter));
+		return instruction
 	}
 	
 	/// Decode language code instruction
@@ -322,6 +902,16 @@ class CPU: ObservableObject {
 				
 				decoded.immediate = signExtend(value: calculateImmediate, bits: 21)
 				
+			// Branch instruction, the offset is a multiple of 2
+			case 0x63:
+				let immediateAt12     = extractBits(instruction, start: 31, end: 31)
+				let immediateAt11     = extractBits(instruction, start: 7, end: 7)
+				let immediateAt10To5  = extractBits(instruction, start: 25, end: 30)
+				let immediateAt4To1   = extractBits(instruction, start: 8, end: 11)
+				let calculateImmediate = immediateAt12 << 12 | immediateAt11 << 11 | immediateAt10To5 << 5 | immediateAt4To1 << 1
+				
+				decoded.immediate = signExtend(value: calculateImmediate, bits: 13)
+				
 			// Upper?
 			case 0x37, 0x17:
 				decoded.immediate = Int(extractBits(instruction, start: 12, end: 31) << 12)
@@ -403,77 +993,59 @@ class CPU: ObservableObject {
 			}
 		}
 		
+		let bits = UInt32(truncatingIfNeeded: value)
+		let access: ram_access_t
+		
 		switch funct3 {
-		case 0x0: // SB - Store Byte
-			return storeByte(ram: ram, address: address, value: UInt8(value & 0xFF))
-			
-		case 0x1: // SH - Store Halfword (2 bytes)
-			return storeHalfword(ram: ram, address: address, value: UInt16(value & 0xFFFF))
-			
-		case 0x2: // SW - Store Word (4 bytes)
-			write_ram32bit(ram, address, UInt32(bitPattern: Int32(value)))
-			return true
+		case 0x0: access = ram_store8(ram, address, bits)  // SB - Store Byte
+		case 0x1: access = ram_store16(ram, address, bits) // SH - Store Halfword
+		case 0x2: access = ram_store32(ram, address, bits) // SW - Store Word
 			
 		default:
 			print("Unknown store instruction with funct3: 0x\(String(format: "%x", funct3))")
 			return false
 		}
-	}
-
-	/// Store a single byte to memory
-	/// - Parameters:
-	///   - ram: RAM instance
-	///   - address: Memory address
-	///   - value: Byte value to store
-	/// - Returns: True if successful
-	private func storeByte(ram: RAM, address: UInt32, value: UInt8) -> Bool {
-		let ramBase = ram.pointee.base_vaddr
-		let ramSize = ram.pointee.size
-		
-		if address < ramBase {
-			print("Store byte: address 0x\(String(format: "%08x", address)) below RAM base 0x\(String(format: "%08x", ramBase))")
-			return false
-		}
 		
-		let offset = address - ramBase
-		if offset >= ramSize {
-			print("Store byte: address 0x\(String(format: "%08x", address)) out of bounds")
+		if access != RAM_ACCESS_OK {
+			print("Store at 0x\(String(format: "%08x", address)) failed: \(String(cString: ram_access_description(access)))")
 			return false
 		}
 		
-		ram.pointee.data[Int(offset)] = value
 		return true
 	}
-
-	/// Store a halfword (2 bytes) to memory in little-endian format
+	
+	/// Perform load operation based on funct3 (load size and extension)
 	/// - Parameters:
-	///   - ram: RAM instance
-	///   - address: Memory address (must be 2-byte aligned)
-	///   - value: Halfword value to store
-	/// - Returns: True if successful
-	private func storeHalfword(ram: RAM, address: UInt32, value: UInt16) -> Bool {
-		if (address % 2) != 0 {
-			print("Store halfword: address 0x\(String(format: "%08x", address)) not aligned to 2 bytes")
-			return false
+	///   - address: Memory address to read
+	///   - funct3: 0=LB, 1=LH, 2=LW, 4=LBU, 5=LHU
+	/// - Returns: The extended value, nil if the load faults
+	private func performLoad(address: UInt32, funct3: UInt8) -> UInt32? {
+		guard let ram = ram else {
+			print("RAM not initialized")
+			return nil
 		}
 		
-		let ramBase = ram.pointee.base_vaddr
-		let ramSize = ram.pointee.size
+		var value: UInt32 = 0
+		let access: ram_access_t
 		
-		if address < ramBase {
-			print("Store halfword: address 0x\(String(format: "%08x", address)) below RAM base")
-			return false
+		switch funct3 {
+		case 0x0: access = ram_load8(ram, address, &value)   // LB
+		case 0x1: access = ram_load16(ram, address, &value)  // LH
+		case 0x2: access = ram_load32(ram, address, &value)  // LW
+		case 0x4: access = ram_load8u(ram, address, &value)  // LBU
+		case 0x5: access = ram_load16u(ram, address, &value) // LHU
+			
+		default:
+			print("Unknown load instruction with funct3: 0x\(String(format: "%x", funct3))")
+			return nil
 		}
 		
-		let offset = address - ramBase
-		if offset + 1 >= ramSize {
-			print("Store halfword: address 0x\(String(format: "%08x", address)) out of bounds")
-			return false
+		if access != RAM_ACCESS_OK {
+			print("Load at 0x\(String(format: "%08x", address)) failed: \(String(cString: ram_access_description(access)))")
+			return nil
 		}
 		
-		ram.pointee.data[Int(offset)] = UInt8(value & 0xFF)
-		ram.pointee.data[Int(offset + 1)] = UInt8((value >> 8) & 0xFF)
-		return true
+		return value
 	}
 	
 }
@@ -12,4 +12,9 @@ enum ExecutionStatus: String {
 	case registerWriteFailed      = "Failed to write to register."
 	case ramReadFailed            = "Failed to read from RAM."
 	case ramStoreFailed           = "Failed to store value in RAM."
+	case memoryProtectionFault    = "Memory access not allowed by the region permissions."
+	case environmentCall          = "Program stopped on an environment call."
+	case programExited            = "Program exited."
+	case breakpointReached        = "Program stopped on a breakpoint."
+	case watchpointReached        = "Program stopped after a store to a watched address."
 }
@@ -0,0 +1,28 @@
+//
+//  Simulator.swift
+//  Aste-RISC
+//
+
+/// Optional parts of the native engine. Each one but the
+/// profile slows the run down, so it is attached only when
+/// the user turns it on
+enum Simulator: String, CaseIterable, Identifiable {
+	case timeline  = "Timeline"
+	case profile   = "Profile"
+	case pipeline  = "Pipeline"
+	case cache     = "Caches"
+	case predictor = "Branch predictor"
+	
+	var id: String { self.rawValue }
+	
+	/// What the simulator records, shown under its name
+	var detail: String {
+		return switch self {
+			case .timeline : "Checkpoints to move to any step of the run"
+			case .profile  : "Executions of each instruction and memory accesses"
+			case .pipeline : "Cycles of a five-stage pipeline with forwarding"
+			case .cache    : "Hits and misses of 32 KiB L1 instruction and data caches"
+			case .predictor: "Accuracy of a bimodal predictor on the conditional branches"
+		}
+	}
+}
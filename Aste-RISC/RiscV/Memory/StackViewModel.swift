@@ -47,13 +47,29 @@ class StackViewModel: ObservableObject {
 	/// A set to store Combine subscriptions.
 	private var cancellables = Set<AnyCancellable>()
 	
-	// MARK: - Internal Throttling State
+	// MARK: - Internal Refresh State
 	
-	/// The last known Stack Pointer value, used for throttling updates.
-	private var lastSP: UInt32 = 0
+	/// Number of words shown from the stack pointer.
+	private let wordsToShow = 128
 	
-	/// A counter to force updates every N calls, even if SP/FP are stable.
-	private var stackUpdateCounter: Int = 0
+	/// Stop if we read too much invalid memory.
+	private let maxConsecutiveErrors = 8
+	
+	/// The stack words as last read, starting at `windowStart`.
+	private var words: [UInt32] = []
+	
+	/// Leading words of `words` the program can load.
+	private var readableWords: Int = 0
+	
+	/// Address of the first word, nil when nothing was read yet.
+	private var windowStart: UInt32?
+	
+	/// The frame pointer the frames were colored with.
+	private var lastFP: UInt32 = 0
+	
+	/// RAM generation `words` was read in, only the pages
+	/// written after it are read again.
+	private var generation: UInt32 = 0
 	
 	/// Creates the StackViewModel.
 	///
@@ -64,10 +80,12 @@ class StackViewModel: ObservableObject {
 		self.cpu 			= cpu
 	
 		// Set up a Combine pipeline to observe the CPU.
-		// We merge changes from registers (for SP/FP) and the PC.
-		Publishers.Merge(
-			cpu.$registers.map { _ in () },     // We only care that it changed
-			cpu.$programCounter.map { _ in () } // not what the new value is.
+		// We merge changes from registers (for SP/FP), the PC and the
+		// end of a background run, the stack is read once it stopped.
+		Publishers.Merge3(
+			cpu.$registers.map { _ in () },      // We only care that it changed
+			cpu.$programCounter.map { _ in () }, // not what the new value is.
+			cpu.$isRunning.map { _ in () }
 		)
 		// Throttle updates to prevent UI churn during rapid execution.
 		.throttle(for: .milliseconds(5), scheduler: RunLoop.main, latest: true)
@@ -78,6 +96,8 @@ class StackViewModel: ObservableObject {
 				self?.updateStackFrames()
 				
 			} else {
+				self?.windowStart = nil
+				
 				withAnimation(.spring()) {
 					self?.callFrames.removeAll()
 					self?.stackFrames.removeAll()
@@ -89,129 +109,82 @@ class StackViewModel: ObservableObject {
 	
 	/// The main work function, called on a throttled basis by the Combine sink.
 	///
-	/// This function reads the raw stack memory from the CPU, analyzes each
-	/// 4-byte word to create the `stackFrames` array, and then calls
-	/// `parseCallFrames` to build the logical `callFrames`.
-	///
-	/// It contains its own throttling logic to avoid re-calculating the stack
-	/// if the Stack Pointer and Frame Pointer have not moved significantly.
+	/// When the stack pointer moves, the whole window is read with a single
+	/// `ram_read_range` call. Otherwise only the pages written since the last
+	/// refresh are read again, and only the words whose value changed get a
+	/// new `StackFrame`. When neither the words nor the frame pointer changed
+	/// nothing is published.
 	func updateStackFrames() {
-		guard let ram = cpu.ram else { return }
+		// The RAM belongs to the engine thread while it runs
+		guard let ram = cpu.ram, !cpu.isRunning else { return }
 		
-		let sp = UInt32(cpu.registers[2]) // x2 = Stack Pointer
-		let fp = UInt32(cpu.registers[8]) // x8 = Frame Pointer
+		let sp = UInt32(truncatingIfNeeded: cpu.registers[2]) // x2 = Stack Pointer
+		let fp = UInt32(truncatingIfNeeded: cpu.registers[8]) // x8 = Frame Pointer
 		
-		// Only update if SP/FP changed,
-		// or if 2 cycles have passed
-		stackUpdateCounter += 1
+		// Stores from now on belong to the next generation
+		let since  	    = self.generation
+		self.generation = ram_next_generation(ram)
 		
-		// 1-word is changed
-		let spChanged = abs(Int(sp) - Int(lastSP)) >= 4
+		// A window reaching unreadable memory is read again whole
+		// when the heap grew into it
+		let isResized = readableWords < wordsToShow && readableLength(ram: ram, from: sp) != readableWords
 		
-		guard stackUpdateCounter >= 2 || spChanged else {
-			return // No significant change, skip update.
+		if sp != windowStart || isResized {
+			readWindow(ram: ram, sp: sp)
+			publish(frames: (0 ..< wordsToShow).map { makeFrame(index: $0, fp: fp) }, fp: fp)
+			
+			return
 		}
 		
-		// Reset for control frame update
-		stackUpdateCounter = 0
-		lastSP 			   = sp
-				
-		var frames: [StackFrame] = []
-		let wordsToShow 		 = 128
-		var consecutiveErrors 	 = 0
+		var changed = [UInt64](repeating: 0, count: (wordsToShow + 63) / 64)
+		let updated = ram_update_words(ram, sp, &words, wordsToShow, since, &changed)
 		
-		// Stop if we read too much invalid memory
-		let maxConsecutiveErrors = 8
+		guard updated > 0 || fp != lastFP else {
+			return // Nothing to redraw.
+		}
 		
-		// Set limits ram, the virtual address for the start
-		// and the ram size + the start for get the end address
-		let ramStart = ram.pointee.base_vaddr
-		let ramEnd   = ramStart + UInt32(ram.pointee.size)
-
-		// Iterate the stack.
-		// This iterate teh stack from top to base,
-		// iterated N words down from the stack pointer
-		for i in 0 ..< wordsToShow {
-			
-			// Calc current iterate addres
-			// This work because exect the 'and' logic operation
-			// on the current index multiplied by 4 to get a word.
-			let addr = sp &+ UInt32(i * 4)
-			
-			// Check memory bounds
-			// Control address is in start and end range
-			// If true then update errors flag
-			if addr < ramStart || addr + 4 > ramEnd {
-				consecutiveErrors += 1
-				if consecutiveErrors >= maxConsecutiveErrors { break }
-				
-				continue
-			}
-			
-			// Get value on address in the ram
-			let rawInstruction = read_ram32bit(ram, addr)
-			
-			// MARK: - Analysis the instruction
-			
-			let isError = rawInstruction == -1
-			if isError {
-				consecutiveErrors += 1
-				if consecutiveErrors >= maxConsecutiveErrors { break }
-				
-			} else { consecutiveErrors = 0 }
-			
-			// Contrel if the instruction is not 'zero'
-			let isNonZero = (!isError && rawInstruction != 0)
-			let rawInstructionUnsigned = UInt32(bitPattern: rawInstruction)
-			
-			let isPointerToText = (
-				rawInstructionUnsigned >= self.cpu.ram!.pointee.text_base &&
-				rawInstructionUnsigned <  self.cpu.ram!.pointee.text_base &+
-										  self.cpu.ram!.pointee.text_size
-			)
-			
-			let isFrameBoundary = isPointerToText && isNonZero
-			let isFramePointer  = (addr == fp)
-			let isSavedRegister = isNonZero && !isPointerToText && i < 32
-
-			// MARK: UI-Data Assignment
-			// Assign colors based on analysis
-			let color = if isError {
-				Color(.systemGray)
-				
-			} else if isFramePointer {
-				Color(.systemPurple).opacity(0.85)
-				
-			} else if isFrameBoundary {
-				Color(.systemRed).opacity(0.85)
-				
-			} else if isSavedRegister {
-				Color(.systemOrange).opacity(0.6)
-				
-			} else if isNonZero {
-				Color(.systemBlue).opacity(0.6)
-				
-			} else {
-				Color(.systemMint)
-				
-			}
-
-			// Create the "raw" frame object
-			let frame = StackFrame(
-				address		   : addr,
-				value		   : rawInstruction,
-				color		   : color,
-				label		   : String(format: "0x%08x", addr),
-				isPointer	   : isPointerToText,
-				isNonZero	   : isNonZero,
-				isError		   : isError,
-				isFrameBoundary: isFrameBoundary,
-				offsetFromSP   : i
-			)
+		// Keep the frames of unchanged words, their identity too,
+		// the frame pointer moving recolors its old and new word
+		let frames = stackFrames.enumerated().map { index, frame in
+			let isChanged = changed[index >> 6] >> UInt64(index & 63) & 1 != 0
+			let isRecolored = fp != lastFP && (frame.address == fp || frame.address == lastFP)
 			
-			frames.append(frame)
+			return isChanged || isRecolored ? makeFrame(index: index, fp: fp) : frame
 		}
-
+		
+		publish(frames: frames, fp: fp)
+	}
+	
+	/// Read the whole window from the stack pointer in one call.
+	private func readWindow(ram: RAM, sp: UInt32) {
+		words = [UInt32](repeating: 0, count: wordsToShow)
+		
+		let readBytes = words.withUnsafeMutableBytes { buffer in
+			ram_read_range(ram, sp, buffer.baseAddress, buffer.count)
+		}
+		
+		readableWords = readBytes / 4
+		windowStart   = sp
+	}
+	
+	/// Leading words the program can load from an address.
+	private func readableLength(ram: RAM, from address: UInt32) -> Int {
+		var scratch = [UInt32](repeating: 0, count: wordsToShow)
+		
+		let readBytes = scratch.withUnsafeMutableBytes { buffer in
+			ram_read_range(ram, address, buffer.baseAddress, buffer.count)
+		}
+		
+		return readBytes / 4
+	}
+	
+	/// Build the frames from the read words and publish them.
+	private func publish(frames: [StackFrame?], fp: UInt32) {
+		
+		// Words past the readable memory end after a few errors
+		let frames = frames.prefix(readableWords + maxConsecutiveErrors).compactMap { $0 }
+		lastFP 	   = fp
+		
 		// MARK: Second-Level Parse
 		// Parse the raw frames into logical call frames
 		let newCallFrames = self.parseCallFrames(from: frames)
@@ -227,6 +200,77 @@ class StackViewModel: ObservableObject {
 		}
 	}
 	
+	/// Analyse one word of the window and assign its UI metadata.
+	///
+	/// - Parameters:
+	///   - index: Offset of the word from the stack pointer, in words.
+	///   - fp: Current frame pointer.
+	/// - Returns: The frame, nil for a word past the end of the RAM.
+	private func makeFrame(index: Int, fp: UInt32) -> StackFrame? {
+		guard let ram = cpu.ram, let start = windowStart else { return nil }
+		
+		// Calc current iterate addres
+		// This work because exect the 'and' logic operation
+		// on the current index multiplied by 4 to get a word.
+		let addr = start &+ UInt32(index * 4)
+		
+		// Words wrapping past the top of the address space are not shown
+		if addr < start { return nil }
+		
+		// MARK: - Analysis the instruction
+		
+		let isError = index >= readableWords
+		let rawInstruction = isError ? -1 : Int32(bitPattern: words[index])
+		
+		// Contrel if the instruction is not 'zero'
+		let isNonZero = (!isError && rawInstruction != 0)
+		let rawInstructionUnsigned = UInt32(bitPattern: rawInstruction)
+		
+		let isPointerToText = (
+			rawInstructionUnsigned >= ram.pointee.text_base &&
+			rawInstructionUnsigned <  ram.pointee.text_base &+ ram.pointee.text_size
+		)
+		
+		let isFrameBoundary = isPointerToText && isNonZero
+		let isFramePointer  = (addr == fp)
+		let isSavedRegister = isNonZero && !isPointerToText && index < 32
+
+		// MARK: UI-Data Assignment
+		// Assign colors based on analysis
+		let color = if isError {
+			Color(.systemGray)
+			
+		} else if isFramePointer {
+			Color(.systemPurple).opacity(0.85)
+			
+		} else if isFrameBoundary {
+			Color(.systemRed).opacity(0.85)
+			
+		} else if isSavedRegister {
+			Color(.systemOrange).opacity(0.6)
+			
+		} else if isNonZero {
+			Color(.systemBlue).opacity(0.6)
+			
+		} else {
+			Color(.systemMint)
+			
+		}
+
+		// Create the "raw" frame object
+		return StackFrame(
+			address		   : addr,
+			value		   : rawInstruction,
+			color		   : color,
+			label		   : String(format: "0x%08x", addr),
+			isPointer	   : isPointerToText,
+			isNonZero	   : isNonZero,
+			isError		   : isError,
+			isFrameBoundary: isFrameBoundary,
+			offsetFromSP   : index
+		)
+	}
+	
 	/// Parses a raw list of `StackFrame` words into logical `CallFrame` objects.
 	///
 	/// This function iterates through the `stackFrames` array and groups them
@@ -9,29 +9,594 @@
 #define RAM_H
 
 #include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
 
+// The 32-bit address space is split in 4 KiB pages, reached through a
+// two-level table: 10 bits of directory, 10 bits of table, 12 of offset
+#define RAM_PAGE_SHIFT  12
+#define RAM_PAGE_SIZE   (1u << RAM_PAGE_SHIFT)
+#define RAM_PAGE_MASK   (RAM_PAGE_SIZE - 1)
+#define RAM_PAGE_COUNT  (1u << (32 - RAM_PAGE_SHIFT))
+#define RAM_TABLE_SHIFT 10
+#define RAM_TABLE_SIZE  (1u << RAM_TABLE_SHIFT)
+
+/**
+ * @brief Private file mapping lending its pages to the RAM.
+ *
+ * base Start of the host mapping.
+ * length Length of the host mapping in bytes.
+ */
+typedef struct {
+	uint8_t *base;
+	size_t   length;
+
+} ram_mapping_t;
+
+// Permissions of a memory region
+#define RAM_PERM_READ   0x1u
+#define RAM_PERM_WRITE  0x2u
+#define RAM_PERM_EXEC   0x4u
+#define RAM_PERM_DEVICE 0x8u // never cached by the TLB, every access is checked
+
+#define RAM_MAX_REGIONS 16
+#define RAM_TLB_SIZE    64 // direct mapped, a power of two
+
+/**
+ * @brief Range of guest addresses with the same permissions.
+ *
+ * start First address of the region.
+ * size Size of the region in bytes.
+ * permissions RAM_PERM_* flags.
+ * name Label used in fault reports, e.g. ".text" or "stack".
+ */
+typedef struct {
+	uint32_t    start;
+	uint32_t    size;
+	uint32_t    permissions;
+	const char *name;
+
+} ram_region_t;
+
+/**
+ * @brief Cached translation of a page.
+ *
+ * page Guest page number.
+ * permissions Allowed accesses, 0 for an empty entry. RAM_PERM_WRITE is
+ * only granted while the page is dirty and stamped with the current
+ * generation, so a cached store never skips the dirty map nor the stamp,
+ * and never for the shared zero page.
+ * host Host address of the page.
+ */
+typedef struct {
+	uint32_t page;
+	uint32_t permissions;
+	uint8_t *host;
+
+} ram_tlb_entry_t;
+
 /**
  * @brief Header file for RAM management in a RISC-V CPU simulator.
  * This file defines the RAM structure and functions to create, free, write, and read from RAM.
  *
- * data Pointer to the RAM data.
- * size Size of the RAM in bytes.
+ * Pages are allocated on first write, unmapped pages read as zero, so
+ * memory use follows what the program touches and not the size.
+ *
+ * directory Page tables, NULL until a page in their 4 MiB range is written.
+ * size Size of the accessible window in bytes, up to 4 GiB.
+ * base_vaddr First address of the window.
+ * dirty_pages Bitmap of the pages written since the last clear, by page number.
+ * generation Generation of the stores from now on, advanced by
+ * ram_next_generation, starts at 1.
+ * page_generations Generation of the last store to each page, by page
+ * number, 0 for a page never written.
+ * mapped_pages Number of allocated pages.
+ * mappings File mappings whose pages are used in place, copy-on-write.
+ * mapping_count Number of file mappings.
+ * regions Permission map of the guest, when empty the whole window is
+ * readable, writable and executable.
+ * region_count Number of regions.
+ * heap_start First address of the heap, set by ram_set_heap.
+ * heap_break End of the heap, moved by the brk syscall.
+ * heap_limit Highest allowed break.
+ * heap_region Index of the "heap" region plus one, 0 when there is no heap.
+ * tlb Last translations of the typed loads and stores.
  */
 typedef struct ram {
-    uint8_t *data;
-    size_t   size;
-	uint32_t base_vaddr;
+	uint8_t **directory[RAM_TABLE_SIZE];
+    size_t    size;
+	uint32_t  base_vaddr;
 	
 	uint32_t text_base;
 	uint32_t text_size;
 	uint32_t data_base;
 	uint32_t data_size;
+	
+	uint64_t *dirty_pages;
+	uint32_t  generation;
+	uint32_t *page_generations;
+	size_t    mapped_pages;
+
+	ram_mapping_t *mappings;
+	uint32_t 	   mapping_count;
+
+	ram_region_t regions[RAM_MAX_REGIONS];
+	uint32_t     region_count;
+
+	uint32_t heap_start;
+	uint32_t heap_break;
+	uint32_t heap_limit;
+	uint32_t heap_region;
+
+	ram_tlb_entry_t tlb[RAM_TLB_SIZE];
 
 } *RAM;
 
+/// Backing of every unmapped page
+extern const uint8_t ram_zero_page[RAM_PAGE_SIZE];
+
+/**
+ * @brief Allocate the page holding an address.
+ * @param ram Pointer to the RAM instance.
+ * @param address Any address inside the page.
+ *
+ * @return Host pointer to the start of the page, NULL if allocation fails.
+ */
+uint8_t *ram_map_page(
+	RAM      ram,
+	uint32_t address
+);
+
+/**
+ * @brief Host pointer to read the byte at address, unmapped pages read as zero.
+ * @param ram Pointer to the RAM instance.
+ * @param address Guest address, the window is not checked.
+ *
+ * @return Pointer valid up to the end of the page, never NULL.
+ */
+static inline const uint8_t *ram_read_pointer(
+	const RAM      ram,
+	const uint32_t address
+) {
+	uint8_t **table = ram->directory[address >> (RAM_PAGE_SHIFT + RAM_TABLE_SHIFT)];
+	uint8_t  *page  = table ? table[(address >> RAM_PAGE_SHIFT) & (RAM_TABLE_SIZE - 1)] : NULL;
+
+	return (page ? page : ram_zero_page) + (address & RAM_PAGE_MASK);
+}
+
+/**
+ * @brief Mark the page holding a written address as dirty and stamp it
+ * with the current generation.
+ * @param ram Pointer to the RAM instance.
+ * @param address Written address.
+ */
+static inline void ram_mark_dirty(
+	RAM      ram,
+	uint32_t address
+) {
+	const uint32_t page = address >> RAM_PAGE_SHIFT;
+
+	ram->dirty_pages[page >> 6] |= 1ull << (page & 63);
+	ram->page_generations[page]  = ram->generation;
+}
+
+/**
+ * @brief Host pointer to write the byte at address, the page is allocated
+ * on first write and marked dirty.
+ * @param ram Pointer to the RAM instance.
+ * @param address Guest address, the window is not checked.
+ *
+ * @return Pointer valid up to the end of the page, NULL if allocation fails.
+ */
+static inline uint8_t *ram_write_pointer(
+	RAM            ram,
+	const uint32_t address
+) {
+	uint8_t **table = ram->directory[address >> (RAM_PAGE_SHIFT + RAM_TABLE_SHIFT)];
+	uint8_t  *page  = table ? table[(address >> RAM_PAGE_SHIFT) & (RAM_TABLE_SIZE - 1)] : NULL;
+
+	if (!page && !(page = ram_map_page(ram, address))) return NULL;
+
+	ram_mark_dirty(ram, address);
+
+	return page + (address & RAM_PAGE_MASK);
+}
+
+// MARK: - Typed access
+
+/**
+ * @brief Outcome of a typed load or store, reported apart from the value.
+ */
+typedef enum {
+	RAM_ACCESS_OK,
+	RAM_ACCESS_MISALIGNED,   // address not a multiple of the width
+	RAM_ACCESS_OUT_OF_RANGE, // some byte outside the window
+	RAM_ACCESS_NO_MEMORY,    // the page could not be allocated
+	RAM_ACCESS_UNMAPPED,     // no region covers the address
+	RAM_ACCESS_PROTECTION    // the region does not allow the access
+
+} ram_access_t;
+
+/**
+ * @brief Check alignment and window of an access with a single branch.
+ *
+ * The window never wraps past 4 GiB, so an address below base_vaddr gives
+ * an offset past the size and one comparison covers both ends.
+ * Aligned accesses never cross a page.
+ * @param ram Pointer to the RAM instance.
+ * @param address Guest address of the first byte.
+ * @param width Access width in bytes, a power of two up to 4.
+ */
+static inline ram_access_t ram_check_access(
+	const RAM      ram,
+	const uint32_t address,
+	const uint32_t width
+) {
+	const uint64_t offset = (uint32_t)(address - ram->base_vaddr);
+
+	if (__builtin_expect((address & (width - 1)) | (offset + width > ram->size), 0)) {
+		return address & (width - 1) ? RAM_ACCESS_MISALIGNED : RAM_ACCESS_OUT_OF_RANGE;
+	}
+
+	return RAM_ACCESS_OK;
+}
+
+/**
+ * @brief Translate a typed access missed by the TLB.
+ *
+ * Checks the window, the region and its permissions, then refills the
+ * TLB entry of the page when the whole page has the same permissions.
+ * @param ram Pointer to the RAM instance.
+ * @param address Guest address of the first byte, aligned to width.
+ * @param width Access width in bytes.
+ * @param permission RAM_PERM_READ for loads, RAM_PERM_WRITE for stores.
+ * @param host Receives the host pointer, a store marks the page dirty.
+ */
+ram_access_t ram_translate(
+	RAM       ram,
+	uint32_t  address,
+	uint32_t  width,
+	uint32_t  permission,
+	uint8_t **host
+);
+
+/**
+ * @brief Host pointer of a cached translation, one compare on a hit.
+ * @return NULL when the page is not cached with the permission.
+ */
+static inline uint8_t *ram_tlb_lookup(
+	const RAM      ram,
+	const uint32_t address,
+	const uint32_t permission
+) {
+	const uint32_t 		   page  = address >> RAM_PAGE_SHIFT;
+	const ram_tlb_entry_t *entry = &ram->tlb[page & (RAM_TLB_SIZE - 1)];
+
+	if (entry->page == page && (entry->permissions & permission)) {
+		return entry->host + (address & RAM_PAGE_MASK);
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Load a little-endian value of width bytes, zero extended.
+ * @param ram Pointer to the RAM instance.
+ * @param address Guest address of the first byte.
+ * @param width 1, 2 or 4.
+ * @param value Receives the value, left unchanged on a fault.
+ */
+static inline ram_access_t ram_load(
+	RAM            ram,
+	const uint32_t address,
+	const uint32_t width,
+	uint32_t      *value
+) {
+	if (address & (width - 1)) return RAM_ACCESS_MISALIGNED;
+
+	uint8_t *p = ram_tlb_lookup(ram, address, RAM_PERM_READ);
+
+	if (__builtin_expect(!p, 0)) {
+		const ram_access_t access = ram_translate(ram, address, width, RAM_PERM_READ, &p);
+		if (access != RAM_ACCESS_OK) return access;
+	}
+
+	switch (width) {
+		case 1:  *value = p[0]; break;
+		case 2:  *value = (uint32_t)p[0] | (uint32_t)p[1] << 8; break;
+		default: *value = (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24; break;
+	}
+
+	return RAM_ACCESS_OK;
+}
+
+/**
+ * @brief Store the low width bytes of value, little-endian.
+ * @param ram Pointer to the RAM instance.
+ * @param address Guest address of the first byte.
+ * @param width 1, 2 or 4.
+ * @param value Value to store.
+ */
+static inline ram_access_t ram_store(
+	RAM            ram,
+	const uint32_t address,
+	const uint32_t width,
+	const uint32_t value
+) {
+	if (address & (width - 1)) return RAM_ACCESS_MISALIGNED;
+
+	uint8_t *p = ram_tlb_lookup(ram, address, RAM_PERM_WRITE);
+
+	if (__builtin_expect(!p, 0)) {
+		const ram_access_t access = ram_translate(ram, address, width, RAM_PERM_WRITE, &p);
+		if (access != RAM_ACCESS_OK) return access;
+	}
+
+	p[0] = (uint8_t)value;
+	if (width > 1) p[1] = (uint8_t)(value >> 8);
+	if (width > 2) {
+		p[2] = (uint8_t)(value >> 16);
+		p[3] = (uint8_t)(value >> 24);
+	}
+
+	return RAM_ACCESS_OK;
+}
+
+/// LB: byte, sign extended
+static inline ram_access_t ram_load8(RAM ram, const uint32_t address, uint32_t *value) {
+	const ram_access_t access = ram_load(ram, address, 1, value);
+	if (access == RAM_ACCESS_OK) *value = (uint32_t)(int32_t)(int8_t)*value;
+
+	return access;
+}
+
+/// LBU: byte, zero extended
+static inline ram_access_t ram_load8u(RAM ram, const uint32_t address, uint32_t *value) {
+	return ram_load(ram, address, 1, value);
+}
+
+/// LH: halfword, sign extended
+static inline ram_access_t ram_load16(RAM ram, const uint32_t address, uint32_t *value) {
+	const ram_access_t access = ram_load(ram, address, 2, value);
+	if (access == RAM_ACCESS_OK) *value = (uint32_t)(int32_t)(int16_t)*value;
+
+	return access;
+}
+
+/// LHU: halfword, zero extended
+static inline ram_access_t ram_load16u(RAM ram, const uint32_t address, uint32_t *value) {
+	return ram_load(ram, address, 2, value);
+}
+
+/// LW: word
+static inline ram_access_t ram_load32(RAM ram, const uint32_t address, uint32_t *value) {
+	return ram_load(ram, address, 4, value);
+}
+
+/// SB: low byte of value
+static inline ram_access_t ram_store8(RAM ram, const uint32_t address, const uint32_t value) {
+	return ram_store(ram, address, 1, value);
+}
+
+/// SH: low halfword of value
+static inline ram_access_t ram_store16(RAM ram, const uint32_t address, const uint32_t value) {
+	return ram_store(ram, address, 2, value);
+}
+
+/// SW: word
+static inline ram_access_t ram_store32(RAM ram, const uint32_t address, const uint32_t value) {
+	return ram_store(ram, address, 4, value);
+}
+
+// MARK: - Regions
+
+/**
+ * @brief Add a region to the permission map, the TLB is flushed.
+ *
+ * Once a region exists, accesses outside every region fault with
+ * RAM_ACCESS_UNMAPPED. Regions are searched in the order they were added.
+ * @param ram Pointer to the RAM instance.
+ * @param start First address of the region.
+ * @param size Size in bytes.
+ * @param permissions RAM_PERM_* flags.
+ * @param name Label used in fault reports, must outlive the RAM.
+ *
+ * @return false if the table is full or the region is empty.
+ */
+bool ram_add_region(
+	RAM         ram,
+	uint32_t    start,
+	uint32_t    size,
+	uint32_t    permissions,
+	const char *name
+);
+
+/**
+ * @brief Remove every region, the whole window is accessible again.
+ * @param ram Pointer to the RAM instance.
+ */
+void ram_clear_regions(RAM ram);
+
+/**
+ * @brief Find the region holding an address.
+ * @param ram Pointer to the RAM instance.
+ * @param address Guest address.
+ *
+ * @return The first region containing address, NULL if there is none.
+ */
+const ram_region_t *ram_find_region(
+	const RAM ram,
+	uint32_t  address
+);
+
+/**
+ * @brief Find the region a page is accounted to, the first one overlapping it.
+ * @param ram Pointer to the RAM instance.
+ * @param page_start Guest address of the first byte of the page.
+ *
+ * @return Index in the region table, -1 when no region overlaps the page.
+ */
+int ram_page_region(
+	const RAM ram,
+	uint64_t  page_start
+);
+
+// MARK: - Heap
+
+/**
+ * @brief Place an empty read/write "heap" region at start, it grows up to
+ * limit through ram_brk. A previous heap is replaced.
+ * @param ram Pointer to the RAM instance.
+ * @param start First address of the heap, also the initial break.
+ * @param limit Highest allowed break, at least start.
+ *
+ * @return false if the region table is full or limit is below start.
+ */
+bool ram_set_heap(
+	RAM      ram,
+	uint32_t start,
+	uint32_t limit
+);
+
+/**
+ * @brief Move the end of the heap, as the brk syscall.
+ * @param ram Pointer to the RAM instance.
+ * @param address New break, 0 only queries it.
+ *
+ * @return The break after the call, unchanged when address is outside
+ * [heap_start, heap_limit].
+ */
+uint32_t ram_brk(
+	RAM      ram,
+	uint32_t address
+);
+
+/**
+ * @brief Forget every cached translation.
+ * @param ram Pointer to the RAM instance.
+ */
+void ram_tlb_flush(RAM ram);
+
+/**
+ * @brief Short description of an access outcome, for fault reports.
+ * @param access Outcome of a typed access.
+ */
+const char *ram_access_description(ram_access_t access);
+
+/**
+ * @brief Check whether a page is allocated.
+ * @param ram Pointer to the RAM instance.
+ * @param page Page number, address >> RAM_PAGE_SHIFT.
+ */
+static inline bool ram_page_mapped(
+	const RAM      ram,
+	const uint32_t page
+) {
+	uint8_t **table = ram->directory[page >> RAM_TABLE_SHIFT];
+	return table && table[page & (RAM_TABLE_SIZE - 1)];
+}
+
+/**
+ * @brief Check whether a page was written since the last clear.
+ * @param ram Pointer to the RAM instance.
+ * @param page Page number, address >> RAM_PAGE_SHIFT.
+ */
+static inline bool ram_page_dirty(
+	const RAM      ram,
+	const uint32_t page
+) {
+	return ram->dirty_pages[page >> 6] >> (page & 63) & 1;
+}
+
+/**
+ * @brief Mark every allocated page as dirty.
+ * @param ram Pointer to the RAM instance.
+ */
+void ram_mark_mapped_dirty(RAM ram);
+
+/**
+ * @brief Forget every dirty page, call it after a checkpoint.
+ * @param ram Pointer to the RAM instance.
+ */
+void ram_clear_dirty(RAM ram);
+
+// MARK: - Views
+
+/**
+ * @brief End the current generation, the stores from now on stamp their
+ * page with the next one.
+ *
+ * A view keeps the generation returned by its last call, the pages written
+ * since then are those stamped with a later one. Cached stores are dropped
+ * from the TLB so the first store to each page stamps it again.
+ * @param ram Pointer to the RAM instance.
+ *
+ * @return The generation that ended.
+ */
+uint32_t ram_next_generation(RAM ram);
+
+/**
+ * @brief Check whether a page of a range was written after a generation.
+ * @param ram Pointer to the RAM instance.
+ * @param address First byte of the range.
+ * @param size Size of the range in bytes.
+ * @param since Generation returned by ram_next_generation, 0 for any write.
+ */
+bool ram_range_changed(
+	const RAM      ram,
+		  uint32_t address,
+		  size_t   size,
+		  uint32_t since
+);
+
+/**
+ * @brief Copy a range of guest memory in one call, without faults nor messages.
+ *
+ * Unmapped pages read as zero. The copy stops at the first byte the guest
+ * could not load, outside the window or every readable region, and the
+ * rest of the buffer is zeroed.
+ * @param ram Pointer to the RAM instance.
+ * @param address First byte to read.
+ * @param buffer Receives size bytes.
+ * @param size Number of bytes to read.
+ *
+ * @return Number of bytes copied from the RAM.
+ */
+size_t ram_read_range(
+	const RAM       ram,
+		  uint32_t  address,
+		  void     *buffer,
+		  size_t    size
+);
+
+/**
+ * @brief Refresh a copy of consecutive words, only the pages written after
+ * a generation are read.
+ *
+ * A word whose value differs from the copy is updated and its bit is set
+ * in changed, the other bits are left as they are. The words from the
+ * first one the guest could not load are left unchanged, ram_read_range
+ * stops there too.
+ * @param ram Pointer to the RAM instance.
+ * @param address Address of the first word, aligned to 4.
+ * @param words Copy to refresh, count little-endian values.
+ * @param count Number of words.
+ * @param since Generation the copy was read in, see ram_next_generation.
+ * @param changed Bitmap of count bits, bit i for words[i].
+ *
+ * @return Number of words changed, 0 for a misaligned address.
+ */
+size_t ram_update_words(
+	const RAM       ram,
+		  uint32_t  address,
+		  uint32_t *words,
+		  size_t    count,
+		  uint32_t  since,
+		  uint64_t *changed
+);
+
 /**
  * @brief Destroy the RAM instance and free its resources.
  * @param ram Pointer to the RAM instance to be destroyed.
@@ -42,7 +607,8 @@ bool destroy_ram(RAM ram);
 
 /**
  * @brief Create a new RAM instance with the specified size.
- * @param size Size of the RAM in bytes.
+ * @param size Size of the RAM in bytes, the window is cut at the end of
+ * the 32-bit address space.
  *
  * @return Pointer to the newly created RAM instance, or NULL if allocation fails.
  */
@@ -68,7 +634,8 @@ void write_ram32bit(
  * @param ram Pointer to the RAM instance.
  * @param address Address in RAM from which the value will be read.
  *
- * @return The 32-bit value read from RAM.
+ * @return The 32-bit value read from RAM, -1 on a fault. -1 is also a valid
+ * word, use ram_load32 when the fault must be told apart.
  */
 int32_t read_ram32bit(
 	RAM ram,
@@ -88,6 +655,28 @@ void load_binary_to_ram(
 		  uint32_t start_addr
 );
 
+/**
+ * @brief Map a file range into RAM without copying it.
+ *
+ * The range is mapped privately, whole pages inside it are used in place
+ * and only copied by the host on first write, the partial pages at its ends
+ * are copied so the bytes around the range stay zero.
+ * @param ram Pointer to the RAM instance.
+ * @param fd Open file descriptor of the file.
+ * @param offset Offset of the range in the file.
+ * @param size Size of the range in bytes.
+ * @param start_addr Guest address of the first byte.
+ *
+ * @return false if the range is outside the file or cannot be mapped.
+ */
+bool map_file_to_ram(
+	RAM      ram,
+	int      fd,
+	uint64_t offset,
+	size_t   size,
+	uint32_t start_addr
+);
+
 /**
  * @brief Load text section information into RAM.
  * @param ram Pointer to RAM struct where instructions will be loaded.
@@ -7,11 +7,50 @@
 
 #include "ram.h"
 
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Size of the dirty bitmap, one bit for each page of the address space
+#define RAM_DIRTY_WORDS (RAM_PAGE_COUNT / 64)
+
+const uint8_t ram_zero_page[RAM_PAGE_SIZE] = { 0 };
+
+/// Check whether a page lives inside a file mapping and was not allocated
+static bool ram_page_borrowed(
+	const RAM      ram,
+	const uint8_t *page
+) {
+	for (uint32_t i = 0; i < ram->mapping_count; i++) {
+		const ram_mapping_t *mapping = &ram->mappings[i];
+		if (page >= mapping->base && page < mapping->base + mapping->length) return true;
+	}
+
+	return false;
+}
+
 bool destroy_ram(RAM ram) {
 
     if (!ram) return false;
 
-    free(ram->data);
+	for (uint32_t i = 0; i < RAM_TABLE_SIZE; i++) {
+		uint8_t **table = ram->directory[i];
+		if (!table) continue;
+
+		for (uint32_t j = 0; j < RAM_TABLE_SIZE; j++) {
+			if (table[j] && !ram_page_borrowed(ram, table[j])) free(table[j]);
+		}
+
+		free(table);
+	}
+
+	for (uint32_t i = 0; i < ram->mapping_count; i++) {
+		munmap(ram->mappings[i].base, ram->mappings[i].length);
+	}
+
+	free(ram->mappings);
+	free(ram->dirty_pages);
+	free(ram->page_generations);
     free(ram);
 	
 	return true;
@@ -26,24 +65,422 @@ bool destroy_ram(RAM ram) {
 RAM new_ram(size_t size, uint32_t base_vaddr) {
     if (size == 0) return NULL;
 
-    RAM main_memory = malloc(sizeof(struct ram));
+	// Nothing is allocated for the pages until they are written
+    RAM main_memory = calloc(1, sizeof(struct ram));
 
     if (!main_memory) return NULL;
 
-    main_memory->data = (u_int8_t *)malloc(size);
-    if (!main_memory->data) {
-        free(main_memory);
-		
-        return NULL;
-    }
+	// The stamps of untouched pages stay zero pages of the host
+	main_memory->dirty_pages 	  = calloc(RAM_DIRTY_WORDS, sizeof(uint64_t));
+	main_memory->page_generations = calloc(RAM_PAGE_COUNT, sizeof(uint32_t));
+
+	if (!main_memory->dirty_pages || !main_memory->page_generations) {
+		free(main_memory->dirty_pages);
+		free(main_memory->page_generations);
+		free(main_memory);
+
+		return NULL;
+	}
+
+	// The window never wraps, ram_check_access relies on it
+	const uint64_t limit = (1ull << 32) - base_vaddr;
 
 	main_memory->base_vaddr = base_vaddr;
-    main_memory->size 		= size;
+    main_memory->size 		= size < limit ? size : (size_t)limit;
+	main_memory->generation = 1;
 
-    memset(main_memory->data, 0, size);
     return main_memory;
 }
 
+/// Slot of the page holding address, its table is allocated if missing
+static uint8_t **ram_page_slot(
+	RAM      ram,
+	uint32_t address
+) {
+	uint8_t ***table = &ram->directory[address >> (RAM_PAGE_SHIFT + RAM_TABLE_SHIFT)];
+
+	if (!*table) {
+		*table = calloc(RAM_TABLE_SIZE, sizeof(uint8_t *));
+		if (!*table) return NULL;
+	}
+
+	return &(*table)[(address >> RAM_PAGE_SHIFT) & (RAM_TABLE_SIZE - 1)];
+}
+
+uint8_t *ram_map_page(
+	RAM      ram,
+	uint32_t address
+) {
+	uint8_t **page = ram_page_slot(ram, address);
+	if (!page) return NULL;
+
+	if (!*page) {
+		*page = calloc(1, RAM_PAGE_SIZE);
+		if (!*page) return NULL;
+
+		ram->mapped_pages++;
+
+		// Reads of the page were served by the zero page
+		ram->tlb[(address >> RAM_PAGE_SHIFT) & (RAM_TLB_SIZE - 1)].permissions = 0;
+	}
+
+	return *page;
+}
+
+void ram_mark_mapped_dirty(RAM ram) {
+	if (!ram) return;
+
+	for (uint32_t i = 0; i < RAM_TABLE_SIZE; i++) {
+		if (!ram->directory[i]) continue;
+
+		for (uint32_t j = 0; j < RAM_TABLE_SIZE; j++) {
+			const uint32_t page = i << RAM_TABLE_SHIFT | j;
+			if (ram->directory[i][j]) ram->dirty_pages[page >> 6] |= 1ull << (page & 63);
+		}
+	}
+}
+
+void ram_clear_dirty(RAM ram) {
+	if (!ram) return;
+
+	memset(ram->dirty_pages, 0, RAM_DIRTY_WORDS * sizeof(uint64_t));
+
+	// The next store to each page must mark it dirty again
+	for (uint32_t i = 0; i < RAM_TLB_SIZE; i++) {
+		ram->tlb[i].permissions &= ~RAM_PERM_WRITE;
+	}
+}
+
+// MARK: - Views
+
+uint32_t ram_next_generation(RAM ram) {
+	if (!ram) return 0;
+
+	// The next store to each page must stamp it again
+	for (uint32_t i = 0; i < RAM_TLB_SIZE; i++) {
+		ram->tlb[i].permissions &= ~RAM_PERM_WRITE;
+	}
+
+	return ram->generation++;
+}
+
+bool ram_range_changed(
+	const RAM      ram,
+		  uint32_t address,
+		  size_t   size,
+		  uint32_t since
+) {
+	if (!ram || size == 0) return false;
+
+	const uint64_t end  = (uint64_t)address + size;
+	const uint32_t last = (uint32_t)(((end < (1ull << 32) ? end : 1ull << 32) - 1) >> RAM_PAGE_SHIFT);
+
+	for (uint32_t page = address >> RAM_PAGE_SHIFT; page <= last; page++) {
+		if (ram->page_generations[page] > since) return true;
+	}
+
+	return false;
+}
+
+/**
+ * @brief Bytes the guest could load from address, up to size and the end
+ * of the page.
+ */
+static size_t readable_span(
+	const RAM      ram,
+		  uint32_t address,
+		  size_t   size
+) {
+	const uint64_t offset = (uint32_t)(address - ram->base_vaddr);
+	if (offset >= ram->size) return 0;
+
+	uint64_t span = RAM_PAGE_SIZE - (address & RAM_PAGE_MASK);
+	if (span > size) 			   span = size;
+	if (span > ram->size - offset) span = ram->size - offset;
+
+	if (ram->region_count) {
+		const ram_region_t *region = ram_find_region(ram, address);
+		if (!region || !(region->permissions & RAM_PERM_READ)) return 0;
+
+		const uint64_t left = (uint64_t)region->start + region->size - address;
+		if (span > left) span = left;
+	}
+
+	return (size_t)span;
+}
+
+/**
+ * @brief Leading bytes of a range the guest could load, the range stops at
+ * the top of the address space.
+ */
+static size_t readable_length(
+	const RAM      ram,
+		  uint32_t address,
+		  size_t   size
+) {
+	const uint64_t top   = (1ull << 32) - address;
+	const size_t   limit = size < top ? size : (size_t)top;
+
+	size_t length = 0;
+
+	while (length < limit) {
+		const size_t span = readable_span(ram, address + (uint32_t)length, limit - length);
+		if (!span) break;
+
+		length += span;
+	}
+
+	return length;
+}
+
+size_t ram_read_range(
+	const RAM       ram,
+		  uint32_t  address,
+		  void     *buffer,
+		  size_t    size
+) {
+	if (!ram || !buffer) return 0;
+
+	uint8_t 	*bytes  = buffer;
+	const size_t length = readable_length(ram, address, size);
+
+	for (size_t done = 0; done < length; ) {
+		const uint32_t from  = address + (uint32_t)done;
+		const size_t   left  = RAM_PAGE_SIZE - (from & RAM_PAGE_MASK);
+		const size_t   chunk = left < length - done ? left : length - done;
+
+		memcpy(bytes + done, ram_read_pointer(ram, from), chunk);
+		done += chunk;
+	}
+
+	memset(bytes + length, 0, size - length);
+
+	return length;
+}
+
+size_t ram_update_words(
+	const RAM       ram,
+		  uint32_t  address,
+		  uint32_t *words,
+		  size_t    count,
+		  uint32_t  since,
+		  uint64_t *changed
+) {
+	if (!ram || !words || !changed || address & 0x3) return 0;
+
+	// Same words as ram_read_range would copy
+	const size_t readable = readable_length(ram, address, count * 4) / 4;
+
+	size_t updated = 0;
+
+	for (size_t i = 0; i < readable; ) {
+		const uint32_t first = address + (uint32_t)(i * 4);
+
+		// The words up to the end of the page share its stamp
+		size_t run = (RAM_PAGE_SIZE - (first & RAM_PAGE_MASK)) / 4;
+		if (run > readable - i) run = readable - i;
+
+		if (ram->page_generations[first >> RAM_PAGE_SHIFT] > since) {
+			const uint8_t *p = ram_read_pointer(ram, first);
+
+			for (size_t j = 0; j < run; j++, p += 4) {
+				const uint32_t value = (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+				if (words[i + j] == value) continue;
+
+				words[i + j] 		   = value;
+				changed[(i + j) >> 6] |= 1ull << ((i + j) & 63);
+				updated++;
+			}
+		}
+
+		i += run;
+	}
+
+	return updated;
+}
+
+// MARK: - Regions
+
+bool ram_add_region(
+	RAM         ram,
+	uint32_t    start,
+	uint32_t    size,
+	uint32_t    permissions,
+	const char *name
+) {
+	if (!ram || size == 0 || ram->region_count == RAM_MAX_REGIONS) return false;
+
+	ram->regions[ram->region_count++] = (ram_region_t){ start, size, permissions, name };
+	ram_tlb_flush(ram);
+
+	return true;
+}
+
+void ram_clear_regions(RAM ram) {
+	if (!ram) return;
+
+	ram->region_count = 0;
+	ram->heap_region  = 0;
+	ram_tlb_flush(ram);
+}
+
+const ram_region_t *ram_find_region(
+	const RAM ram,
+	uint32_t  address
+) {
+	if (!ram) return NULL;
+
+	for (uint32_t i = 0; i < ram->region_count; i++) {
+		const ram_region_t *region = &ram->regions[i];
+		if (address - region->start < region->size) return region;
+	}
+
+	return NULL;
+}
+
+int ram_page_region(
+	const RAM ram,
+	uint64_t  page_start
+) {
+	for (uint32_t i = 0; i < ram->region_count; i++) {
+		const ram_region_t *region = &ram->regions[i];
+		const uint64_t end = (uint64_t)region->start + region->size;
+
+		if (region->start < page_start + RAM_PAGE_SIZE && page_start < end) return (int)i;
+	}
+
+	return -1;
+}
+
+// MARK: - Heap
+
+bool ram_set_heap(
+	RAM      ram,
+	uint32_t start,
+	uint32_t limit
+) {
+	if (!ram || limit < start) return false;
+
+	// The region starts empty, ram_add_region refuses those
+	if (!ram->heap_region) {
+		if (ram->region_count == RAM_MAX_REGIONS) return false;
+		ram->heap_region = ++ram->region_count;
+	}
+
+	ram->regions[ram->heap_region - 1] = (ram_region_t){ start, 0, RAM_PERM_READ | RAM_PERM_WRITE, "heap" };
+
+	ram->heap_start = start;
+	ram->heap_break = start;
+	ram->heap_limit = limit;
+
+	ram_tlb_flush(ram);
+
+	return true;
+}
+
+uint32_t ram_brk(
+	RAM      ram,
+	uint32_t address
+) {
+	if (!ram || !ram->heap_region) return 0;
+	if (address < ram->heap_start || address > ram->heap_limit) return ram->heap_break;
+
+	const bool shrink = address < ram->heap_break;
+
+	ram->heap_break = address;
+	ram->regions[ram->heap_region - 1].size = address - ram->heap_start;
+
+	// Pages past a lower break may still be cached, a growing heap only
+	// adds translations the TLB has never seen
+	if (shrink) ram_tlb_flush(ram);
+
+	return address;
+}
+
+void ram_tlb_flush(RAM ram) {
+	if (!ram) return;
+
+	memset(ram->tlb, 0, sizeof(ram->tlb));
+}
+
+const char *ram_access_description(ram_access_t access) {
+	switch (access) {
+		case RAM_ACCESS_OK:           return "ok";
+		case RAM_ACCESS_MISALIGNED:   return "misaligned access";
+		case RAM_ACCESS_OUT_OF_RANGE: return "address outside the RAM";
+		case RAM_ACCESS_NO_MEMORY:    return "page could not be allocated";
+		case RAM_ACCESS_UNMAPPED:     return "address outside every region";
+		case RAM_ACCESS_PROTECTION:   return "access not allowed by the region";
+	}
+
+	return "unknown fault";
+}
+
+ram_access_t ram_translate(
+	RAM       ram,
+	uint32_t  address,
+	uint32_t  width,
+	uint32_t  permission,
+	uint8_t **host
+) {
+	const ram_access_t window = ram_check_access(ram, address, width);
+	if (window != RAM_ACCESS_OK) return window;
+
+	// Without regions the whole window behaves as one RWX region
+	uint64_t start 		 = ram->base_vaddr;
+	uint64_t end 		 = start + ram->size;
+	uint32_t permissions = RAM_PERM_READ | RAM_PERM_WRITE | RAM_PERM_EXEC;
+
+	if (ram->region_count) {
+		const ram_region_t *region = ram_find_region(ram, address);
+		if (!region || (uint64_t)(address - region->start) + width > region->size) return RAM_ACCESS_UNMAPPED;
+
+		start 		= region->start;
+		end 		= start + region->size;
+		permissions = region->permissions;
+	}
+
+	if (!(permissions & permission)) return RAM_ACCESS_PROTECTION;
+
+	const uint32_t page = address >> RAM_PAGE_SHIFT;
+	uint8_t *p;
+
+	if (permission & RAM_PERM_WRITE) {
+		p = ram_write_pointer(ram, address);
+		if (!p) return RAM_ACCESS_NO_MEMORY;
+
+	} else {
+		p = (uint8_t *)ram_read_pointer(ram, address);
+	}
+
+	*host = p;
+
+	// Only pages inside the window with a single set of permissions are
+	// cached, the window is inside the region when there are none
+	const uint64_t first = (uint64_t)page << RAM_PAGE_SHIFT;
+	const uint64_t last  = first + RAM_PAGE_SIZE;
+
+	const bool whole_page = first >= start && last <= end &&
+							first >= ram->base_vaddr && last - ram->base_vaddr <= ram->size;
+
+	if (whole_page && !(permissions & RAM_PERM_DEVICE)) {
+		uint32_t cached = permissions & (RAM_PERM_READ | RAM_PERM_EXEC);
+
+		// Stores are cached only once the page is allocated and dirty
+		if ((permissions & RAM_PERM_WRITE) && ram_page_mapped(ram, page) && ram_page_dirty(ram, page)) {
+			cached |= RAM_PERM_WRITE;
+		}
+
+		ram->tlb[page & (RAM_TLB_SIZE - 1)] = (ram_tlb_entry_t){
+			.page 		 = page,
+			.permissions = cached,
+			.host 		 = p - (address & RAM_PAGE_MASK)
+		};
+	}
+
+	return RAM_ACCESS_OK;
+}
+
 /**
  * @brief Write a 32-bit value to the specified address in RAM.
  * @param ram Pointer to the RAM instance.
@@ -56,34 +493,29 @@ void write_ram32bit(
     const uint32_t value
 ) {
 
-    if (!ram || !ram->data) {
+    if (!ram) {
         fprintf(stderr, "Errore: RAM non inizializzata\n");
         return;
     }
 
-    if (address % 4 != 0) {
-        fprintf(stderr, "Errore: indirizzo 0x%08x non allineato a 4 byte\n", address);
-        return;
-    }
-	
-	if (address < ram->base_vaddr) {
-		fprintf(stderr, "Errore: indirizzo 0x%08x sotto base ram 0x%08x\n", address, ram->base_vaddr);
-		return;
-	}
-	const uint32_t offset = address - ram->base_vaddr;
+    const ram_access_t access = ram_store32(ram, address, value);
 
-    if (offset + 3 >= ram->size) {
-        fprintf(stderr, "Errore write: accesso fuori bounds 0x%08x + 4 > 0x%08x\n",
-				offset, (int32_t)ram->size);
-        return;
-    }
+    switch (access) {
+        case RAM_ACCESS_OK:
+            break;
 
-    uint8_t *p = ram->data + offset;
+        case RAM_ACCESS_MISALIGNED:
+            fprintf(stderr, "Errore: indirizzo 0x%08x non allineato a 4 byte\n", address);
+            break;
 
-    p[0] = (uint8_t)(value & 0xFF);
-    p[1] = (uint8_t)(value >> 8 & 0xFF);
-    p[2] = (uint8_t)(value >> 16 & 0xFF);
-    p[3] = (uint8_t)(value >> 24 & 0xFF);
+        case RAM_ACCESS_OUT_OF_RANGE:
+            fprintf(stderr, "Errore write: accesso 0x%08x fuori dalla RAM\n", address);
+            break;
+
+        default:
+            fprintf(stderr, "Errore write: 0x%08x, %s\n", address, ram_access_description(access));
+            break;
+    }
 }
 
 /**
@@ -91,40 +523,31 @@ void write_ram32bit(
  * @param ram Pointer to the RAM instance.
  * @param address Address in RAM from which the value will be read.
  *
- * @return The 32-bit value read from RAM.
+ * @return The 32-bit value read from RAM, -1 on a fault.
  */
 int32_t read_ram32bit(
           RAM ram,
     const uint32_t address
 ) {
-    if (!ram || !ram->data) {
+    if (!ram) {
         fprintf(stderr, "Errore: RAM non inizializzata\n");
         return -1;
     }
 
-    if (address % 4 != 0) {
-        fprintf(stderr, "Errore: indirizzo 0x%08x non allineato a 4 byte\n", address);
-        return -1;
-    }
-	
-	if (address < ram->base_vaddr) {
-		fprintf(stderr, "Errore: indirizzo 0x%08x sotto base ram 0x%08x\n", address, ram->base_vaddr);
-		return -1;
-	}
-	const uint32_t offset = address - ram->base_vaddr;
+    uint32_t value;
 
-    if (offset + 3 >= ram->size) {
-        fprintf(stderr, "Errore read: accesso fuori bounds 0x%08x + 4 > 0x%08lu\n",
-                address, ram->size);
-        return -1;
-    }
+    switch (ram_load32(ram, address, &value)) {
+        case RAM_ACCESS_OK:
+            return (int32_t)value;
 
-    const uint8_t *p = ram->data + offset;
-    return (int32_t)p[0]
-         | (int32_t)p[1] << 8
-         | (int32_t)p[2] << 16
-         | (int32_t)p[3] << 24;
+        case RAM_ACCESS_MISALIGNED:
+            fprintf(stderr, "Errore: indirizzo 0x%08x non allineato a 4 byte\n", address);
+            return -1;
 
+        default:
+            fprintf(stderr, "Errore read: accesso 0x%08x fuori dalla RAM\n", address);
+            return -1;
+    }
 }
 
 /**
@@ -159,7 +582,100 @@ void load_binary_to_ram(
 		size = ram->size - offset;
 	}
 
-	memcpy(ram->data + offset, binary, size);
+	// Copy one page at a time, allocating only the pages covered
+	uint32_t address = start_addr;
+	while (size > 0) {
+		const size_t chunk = RAM_PAGE_SIZE - (address & RAM_PAGE_MASK) < size
+			? RAM_PAGE_SIZE - (address & RAM_PAGE_MASK)
+			: size;
+
+		uint8_t *p = ram_write_pointer(ram, address);
+		if (!p) {
+			fprintf(stderr, "Pagina 0x%08x non allocata, caricamento interrotto\n", address);
+			return;
+		}
+
+		memcpy(p, binary, chunk);
+
+		binary  += chunk;
+		address += (uint32_t)chunk;
+		size 	-= chunk;
+	}
+}
+
+bool map_file_to_ram(
+	RAM      ram,
+	int      fd,
+	uint64_t offset,
+	size_t   size,
+	uint32_t start_addr
+) {
+	if (!ram || fd < 0) return false;
+	if (size == 0) return true;
+
+	if (start_addr < ram->base_vaddr || (uint64_t)(start_addr - ram->base_vaddr) + size > ram->size) {
+		fprintf(stderr, "Range 0x%08x + %zu fuori dai limiti della RAM\n", start_addr, size);
+		return false;
+	}
+
+	// Mapping past the end of the file faults on access
+	struct stat status;
+	if (fstat(fd, &status) != 0 || offset + size > (uint64_t)status.st_size) return false;
+
+	const uint64_t host_page  = (uint64_t)sysconf(_SC_PAGESIZE);
+	const uint64_t map_offset = offset - offset % host_page;
+	const size_t   map_length = size + (size_t)(offset - map_offset);
+
+	uint8_t *map = mmap(NULL, map_length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, (off_t)map_offset);
+	if (map == MAP_FAILED) return false;
+
+	ram_mapping_t *mappings = realloc(ram->mappings, (ram->mapping_count + 1) * sizeof(ram_mapping_t));
+	if (!mappings) {
+		munmap(map, map_length);
+		return false;
+	}
+
+	ram->mappings = mappings;
+
+	const uint8_t *bytes = map + (offset - map_offset);
+	uint32_t address 	 = start_addr;
+	bool borrowed 		 = false;
+
+	while (size > 0) {
+		const size_t chunk = RAM_PAGE_SIZE - (address & RAM_PAGE_MASK) < size
+			? RAM_PAGE_SIZE - (address & RAM_PAGE_MASK)
+			: size;
+
+		uint8_t **page = chunk == RAM_PAGE_SIZE ? ram_page_slot(ram, address) : NULL;
+
+		if (page && !*page) {
+			// Host pointers need no alignment, the page is used in place
+			*page = (uint8_t *)bytes;
+			ram->mapped_pages++;
+			ram_mark_dirty(ram, address);
+			ram->tlb[(address >> RAM_PAGE_SHIFT) & (RAM_TLB_SIZE - 1)].permissions = 0;
+			borrowed = true;
+
+		} else {
+			uint8_t *p = ram_write_pointer(ram, address);
+			if (!p) {
+				fprintf(stderr, "Pagina 0x%08x non allocata, caricamento interrotto\n", address);
+				break;
+			}
+
+			memcpy(p, bytes, chunk);
+		}
+
+		bytes 	+= chunk;
+		address += (uint32_t)chunk;
+		size 	-= chunk;
+	}
+
+	// Nothing references a mapping whose pages were all copied
+	if (borrowed) ram->mappings[ram->mapping_count++] = (ram_mapping_t){ map, map_length };
+	else munmap(map, map_length);
+
+	return size == 0;
 }
 
 /**
@@ -86,6 +86,19 @@ ControlSignals getControlSignals(uint8_t opcode) {
 			
             break;
 
+        // B-Type: BEQ, BNE, BLT, etc. (opcode = 0x63)
+        case 0x63:
+            signals.branch     = true;  // branch instruction
+            signals.mem_read   = false; // non-memory read instruction
+            signals.mem_to_reg = false; // non-memory to register instruction
+            signals.operation  = 0x63;  // Operation code
+            signals.mem_write  = false; // non-memory write instruction
+            signals.alu_src    = false; // non immediate value, compares rs1 with rs2
+            signals.reg_write  = false; // does not write to registers
+			signals.type 	   = B_TYPE;
+
+            break;
+
         case 0x73:
             signals.branch     = false; // non-branch instruction
             signals.mem_read   = false; // non-memory read instruction
@@ -98,23 +111,25 @@ ControlSignals getControlSignals(uint8_t opcode) {
 			
             break;
 
+        // U-Type: lui, the ALU adds the immediate to zero (opcode = 0x37)
         case 0x37:
             signals.branch     = false; // non-branch instruction
             signals.mem_read   = false; // non-memory read instruction
             signals.mem_to_reg = false; // non-memory to register instruction
-            signals.operation  = 0x37;  // Operation code for ecall
+            signals.operation  = 0x37;  // Operation code for lui
             signals.mem_write  = false; // non-memory write instruction
-            signals.alu_src    = false; // use immediate value
+            signals.alu_src    = true;  // use immediate value
             signals.reg_write  = true;  // write to registers
-			signals.type 	   = ECALL;
+			signals.type 	   = I_TYPE;
 
             break;
 
+        // U-Type: auipc, the ALU adds the immediate to pc (opcode = 0x17)
         case 0x17:
             signals.branch     = false; // non-branch instruction
             signals.mem_read   = false; // non-memory read instruction
             signals.mem_to_reg = false; // non-memory to register instruction
-            signals.operation  = 0x17;  // Operation code for ecall
+            signals.operation  = 0x17;  // Operation code for auipc
             signals.mem_write  = false; // non-memory write instruction
             signals.alu_src    = true;  // use immediate value
             signals.reg_write  = true;  // write to registers
@@ -19,6 +19,7 @@ typedef enum {
 	I_SAVE_TYPE,
 	UJ_TYPE,
 	S_TYPE,
+	B_TYPE,
 	ECALL
 	
 } TypeInstruction;
@@ -0,0 +1,322 @@
+/**
+ * @file cache.c
+ * @brief Tag arrays of the L1 caches and the reports built on them.
+ */
+
+#include "cache.h"
+
+static bool is_power_of_two(uint32_t value) {
+	return value && !(value & (value - 1));
+}
+
+// MARK: - Lifecycle
+
+cache_config_t cache_default_config(void) {
+	return (cache_config_t){
+		.size         = 32 * 1024,
+		.line_size    = 64,
+		.ways         = 4,
+		.replacement  = CACHE_LRU,
+		.write_policy = CACHE_WRITE_BACK
+	};
+}
+
+bool cache_config_valid(const cache_config_t *config) {
+	if (!config || !is_power_of_two(config->line_size) || config->line_size < 4 || !config->ways) return false;
+
+	const uint64_t set_size = (uint64_t)config->line_size * config->ways;
+	if (config->size % set_size) return false;
+
+	return (uint64_t)config->size >= set_size && is_power_of_two((uint32_t)(config->size / set_size));
+}
+
+static void free_array(cache_array_t *array) {
+	free(array->tags);
+	free(array->stamps);
+	free(array->dirty);
+	free(array->page_accesses);
+	free(array->page_misses);
+	free(array->page_evictions);
+}
+
+/**
+ * @brief Allocate the tags and the page counters of a cache.
+ * @return false if allocation fails, the array is then released by the caller.
+ */
+static bool new_array(
+		  cache_array_t  *array,
+	const cache_config_t *config,
+		  uint32_t        page_count
+) {
+	const uint32_t lines = config->size / config->line_size;
+
+	array->config 	  = *config;
+	array->line_shift = (uint32_t)__builtin_ctz(config->line_size);
+	array->set_mask   = lines / config->ways - 1;
+	array->seed 	  = 0x2545F491u;
+
+	array->tags   = calloc(lines, sizeof(uint32_t));
+	array->stamps = calloc(lines, sizeof(uint64_t));
+	array->dirty  = calloc(lines, sizeof(uint8_t));
+
+	// Zeroed on demand by the system, only touched pages use memory
+	array->page_accesses  = calloc(page_count, sizeof(uint64_t));
+	array->page_misses 	  = calloc(page_count, sizeof(uint64_t));
+	array->page_evictions = calloc(page_count, sizeof(uint64_t));
+
+	return array->tags && array->stamps && array->dirty &&
+		   array->page_accesses && array->page_misses && array->page_evictions;
+}
+
+/**
+ * @brief Invalidate every line and zero the counters.
+ */
+static void empty_array(
+	cache_array_t *array,
+	uint32_t       page_count
+) {
+	if (!array->tags) return;
+
+	const uint32_t lines = array->config.size / array->config.line_size;
+
+	memset(array->tags, 0, lines * sizeof(uint32_t));
+	memset(array->stamps, 0, lines * sizeof(uint64_t));
+	memset(array->dirty, 0, lines * sizeof(uint8_t));
+	memset(array->page_accesses, 0, page_count * sizeof(uint64_t));
+	memset(array->page_misses, 0, page_count * sizeof(uint64_t));
+	memset(array->page_evictions, 0, page_count * sizeof(uint64_t));
+
+	array->clock 		  = 0;
+	array->last_tag 	  = 0;
+	array->last_way 	  = 0;
+	array->writebacks 	  = 0;
+	array->write_throughs = 0;
+}
+
+CACHE new_cache(
+	const RAM             ram,
+	const cache_config_t *instruction,
+	const cache_config_t *data
+) {
+	if (!ram) return NULL;
+	if ((instruction && !cache_config_valid(instruction)) || (data && !cache_config_valid(data))) return NULL;
+
+	CACHE cache = calloc(1, sizeof(struct cache));
+	if (!cache) return NULL;
+
+	cache->page_count = (uint32_t)((ram->size + RAM_PAGE_MASK) >> RAM_PAGE_SHIFT);
+	if (!cache->page_count) cache->page_count = 1;
+
+	const cache_config_t *configs[CACHE_KIND_COUNT] = { instruction, data };
+
+	for (uint32_t kind = 0; kind < CACHE_KIND_COUNT; kind++) {
+		if (configs[kind] && !new_array(&cache->arrays[kind], configs[kind], cache->page_count)) {
+			destroy_cache(cache);
+			return NULL;
+		}
+	}
+
+	return cache;
+}
+
+bool destroy_cache(CACHE cache) {
+	if (!cache) return false;
+
+	for (uint32_t kind = 0; kind < CACHE_KIND_COUNT; kind++) free_array(&cache->arrays[kind]);
+	free(cache);
+
+	return true;
+}
+
+bool enable_cache(
+		  MACHINE         machine,
+	const cache_config_t *instruction,
+	const cache_config_t *data
+) {
+	if (!machine || !machine->ram) return false;
+
+	CACHE cache = new_cache(machine->ram, instruction, data);
+	if (!cache) return false;
+
+	destroy_cache(machine->cache);
+
+	cache->horizon = machine->instret;
+	machine->cache = cache;
+
+	return true;
+}
+
+void disable_cache(MACHINE machine) {
+	if (!machine) return;
+
+	destroy_cache(machine->cache);
+	machine->cache = NULL;
+}
+
+void cache_clear(MACHINE machine) {
+	if (!machine || !machine->cache) return;
+
+	CACHE cache = machine->cache;
+	for (uint32_t kind = 0; kind < CACHE_KIND_COUNT; kind++) empty_array(&cache->arrays[kind], cache->page_count);
+
+	cache->horizon = machine->instret;
+}
+
+// MARK: - Lookup
+
+/**
+ * @brief Way of a full set to replace.
+ * @param first Index in tags of the first way of the set.
+ */
+static uint32_t choose_victim(
+	cache_array_t *array,
+	uint32_t       first
+) {
+	const uint32_t ways = array->config.ways;
+
+	for (uint32_t way = 0; way < ways; way++) {
+		if (!array->tags[first + way]) return first + way;
+	}
+
+	if (array->config.replacement == CACHE_RANDOM) {
+		uint32_t seed = array->seed;
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		array->seed = seed;
+
+		return first + seed % ways;
+	}
+
+	// The oldest stamp is the least recently used or the first filled way
+	uint32_t victim = first;
+	for (uint32_t way = 1; way < ways; way++) {
+		if (array->stamps[first + way] < array->stamps[victim]) victim = first + way;
+	}
+
+	return victim;
+}
+
+void cache_lookup(
+		  cache_array_t *array,
+	const RAM            ram,
+		  uint32_t       address,
+		  bool           write
+) {
+	const uint32_t line  = address >> array->line_shift;
+	const uint32_t tag 	 = line + 1;
+	const uint32_t ways  = array->config.ways;
+	const uint32_t first = (line & array->set_mask) * ways;
+
+	for (uint32_t way = first; way < first + ways; way++) {
+		if (array->tags[way] != tag) continue;
+
+		if (array->config.replacement == CACHE_LRU) array->stamps[way] = ++array->clock;
+		if (write) cache_write_hit(array, way);
+
+		array->last_tag = tag;
+		array->last_way = way;
+
+		return;
+	}
+
+	array->page_misses[(address - ram->base_vaddr) >> RAM_PAGE_SHIFT]++;
+
+	if (write && array->config.write_policy == CACHE_WRITE_THROUGH) {
+		array->write_throughs++;
+		return;
+	}
+
+	const uint32_t victim = choose_victim(array, first);
+
+	if (array->tags[victim]) {
+		const uint32_t evicted = (array->tags[victim] - 1) << array->line_shift;
+		array->page_evictions[(evicted - ram->base_vaddr) >> RAM_PAGE_SHIFT]++;
+
+		if (array->dirty[victim]) array->writebacks++;
+	}
+
+	array->tags[victim]   = tag;
+	array->stamps[victim] = ++array->clock;
+	array->dirty[victim]  = write;
+
+	array->last_tag = tag;
+	array->last_way = victim;
+}
+
+// MARK: - Reports
+
+bool cache_stats(
+	const MACHINE        machine,
+		  cache_kind_t   kind,
+		  cache_stats_t *stats
+) {
+	if (!machine || !machine->cache || kind >= CACHE_KIND_COUNT || !stats) return false;
+
+	const CACHE          cache = machine->cache;
+	const cache_array_t *array = &cache->arrays[kind];
+	const RAM            ram   = machine->ram;
+
+	if (!array->tags) return false;
+
+	memset(stats, 0, sizeof(*stats));
+
+	stats->config 		  = array->config;
+	stats->writebacks 	  = array->writebacks;
+	stats->write_throughs = array->write_throughs;
+
+	// Without a permission map the whole window is one region
+	if (ram->region_count == 0) {
+		stats->regions[0] = (cache_region_t){ "memory", ram->base_vaddr, (uint32_t)ram->size, 0, 0, 0 };
+		stats->region_count = 1;
+
+	} else {
+		for (uint32_t i = 0; i < ram->region_count; i++) {
+			const ram_region_t *region = &ram->regions[i];
+			stats->regions[i] = (cache_region_t){ region->name, region->start, region->size, 0, 0, 0 };
+		}
+
+		stats->region_count = ram->region_count;
+	}
+
+	for (uint32_t page = 0; page < cache->page_count; page++) {
+		const uint64_t accesses  = array->page_accesses[page];
+		const uint64_t evictions = array->page_evictions[page];
+		if (!accesses && !evictions) continue;
+
+		const uint64_t misses = array->page_misses[page];
+
+		stats->accesses  += accesses;
+		stats->misses 	 += misses;
+		stats->evictions += evictions;
+
+		const uint64_t page_start = (uint64_t)ram->base_vaddr + ((uint64_t)page << RAM_PAGE_SHIFT);
+		const int      region 	  = ram->region_count ? ram_page_region(ram, page_start) : 0;
+
+		if (region < 0) continue;
+
+		stats->regions[region].accesses  += accesses;
+		stats->regions[region].misses 	 += misses;
+		stats->regions[region].evictions += evictions;
+	}
+
+	stats->hits = stats->accesses - stats->misses;
+
+	return true;
+}
+
+double cache_miss_rate(
+	uint64_t misses,
+	uint64_t accesses
+) {
+	return accesses ? (double)misses / (double)accesses : 0.0;
+}
+
+const char *cache_replacement_name(cache_replacement_t replacement) {
+	switch (replacement) {
+		case CACHE_LRU:    return "LRU";
+		case CACHE_FIFO:   return "FIFO";
+		case CACHE_RANDOM: return "random";
+		default:           return "?";
+	}
+}
@@ -0,0 +1,468 @@
+/**
+ * @file debugger.c
+ * @brief Breakpoint bitmaps, watched ranges and the stepping commands.
+ */
+
+#include "debugger.h"
+
+static bool test_bit(
+	const uint32_t *bits,
+		  uint32_t  index
+) {
+	return bits[index >> 5] >> (index & 31) & 1;
+}
+
+static void assign_bit(
+	uint32_t *bits,
+	uint32_t  index,
+	bool      value
+) {
+	if (value) bits[index >> 5] |= 1u << (index & 31);
+	else 	   bits[index >> 5] &= ~(1u << (index & 31));
+}
+
+/**
+ * @brief Words of .text the bitmaps cover, the predecoded records once they
+ * exist and the RAM section before.
+ */
+static void text_window(
+	const MACHINE   machine,
+		  uint32_t *base,
+		  uint32_t *count
+) {
+	if (machine->decoded) {
+		*base  = machine->decoded_base;
+		*count = machine->decoded_count;
+
+	} else {
+		*base  = machine->ram->text_base;
+		*count = machine->ram->text_size >> 2;
+	}
+}
+
+/**
+ * @brief Bit of an address in the bitmaps.
+ * @return false when the address is not a word of the window.
+ */
+static bool bit_index(
+	const DEBUGGER  debugger,
+		  uint32_t  address,
+		  uint32_t *index
+) {
+	const uint32_t offset = address - debugger->base;
+	if (address & 0x3 || offset >> 2 >= debugger->count) return false;
+
+	*index = offset >> 2;
+
+	return true;
+}
+
+/**
+ * @brief Move the bitmaps over a new window, the breakpoints keep their
+ * address and those outside the window are dropped.
+ */
+static bool resize_bitmaps(
+	DEBUGGER debugger,
+	uint32_t base,
+	uint32_t count
+) {
+	const size_t words = ((size_t)count + 31) / 32;
+
+	uint32_t *breakpoints = calloc(words ? words : 1, sizeof(uint32_t));
+	uint32_t *stops 	  = calloc(words ? words : 1, sizeof(uint32_t));
+
+	if (!breakpoints || !stops) {
+		free(breakpoints);
+		free(stops);
+		return false;
+	}
+
+	uint32_t breakpoint_count = 0;
+
+	for (uint32_t index = 0; debugger->breakpoints && index < debugger->count; index++) {
+		if (!test_bit(debugger->breakpoints, index)) continue;
+
+		const uint32_t moved = (debugger->base + index * 4 - base) >> 2;
+		if (moved >= count) continue;
+
+		assign_bit(breakpoints, moved, true);
+		breakpoint_count++;
+	}
+
+	memcpy(stops, breakpoints, words * sizeof(uint32_t));
+
+	free(debugger->breakpoints);
+	free(debugger->stops);
+
+	debugger->breakpoints 	   = breakpoints;
+	debugger->stops 		   = stops;
+	debugger->base 			   = base;
+	debugger->count 		   = count;
+	debugger->breakpoint_count = breakpoint_count;
+
+	// The target of the command in flight stays armed
+	uint32_t index;
+	if (debugger->target && bit_index(debugger, debugger->target_pc, &index)) assign_bit(debugger->stops, index, true);
+
+	return true;
+}
+
+/**
+ * @brief Bitmaps over the current text window.
+ */
+static bool fit_window(MACHINE machine) {
+	DEBUGGER debugger = machine->debugger;
+
+	uint32_t base, count;
+	text_window(machine, &base, &count);
+
+	if (debugger->breakpoints && debugger->base == base && debugger->count == count) return true;
+
+	return resize_bitmaps(debugger, base, count);
+}
+
+/**
+ * @brief Lowest and highest watched byte.
+ */
+static void update_watch_bounds(DEBUGGER debugger) {
+	debugger->watch_first = UINT32_MAX;
+	debugger->watch_last  = 0;
+
+	for (uint32_t i = 0; i < debugger->watch_count; i++) {
+		const debugger_watchpoint_t *watchpoint = &debugger->watchpoints[i];
+
+		if (watchpoint->first < debugger->watch_first) debugger->watch_first = watchpoint->first;
+		if (watchpoint->last  > debugger->watch_last)  debugger->watch_last  = watchpoint->last;
+	}
+}
+
+/**
+ * @brief Calls link the return address in ra or t0.
+ */
+static bool is_link(uint32_t reg) {
+	return reg == 1 || reg == 5;
+}
+
+static bool is_call(const decoded_instruction_t *instruction) {
+	return (instruction->handler == HANDLER_JAL || instruction->handler == HANDLER_JALR) && is_link(instruction->rd);
+}
+
+// MARK: - Lifecycle
+
+DEBUGGER new_debugger(void) {
+	DEBUGGER debugger = calloc(1, sizeof(struct debugger));
+	if (!debugger) return NULL;
+
+	update_watch_bounds(debugger);
+
+	return debugger;
+}
+
+bool destroy_debugger(DEBUGGER debugger) {
+	if (!debugger) return false;
+
+	free(debugger->breakpoints);
+	free(debugger->stops);
+	free(debugger);
+
+	return true;
+}
+
+bool enable_debugger(MACHINE machine) {
+	if (!machine) return false;
+	if (machine->debugger) return true;
+
+	machine->debugger = new_debugger();
+
+	return machine->debugger != NULL;
+}
+
+// MARK: - Breakpoints and watchpoints
+
+bool set_breakpoint(
+	MACHINE  machine,
+	uint32_t address,
+	bool     enabled
+) {
+	if (!enable_debugger(machine) || !fit_window(machine)) return false;
+
+	DEBUGGER debugger = machine->debugger;
+
+	uint32_t index;
+	if (!bit_index(debugger, address, &index)) return false;
+
+	if (test_bit(debugger->breakpoints, index) != enabled) debugger->breakpoint_count += enabled ? 1 : -1;
+
+	assign_bit(debugger->breakpoints, index, enabled);
+	assign_bit(debugger->stops, index, enabled || (debugger->target && debugger->target_pc == address));
+
+	return true;
+}
+
+bool has_breakpoint(
+	const MACHINE  machine,
+		  uint32_t address
+) {
+	if (!machine || !machine->debugger || !machine->debugger->breakpoints) return false;
+
+	uint32_t index;
+	return bit_index(machine->debugger, address, &index) && test_bit(machine->debugger->breakpoints, index);
+}
+
+void clear_breakpoints(MACHINE machine) {
+	if (!machine || !machine->debugger || !machine->debugger->breakpoints) return;
+
+	DEBUGGER debugger = machine->debugger;
+	const size_t words = ((size_t)debugger->count + 31) / 32;
+
+	memset(debugger->breakpoints, 0, words * sizeof(uint32_t));
+	memset(debugger->stops, 0, words * sizeof(uint32_t));
+	debugger->breakpoint_count = 0;
+}
+
+bool add_watchpoint(
+	MACHINE  machine,
+	uint32_t address,
+	uint32_t size
+) {
+	if (!size || !enable_debugger(machine)) return false;
+
+	DEBUGGER debugger = machine->debugger;
+	if (debugger->watch_count == DEBUGGER_WATCHPOINTS) return false;
+
+	// A range past the top of the address space is cut there
+	const uint32_t last = address + size - 1 < address ? UINT32_MAX : address + size - 1;
+
+	debugger->watchpoints[debugger->watch_count++] = (debugger_watchpoint_t){ address, last };
+	update_watch_bounds(debugger);
+
+	return true;
+}
+
+bool remove_watchpoint(
+	MACHINE  machine,
+	uint32_t address,
+	uint32_t size
+) {
+	if (!size || !machine || !machine->debugger) return false;
+
+	DEBUGGER debugger = machine->debugger;
+	const uint32_t last = address + size - 1 < address ? UINT32_MAX : address + size - 1;
+
+	for (uint32_t i = 0; i < debugger->watch_count; i++) {
+		if (debugger->watchpoints[i].first != address || debugger->watchpoints[i].last != last) continue;
+
+		debugger->watchpoints[i] = debugger->watchpoints[--debugger->watch_count];
+		update_watch_bounds(debugger);
+
+		return true;
+	}
+
+	return false;
+}
+
+void clear_watchpoints(MACHINE machine) {
+	if (!machine || !machine->debugger) return;
+
+	machine->debugger->watch_count = 0;
+	update_watch_bounds(machine->debugger);
+}
+
+// MARK: - Commands
+
+/**
+ * @brief Disarm the target of the command in flight, a command cut by its
+ * budget keeps it until the next one starts.
+ */
+static void end_command(DEBUGGER debugger) {
+	uint32_t index;
+	if (debugger->target && debugger->stops && bit_index(debugger, debugger->target_pc, &index)) {
+		assign_bit(debugger->stops, index, test_bit(debugger->breakpoints, index));
+	}
+
+	debugger->target = false;
+	debugger->frames = false;
+}
+
+/**
+ * @brief Run with the stops checked. The command ends unless the budget
+ * cut it, then debug_resume carries it on.
+ * @param resume The command already ran up to pc, its breakpoint is not passed.
+ */
+static cpu_status_t run_command(
+	MACHINE  machine,
+	uint64_t max_instructions,
+	bool     resume
+) {
+	DEBUGGER debugger = machine->debugger;
+
+	debugger->active 	  = true;
+	debugger->resume_step = resume ? UINT64_MAX : machine->instret;
+	debugger->stop 		  = DEBUGGER_STOP_NONE;
+
+	uint32_t index;
+	if (debugger->target && fit_window(machine) && bit_index(debugger, debugger->target_pc, &index)) {
+		assign_bit(debugger->stops, index, true);
+	}
+
+	const cpu_status_t status = cpu_run(machine, max_instructions);
+
+	debugger->active = false;
+
+	// The window may have moved while running, end_command looks it up again
+	if (status != CPU_STATUS_BUDGET_EXHAUSTED) end_command(debugger);
+
+	return status;
+}
+
+cpu_status_t debug_continue(
+	MACHINE  machine,
+	uint64_t max_instructions
+) {
+	if (!machine || !enable_debugger(machine)) return CPU_STATUS_FETCH_FAULT;
+
+	end_command(machine->debugger);
+
+	return run_command(machine, max_instructions, false);
+}
+
+cpu_status_t debug_step_over(
+	MACHINE  machine,
+	uint64_t max_instructions
+) {
+	if (!machine || !machine->ram || !enable_debugger(machine)) return CPU_STATUS_FETCH_FAULT;
+
+	DEBUGGER debugger = machine->debugger;
+	end_command(debugger);
+
+	// Peek at the word in RAM, the record may not be decoded yet
+	const uint8_t *word = machine_translate(machine->ram, machine->pc, 4);
+
+	uint32_t raw = 0;
+	if (word) memcpy(&raw, word, sizeof(raw));
+
+	const decoded_instruction_t instruction = decode_instruction(raw);
+
+	if (!word || !is_call(&instruction)) return run_command(machine, max_instructions ? 1 : 0, false);
+
+	debugger->target 	= true;
+	debugger->target_pc = machine->pc + 4;
+	debugger->target_sp = machine->registers[2];
+
+	return run_command(machine, max_instructions, false);
+}
+
+cpu_status_t debug_step_out(
+	MACHINE  machine,
+	uint64_t max_instructions
+) {
+	if (!machine || !enable_debugger(machine)) return CPU_STATUS_FETCH_FAULT;
+
+	end_command(machine->debugger);
+
+	machine->debugger->frames = true;
+	machine->debugger->depth  = 0;
+
+	return run_command(machine, max_instructions, false);
+}
+
+cpu_status_t debug_run_to(
+	MACHINE  machine,
+	uint32_t address,
+	uint64_t max_instructions
+) {
+	if (!machine || !enable_debugger(machine)) return CPU_STATUS_FETCH_FAULT;
+
+	end_command(machine->debugger);
+
+	machine->debugger->target 	 = true;
+	machine->debugger->target_pc = address;
+	machine->debugger->target_sp = 0;
+
+	return run_command(machine, max_instructions, false);
+}
+
+cpu_status_t debug_resume(
+	MACHINE  machine,
+	uint64_t max_instructions
+) {
+	if (!machine || !enable_debugger(machine)) return CPU_STATUS_FETCH_FAULT;
+
+	return run_command(machine, max_instructions, true);
+}
+
+bool debug_pending(const MACHINE machine) {
+	return machine && machine->debugger && (machine->debugger->target || machine->debugger->frames);
+}
+
+// MARK: - Run loop hooks
+
+bool debugger_prepare(MACHINE machine) {
+	return fit_window(machine);
+}
+
+bool debugger_fetch(
+	MACHINE  machine,
+	uint32_t pc,
+	uint64_t step
+) {
+	DEBUGGER debugger = machine->debugger;
+
+	// The command does not stop where it started
+	if (step == debugger->resume_step) return false;
+
+	uint32_t index;
+	if (bit_index(debugger, pc, &index) && test_bit(debugger->breakpoints, index)) {
+		debugger->stop = DEBUGGER_STOP_BREAKPOINT;
+		return true;
+	}
+
+	// Returns of deeper recursive calls run with a lower sp
+	if (debugger->target && pc == debugger->target_pc && machine->registers[2] >= debugger->target_sp) {
+		debugger->stop = DEBUGGER_STOP_STEP;
+		return true;
+	}
+
+	return false;
+}
+
+bool debugger_store(
+	DEBUGGER debugger,
+	uint32_t address,
+	uint32_t width
+) {
+	const uint32_t last = address + width - 1;
+
+	for (uint32_t i = 0; i < debugger->watch_count; i++) {
+		const debugger_watchpoint_t *watchpoint = &debugger->watchpoints[i];
+		if (address > watchpoint->last || last < watchpoint->first) continue;
+
+		debugger->stop 		   = DEBUGGER_STOP_WATCHPOINT;
+		debugger->stop_address = address;
+		return true;
+	}
+
+	return false;
+}
+
+bool debugger_jump(
+	DEBUGGER                     debugger,
+	const decoded_instruction_t *instruction
+) {
+	if (is_link(instruction->rd)) {
+		debugger->depth++;
+		return false;
+	}
+
+	const bool is_return = instruction->handler == HANDLER_JALR && instruction->rd == 0 && is_link(instruction->rs1);
+	if (!is_return) return false;
+
+	if (debugger->depth) {
+		debugger->depth--;
+		return false;
+	}
+
+	debugger->stop = DEBUGGER_STOP_STEP;
+
+	return true;
+}
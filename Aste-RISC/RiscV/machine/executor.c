@@ -0,0 +1,287 @@
+/**
+ * @file executor.c
+ * @brief Command slot, slices and seqlock snapshots of the run thread.
+ */
+
+#include "executor.h"
+
+#include <string.h>
+#include <time.h>
+
+#include "debugger.h"
+#include "syscalls.h"
+
+static uint64_t monotonic_ns(void) {
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+
+	return (uint64_t)time.tv_sec * 1000000000ull + (uint64_t)time.tv_nsec;
+}
+
+/**
+ * @brief Write a snapshot of the machine, readers retry while it changes.
+ */
+static void publish(
+	EXECUTOR     executor,
+	cpu_status_t status,
+	bool         running
+) {
+	const MACHINE machine = executor->machine;
+
+	executor_snapshot_t snapshot = {
+		.publications = ++executor->publications,
+		.instret 	  = machine->instret,
+		.pc 		  = machine->pc,
+		.status 	  = status,
+		.running 	  = running
+	};
+
+	memcpy(snapshot.registers, machine->registers, sizeof(snapshot.registers));
+
+	uint32_t words[EXECUTOR_SNAPSHOT_WORDS] = { 0 };
+	memcpy(words, &snapshot, sizeof(snapshot));
+
+	// Odd while the words change
+	const uint32_t sequence = atomic_load_explicit(&executor->sequence, memory_order_relaxed);
+
+	atomic_store_explicit(&executor->sequence, sequence + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	for (size_t i = 0; i < EXECUTOR_SNAPSHOT_WORDS; i++) {
+		atomic_store_explicit(&executor->snapshot[i], words[i], memory_order_relaxed);
+	}
+
+	atomic_store_explicit(&executor->sequence, sequence + 2, memory_order_release);
+}
+
+/**
+ * @brief Wait for a command, the slot is emptied.
+ * @param address Receives the address posted with it.
+ */
+static executor_command_t take_command(
+	EXECUTOR  executor,
+	uint32_t *address
+) {
+	pthread_mutex_lock(&executor->lock);
+
+	uint32_t command;
+
+	while ((command = atomic_exchange_explicit(&executor->command, EXECUTOR_NONE, memory_order_acquire)) == EXECUTOR_NONE) {
+
+		// Every command posted so far is handled, the machine is free
+		const uint64_t posted = atomic_load_explicit(&executor->posted, memory_order_relaxed);
+		atomic_store_explicit(&executor->completed, posted, memory_order_release);
+
+		pthread_cond_wait(&executor->wake, &executor->lock);
+	}
+
+	*address = executor->address;
+
+	pthread_mutex_unlock(&executor->lock);
+
+	return (executor_command_t)command;
+}
+
+/**
+ * @brief Size the next slice so it lasts about EXECUTOR_SLICE_NS.
+ * @param executed Instructions retired by a whole slice.
+ * @param elapsed Its wall time.
+ */
+static void adapt_slice(
+	EXECUTOR executor,
+	uint64_t executed,
+	uint64_t elapsed
+) {
+	if (!executed || !elapsed) return;
+
+	uint64_t slice = executed * EXECUTOR_SLICE_NS / elapsed;
+
+	if (slice < EXECUTOR_SLICE_MIN) slice = EXECUTOR_SLICE_MIN;
+	if (slice > EXECUTOR_SLICE_MAX) slice = EXECUTOR_SLICE_MAX;
+
+	executor->slice = slice;
+}
+
+/**
+ * @brief Run a command slice by slice until the program stops, the command
+ * ends or another command is posted.
+ */
+static void run_command(
+	EXECUTOR           executor,
+	executor_command_t command,
+	uint32_t           address
+) {
+	const MACHINE machine = executor->machine;
+
+	for (bool first = true;; first = false) {
+		const uint64_t slice  = command == EXECUTOR_STEP ? 1 : executor->slice;
+		const uint64_t start  = monotonic_ns();
+		const uint64_t before = machine->instret;
+
+		cpu_status_t status;
+
+		// The later slices carry the command on
+		if (!first) status = debug_resume(machine, slice);
+		else switch (command) {
+			case EXECUTOR_STEP: 	 status = cpu_run(machine, 1); 					break;
+			case EXECUTOR_STEP_OVER: status = debug_step_over(machine, slice); 		break;
+			case EXECUTOR_STEP_OUT:  status = debug_step_out(machine, slice); 		break;
+			case EXECUTOR_RUN_TO: 	 status = debug_run_to(machine, address, slice); break;
+			default: 				 status = debug_continue(machine, slice); 		break;
+		}
+
+		const bool cut = status == CPU_STATUS_BUDGET_EXHAUSTED;
+		if (cut && command != EXECUTOR_STEP) adapt_slice(executor, machine->instret - before, monotonic_ns() - start);
+
+		syscall_flush(machine->syscalls);
+
+		// A step over an instruction that is not a call ends after one slice
+		const bool more = cut && command != EXECUTOR_STEP && (command == EXECUTOR_RUN || debug_pending(machine));
+
+		// A pause is taken here, any other command runs next
+		uint32_t next = atomic_load_explicit(&executor->command, memory_order_acquire);
+
+		if (!more || next != EXECUTOR_NONE) {
+			if (next == EXECUTOR_PAUSE) {
+				atomic_compare_exchange_strong_explicit(&executor->command, &next, EXECUTOR_NONE,
+														memory_order_acquire, memory_order_relaxed);
+			}
+
+			publish(executor, status, false);
+			return;
+		}
+
+		publish(executor, status, true);
+	}
+}
+
+static void *executor_thread(void *argument) {
+	EXECUTOR executor = argument;
+
+	for (;;) {
+		uint32_t address;
+		const executor_command_t command = take_command(executor, &address);
+
+		if (command == EXECUTOR_QUIT) break;
+		if (command == EXECUTOR_PAUSE) continue; // nothing runs
+
+		run_command(executor, command, address);
+	}
+
+	return NULL;
+}
+
+// MARK: - Lifecycle
+
+EXECUTOR new_executor(MACHINE machine) {
+	if (!machine || !enable_debugger(machine)) return NULL;
+
+	// The atomics shared with the thread sit on their own cache lines
+	EXECUTOR executor = aligned_alloc(_Alignof(struct executor), sizeof(struct executor));
+	if (!executor) return NULL;
+
+	memset(executor, 0, sizeof(struct executor));
+
+	executor->machine = machine;
+	executor->slice   = EXECUTOR_SLICE_FIRST;
+
+	atomic_init(&executor->command, EXECUTOR_NONE);
+	atomic_init(&executor->posted, 0);
+	atomic_init(&executor->completed, 0);
+	atomic_init(&executor->sequence, 0);
+
+	if (pthread_mutex_init(&executor->lock, NULL) != 0) {
+		free(executor);
+		return NULL;
+	}
+
+	if (pthread_cond_init(&executor->wake, NULL) != 0) {
+		pthread_mutex_destroy(&executor->lock);
+		free(executor);
+		return NULL;
+	}
+
+	// The state before the first command
+	publish(executor, CPU_STATUS_BUDGET_EXHAUSTED, false);
+
+	if (pthread_create(&executor->thread, NULL, executor_thread, executor) != 0) {
+		pthread_cond_destroy(&executor->wake);
+		pthread_mutex_destroy(&executor->lock);
+		free(executor);
+		return NULL;
+	}
+
+	return executor;
+}
+
+bool destroy_executor(EXECUTOR executor) {
+	if (!executor) return false;
+
+	// The command running ends at the end of its slice
+	pthread_mutex_lock(&executor->lock);
+	atomic_store_explicit(&executor->command, EXECUTOR_QUIT, memory_order_release);
+	pthread_cond_signal(&executor->wake);
+	pthread_mutex_unlock(&executor->lock);
+
+	pthread_join(executor->thread, NULL);
+
+	pthread_cond_destroy(&executor->wake);
+	pthread_mutex_destroy(&executor->lock);
+	free(executor);
+
+	return true;
+}
+
+// MARK: - Commands
+
+bool executor_post(
+	EXECUTOR           executor,
+	executor_command_t command,
+	uint32_t           address
+) {
+	if (!executor || command == EXECUTOR_NONE || command == EXECUTOR_QUIT) return false;
+
+	pthread_mutex_lock(&executor->lock);
+
+	executor->address = address;
+	atomic_fetch_add_explicit(&executor->posted, 1, memory_order_relaxed);
+	atomic_store_explicit(&executor->command, command, memory_order_release);
+
+	pthread_cond_signal(&executor->wake);
+	pthread_mutex_unlock(&executor->lock);
+
+	return true;
+}
+
+bool executor_busy(const EXECUTOR executor) {
+	if (!executor) return false;
+
+	const uint64_t posted = atomic_load_explicit(&executor->posted, memory_order_relaxed);
+
+	return atomic_load_explicit(&executor->completed, memory_order_acquire) != posted;
+}
+
+void executor_sample(
+	const EXECUTOR             executor,
+		  executor_snapshot_t *snapshot
+) {
+	if (!executor || !snapshot) return;
+
+	uint32_t words[EXECUTOR_SNAPSHOT_WORDS];
+	uint32_t before, after;
+
+	// Copy again when a publication overlapped the copy
+	do {
+		before = atomic_load_explicit(&executor->sequence, memory_order_acquire);
+
+		for (size_t i = 0; i < EXECUTOR_SNAPSHOT_WORDS; i++) {
+			words[i] = atomic_load_explicit(&executor->snapshot[i], memory_order_relaxed);
+		}
+
+		atomic_thread_fence(memory_order_acquire);
+		after = atomic_load_explicit(&executor->sequence, memory_order_relaxed);
+
+	} while (before != after || before & 1);
+
+	memcpy(snapshot, words, sizeof(*snapshot));
+}
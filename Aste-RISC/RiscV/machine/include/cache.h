@@ -0,0 +1,320 @@
+/**
+ * @file cache.h
+ * @brief L1 instruction and data caches simulated on the access path.
+ *
+ * The caches only count, every value still comes from the RAM. The tags of
+ * a cache are one flat array, set after set, so a lookup reads the few
+ * consecutive words of a single set. An access to the line touched last,
+ * the common case of a fetch, skips the lookup: that line is already the
+ * most recently used of its set.
+ *
+ * Accesses, misses and evictions are counted per RAM page, the totals of
+ * each region are derived when the statistics are read. Steps run again
+ * after an undo or a seek are simulated once, like the guest output.
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "machine.h"
+
+/**
+ * @brief The two L1 caches.
+ */
+typedef enum {
+	CACHE_INSTRUCTION,
+	CACHE_DATA,
+
+	CACHE_KIND_COUNT
+
+} cache_kind_t;
+
+/**
+ * @brief Way replaced on a miss when the set is full.
+ */
+typedef enum {
+	CACHE_LRU,   // least recently used
+	CACHE_FIFO,  // filled first
+	CACHE_RANDOM
+
+} cache_replacement_t;
+
+/**
+ * @brief What a store does to the cache.
+ */
+typedef enum {
+	CACHE_WRITE_BACK,    // dirty lines are written on eviction, a miss allocates
+	CACHE_WRITE_THROUGH  // every store reaches memory, a miss does not allocate
+
+} cache_write_policy_t;
+
+/**
+ * @brief Geometry and policies of a cache.
+ *
+ * size Capacity in bytes.
+ * line_size Bytes in a line, a power of two of at least 4.
+ * ways Lines in a set, size / (line_size * ways) sets must be a power of two.
+ */
+typedef struct {
+	uint32_t             size;
+	uint32_t             line_size;
+	uint32_t             ways;
+	cache_replacement_t  replacement;
+	cache_write_policy_t write_policy;
+
+} cache_config_t;
+
+/**
+ * @brief State of one cache.
+ *
+ * tags Line number plus one of each way, set after set, 0 for an empty way.
+ * NULL when the cache is not simulated.
+ * stamps Clock of the last use of each way with LRU, of its fill with FIFO.
+ * dirty Ways written since their fill, write-back only.
+ * clock Accesses that moved a stamp.
+ * seed State of the random replacement.
+ * last_tag, last_way Line touched last and its index in tags.
+ * writebacks Dirty lines written to memory on eviction.
+ * write_throughs Stores that reached memory, write-through only.
+ * page_accesses, page_misses Accesses to each page of the RAM window, an
+ * access straddling two lines counts once per line.
+ * page_evictions Lines of each page evicted.
+ */
+typedef struct {
+	cache_config_t config;
+	uint32_t       line_shift;
+	uint32_t       set_mask;
+
+	uint32_t *tags;
+	uint64_t *stamps;
+	uint8_t  *dirty;
+	uint64_t  clock;
+	uint32_t  seed;
+	uint32_t  last_tag;
+	uint32_t  last_way;
+
+	uint64_t writebacks;
+	uint64_t write_throughs;
+
+	uint64_t *page_accesses;
+	uint64_t *page_misses;
+	uint64_t *page_evictions;
+
+} cache_array_t;
+
+/**
+ * @brief L1 caches of a machine.
+ *
+ * arrays The instruction and the data cache, by cache_kind_t.
+ * page_count Number of pages in the RAM window.
+ * horizon Highest step simulated, steps below it are not simulated again.
+ */
+typedef struct cache {
+	cache_array_t arrays[CACHE_KIND_COUNT];
+	uint32_t      page_count;
+
+	uint64_t horizon;
+
+} *CACHE;
+
+/**
+ * @brief Accesses of a cache that fell in a region of the RAM.
+ *
+ * A page shared by two regions counts for the first one.
+ */
+typedef struct {
+	const char *name;
+	uint32_t    start;
+	uint32_t    size;
+	uint64_t    accesses;
+	uint64_t    misses;
+	uint64_t    evictions;
+
+} cache_region_t;
+
+/**
+ * @brief Totals of a cache.
+ *
+ * config Geometry and policies.
+ * hits, misses Accesses found and not found in the cache.
+ * evictions Valid lines replaced.
+ * writebacks, write_throughs See cache_array_t.
+ * regions Accesses by region, a single "memory" region when the RAM has
+ * no permission map.
+ * region_count Number of entries in regions.
+ */
+typedef struct {
+	cache_config_t config;
+
+	uint64_t accesses;
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+	uint64_t writebacks;
+	uint64_t write_throughs;
+
+	cache_region_t regions[RAM_MAX_REGIONS];
+	uint32_t       region_count;
+
+} cache_stats_t;
+
+/**
+ * @brief 32 KiB, 64-byte lines, 4 ways, LRU and write-back.
+ */
+cache_config_t cache_default_config(void);
+
+/**
+ * @brief Check that a geometry can be simulated.
+ * @return false when a size is not a power of two or the cache has no set.
+ */
+bool cache_config_valid(const cache_config_t *config);
+
+/**
+ * @brief Create empty caches for a RAM window.
+ * @param ram RAM the machine runs on.
+ * @param instruction Instruction cache, NULL to leave fetches out.
+ * @param data Data cache, NULL to leave loads and stores out.
+ *
+ * @return The caches, NULL if allocation fails or a geometry is invalid.
+ */
+CACHE new_cache(
+	const RAM             ram,
+	const cache_config_t *instruction,
+	const cache_config_t *data
+);
+
+/**
+ * @brief Release the caches.
+ * @param cache Caches to destroy, NULL is ignored.
+ */
+bool destroy_cache(CACHE cache);
+
+/**
+ * @brief Attach new caches to the machine, from now on every fetch, load
+ * and store goes through them. Execution is interpreted while they are
+ * attached, translated blocks do not fetch one instruction at a time.
+ * @param machine Machine to simulate.
+ * @param instruction Instruction cache, NULL to leave fetches out.
+ * @param data Data cache, NULL to leave loads and stores out.
+ *
+ * @return false if allocation fails or a geometry is invalid.
+ */
+bool enable_cache(
+		  MACHINE         machine,
+	const cache_config_t *instruction,
+	const cache_config_t *data
+);
+
+/**
+ * @brief Detach the caches and release them.
+ * @param machine Machine to stop simulating, NULL is ignored.
+ */
+void disable_cache(MACHINE machine);
+
+/**
+ * @brief Empty the caches and zero the counters.
+ * @param machine Simulated machine.
+ */
+void cache_clear(MACHINE machine);
+
+/**
+ * @brief Look an access up when it is not to the line touched last.
+ * Called by cache_access.
+ */
+void cache_lookup(
+		  cache_array_t *array,
+	const RAM            ram,
+		  uint32_t       address,
+		  bool           write
+);
+
+/**
+ * @brief Totals of a cache and of each region.
+ * @param machine Simulated machine.
+ * @param kind Cache to report.
+ * @param stats Filled with the totals.
+ *
+ * @return false when the machine does not simulate that cache.
+ */
+bool cache_stats(
+	const MACHINE        machine,
+		  cache_kind_t   kind,
+		  cache_stats_t *stats
+);
+
+/**
+ * @brief Misses per access.
+ * @return 0 when nothing was accessed.
+ */
+double cache_miss_rate(
+	uint64_t misses,
+	uint64_t accesses
+);
+
+/**
+ * @brief Name of a replacement policy, e.g. "LRU".
+ */
+const char *cache_replacement_name(cache_replacement_t replacement);
+
+/**
+ * @brief Store hit on a resident way.
+ */
+static inline void cache_write_hit(
+	cache_array_t *array,
+	uint32_t       way
+) {
+	if (array->config.write_policy == CACHE_WRITE_BACK) array->dirty[way] = 1;
+	else 												array->write_throughs++;
+}
+
+/**
+ * @brief Simulate an access to one line, address must be inside the RAM window.
+ */
+static inline void cache_access(
+		  cache_array_t *array,
+	const RAM            ram,
+		  uint32_t       address,
+		  bool           write
+) {
+	array->page_accesses[(address - ram->base_vaddr) >> RAM_PAGE_SHIFT]++;
+
+	if ((address >> array->line_shift) + 1 != array->last_tag) cache_lookup(array, ram, address, write);
+	else if (write) cache_write_hit(array, array->last_way);
+}
+
+/**
+ * @brief Simulate the fetch of an instruction word.
+ */
+static inline void cache_fetch(
+		  CACHE    cache,
+	const RAM      ram,
+		  uint32_t pc
+) {
+	cache_array_t *array = &cache->arrays[CACHE_INSTRUCTION];
+	if (array->tags) cache_access(array, ram, pc, false);
+}
+
+/**
+ * @brief Simulate a load or a store of width bytes.
+ */
+static inline void cache_data(
+		  CACHE    cache,
+	const RAM      ram,
+		  uint32_t address,
+		  uint32_t width,
+		  bool     write
+) {
+	cache_array_t *array = &cache->arrays[CACHE_DATA];
+	if (!array->tags) return;
+
+	cache_access(array, ram, address, write);
+
+	// A misaligned access may end in the next line
+	const uint32_t last = address + width - 1;
+	if ((last ^ address) >> array->line_shift) cache_access(array, ram, last, write);
+}
+
+#endif //CACHE_H
@@ -0,0 +1,318 @@
+/**
+ * @file debugger.h
+ * @brief Breakpoints, watchpoints and stepping commands run by the engine.
+ *
+ * Breakpoints are a bitmap with one bit per predecoded word of .text, the
+ * run loop tests the bit of every fetched word. Watchpoints are address
+ * ranges written by stores, a store is compared with them only when it
+ * falls between the lowest and the highest watched byte.
+ *
+ * Breakpoints and watchpoints are only checked while a debugger command
+ * runs: continue, step over, step out and run to cursor. A plain cpu_run
+ * ignores them and keeps the translator, so single steps and batches cost
+ * the same with or without breakpoints. A command interprets, at the speed
+ * of the plain interpreter, and stops:
+ *
+ * - before the instruction of a breakpoint, the one the command starts on
+ *   is passed, so continue moves off a breakpoint
+ * - after a store into a watched range
+ * - at the end of a step over, a step out or a run to cursor
+ *
+ * A command cut by its budget stays in flight, debug_resume carries it on
+ * so a long command can run in slices. The next command drops it.
+ *
+ * A step over a call runs until the return address is reached with sp at
+ * or above its value at the call, a recursive call returning to the same
+ * address is passed. A step out counts the calls and the returns, a call
+ * is a jal or jalr linking ra or t0, a return a jalr through them without
+ * a link. Both are the conventions of the RISC-V psABI.
+ */
+
+#ifndef DEBUGGER_H
+#define DEBUGGER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "machine.h"
+
+#define DEBUGGER_WATCHPOINTS 16
+
+/**
+ * @brief Why the last command stopped, CPU_STATUS_BREAKPOINT and
+ * CPU_STATUS_WATCHPOINT are detailed here.
+ */
+typedef enum {
+	DEBUGGER_STOP_NONE,       // the command ended for another reason
+	DEBUGGER_STOP_BREAKPOINT, // pc is on a breakpoint, not executed yet
+	DEBUGGER_STOP_WATCHPOINT, // a store wrote a watched range, pc is after it
+	DEBUGGER_STOP_STEP        // the step over, the step out or the run to cursor ended
+
+} debugger_stop_t;
+
+/**
+ * @brief Range of bytes watched for stores.
+ *
+ * first, last First and last byte, last is included so a range can end at
+ * the top of the address space.
+ */
+typedef struct {
+	uint32_t first;
+	uint32_t last;
+
+} debugger_watchpoint_t;
+
+/**
+ * @brief Breakpoints and the command in flight.
+ *
+ * breakpoints Bit per word of .text, set on a breakpoint.
+ * stops Breakpoints and the target of the command, tested on fetch.
+ * base Address of the word of bit 0.
+ * count Words covered by the bitmaps.
+ * breakpoint_count Breakpoints set.
+ * watchpoints Watched ranges.
+ * watch_count Number of watched ranges.
+ * watch_first, watch_last Lowest and highest watched byte, first > last
+ * when nothing is watched.
+ * active A command is running, the loops check the stops.
+ * resume_step Step the command started on, its breakpoint is passed.
+ * target A stop at target_pc is armed for this command.
+ * target_pc, target_sp Where the step over or the run to cursor ends, once
+ * sp is at or above target_sp.
+ * frames The command is a step out.
+ * depth Calls not returned yet since the step out started.
+ * stop Why the last command stopped.
+ * stop_address First byte of the store that hit a watchpoint.
+ */
+typedef struct debugger {
+	uint32_t *breakpoints;
+	uint32_t *stops;
+	uint32_t  base;
+	uint32_t  count;
+	uint32_t  breakpoint_count;
+
+	debugger_watchpoint_t watchpoints[DEBUGGER_WATCHPOINTS];
+	uint32_t              watch_count;
+	uint32_t              watch_first;
+	uint32_t              watch_last;
+
+	bool     active;
+	uint64_t resume_step;
+
+	bool     target;
+	uint32_t target_pc;
+	uint32_t target_sp;
+
+	bool     frames;
+	uint32_t depth;
+
+	debugger_stop_t stop;
+	uint32_t        stop_address;
+
+} *DEBUGGER;
+
+/**
+ * @brief Create a debugger without breakpoints nor watchpoints.
+ *
+ * @return The debugger, NULL if allocation fails.
+ */
+DEBUGGER new_debugger(void);
+
+/**
+ * @brief Free the debugger, NULL is ignored.
+ */
+bool destroy_debugger(DEBUGGER debugger);
+
+/**
+ * @brief Attach a debugger to the machine, an attached one is kept with
+ * its breakpoints.
+ * @param machine Machine to debug.
+ *
+ * @return false if allocation fails.
+ */
+bool enable_debugger(MACHINE machine);
+
+/**
+ * @brief Set or clear a breakpoint.
+ * @param machine Debugged machine.
+ * @param address Address of the instruction.
+ * @param enabled true to set it, false to clear it.
+ *
+ * @return false when the address is not an instruction of .text or
+ * allocation fails.
+ */
+bool set_breakpoint(
+	MACHINE  machine,
+	uint32_t address,
+	bool     enabled
+);
+
+/**
+ * @brief true when a breakpoint is set on the address.
+ */
+bool has_breakpoint(
+	const MACHINE  machine,
+		  uint32_t address
+);
+
+/**
+ * @brief Clear every breakpoint.
+ */
+void clear_breakpoints(MACHINE machine);
+
+/**
+ * @brief Watch stores into a range of bytes.
+ * @param machine Debugged machine.
+ * @param address First byte.
+ * @param size Number of bytes, at least one.
+ *
+ * @return false when DEBUGGER_WATCHPOINTS ranges are already watched or
+ * allocation fails.
+ */
+bool add_watchpoint(
+	MACHINE  machine,
+	uint32_t address,
+	uint32_t size
+);
+
+/**
+ * @brief Stop watching a range added with the same address and size.
+ *
+ * @return false when no such range is watched.
+ */
+bool remove_watchpoint(
+	MACHINE  machine,
+	uint32_t address,
+	uint32_t size
+);
+
+/**
+ * @brief Stop watching every range.
+ */
+void clear_watchpoints(MACHINE machine);
+
+/**
+ * @brief Run until a breakpoint or a watchpoint stops the program.
+ * @param machine Debugged machine.
+ * @param max_instructions Maximum number of instructions to retire.
+ *
+ * @return CPU_STATUS_BREAKPOINT, CPU_STATUS_WATCHPOINT or the status of
+ * cpu_run when the program stops for another reason.
+ */
+cpu_status_t debug_continue(
+	MACHINE  machine,
+	uint64_t max_instructions
+);
+
+/**
+ * @brief Execute the instruction at pc, a call is run until it returns.
+ * Breakpoints and watchpoints inside the call stop it too.
+ * @param machine Debugged machine.
+ * @param max_instructions Maximum number of instructions to retire.
+ *
+ * @return CPU_STATUS_BREAKPOINT when the call returned, the status of a
+ * single cpu_run step for any other instruction.
+ */
+cpu_status_t debug_step_over(
+	MACHINE  machine,
+	uint64_t max_instructions
+);
+
+/**
+ * @brief Run until the current function returns, pc is then on the
+ * instruction after its call.
+ * @param machine Debugged machine.
+ * @param max_instructions Maximum number of instructions to retire.
+ *
+ * @return CPU_STATUS_BREAKPOINT once returned, see debug_continue.
+ */
+cpu_status_t debug_step_out(
+	MACHINE  machine,
+	uint64_t max_instructions
+);
+
+/**
+ * @brief Run until pc reaches an address, the instruction there is not
+ * executed. Starting on it runs until it is reached again.
+ * @param machine Debugged machine.
+ * @param address Address of the instruction to stop on.
+ * @param max_instructions Maximum number of instructions to retire.
+ *
+ * @return CPU_STATUS_BREAKPOINT once reached, see debug_continue.
+ */
+cpu_status_t debug_run_to(
+	MACHINE  machine,
+	uint32_t address,
+	uint64_t max_instructions
+);
+
+/**
+ * @brief Carry on the command cut by its budget, a continue when there is
+ * none. The breakpoint at pc is not passed, the command has not run it yet.
+ * @param machine Debugged machine.
+ * @param max_instructions Maximum number of instructions to retire.
+ *
+ * @return See the command resumed.
+ */
+cpu_status_t debug_resume(
+	MACHINE  machine,
+	uint64_t max_instructions
+);
+
+/**
+ * @brief true when a step over, a step out or a run to cursor was cut by
+ * its budget and can be resumed.
+ */
+bool debug_pending(const MACHINE machine);
+
+/**
+ * @brief Resize the bitmaps to the predecoded text, called by the run loop.
+ *
+ * @return false if allocation fails, the stops are not checked then.
+ */
+bool debugger_prepare(MACHINE machine);
+
+/**
+ * @brief Decide whether a fetch on a stop bit ends the command, called by
+ * the run loop.
+ * @param machine Debugged machine, its registers are current.
+ * @param pc Address of the fetched instruction.
+ * @param step Retired instructions before it.
+ *
+ * @return true to stop before the instruction.
+ */
+bool debugger_fetch(
+	MACHINE  machine,
+	uint32_t pc,
+	uint64_t step
+);
+
+/**
+ * @brief Compare a store with the watched ranges, called by the run loop
+ * once the store is inside the bounds of all of them.
+ * @param debugger Active debugger.
+ * @param address First byte written.
+ * @param width Number of bytes written.
+ *
+ * @return true to stop after the store.
+ */
+bool debugger_store(
+	DEBUGGER debugger,
+	uint32_t address,
+	uint32_t width
+);
+
+/**
+ * @brief Count the calls and the returns of a step out, called by the run
+ * loop on jal and jalr.
+ * @param debugger Active debugger.
+ * @param instruction Retiring jump.
+ *
+ * @return true to stop after the jump, the function returned.
+ */
+bool debugger_jump(
+	DEBUGGER                     debugger,
+	const decoded_instruction_t *instruction
+);
+
+#endif //DEBUGGER_H
@@ -0,0 +1,156 @@
+/**
+ * @file executor.h
+ * @brief Runs a machine on its own thread, driven by atomic commands.
+ *
+ * The thread sleeps until a command is posted, then runs the machine in
+ * slices of about EXECUTOR_SLICE_NS. Between two slices it flushes the
+ * guest output, publishes a snapshot of the registers, pc and status, and
+ * looks at the command slot, so a pause or a new command is seen within a
+ * slice. The slice length follows the speed of the engine, the profiling
+ * loops retire fewer instructions in the same time.
+ *
+ * Snapshots go through a seqlock: the thread never waits for a reader, a
+ * reader copies again when a publication overlapped its copy. The user
+ * interface samples them at display rate while the program runs.
+ *
+ * While a command runs the machine and its RAM belong to the thread. The
+ * caller only reads snapshots, and touches the machine again once
+ * executor_busy returns false.
+ */
+
+#ifndef EXECUTOR_H
+#define EXECUTOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "machine.h"
+
+#define EXECUTOR_SLICE_NS    2000000ull // wall time of a slice
+#define EXECUTOR_SLICE_FIRST (1u << 16) // instructions of the first slice
+#define EXECUTOR_SLICE_MIN   (1u << 10)
+#define EXECUTOR_SLICE_MAX   (1u << 24)
+
+/**
+ * @brief Commands posted to the thread.
+ */
+typedef enum {
+	EXECUTOR_NONE,      // the slot is empty
+	EXECUTOR_RUN,       // run until the program stops, breakpoints and watchpoints included
+	EXECUTOR_STEP,      // retire one instruction
+	EXECUTOR_STEP_OVER, // see debug_step_over
+	EXECUTOR_STEP_OUT,  // see debug_step_out
+	EXECUTOR_RUN_TO,    // see debug_run_to, the address comes with the command
+	EXECUTOR_PAUSE,     // end the command running at the end of its slice
+	EXECUTOR_QUIT       // end the thread, posted by destroy_executor
+
+} executor_command_t;
+
+/**
+ * @brief State published by the thread.
+ *
+ * publications Snapshots published so far, a sampler skips the same one.
+ * instret Retired instructions.
+ * registers, pc Hart state at the end of the last slice.
+ * status Status of the last slice, CPU_STATUS_BUDGET_EXHAUSTED for a
+ * command paused or still running.
+ * running A command is running.
+ */
+typedef struct {
+	uint64_t     publications;
+	uint64_t     instret;
+	uint32_t     registers[32];
+	uint32_t     pc;
+	cpu_status_t status;
+	bool         running;
+
+} executor_snapshot_t;
+
+// Snapshot size in words, as copied through the seqlock
+#define EXECUTOR_SNAPSHOT_WORDS ((sizeof(executor_snapshot_t) + 3) / 4)
+
+/**
+ * @brief Thread running a machine.
+ *
+ * machine Machine run by the thread.
+ * thread The thread.
+ * lock, wake Sleep of the thread while the slot is empty.
+ * command Slot of the next command, EXECUTOR_NONE once taken.
+ * address Address of an EXECUTOR_RUN_TO, under lock.
+ * posted Commands posted, written under lock.
+ * completed Commands posted before the thread last found the slot empty.
+ * slice Instructions of the next slice.
+ * sequence Seqlock counter, odd while a snapshot is written.
+ * snapshot Last snapshot, copied a word at a time.
+ * publications Snapshots published, owned by the thread.
+ */
+typedef struct executor {
+	MACHINE 		machine;
+	pthread_t 		thread;
+	pthread_mutex_t lock;
+	pthread_cond_t  wake;
+
+	// The slot is written by the caller, the snapshot by the thread
+	_Alignas(64) _Atomic uint32_t command;
+	uint32_t                      address;
+	_Atomic uint64_t              posted;
+	_Atomic uint64_t              completed;
+
+	_Alignas(64) uint64_t         slice;
+	uint64_t                      publications;
+	_Atomic uint32_t              sequence;
+	_Atomic uint32_t              snapshot[EXECUTOR_SNAPSHOT_WORDS];
+
+} *EXECUTOR;
+
+/**
+ * @brief Start the thread of a machine, it waits for a command.
+ * @param machine Machine to run, it must outlive the executor. A debugger
+ * is attached for the run commands.
+ *
+ * @return The executor, NULL if allocation or the thread fails.
+ */
+EXECUTOR new_executor(MACHINE machine);
+
+/**
+ * @brief End the command running at the end of its slice, stop the thread
+ * and free the executor. The machine is kept.
+ * @param executor Executor to destroy, NULL is ignored.
+ */
+bool destroy_executor(EXECUTOR executor);
+
+/**
+ * @brief Post a command, it replaces one not taken yet. A run command
+ * posted while another runs ends that one at the end of its slice.
+ * @param executor Executor of the machine.
+ * @param command Command to run.
+ * @param address Address of an EXECUTOR_RUN_TO, ignored otherwise.
+ *
+ * @return false for EXECUTOR_NONE or EXECUTOR_QUIT.
+ */
+bool executor_post(
+	EXECUTOR           executor,
+	executor_command_t command,
+	uint32_t           address
+);
+
+/**
+ * @brief true until the thread has handled every command posted. Once it
+ * returns false the machine can be used again, and the next snapshot is
+ * the final state.
+ */
+bool executor_busy(const EXECUTOR executor);
+
+/**
+ * @brief Copy the last snapshot, never makes the thread wait.
+ * @param executor Executor of the machine.
+ * @param snapshot Filled with the snapshot.
+ */
+void executor_sample(
+	const EXECUTOR             executor,
+		  executor_snapshot_t *snapshot
+);
+
+#endif //EXECUTOR_H
@@ -0,0 +1,65 @@
+/**
+ * @file jit.h
+ * @brief Basic-block translator from RV32I to x86-64 host code.
+ *
+ * Hot basic blocks of the predecoded .text are translated into an
+ * executable buffer and chained together, cold code, faults and ecalls
+ * fall back to the interpreter. Only x86-64 Linux hosts are supported,
+ * on other hosts enable_jit fails and the machine keeps interpreting.
+ */
+
+#ifndef JIT_H
+#define JIT_H
+
+#include <stdbool.h>
+
+#include "machine.h"
+
+/**
+ * @brief Check whether the translator can run on this host.
+ *
+ * @return true on x86-64 Linux.
+ */
+bool jit_available(void);
+
+/**
+ * @brief Attach a translator to the machine, cpu_run then uses it.
+ * @param machine Machine to accelerate, its text must be predecoded.
+ *
+ * @return false if the host is not supported or allocation fails.
+ */
+bool enable_jit(MACHINE machine);
+
+/**
+ * @brief Release the translator and its executable buffer.
+ * @param jit Translator to destroy, NULL is ignored.
+ */
+void destroy_jit(struct jit *jit);
+
+/**
+ * @brief Drop every translated block, called when .text is modified.
+ * The buffer is recycled at the next block boundary, never while
+ * translated code is still running.
+ * @param jit Translator to invalidate.
+ */
+void jit_invalidate(struct jit *jit);
+
+/**
+ * @brief Add the block entries counted by translated code to the per-word
+ * counters of the machine profile, the profile functions call it before
+ * reading them.
+ * @param machine Machine with an enabled translator, others are ignored.
+ */
+void jit_fold_profile(MACHINE machine);
+
+/**
+ * @brief Run loop of the translator, same contract as cpu_run.
+ * @param machine Machine with an enabled translator.
+ * @param max_instructions Maximum number of instructions to retire.
+ */
+cpu_status_t jit_run(
+	MACHINE  machine,
+	uint64_t max_instructions
+);
+
+#endif //JIT_H
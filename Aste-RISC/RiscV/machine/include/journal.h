@@ -0,0 +1,195 @@
+/**
+ * @file journal.h
+ * @brief Bounded reverse-execution journal.
+ *
+ * Every retired step pushes the old value of what it overwrote into a ring
+ * buffer of fixed-size records, rewinding pops them back in reverse order.
+ * When the memory cap is reached the oldest whole steps are dropped, so the
+ * journal always holds the most recent history and never grows.
+ *
+ * A step is one or more records, the first one carries JOURNAL_STEP_START.
+ * Instructions write a single record, system calls may append more records
+ * to the same step.
+ */
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "machine.h"
+
+// Flags kept in the low bits of the record pc, instructions are 4-byte aligned
+#define JOURNAL_STEP_START 0x1u // first record of a step
+#define JOURNAL_MEMORY     0x2u // location is a word address, not a register
+#define JOURNAL_FLAGS      0x3u
+
+// Location of a register record holding the heap break, moved by brk
+#define JOURNAL_HEAP_BREAK 32u
+
+/**
+ * @brief Packed undo record, 12 bytes.
+ *
+ * tag Pc of the step with the JOURNAL_* flags in the low bits.
+ * location Register index or JOURNAL_HEAP_BREAK, or word-aligned address
+ * for memory records.
+ * old_value Value before the step.
+ */
+typedef struct {
+	uint32_t tag;
+	uint32_t location;
+	uint32_t old_value;
+
+} journal_record_t;
+
+/**
+ * @brief Ring buffer of undo records.
+ *
+ * records Storage, capacity records long.
+ * head Index of the next record to write.
+ * count Records currently stored.
+ * steps Complete steps currently stored.
+ * step_open A step was started and has no record yet.
+ * step_pc Pc of the open step.
+ */
+typedef struct journal {
+	journal_record_t *records;
+	uint32_t 		  capacity;
+	uint32_t 		  head;
+	uint32_t 		  count;
+	uint64_t 		  steps;
+
+	bool 	 step_open;
+	uint32_t step_pc;
+
+} *JOURNAL;
+
+/**
+ * @brief Create a journal using at most max_bytes for its records.
+ * @param max_bytes Memory cap, at least one record is always allocated.
+ *
+ * @return Pointer to the new journal, or NULL if allocation fails.
+ */
+JOURNAL new_journal(size_t max_bytes);
+
+/**
+ * @brief Destroy the journal and its records.
+ * @param journal Journal to destroy.
+ */
+bool destroy_journal(JOURNAL journal);
+
+/**
+ * @brief Drop every record.
+ * @param journal Journal to clear.
+ */
+void journal_clear(JOURNAL journal);
+
+/**
+ * @brief Attach a new journal to the machine, from now on every retired
+ * instruction is recorded and the translator is bypassed.
+ * @param machine Machine to record.
+ * @param max_bytes Memory cap of the journal.
+ *
+ * @return false if allocation fails.
+ */
+bool enable_journal(
+	MACHINE machine,
+	size_t 	max_bytes
+);
+
+/**
+ * @brief Append a record, dropping the oldest whole step when full.
+ * @param journal Journal to write.
+ * @param tag Pc of the step with JOURNAL_* flags.
+ * @param location Register index or word address.
+ * @param old_value Value overwritten by the step.
+ */
+static inline void journal_push(
+	JOURNAL  journal,
+	uint32_t tag,
+	uint32_t location,
+	uint32_t old_value
+) {
+	if (journal->count == journal->capacity) {
+
+		// Drop the oldest record and the rest of its step
+		while (journal->count > 0) {
+			uint32_t next = journal->head + journal->capacity - journal->count + 1;
+			if (next >= journal->capacity) next -= journal->capacity;
+
+			journal->count--;
+			if (journal->records[next].tag & JOURNAL_STEP_START) break;
+		}
+
+		if (journal->steps) journal->steps--;
+	}
+
+	journal->records[journal->head] = (journal_record_t){ tag, location, old_value };
+
+	if (++journal->head == journal->capacity) journal->head = 0;
+	journal->count++;
+
+	if (tag & JOURNAL_STEP_START) journal->steps++;
+}
+
+/**
+ * @brief Start a step, its first record gets JOURNAL_STEP_START.
+ * @param journal Journal to write.
+ * @param pc Pc of the instruction being executed.
+ */
+void journal_begin_step(
+	JOURNAL  journal,
+	uint32_t pc
+);
+
+/**
+ * @brief Record the old value of a register written by the current step.
+ * @param journal Journal to write.
+ * @param index Register index.
+ * @param old_value Value before the write.
+ */
+void journal_record_register(
+	JOURNAL  journal,
+	uint32_t index,
+	uint32_t old_value
+);
+
+/**
+ * @brief Record the old word around a memory write of the current step.
+ * @param journal Journal to write.
+ * @param address Address of the write, rounded down to its word.
+ * @param old_value Word before the write.
+ */
+void journal_record_memory(
+	JOURNAL  journal,
+	uint32_t address,
+	uint32_t old_value
+);
+
+/**
+ * @brief Close the current step, a step without records still gets one so
+ * that rewinding it restores its pc.
+ * @param journal Journal to write.
+ */
+void journal_end_step(JOURNAL journal);
+
+/**
+ * @brief Undo the last steps on the machine state.
+ * @param machine Machine with an attached journal.
+ * @param steps Number of steps to undo.
+ *
+ * @return Number of steps undone, lower than steps when history runs out.
+ */
+uint64_t journal_rewind(
+	MACHINE  machine,
+	uint64_t steps
+);
+
+/**
+ * @brief Number of steps that can be undone.
+ */
+uint64_t journal_steps(const JOURNAL journal);
+
+#endif //JOURNAL_H
@@ -0,0 +1,257 @@
+/**
+ * @file machine.h
+ * @brief Native execution engine for the RISC-V CPU simulator.
+ *
+ * This file defines the machine state (registers, program counter and RAM)
+ * and the batched run loop used to execute many instructions per call,
+ * without crossing the Swift bridge for every single instruction.
+ */
+
+#ifndef MACHINE_H
+#define MACHINE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ram.h"
+#include "predecode.h"
+
+// Labels as values are a GNU extension, build with
+// -DMACHINE_NO_COMPUTED_GOTO to force the portable switch loop
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(MACHINE_NO_COMPUTED_GOTO)
+#define MACHINE_HAS_COMPUTED_GOTO 1
+#else
+#define MACHINE_HAS_COMPUTED_GOTO 0
+#endif
+
+/**
+ * @brief Reason why `cpu_run` returned control to the caller.
+ */
+typedef enum {
+	CPU_STATUS_BUDGET_EXHAUSTED,    // executed max_instructions
+	CPU_STATUS_ECALL,               // ecall retired, pc points after it
+	CPU_STATUS_EBREAK,              // ebreak retired, pc points after it
+	CPU_STATUS_EXIT,                // exit syscall, code in the syscall state
+	CPU_STATUS_OUT_OF_TEXT,         // pc left the .text section, program ended
+	CPU_STATUS_FETCH_FAULT,         // pc misaligned or not readable
+	CPU_STATUS_ILLEGAL_INSTRUCTION, // opcode or function code not supported
+	CPU_STATUS_LOAD_FAULT,          // load faulted, reason in fault_access
+	CPU_STATUS_STORE_FAULT,         // store faulted, reason in fault_access
+	CPU_STATUS_BREAKPOINT,          // debugger stop before pc, reason in the debugger
+	CPU_STATUS_WATCHPOINT           // store into a watched range, pc points after it
+
+} cpu_status_t;
+
+/**
+ * @brief Strategy used by the run loop to jump to the next handler.
+ */
+typedef enum {
+	DISPATCH_SWITCH,   // single switch at the top of the loop, portable
+	DISPATCH_THREADED  // computed goto replicated at the end of each handler
+
+} dispatch_mode_t;
+
+/**
+ * @brief Architectural state of a RV32I hart.
+ *
+ * registers General purpose registers, x0 is always zero.
+ * pc Address of the next instruction to execute.
+ * ram Main memory, owned by the caller and not freed by the machine.
+ * instret Number of instructions retired since creation.
+ * fault_address Faulting address when a fault status is returned.
+ * fault_access Reason of the last load or store fault.
+ * decoded Predecoded .text records, indexed by (pc - decoded_base) >> 2.
+ * decoded_base Virtual address of the first predecoded instruction.
+ * decoded_count Number of predecoded records.
+ * dispatch Run loop used by cpu_interpret.
+ * jit Basic-block translator, NULL when execution is interpreted only.
+ * jit_budget Instructions left to the translated code of the current run.
+ * journal Undo history, NULL when execution is not recorded.
+ * timeline Periodic checkpoints, NULL when seeking is not enabled.
+ * syscalls Environment calls serviced in C, NULL to return every ecall.
+ * profile Execution counters, NULL when execution is not profiled.
+ * pipeline Five-stage timing model, NULL when cycles are not modeled.
+ * cache L1 cache simulator, NULL when caches are not simulated.
+ * predictor Branch predictor simulator, NULL when branches are not predicted.
+ * trace Execution trace recorder, NULL when execution is not traced.
+ * debugger Breakpoints and watchpoints, NULL when execution is not debugged.
+ */
+typedef struct machine {
+	uint32_t registers[32];
+	uint32_t pc;
+	RAM      ram;
+
+	uint64_t instret;
+	uint32_t     fault_address;
+	ram_access_t fault_access;
+
+	decoded_instruction_t *decoded;
+	uint32_t               decoded_base;
+	uint32_t               decoded_count;
+
+	dispatch_mode_t dispatch;
+
+	struct jit *jit;
+	uint64_t    jit_budget;
+
+	struct journal   *journal;
+	struct timeline  *timeline;
+	struct syscalls  *syscalls;
+	struct profile   *profile;
+	struct pipeline  *pipeline;
+	struct cache     *cache;
+	struct predictor *predictor;
+	struct trace     *trace;
+	struct debugger  *debugger;
+
+} *MACHINE;
+
+/**
+ * @brief Check an access against the alignment and the RAM window.
+ * Aligned accesses never cross a page.
+ */
+static inline bool machine_access_valid(
+	const RAM      ram,
+	const uint32_t address,
+	const uint32_t width
+) {
+	return ram_check_access(ram, address, width) == RAM_ACCESS_OK;
+}
+
+/**
+ * @brief Translate a guest address to a host pointer for a load.
+ * @param ram RAM instance.
+ * @param address Guest address of the first byte.
+ * @param width Access width in bytes, the address must be aligned to it.
+ *
+ * @return Host pointer, or NULL when the access is misaligned or out of bounds.
+ */
+static inline const uint8_t *machine_translate(
+	const RAM      ram,
+	const uint32_t address,
+	const uint32_t width
+) {
+	if (!machine_access_valid(ram, address, width)) return NULL;
+
+	return ram_read_pointer(ram, address);
+}
+
+/**
+ * @brief Translate a guest address to a host pointer for a store, the page
+ * is allocated on first write and marked dirty.
+ * @param ram RAM instance.
+ * @param address Guest address of the first byte.
+ * @param width Access width in bytes, the address must be aligned to it.
+ *
+ * @return Host pointer, or NULL when the access is misaligned, out of
+ * bounds or the page can not be allocated.
+ */
+static inline uint8_t *machine_translate_store(
+	RAM            ram,
+	const uint32_t address,
+	const uint32_t width
+) {
+	if (!machine_access_valid(ram, address, width)) return NULL;
+
+	return ram_write_pointer(ram, address);
+}
+
+/**
+ * @brief Create a new machine bound to a RAM instance.
+ * @param ram RAM holding the loaded program, must outlive the machine.
+ * @param entry_point First instruction address.
+ *
+ * @return Pointer to the newly created machine, or NULL if allocation fails.
+ */
+MACHINE new_machine(
+	RAM      ram,
+	uint32_t entry_point
+);
+
+/**
+ * @brief Destroy the machine instance, the bound RAM is not released.
+ * @param machine Pointer to the machine to be destroyed.
+ */
+bool destroy_machine(MACHINE machine);
+
+/**
+ * @brief Predecode the text section, call it once the program is loaded.
+ * @param machine Machine that will execute the section.
+ * @param text_data Raw .text bytes, NULL decodes lazily from RAM on fetch.
+ * @param text_size Size of .text in bytes.
+ * @param text_vaddr Virtual address of .text.
+ *
+ * @return true on success, false if allocation fails.
+ */
+bool load_decoded_text(
+		  MACHINE  machine,
+	const uint8_t *text_data,
+		  size_t   text_size,
+		  uint32_t text_vaddr
+);
+
+/**
+ * @brief Drop the predecoded records (and translated code) overlapped by a
+ * store into .text, they are decoded again from RAM on the next fetch.
+ * @param machine Machine owning the records.
+ * @param address First byte written.
+ * @param width Number of bytes written.
+ */
+void invalidate_decoded_text(
+	MACHINE  machine,
+	uint32_t address,
+	uint32_t width
+);
+
+/**
+ * @brief Select the run loop dispatch strategy.
+ * @param machine Machine to configure.
+ * @param mode Requested strategy.
+ *
+ * @return false if the strategy is not available with this compiler.
+ */
+bool set_dispatch_mode(
+	MACHINE 		machine,
+	dispatch_mode_t mode
+);
+
+/**
+ * @brief Copy the registers into a view and tell which ones changed, a
+ * view with the same registers can skip its refresh.
+ * @param machine Machine to read.
+ * @param copy Registers the view shows, updated in place.
+ *
+ * @return Mask with bit i set when copy[i] changed.
+ */
+uint32_t machine_sync_registers(
+	const MACHINE   machine,
+		  uint32_t  copy[32]
+);
+
+/**
+ * @brief Same as cpu_run, but always interprets the predecoded records
+ * even when a translator is enabled.
+ */
+cpu_status_t cpu_interpret(
+	MACHINE  machine,
+	uint64_t max_instructions
+);
+
+/**
+ * @brief Execute instructions until the budget is spent, an ecall/ebreak
+ * retires or a fault occurs. Uses translated code when the JIT is enabled
+ * and no journal is recording, takes the checkpoints of the timeline.
+ * With syscalls enabled the known ecalls are serviced without returning,
+ * after exit it returns CPU_STATUS_EXIT until the program is rewound.
+ * @param machine Machine to run.
+ * @param max_instructions Maximum number of instructions to retire.
+ *
+ * @return Reason the loop stopped. On faults pc is left on the faulting
+ * instruction and nothing is written back.
+ */
+cpu_status_t cpu_run(
+	MACHINE  machine,
+	uint64_t max_instructions
+);
+
+#endif //MACHINE_H
@@ -0,0 +1,295 @@
+/**
+ * @file pipeline.h
+ * @brief Timing model of the classic IF/ID/EX/MEM/WB pipeline.
+ *
+ * The model runs alongside functional execution and never changes its
+ * results, no pipeline stage is simulated cycle by cycle. The run loop hands
+ * over straight-line runs, the words retired between two redirects of the
+ * fetch. A run is scheduled once for each hazard state it starts in, later
+ * executions only add its memoized effect.
+ *
+ * Branches are predicted not taken and resolved in EX, jal is resolved in
+ * ID. The register file is written in the first half of WB and read in the
+ * second half of ID. With forwarding only a load followed by a consumer
+ * stalls, without it every consumer waits for the producer's WB. A result
+ * is never more than three cycles late, so the hazard state between two
+ * runs is the destination of the last two instructions in flight.
+ *
+ * The first instruction enters IF in cycle 1, so a program of n independent
+ * instructions takes n + 4 cycles. Steps run again after an undo or a seek
+ * are scheduled once, like the guest output.
+ */
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "machine.h"
+#include "predecode.h"
+
+// Memoized runs, a power of two
+#define PIPELINE_RUNS 4096
+
+// Set in the state of a run key when the run ends with a redirect
+#define PIPELINE_REDIRECTED 0x80000000u
+
+/**
+ * @brief Kind of control transfer of a handler.
+ */
+typedef enum {
+	PIPELINE_SEQUENTIAL,
+	PIPELINE_BRANCH,
+	PIPELINE_JAL,  // target known in ID
+	PIPELINE_JALR  // target known in EX, like a branch
+
+} pipeline_control_t;
+
+/**
+ * @brief Shape of the modeled pipeline.
+ *
+ * forwarding Results are forwarded from EX/MEM and MEM/WB to EX.
+ * branch_penalty Cycles flushed by a taken branch or a jalr.
+ * jump_penalty Cycles flushed by a jal.
+ */
+typedef struct {
+	bool    forwarding;
+	uint8_t branch_penalty;
+	uint8_t jump_penalty;
+
+} pipeline_config_t;
+
+/**
+ * @brief Totals of the scheduled instructions.
+ *
+ * instructions Instructions scheduled.
+ * cycles Cycles until the last one leaves WB.
+ * load_use_stalls Bubbles inserted for a load followed by a consumer.
+ * data_stalls Bubbles inserted for the other RAW hazards, only without
+ * forwarding.
+ * branch_flushes Cycles lost to taken branches and jalr.
+ * jump_flushes Cycles lost to jal.
+ * forwards_ex_mem Operands forwarded from the EX/MEM register.
+ * forwards_mem_wb Operands forwarded from the MEM/WB register.
+ * branches, taken_branches Conditional branches, the taken ones.
+ * jumps jal and jalr.
+ */
+typedef struct {
+	uint64_t instructions;
+	uint64_t cycles;
+
+	uint64_t load_use_stalls;
+	uint64_t data_stalls;
+	uint64_t branch_flushes;
+	uint64_t jump_flushes;
+
+	uint64_t forwards_ex_mem;
+	uint64_t forwards_mem_wb;
+
+	uint64_t branches;
+	uint64_t taken_branches;
+	uint64_t jumps;
+
+} pipeline_stats_t;
+
+/**
+ * @brief How the scheduler treats a handler.
+ *
+ * rs1_mask, rs2_mask 0x1F for the source registers read, 0 maps an unused
+ * operand to x0, which is always ready.
+ * writes_rd The handler writes rd.
+ * latency EX cycles before a consumer can use the result.
+ * penalty Cycles flushed when the handler redirects the fetch.
+ * control Kind of control transfer, see pipeline_control_t.
+ */
+typedef struct {
+	uint8_t rs1_mask;
+	uint8_t rs2_mask;
+	uint8_t writes_rd;
+	uint8_t latency;
+	uint8_t penalty;
+	uint8_t control;
+
+} pipeline_signals_t;
+
+/**
+ * @brief Memoized effect of a straight-line run.
+ *
+ * start Decoded index of the first word.
+ * length Words in the run, 0 for an empty slot.
+ * state Hazards in flight when the run starts, with PIPELINE_REDIRECTED
+ * when its last word redirects the fetch.
+ * next_state Hazards in flight when the next run starts.
+ * cycles Cycles the issue slot moves forward.
+ * tail Cycles from the EX of the last word to the next issue slot.
+ * hits Executions not folded into the totals yet.
+ *
+ * The other fields count the events of one execution, see pipeline_stats_t.
+ */
+typedef struct {
+	uint32_t start;
+	uint32_t length;
+	uint32_t state;
+	uint32_t next_state;
+	uint32_t cycles;
+	uint32_t tail;
+
+	uint32_t forwards_ex_mem;
+	uint32_t forwards_mem_wb;
+	uint32_t branches;
+	uint32_t jumps;
+	uint8_t  taken_branches;
+	uint8_t  branch_flushes;
+	uint8_t  jump_flushes;
+
+	uint64_t hits;
+
+} pipeline_run_t;
+
+/**
+ * @brief Scoreboard of a machine.
+ *
+ * config Shape of the pipeline.
+ * signals Scheduling of each handler.
+ * runs Memoized runs, direct-mapped on their key.
+ * state Hazards in flight before the next run.
+ * tail Tail of the last run.
+ * slot Issue slot reached by the runs folded into stats.
+ * stats Totals of the runs folded so far, see pipeline_stats.
+ * horizon Highest step scheduled, steps below it are not scheduled again.
+ */
+typedef struct pipeline {
+	pipeline_config_t  config;
+	pipeline_signals_t signals[HANDLER_COUNT];
+	pipeline_run_t     runs[PIPELINE_RUNS];
+
+	uint32_t state;
+	uint32_t tail;
+	uint64_t slot;
+
+	pipeline_stats_t stats;
+	uint64_t         horizon;
+
+} *PIPELINE;
+
+/**
+ * @brief Five stages with full forwarding, two cycles lost to a taken
+ * branch and one to a jal.
+ */
+pipeline_config_t pipeline_default_config(void);
+
+/**
+ * @brief Create an empty scoreboard.
+ * @param config Shape of the pipeline, NULL for the default one.
+ *
+ * @return The scoreboard, NULL if allocation fails.
+ */
+PIPELINE new_pipeline(const pipeline_config_t *config);
+
+/**
+ * @brief Release a scoreboard.
+ * @param pipeline Scoreboard to destroy, NULL is ignored.
+ */
+bool destroy_pipeline(PIPELINE pipeline);
+
+/**
+ * @brief Attach a new timing model to the machine, from now on every
+ * retired instruction is scheduled. Execution is interpreted while it is
+ * attached, translated blocks do not retire one instruction at a time.
+ * @param machine Machine to model.
+ * @param config Shape of the pipeline, NULL for the default one.
+ *
+ * @return false if allocation fails.
+ */
+bool enable_pipeline(
+		  MACHINE            machine,
+	const pipeline_config_t *config
+);
+
+/**
+ * @brief Detach the timing model and release it.
+ * @param machine Machine to stop modeling, NULL is ignored.
+ */
+void disable_pipeline(MACHINE machine);
+
+/**
+ * @brief Empty the pipeline and zero the totals, the next instruction
+ * enters IF in cycle 1.
+ * @param machine Modeled machine.
+ */
+void pipeline_clear(MACHINE machine);
+
+/**
+ * @brief Schedule a run missing from the memo and store it in its slot,
+ * folding the run it replaces into the totals.
+ * @param pipeline Scoreboard.
+ * @param decoded Decoded text of the machine.
+ * @param run Slot of the run.
+ * @param start Decoded index of the first word.
+ * @param length Words in the run.
+ * @param state Key state, see pipeline_run_t.
+ */
+void pipeline_schedule(
+		  PIPELINE               pipeline,
+	const decoded_instruction_t *decoded,
+		  pipeline_run_t        *run,
+		  uint32_t               start,
+		  uint32_t               length,
+		  uint32_t               state
+);
+
+/**
+ * @brief Forget the memoized runs after the decoded text changed, their
+ * executions so far stay in the totals.
+ * @param pipeline Scoreboard, NULL is ignored.
+ */
+void pipeline_invalidate(PIPELINE pipeline);
+
+/**
+ * @brief Totals of the instructions scheduled so far.
+ * @param machine Modeled machine.
+ * @param stats Filled with the totals.
+ *
+ * @return false without a timing model.
+ */
+bool pipeline_stats(
+	const MACHINE           machine,
+		  pipeline_stats_t *stats
+);
+
+/**
+ * @brief Cycles per instruction of a run.
+ * @return 0 when nothing was scheduled.
+ */
+double pipeline_cpi(const pipeline_stats_t *stats);
+
+/**
+ * @brief Schedule a straight-line run retired by the run loop.
+ * @param pipeline Scoreboard.
+ * @param decoded Decoded text of the machine.
+ * @param start Decoded index of the first word.
+ * @param length Words in the run, at least one.
+ * @param redirected The last word redirected the fetch.
+ */
+static inline void pipeline_retire_run(
+		  PIPELINE               pipeline,
+	const decoded_instruction_t *decoded,
+		  uint32_t               start,
+		  uint32_t               length,
+		  bool                   redirected
+) {
+	const uint32_t state = pipeline->state | (redirected ? PIPELINE_REDIRECTED : 0);
+	const uint32_t key 	 = (start * 0x9E3779B1u) ^ (length * 0x85EBCA77u) ^ (state * 0xC2B2AE3Du);
+
+	pipeline_run_t *run = &pipeline->runs[key >> 20 & (PIPELINE_RUNS - 1)];
+	if (run->start != start || run->length != length || run->state != state) {
+		pipeline_schedule(pipeline, decoded, run, start, length, state);
+	}
+
+	run->hits++;
+	pipeline->state = run->next_state;
+	pipeline->tail 	= run->tail;
+}
+
+#endif //PIPELINE_H
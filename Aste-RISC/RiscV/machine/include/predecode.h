@@ -0,0 +1,134 @@
+/**
+ * @file predecode.h
+ * @brief Predecoded instruction records for the native execution engine.
+ *
+ * Every word of the .text section is decoded once at load time into a
+ * compact record, the run loop then dispatches on the handler id without
+ * extracting bit fields again.
+ */
+
+#ifndef PREDECODE_H
+#define PREDECODE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "control_unit.h"
+
+/**
+ * @brief Handler executed for a predecoded instruction, one per operation.
+ */
+typedef enum {
+	HANDLER_ILLEGAL,
+	HANDLER_UNDECODED, // entry invalidated by a store, decode again on fetch
+
+	// R-Type
+	HANDLER_ADD,
+	HANDLER_SUB,
+	HANDLER_SLL,
+	HANDLER_SLT,
+	HANDLER_SLTU,
+	HANDLER_XOR,
+	HANDLER_SRL,
+	HANDLER_SRA,
+	HANDLER_OR,
+	HANDLER_AND,
+
+	// I-Type arithmetic
+	HANDLER_ADDI,
+	HANDLER_SLTI,
+	HANDLER_SLTIU,
+	HANDLER_XORI,
+	HANDLER_ORI,
+	HANDLER_ANDI,
+	HANDLER_SLLI,
+	HANDLER_SRLI,
+	HANDLER_SRAI,
+
+	// Memory, loads in funct3 order
+	HANDLER_LB,
+	HANDLER_LH,
+	HANDLER_LW,
+	HANDLER_LBU,
+	HANDLER_LHU,
+	HANDLER_SB,
+	HANDLER_SH,
+	HANDLER_SW,
+
+	// Control transfer and upper immediates, branches in funct3 order
+	HANDLER_JAL,
+	HANDLER_JALR,
+	HANDLER_BEQ,
+	HANDLER_BNE,
+	HANDLER_BLT,
+	HANDLER_BGE,
+	HANDLER_BLTU,
+	HANDLER_BGEU,
+	HANDLER_LUI,
+	HANDLER_AUIPC,
+
+	// System
+	HANDLER_ECALL,
+	HANDLER_EBREAK,
+
+	HANDLER_COUNT
+
+} handler_id_t;
+
+/**
+ * @brief Compact decoded instruction, 8 bytes.
+ *
+ * handler Operation to execute, see handler_id_t.
+ * rd Destination register.
+ * rs1 First source register.
+ * rs2 Second source register.
+ * imm Sign-extended immediate (shift amount, offset or upper value).
+ */
+typedef struct {
+	uint8_t handler;
+	uint8_t rd;
+	uint8_t rs1;
+	uint8_t rs2;
+	int32_t imm;
+
+} decoded_instruction_t;
+
+/**
+ * @brief Decode a raw 32-bit instruction into its record.
+ * @param instruction Raw instruction word.
+ *
+ * @return Decoded record, handler is HANDLER_ILLEGAL for unsupported words.
+ */
+decoded_instruction_t decode_instruction(uint32_t instruction);
+
+/**
+ * @brief Get the instruction class of a handler.
+ * @param handler Handler id.
+ *
+ * @return Instruction type as classified by the control unit.
+ */
+TypeInstruction handler_type(handler_id_t handler);
+
+/**
+ * @brief Get the mnemonic of a handler.
+ * @param handler Handler id.
+ *
+ * @return Lowercase mnemonic, e.g. "addi", "?" for invalid ids.
+ */
+const char *handler_name(handler_id_t handler);
+
+/**
+ * @brief Decode a whole section into a freshly allocated array.
+ * @param text_data Raw section bytes.
+ * @param text_size Section size in bytes.
+ * @param count Filled with the number of records.
+ *
+ * @return Array indexed by (pc - text_vaddr) >> 2, or NULL if allocation fails.
+ */
+decoded_instruction_t *predecode_section(
+	const uint8_t *text_data,
+		  size_t   text_size,
+		  uint32_t *count
+);
+
+#endif //PREDECODE_H
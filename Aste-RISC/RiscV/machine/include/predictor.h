@@ -0,0 +1,336 @@
+/**
+ * @file predictor.h
+ * @brief Branch predictors simulated on the retired conditional branches.
+ *
+ * The predictor only counts, it never changes the path the program takes.
+ * Each conditional branch is predicted when it retires, then the predictor
+ * learns its outcome. The 2-bit counters of bimodal and gshare are packed
+ * four to a byte, a table of 4096 counters fits in 1 KiB and stays in the
+ * host L1 cache over long runs.
+ *
+ * With a BTB a branch predicted taken is only redirected in time when the
+ * BTB holds its target, jal and jalr go through the BTB too. Without one
+ * the target of a branch is known as soon as it is decoded.
+ *
+ * Executions, taken branches and mispredictions are counted per branch
+ * word, the totals are derived when the statistics are read. Steps run
+ * again after an undo or a seek are simulated once, like the guest output.
+ */
+
+#ifndef PREDICTOR_H
+#define PREDICTOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "machine.h"
+
+// Largest counter table and BTB, in log2 entries
+#define PREDICTOR_MAX_TABLE_BITS 20
+#define PREDICTOR_MAX_BTB_BITS   16
+
+/**
+ * @brief Direction predictors.
+ */
+typedef enum {
+	PREDICTOR_NOT_TAKEN, // static, every branch falls through
+	PREDICTOR_BTFN,      // static, backward taken and forward not taken
+	PREDICTOR_BIMODAL,   // 2-bit counter per branch address
+	PREDICTOR_GSHARE,    // 2-bit counter per branch address xor global history
+
+	PREDICTOR_KIND_COUNT
+
+} predictor_kind_t;
+
+/**
+ * @brief Shape of a predictor.
+ *
+ * kind Direction predictor.
+ * table_bits Log2 of the counters of bimodal and gshare.
+ * history_bits Outcomes in the global history of gshare, at most table_bits.
+ * btb_entries Entries of the direct-mapped BTB, a power of two, 0 for none.
+ */
+typedef struct {
+	predictor_kind_t kind;
+	uint32_t         table_bits;
+	uint32_t         history_bits;
+	uint32_t         btb_entries;
+
+} predictor_config_t;
+
+/**
+ * @brief Outcomes of one branch word.
+ */
+typedef struct {
+	uint64_t executed;
+	uint64_t taken;
+	uint64_t mispredicted;
+
+} predictor_site_t;
+
+/**
+ * @brief State of the predictor of a machine.
+ *
+ * config Shape of the predictor.
+ * counters 2-bit saturating counters, four to a byte, NULL for the static
+ * predictors.
+ * table_mask, history_mask Masks of a counter index and of the history.
+ * history Outcomes of the last branches, the newest in bit 0.
+ * btb_tags Address plus one of the jump in each BTB entry, 0 when empty.
+ * btb_targets Target of each BTB entry.
+ * btb_mask Mask of a BTB index.
+ * sites Outcomes of each .text word, indexed like the predecoded records.
+ * site_count Number of words in sites.
+ * target_misses Branches predicted taken whose target the BTB lacked.
+ * jumps, jump_misses jal and jalr retired, those the BTB lacked the target of.
+ * horizon Highest step simulated, steps below it are not simulated again.
+ */
+typedef struct predictor {
+	predictor_config_t config;
+
+	uint8_t  *counters;
+	uint32_t  table_mask;
+	uint32_t  history_mask;
+	uint32_t  history;
+
+	uint32_t *btb_tags;
+	uint32_t *btb_targets;
+	uint32_t  btb_mask;
+
+	predictor_site_t *sites;
+	uint32_t          site_count;
+
+	uint64_t target_misses;
+	uint64_t jumps;
+	uint64_t jump_misses;
+
+	uint64_t horizon;
+
+} *PREDICTOR;
+
+/**
+ * @brief Totals of a predictor.
+ *
+ * config Shape of the predictor.
+ * branches, taken Conditional branches retired, the taken ones.
+ * mispredicted Branches that redirected the fetch late, wrong direction or
+ * missing target.
+ * direction_misses Branches predicted in the wrong direction.
+ * target_misses, jumps, jump_misses See struct predictor.
+ */
+typedef struct {
+	predictor_config_t config;
+
+	uint64_t branches;
+	uint64_t taken;
+	uint64_t mispredicted;
+	uint64_t direction_misses;
+	uint64_t target_misses;
+
+	uint64_t jumps;
+	uint64_t jump_misses;
+
+} predictor_stats_t;
+
+/**
+ * @brief Entry of the branch report.
+ */
+typedef struct {
+	uint32_t         pc;
+	predictor_site_t site;
+
+} predictor_entry_t;
+
+/**
+ * @brief Bimodal with 4096 counters, gshare would use 8 history bits, no BTB.
+ */
+predictor_config_t predictor_default_config(void);
+
+/**
+ * @brief Check that a shape can be simulated.
+ * @return false when a table is too large or the BTB is not a power of two.
+ */
+bool predictor_config_valid(const predictor_config_t *config);
+
+/**
+ * @brief Create a predictor with weakly not-taken counters and an empty BTB.
+ * @param config Shape of the predictor, NULL for the default one.
+ *
+ * @return The predictor, NULL if allocation fails or the shape is invalid.
+ */
+PREDICTOR new_predictor(const predictor_config_t *config);
+
+/**
+ * @brief Release a predictor.
+ * @param predictor Predictor to destroy, NULL is ignored.
+ */
+bool destroy_predictor(PREDICTOR predictor);
+
+/**
+ * @brief Attach a new predictor to the machine, from now on every retired
+ * branch and jump is predicted. Execution is interpreted while it is
+ * attached, translated blocks do not retire one branch at a time.
+ * @param machine Machine to simulate.
+ * @param config Shape of the predictor, NULL for the default one.
+ *
+ * @return false if allocation fails or the shape is invalid.
+ */
+bool enable_predictor(
+		  MACHINE             machine,
+	const predictor_config_t *config
+);
+
+/**
+ * @brief Detach the predictor and release it.
+ * @param machine Machine to stop simulating, NULL is ignored.
+ */
+void disable_predictor(MACHINE machine);
+
+/**
+ * @brief Forget what the predictor learned and zero the counters.
+ * @param machine Simulated machine.
+ */
+void predictor_clear(MACHINE machine);
+
+/**
+ * @brief Size the per-word outcomes for the predecoded .text, they are
+ * zeroed when the section changes. Called by the run loops.
+ * @param machine Simulated machine.
+ *
+ * @return false if allocation fails, the branches are then not predicted.
+ */
+bool predictor_prepare(MACHINE machine);
+
+/**
+ * @brief Totals of the branches predicted so far.
+ * @param machine Simulated machine.
+ * @param stats Filled with the totals.
+ *
+ * @return false without a predictor.
+ */
+bool predictor_stats(
+	const MACHINE            machine,
+		  predictor_stats_t *stats
+);
+
+/**
+ * @brief Most mispredicted branches, the most executed first on a tie.
+ * @param machine Simulated machine.
+ * @param entries Filled with up to max entries.
+ * @param max Size of entries.
+ *
+ * @return Number of entries written, branches never executed are left out.
+ */
+uint32_t predictor_branches(
+	const MACHINE            machine,
+		  predictor_entry_t *entries,
+		  uint32_t           max
+);
+
+/**
+ * @brief Correct predictions per branch.
+ * @return 1 when nothing was predicted.
+ */
+double predictor_accuracy(
+	uint64_t mispredicted,
+	uint64_t branches
+);
+
+/**
+ * @brief Name of a direction predictor, e.g. "gshare".
+ */
+const char *predictor_kind_name(predictor_kind_t kind);
+
+/**
+ * @brief Look a control transfer up in the BTB and store its target.
+ * @return true when the BTB held the target.
+ */
+static inline bool predictor_btb(
+	PREDICTOR predictor,
+	uint32_t  pc,
+	uint32_t  target
+) {
+	const uint32_t slot = (pc >> 2) & predictor->btb_mask;
+	const bool     hit  = predictor->btb_tags[slot] == pc + 1 && predictor->btb_targets[slot] == target;
+
+	predictor->btb_tags[slot] 	 = pc + 1;
+	predictor->btb_targets[slot] = target;
+
+	return hit;
+}
+
+/**
+ * @brief Predict a retired conditional branch and learn its outcome.
+ * @param predictor Predictor.
+ * @param index Decoded index of the branch.
+ * @param pc Address of the branch.
+ * @param target Address it jumps to when taken.
+ * @param taken The branch was taken.
+ */
+static inline void predictor_branch(
+	PREDICTOR predictor,
+	uint32_t  index,
+	uint32_t  pc,
+	uint32_t  target,
+	bool      taken
+) {
+	bool predicted;
+
+	switch (predictor->config.kind) {
+		case PREDICTOR_NOT_TAKEN:
+			predicted = false;
+			break;
+
+		case PREDICTOR_BTFN:
+			predicted = target <= pc;
+			break;
+
+		default: {
+			const uint32_t slot  = ((pc >> 2) ^ predictor->history) & predictor->table_mask;
+			uint8_t       *byte  = &predictor->counters[slot >> 2];
+			const uint32_t shift = (slot & 0x3) * 2;
+
+			uint32_t counter = *byte >> shift & 0x3;
+			predicted = counter >> 1;
+
+			if (taken) counter += counter < 3;
+			else 	   counter -= counter > 0;
+
+			*byte = (uint8_t)((*byte & ~(0x3u << shift)) | counter << shift);
+
+			predictor->history = ((predictor->history << 1) | taken) & predictor->history_mask;
+			break;
+		}
+	}
+
+	bool mispredicted = predicted != taken;
+
+	// A taken branch the BTB lacks is fetched past until it is decoded
+	if (predictor->btb_tags && taken) {
+		const bool hit = predictor_btb(predictor, pc, target);
+
+		if (predicted && !hit) {
+			predictor->target_misses++;
+			mispredicted = true;
+		}
+	}
+
+	predictor_site_t *site = &predictor->sites[index];
+	site->executed++;
+	site->taken 		+= taken;
+	site->mispredicted  += mispredicted;
+}
+
+/**
+ * @brief Look a retired jal or jalr up in the BTB.
+ */
+static inline void predictor_jump(
+	PREDICTOR predictor,
+	uint32_t  pc,
+	uint32_t  target
+) {
+	predictor->jumps++;
+	if (predictor->btb_tags) predictor->jump_misses += !predictor_btb(predictor, pc, target);
+}
+
+#endif //PREDICTOR_H
@@ -0,0 +1,253 @@
+/**
+ * @file profile.h
+ * @brief Execution counters of a machine, cheap enough to stay enabled.
+ *
+ * While the program runs only two kinds of counters move: one for each
+ * retired .text word and one for each RAM page a load or a store touches.
+ * The per-opcode and per-ALU-operation histograms and the load/store
+ * totals of each region are derived from them when a snapshot is taken,
+ * so they cost nothing on the run loop.
+ *
+ * Translated code counts whole blocks and its counters are folded into the
+ * per-word ones on demand, read the counters through this API and not
+ * from the struct. Steps run again after an undo or a seek are counted
+ * once, like the guest output.
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "machine.h"
+#include "predecode.h"
+
+/**
+ * @brief Major opcode groups of RV32I.
+ */
+typedef enum {
+	PROFILE_CLASS_OP,     // register-register arithmetic
+	PROFILE_CLASS_OP_IMM, // register-immediate arithmetic
+	PROFILE_CLASS_LOAD,
+	PROFILE_CLASS_STORE,
+	PROFILE_CLASS_BRANCH,
+	PROFILE_CLASS_JAL,
+	PROFILE_CLASS_JALR,
+	PROFILE_CLASS_LUI,
+	PROFILE_CLASS_AUIPC,
+	PROFILE_CLASS_SYSTEM,
+
+	PROFILE_CLASS_COUNT
+
+} profile_class_t;
+
+/**
+ * @brief ALU operations, the register and the immediate forms together.
+ */
+typedef enum {
+	PROFILE_ALU_ADD,
+	PROFILE_ALU_SUB,
+	PROFILE_ALU_SLL,
+	PROFILE_ALU_SLT,
+	PROFILE_ALU_SLTU,
+	PROFILE_ALU_XOR,
+	PROFILE_ALU_SRL,
+	PROFILE_ALU_SRA,
+	PROFILE_ALU_OR,
+	PROFILE_ALU_AND,
+
+	PROFILE_ALU_COUNT
+
+} profile_alu_t;
+
+/**
+ * @brief Counters of a machine.
+ *
+ * counts Retired executions of each .text word, indexed like the
+ * predecoded records.
+ * count Number of words in counts.
+ * page_loads Loads of each page of the RAM window.
+ * page_stores Stores of each page of the RAM window.
+ * page_count Number of pages in the window.
+ * horizon Highest step counted, steps below it are not counted again.
+ */
+typedef struct profile {
+	uint64_t *counts;
+	uint32_t  count;
+
+	uint64_t *page_loads;
+	uint64_t *page_stores;
+	uint32_t  page_count;
+
+	uint64_t horizon;
+
+} *PROFILE;
+
+/**
+ * @brief Loads and stores that hit a region of the RAM.
+ *
+ * A page shared by two regions counts for the first one.
+ */
+typedef struct {
+	const char *name;
+	uint32_t    start;
+	uint32_t    size;
+	uint64_t    loads;
+	uint64_t    stores;
+
+} profile_region_t;
+
+/**
+ * @brief Totals of a profile at a point in time.
+ *
+ * instructions Retired instructions counted.
+ * handlers Executions of each operation, by handler id.
+ * classes Executions of each opcode group.
+ * alu Executions of each ALU operation.
+ * loads, stores Memory accesses.
+ * regions Accesses by region, a single "memory" region when the RAM has
+ * no permission map.
+ * region_count Number of entries in regions.
+ */
+typedef struct {
+	uint64_t instructions;
+	uint64_t handlers[HANDLER_COUNT];
+	uint64_t classes[PROFILE_CLASS_COUNT];
+	uint64_t alu[PROFILE_ALU_COUNT];
+
+	uint64_t loads;
+	uint64_t stores;
+
+	profile_region_t regions[RAM_MAX_REGIONS];
+	uint32_t         region_count;
+
+} profile_snapshot_t;
+
+/**
+ * @brief Entry of the hot instructions report.
+ */
+typedef struct {
+	uint32_t     pc;
+	uint64_t     count;
+	handler_id_t handler;
+
+} profile_entry_t;
+
+/**
+ * @brief Create empty counters for a RAM window.
+ * @param ram RAM the profiled machine runs on.
+ *
+ * @return The profile, NULL if allocation fails.
+ */
+PROFILE new_profile(const RAM ram);
+
+/**
+ * @brief Release a profile.
+ * @param profile Profile to destroy, NULL is ignored.
+ */
+bool destroy_profile(PROFILE profile);
+
+/**
+ * @brief Attach new counters to the machine, from now on every retired
+ * instruction and every memory access is counted.
+ * @param machine Machine to profile.
+ *
+ * @return false if allocation fails.
+ */
+bool enable_profile(MACHINE machine);
+
+/**
+ * @brief Detach the counters and release them, the machine runs on the
+ * unprofiled interpreter and its translated code stops counting blocks.
+ * @param machine Machine to stop profiling, NULL is ignored.
+ */
+void disable_profile(MACHINE machine);
+
+/**
+ * @brief Zero every counter of the machine, the next steps start a new
+ * profile.
+ * @param machine Profiled machine.
+ */
+void profile_clear(MACHINE machine);
+
+/**
+ * @brief Size the per-word counters for the predecoded .text, they are
+ * zeroed when the section changes. Called by the run loops.
+ * @param machine Profiled machine.
+ *
+ * @return false if allocation fails, the words are then not counted.
+ */
+bool profile_prepare(MACHINE machine);
+
+/**
+ * @brief Retired executions of each .text word.
+ * @param machine Profiled machine.
+ * @param count Filled with the number of words, indexed by (pc - decoded_base) >> 2.
+ *
+ * @return The counters, valid until the next run, NULL without a profile.
+ */
+const uint64_t *profile_counts(
+	MACHINE   machine,
+	uint32_t *count
+);
+
+/**
+ * @brief Compute the histograms and the region totals.
+ * @param machine Profiled machine.
+ * @param snapshot Filled with the totals.
+ *
+ * @return false without a profile.
+ */
+bool profile_snapshot(
+	MACHINE             machine,
+	profile_snapshot_t *snapshot
+);
+
+/**
+ * @brief Most executed instructions, most executed first.
+ * @param machine Profiled machine.
+ * @param entries Filled with up to max entries.
+ * @param max Size of entries.
+ *
+ * @return Number of entries written, words never executed are left out.
+ */
+uint32_t profile_hot(
+	MACHINE          machine,
+	profile_entry_t *entries,
+	uint32_t         max
+);
+
+/**
+ * @brief Name of an opcode group, e.g. "OP-IMM".
+ */
+const char *profile_class_name(profile_class_t group);
+
+/**
+ * @brief Name of an ALU operation, e.g. "sltu".
+ */
+const char *profile_alu_name(profile_alu_t operation);
+
+/**
+ * @brief Count a load, address must be inside the RAM window.
+ */
+static inline void profile_load(
+	PROFILE        profile,
+	const RAM      ram,
+	const uint32_t address
+) {
+	profile->page_loads[(address - ram->base_vaddr) >> RAM_PAGE_SHIFT]++;
+}
+
+/**
+ * @brief Count a store, address must be inside the RAM window.
+ */
+static inline void profile_store(
+	PROFILE        profile,
+	const RAM      ram,
+	const uint32_t address
+) {
+	profile->page_stores[(address - ram->base_vaddr) >> RAM_PAGE_SHIFT]++;
+}
+
+#endif //PROFILE_H
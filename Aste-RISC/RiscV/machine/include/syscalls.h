@@ -0,0 +1,127 @@
+/**
+ * @file syscalls.h
+ * @brief Environment calls of the guest, numbered as Linux/newlib on RV32.
+ *
+ * The number is taken from a7, the arguments from a0..a2 and the result
+ * is written to a0. Output of write is collected in a ring buffer and sent
+ * to the log callback a whole batch of lines at a time, so a program
+ * printing one character per ecall does not cross into Swift every time.
+ */
+
+#ifndef SYSCALLS_H
+#define SYSCALLS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "machine.h"
+#include "assembler_with_logs.h"
+
+// Numbers passed in a7
+#define SYSCALL_READ       63
+#define SYSCALL_WRITE      64
+#define SYSCALL_EXIT       93
+#define SYSCALL_EXIT_GROUP 94
+#define SYSCALL_BRK        214
+
+// Negated errno values returned in a0
+#define SYSCALL_EIO    5
+#define SYSCALL_EBADF  9
+#define SYSCALL_EFAULT 14
+
+#define SYSCALL_OUTPUT_SIZE (64u << 10) // bytes of guest output held before a flush
+#define SYSCALL_LINE_MAX    1024        // longer lines are split
+
+/**
+ * @brief Syscall state of a machine.
+ *
+ * callback Sink of the guest output, NULL discards it.
+ * batch Lines being sent to the callback.
+ * files Host descriptors of the guest fd 0, 1 and 2, -1 when not
+ * redirected: standard input is then at its end and the output goes to
+ * the callback.
+ * output Ring of bytes written by the guest and not sent yet.
+ * head Position of the oldest byte in output.
+ * count Number of bytes in output.
+ * stream Descriptor the bytes in output were written to.
+ * horizon Step of the last write that was sent, writes replayed by a seek
+ * or after an undo are not sent twice.
+ * exit_step Step of the exit call, 0 while the program runs.
+ * exit_code Status passed to exit.
+ */
+typedef struct syscalls {
+	LogCallback callback;
+	log_batch_t batch;
+	int         files[3];
+
+	char     output[SYSCALL_OUTPUT_SIZE];
+	uint32_t head;
+	uint32_t count;
+	uint32_t stream;
+
+	uint64_t horizon;
+	uint64_t exit_step;
+	int32_t  exit_code;
+
+} *SYSCALLS;
+
+/**
+ * @brief Create the syscall state.
+ * @param callback Function receiving the guest output, may be NULL.
+ *
+ * @return Pointer to the new state, or NULL if allocation fails.
+ */
+SYSCALLS new_syscalls(LogCallback callback);
+
+/**
+ * @brief Send the pending output, then destroy the state.
+ * @param syscalls State to destroy.
+ */
+bool destroy_syscalls(SYSCALLS syscalls);
+
+/**
+ * @brief Attach a new syscall state to the machine, from now on cpu_run
+ * services the known ecalls itself and only stops on exit.
+ * @param machine Machine running the program.
+ * @param callback Function receiving the guest output, may be NULL.
+ *
+ * @return false if allocation fails.
+ */
+bool enable_syscalls(
+	MACHINE     machine,
+	LogCallback callback
+);
+
+/**
+ * @brief Connect a guest standard stream to a host descriptor. Redirected
+ * output is written as it is, without splitting it in lines.
+ * @param syscalls State to configure.
+ * @param fd Guest descriptor, 0 to 2.
+ * @param host_fd Open host descriptor, -1 to restore the default.
+ *
+ * @return false if fd is not a standard stream.
+ */
+bool syscall_redirect(
+	SYSCALLS syscalls,
+	uint32_t fd,
+	int      host_fd
+);
+
+/**
+ * @brief Service the ecall that just retired, pc already points after it.
+ * @param machine Machine that stopped with CPU_STATUS_ECALL.
+ *
+ * @return CPU_STATUS_BUDGET_EXHAUSTED when the program can go on,
+ * CPU_STATUS_EXIT after exit, CPU_STATUS_ECALL for an unknown number.
+ */
+cpu_status_t syscall_handle(MACHINE machine);
+
+/**
+ * @brief Send the complete lines of the pending output, a line without
+ * its newline waits for the rest unless it fills the ring. Redirected
+ * output is written whole.
+ * @param syscalls State holding the output, may be NULL.
+ */
+void syscall_flush(SYSCALLS syscalls);
+
+#endif //SYSCALLS_H
@@ -0,0 +1,128 @@
+/**
+ * @file timeline.h
+ * @brief Periodic copy-on-write checkpoints for random access in time.
+ *
+ * Every interval retired instructions cpu_run takes a checkpoint holding
+ * the registers and only the RAM pages written since the previous one.
+ * Seeking restores the nearest checkpoint before the requested step and
+ * runs forward from there, so it costs at most interval instructions plus
+ * the pages written after that checkpoint.
+ */
+
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "machine.h"
+
+#define TIMELINE_NONE 0 // page never stored, it reads as zero
+
+/**
+ * @brief Machine state at a retired instruction count.
+ *
+ * instret Step of the checkpoint.
+ * registers Register file at that step.
+ * pc Program counter at that step.
+ * heap_break End of the heap at that step.
+ * page_count Number of pages stored by this checkpoint.
+ * pages Page numbers in ascending order.
+ * previous For each stored page, version (checkpoint index + 1) holding
+ * its older content, or TIMELINE_NONE.
+ * data Page contents, page_count * RAM_PAGE_SIZE bytes.
+ */
+typedef struct {
+	uint64_t instret;
+	uint32_t registers[32];
+	uint32_t pc;
+	uint32_t heap_break;
+
+	uint32_t  page_count;
+	uint32_t *pages;
+	uint32_t *previous;
+	uint8_t  *data;
+
+} checkpoint_t;
+
+/**
+ * @brief Checkpoints of a machine, oldest first.
+ *
+ * interval Instructions between two checkpoints.
+ * checkpoints Taken checkpoints.
+ * latest For each RAM page, version (checkpoint index + 1) of its last copy.
+ * stored_bytes Page data held by all checkpoints.
+ */
+typedef struct timeline {
+	uint64_t interval;
+
+	checkpoint_t *checkpoints;
+	uint32_t 	  count;
+	uint32_t 	  capacity;
+
+	uint32_t *latest;
+	size_t 	  stored_bytes;
+
+} *TIMELINE;
+
+/**
+ * @brief Attach a timeline to the machine and take the first checkpoint
+ * at the current state.
+ * @param machine Machine to record.
+ * @param interval Instructions between two checkpoints, at least 1.
+ *
+ * @return false if allocation fails.
+ */
+bool enable_timeline(
+	MACHINE  machine,
+	uint64_t interval
+);
+
+/**
+ * @brief Detach the timeline and release its checkpoints, the machine
+ * can no longer seek.
+ * @param machine Machine to stop recording, NULL is ignored.
+ */
+void disable_timeline(MACHINE machine);
+
+/**
+ * @brief Release the timeline and every checkpoint.
+ * @param timeline Timeline to destroy, NULL is ignored.
+ */
+void destroy_timeline(struct timeline *timeline);
+
+/**
+ * @brief Instructions left before the next checkpoint is due.
+ * @param machine Machine with an attached timeline.
+ *
+ * @return 0 when a checkpoint must be taken now.
+ */
+uint64_t timeline_due(const MACHINE machine);
+
+/**
+ * @brief Store the registers and the dirty pages, then clear the dirty map.
+ * @param machine Machine with an attached timeline.
+ *
+ * @return false if allocation fails, the timeline is left unchanged.
+ */
+bool timeline_checkpoint(MACHINE machine);
+
+/**
+ * @brief Move the machine to the state after step instructions.
+ *
+ * The nearest checkpoint at or before step is restored, the checkpoints
+ * after it are dropped and execution resumes until step is reached.
+ * Ecalls and ebreaks on the way are stepped over, the journal is cleared
+ * because it no longer describes the path to the current state.
+ * @param machine Machine with an attached timeline.
+ * @param step Retired instruction count to reach.
+ *
+ * @return CPU_STATUS_BUDGET_EXHAUSTED when step was reached, otherwise the
+ * status that stopped the machine before it.
+ */
+cpu_status_t timeline_seek(
+	MACHINE  machine,
+	uint64_t step
+);
+
+#endif //TIMELINE_H
@@ -0,0 +1,379 @@
+/**
+ * @file trace.h
+ * @brief Binary execution trace, written in the background and read back
+ * with mmap.
+ *
+ * Every retired instruction becomes a record: its pc, its raw word, the
+ * value it wrote to rd and the address and value of its memory access.
+ * Records are packed into blocks of at most TRACE_BLOCK_RECORDS. Inside a
+ * block each field is a delta from the previous record and is written as
+ * a varint:
+ *
+ * - the pc is left out when it follows the previous one
+ * - a word is left out when the same pc had it earlier in the block
+ * - a register value is a delta from the last value of that register
+ * - an address is a delta from the previous access
+ *
+ * A straight-line ALU instruction usually takes two or three bytes.
+ *
+ * Every block starts from an empty state, so a reader can decode any
+ * block on its own. Whole blocks are pushed into a lock-free ring, and a
+ * writer thread drains the ring to the file. When the disk falls behind
+ * and the ring is full, the block is dropped and counted, and the run
+ * never waits. A dropped block leaves a gap in the steps of the file.
+ *
+ * Steps run again after an undo or a seek are traced once, like the guest
+ * output. Read syscalls write guest memory that is not traced, and a0
+ * after an ecall is traced as its rd.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "machine.h"
+
+#define TRACE_MAGIC   "ASTETRC1"
+#define TRACE_VERSION 1
+
+#define TRACE_BLOCK_MAGIC   0x4B4C4254u  // "TBLK" in the file
+#define TRACE_BLOCK_RECORDS 4096
+#define TRACE_BLOCK_BYTES   (64u << 10)  // payload past which a block is closed
+#define TRACE_RECORD_MAX    26           // flags, 4 varints and a raw word
+#define TRACE_RING_BYTES    (8u << 20)   // blocks waiting for the writer, a power of two
+#define TRACE_WORDS         256          // words remembered by pc in a block
+
+// Fields present in a record, the flags byte starts it
+#define TRACE_JUMP   0x01u // pc is not the previous pc + 4
+#define TRACE_WORD   0x02u // raw word, not remembered for this pc
+#define TRACE_RD     0x04u // value written to rd, a0 for an ecall
+#define TRACE_MEMORY 0x08u // address of a load or a store
+#define TRACE_VALUE  0x10u // value stored, or loaded into x0
+
+/**
+ * @brief Start of a trace file.
+ */
+typedef struct {
+	char     magic[8];
+	uint32_t version;
+	uint32_t block_records;
+
+} trace_file_header_t;
+
+/**
+ * @brief Start of a block, its payload follows.
+ *
+ * magic TRACE_BLOCK_MAGIC.
+ * bytes Payload size.
+ * count Records in the payload.
+ * first_step Step of the first record, the others follow one by one.
+ */
+typedef struct {
+	uint32_t magic;
+	uint32_t bytes;
+	uint32_t count;
+	uint32_t reserved;
+	uint64_t first_step;
+
+} trace_block_header_t;
+
+/**
+ * @brief A decoded record.
+ *
+ * flags TRACE_RD, TRACE_MEMORY and TRACE_VALUE for the fields set.
+ * rd Register written, from the word or 10 for an ecall.
+ * address, value Address and value of the load or the store.
+ */
+typedef struct {
+	uint64_t step;
+	uint32_t pc;
+	uint32_t word;
+	uint32_t flags;
+	uint32_t rd;
+	uint32_t rd_value;
+	uint32_t address;
+	uint32_t value;
+
+} trace_record_t;
+
+/**
+ * @brief What the encoder and the decoder remember inside a block.
+ *
+ * pc Pc of the previous record.
+ * address Address of the previous access.
+ * registers Last value written to each register.
+ * word_tags Pc plus one of each remembered word, 0 when empty.
+ * words Remembered words, indexed by pc.
+ */
+typedef struct {
+	uint32_t pc;
+	uint32_t address;
+	uint32_t registers[32];
+	uint32_t word_tags[TRACE_WORDS];
+	uint32_t words[TRACE_WORDS];
+
+} trace_state_t;
+
+/**
+ * @brief Recorder of a machine.
+ *
+ * fd Trace file.
+ * state Encoder state of the open block.
+ * block Header and payload of the open block.
+ * block_bytes, block_count Payload size and records of the open block.
+ * next_step Step the next record must have to extend the block.
+ * address, value, memory Access of the instruction in flight.
+ * ecall_pending An ecall retired, it is written with its result.
+ * ecall_pc, ecall_step The ecall waiting.
+ * ring Blocks not written yet, TRACE_RING_BYTES long.
+ * head Bytes pushed into the ring, advanced by the run.
+ * tail Bytes written to the file, advanced by the writer.
+ * stop Set to end the writer once the ring is empty.
+ * failed A write to the file failed.
+ * writer Thread draining the ring.
+ * records, blocks Records and blocks pushed into the ring.
+ * dropped_records, dropped_blocks Those lost because the ring was full.
+ * horizon Highest step traced, steps below it are not traced again.
+ */
+typedef struct trace {
+	int fd;
+
+	trace_state_t state;
+	uint8_t       block[sizeof(trace_block_header_t) + TRACE_BLOCK_BYTES + TRACE_RECORD_MAX];
+	uint32_t      block_bytes;
+	uint32_t      block_count;
+	uint64_t      next_step;
+
+	uint32_t address;
+	uint32_t value;
+	bool     memory;
+
+	bool     ecall_pending;
+	uint32_t ecall_pc;
+	uint64_t ecall_step;
+
+	// The counters shared with the writer sit on their own cache lines
+	uint8_t                      *ring;
+	_Alignas(64) _Atomic uint64_t head;
+	_Alignas(64) _Atomic uint64_t tail;
+	_Atomic bool                  stop;
+	_Atomic bool                  failed;
+	pthread_t                     writer;
+
+	_Alignas(64) uint64_t records;
+	uint64_t              blocks;
+	uint64_t              dropped_records;
+	uint64_t              dropped_blocks;
+
+	uint64_t horizon;
+
+} *TRACE;
+
+/**
+ * @brief Totals of a recorder.
+ *
+ * bytes Bytes written to the file so far.
+ * failed A write to the file failed.
+ * See struct trace for the other fields.
+ */
+typedef struct {
+	uint64_t records;
+	uint64_t blocks;
+	uint64_t dropped_records;
+	uint64_t dropped_blocks;
+	uint64_t bytes;
+	bool     failed;
+
+} trace_stats_t;
+
+/**
+ * @brief Block of a trace file, as indexed by the reader.
+ */
+typedef struct {
+	size_t   offset;
+	uint32_t bytes;
+	uint32_t count;
+	uint64_t first_step;
+
+} trace_block_t;
+
+/**
+ * @brief Trace file mapped for reading.
+ *
+ * data, size Mapped file.
+ * blocks Complete blocks in file order, a block cut short by a crash is
+ * left out.
+ * block_count Number of blocks.
+ * records Records in the blocks.
+ */
+typedef struct trace_reader {
+	const uint8_t *data;
+	size_t         size;
+
+	trace_block_t *blocks;
+	uint32_t       block_count;
+	uint64_t       records;
+
+} *TRACE_READER;
+
+/**
+ * @brief Position in a mapped trace.
+ *
+ * reader Trace being read.
+ * block Index of the block being decoded.
+ * index Records of the block already decoded.
+ * cursor Next byte of the block payload.
+ * state Decoder state of the block.
+ */
+typedef struct {
+	TRACE_READER   reader;
+	uint32_t       block;
+	uint32_t       index;
+	const uint8_t *cursor;
+	trace_state_t  state;
+
+} trace_cursor_t;
+
+/**
+ * @brief Create the trace file and start its writer.
+ * @param path File to create, truncated when it exists.
+ *
+ * @return The recorder, NULL if the file or the thread cannot be created.
+ */
+TRACE new_trace(const char *path);
+
+/**
+ * @brief Write what is left, stop the writer and close the file.
+ * @param trace Recorder to destroy, NULL is ignored.
+ *
+ * @return false when a write failed or trace is NULL.
+ */
+bool destroy_trace(TRACE trace);
+
+/**
+ * @brief Attach a new recorder to the machine, from now on every retired
+ * instruction is traced. Execution is interpreted while it is attached,
+ * because translated blocks do not retire one instruction at a time.
+ * @param machine Machine to trace.
+ * @param path File to create.
+ *
+ * @return false if the file or the writer cannot be created.
+ */
+bool enable_trace(
+		  MACHINE  machine,
+	const char    *path
+);
+
+/**
+ * @brief Detach the recorder and complete its file, this waits for the
+ * blocks still in the ring to be written.
+ * @param machine Traced machine.
+ * @param stats Filled with the final totals, NULL to ignore.
+ *
+ * @return false when a write failed or the machine was not traced.
+ */
+bool disable_trace(
+	MACHINE        machine,
+	trace_stats_t *stats
+);
+
+/**
+ * @brief Totals of the recorder of the machine so far, the open block is
+ * not counted yet.
+ * @param machine Traced machine.
+ * @param stats Filled with the totals.
+ *
+ * @return false without a recorder.
+ */
+bool trace_stats(
+	const MACHINE        machine,
+		  trace_stats_t *stats
+);
+
+/**
+ * @brief Trace a retired instruction. Called by the run loop.
+ * @param trace Recorder.
+ * @param ram RAM holding the word.
+ * @param pc Address of the instruction.
+ * @param registers Register file after the instruction.
+ * @param step Retired instructions before it.
+ */
+void trace_retire(
+		  TRACE     trace,
+	const RAM       ram,
+		  uint32_t  pc,
+	const uint32_t *registers,
+		  uint64_t  step
+);
+
+/**
+ * @brief Trace the ecall retired last with its result in a0. Called once
+ * the syscall is serviced.
+ * @param trace Recorder, NULL is ignored.
+ * @param registers Register file after the syscall.
+ */
+void trace_syscall(
+		  TRACE     trace,
+	const uint32_t *registers
+);
+
+/**
+ * @brief Map a trace file and index its blocks.
+ * @param path Trace file.
+ *
+ * @return The reader, NULL when the file cannot be mapped or is not a trace.
+ */
+TRACE_READER new_trace_reader(const char *path);
+
+/**
+ * @brief Unmap a trace file.
+ * @param reader Reader to destroy, NULL is ignored.
+ */
+bool destroy_trace_reader(TRACE_READER reader);
+
+/**
+ * @brief Place a cursor on a step, only the block holding it is decoded.
+ * @param reader Mapped trace.
+ * @param step Step to read next.
+ * @param cursor Filled with the position.
+ *
+ * @return false when no record has that step or a later one.
+ */
+bool trace_seek(
+	TRACE_READER    reader,
+	uint64_t        step,
+	trace_cursor_t *cursor
+);
+
+/**
+ * @brief Read the record under the cursor and move past it. The steps
+ * advance one by one, except over the gap of a dropped block.
+ * @param cursor Position in the trace.
+ * @param record Filled with the record.
+ *
+ * @return false at the end of the trace or on a damaged block.
+ */
+bool trace_next(
+	trace_cursor_t *cursor,
+	trace_record_t *record
+);
+
+/**
+ * @brief Note the memory access of the instruction in flight.
+ */
+static inline void trace_memory(
+	TRACE    trace,
+	uint32_t address,
+	uint32_t value
+) {
+	trace->address = address;
+	trace->value   = value;
+	trace->memory  = true;
+}
+
+#endif //TRACE_H
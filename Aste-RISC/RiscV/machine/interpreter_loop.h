@@ -0,0 +1,505 @@
+/**
+ * @file interpreter_loop.h
+ * @brief Run loop template over predecoded handlers.
+ *
+ * This file is included by machine.c once per dispatch strategy, it is not
+ * a public header. Before including it define:
+ *
+ * INTERPRETER_NAME Name of the generated function.
+ * INTERPRETER_THREADED 1 to dispatch with computed goto, 0 for a switch.
+ * INTERPRETER_JOURNAL 1 to push an undo record for every retired instruction.
+ * INTERPRETER_PROFILE 1 to count retired words and memory accesses when a
+ * profile is attached, to schedule them when a pipeline is attached and to
+ * pass fetches, loads and stores through the caches when they are attached.
+ * INTERPRETER_PREDICTOR 1 to predict branches and jumps when a predictor is
+ * attached, the hooks sit in the control transfers only.
+ * INTERPRETER_TRACE 1 to record every retired instruction when a trace is
+ * attached.
+ * INTERPRETER_DEBUGGER 1 to stop on breakpoints, watchpoints and the end
+ * of a step while a debugger command runs.
+ *
+ * With computed goto every handler ends with its own indirect jump, so the
+ * host branch predictor learns one target history per handler instead of a
+ * single shared one at the top of the switch.
+ */
+
+static cpu_status_t INTERPRETER_NAME(
+	MACHINE  machine,
+	uint64_t max_instructions
+) {
+	const RAM ram = machine->ram;
+
+	decoded_instruction_t *decoded = machine->decoded;
+	const uint32_t decoded_base    = machine->decoded_base;
+	const uint32_t decoded_count   = machine->decoded_count;
+
+	uint32_t *regs 	   = machine->registers;
+	uint32_t  pc   	   = machine->pc;
+	uint64_t  executed = 0;
+
+	const decoded_instruction_t *d = NULL;
+	uint32_t index 	 = 0;
+	uint32_t imm 	 = 0;
+	uint32_t next_pc = 0;
+
+	cpu_status_t status = CPU_STATUS_BUDGET_EXHAUSTED;
+
+#if INTERPRETER_JOURNAL
+
+	// Undo record of the instruction in flight, pushed when it retires
+	JOURNAL  journal 		 = machine->journal;
+	uint32_t journal_old 	 = 0;
+	uint32_t journal_address = 0;
+	uint32_t journal_flags 	 = 0;
+
+#define JOURNAL_SNAPSHOT() do { journal_old = regs[d->rd]; journal_flags = 0; } while (0)
+
+#define JOURNAL_STORE(address) do {											\
+		journal_address = (address) & ~0x3u;								\
+		const uint8_t *word = machine_translate(ram, journal_address, 4);	\
+		if (word) memcpy(&journal_old, word, sizeof(journal_old));			\
+		journal_flags = JOURNAL_MEMORY;										\
+	} while (0)
+
+#define JOURNAL_RETIRE() journal_push(											\
+		journal,																\
+		pc | JOURNAL_STEP_START | journal_flags,								\
+		journal_flags ? journal_address : d->rd,								\
+		journal_old																\
+	)
+
+#else
+
+#define JOURNAL_SNAPSHOT()     do { } while (0)
+#define JOURNAL_STORE(address) do { } while (0)
+#define JOURNAL_RETIRE()       do { } while (0)
+
+#endif
+
+#if INTERPRETER_PROFILE
+
+	PROFILE   profile 		 = machine->profile;
+	uint64_t *profile_counts = profile && profile_prepare(machine) ? profile->counts : NULL;
+	PIPELINE  pipeline 		 = machine->pipeline;
+	CACHE     cache 		 = machine->cache;
+
+	// First decoded index of the straight-line run in flight
+	uint32_t pipeline_start = (pc - decoded_base) >> 2;
+
+#define PROFILE_RETIRE() do {																\
+		if (profile_counts) profile_counts[index]++;										\
+		if (cache) cache_fetch(cache, ram, pc);												\
+		if (pipeline && next_pc != pc + 4) {												\
+			pipeline_retire_run(pipeline, decoded, pipeline_start, index + 1 - pipeline_start, true);	\
+			pipeline_start = (next_pc - decoded_base) >> 2;									\
+		}																					\
+	} while (0)
+
+// The run in flight ends before its words are decoded again
+#define PROFILE_SPLIT() do {																\
+		if (pipeline) {																		\
+			pipeline_retire_run(pipeline, decoded, pipeline_start, index + 1 - pipeline_start, false);	\
+			pipeline_start = index + 1;														\
+		}																					\
+	} while (0)
+
+#define PROFILE_LOAD(address, width) do {												\
+		if (profile) profile_load(profile, ram, address);									\
+		if (cache) cache_data(cache, ram, address, width, false);							\
+	} while (0)
+
+#define PROFILE_STORE(address, width) do {												\
+		if (profile) profile_store(profile, ram, address);									\
+		if (cache) cache_data(cache, ram, address, width, true);							\
+	} while (0)
+
+#define PROFILE_STOP() do {																	\
+		const uint32_t pipeline_length = ((pc - decoded_base) >> 2) - pipeline_start;		\
+		if (pipeline && pipeline_length) {													\
+			pipeline_retire_run(pipeline, decoded, pipeline_start, pipeline_length, false);	\
+		}																					\
+	} while (0)
+
+#else
+
+#define PROFILE_RETIRE()              do { } while (0)
+#define PROFILE_LOAD(address, width)  do { } while (0)
+#define PROFILE_STORE(address, width) do { } while (0)
+#define PROFILE_SPLIT()               do { } while (0)
+#define PROFILE_STOP()                do { } while (0)
+
+#endif
+
+#if INTERPRETER_PREDICTOR
+
+	PREDICTOR predictor = machine->predictor && predictor_prepare(machine) ? machine->predictor : NULL;
+
+#define PREDICT_BRANCH(taken) do {													\
+		if (predictor) predictor_branch(predictor, index, pc, pc + imm, taken);		\
+	} while (0)
+
+#define PREDICT_JUMP() do {															\
+		if (predictor) predictor_jump(predictor, pc, next_pc);						\
+	} while (0)
+
+#else
+
+#define PREDICT_BRANCH(taken) do { } while (0)
+#define PREDICT_JUMP()        do { } while (0)
+
+#endif
+
+#if INTERPRETER_TRACE
+
+	TRACE trace = machine->trace;
+
+#define TRACE_RETIRE() do {																	\
+		if (trace) trace_retire(trace, ram, pc, regs, machine->instret + executed);			\
+	} while (0)
+
+#define TRACE_LOAD(address, value) do {														\
+		if (trace) trace_memory(trace, address, value);										\
+	} while (0)
+
+#define TRACE_STORE(address, width) do {													\
+		if (trace) trace_memory(trace, address, regs[d->rs2] & (0xFFFFFFFFu >> (32 - 8 * (width))));	\
+	} while (0)
+
+#else
+
+#define TRACE_RETIRE()              do { } while (0)
+#define TRACE_LOAD(address, value)  do { } while (0)
+#define TRACE_STORE(address, width) do { } while (0)
+
+#endif
+
+#if INTERPRETER_DEBUGGER
+
+	DEBUGGER debugger = machine->debugger && machine->debugger->active && debugger_prepare(machine) ? machine->debugger : NULL;
+
+	// Outside a command nothing is stopped on, and no store is in bounds
+	const uint32_t *debugger_stops  = debugger ? debugger->stops : NULL;
+	const uint32_t  watch_first     = debugger ? debugger->watch_first : UINT32_MAX;
+	const uint32_t  watch_last      = debugger ? debugger->watch_last : 0;
+	const bool      debugger_frames = debugger && debugger->frames;
+
+#define DEBUGGER_FETCH() do {																\
+		if (debugger_stops && (debugger_stops[index >> 5] >> (index & 31) & 1) &&			\
+			debugger_fetch(machine, pc, machine->instret + executed)) {						\
+			status = CPU_STATUS_BREAKPOINT;													\
+			goto stop;																		\
+		}																					\
+	} while (0)
+
+#define DEBUGGER_STORE(address, width) do {													\
+		if ((address) <= watch_last && (address) + (width) - 1 >= watch_first &&			\
+			debugger_store(debugger, address, width)) {										\
+			status = CPU_STATUS_WATCHPOINT;													\
+			RETIRE();																		\
+			goto stop;																		\
+		}																					\
+	} while (0)
+
+#define DEBUGGER_JUMP() do {																\
+		if (debugger_frames && debugger_jump(debugger, d)) {								\
+			status = CPU_STATUS_BREAKPOINT;													\
+			RETIRE();																		\
+			goto stop;																		\
+		}																					\
+	} while (0)
+
+#else
+
+#define DEBUGGER_FETCH()               do { } while (0)
+#define DEBUGGER_STORE(address, width) do { } while (0)
+#define DEBUGGER_JUMP()                do { } while (0)
+
+#endif
+
+#define FETCH() do { 												\
+		if (executed >= max_instructions) {							\
+			status = CPU_STATUS_BUDGET_EXHAUSTED;					\
+			goto stop;												\
+		}															\
+																	\
+		index = (pc - decoded_base) >> 2;							\
+		if (index >= decoded_count) {								\
+			status = CPU_STATUS_OUT_OF_TEXT;						\
+			goto stop;												\
+		}															\
+																	\
+		if (pc & 0x3) {												\
+			machine->fault_address = pc;							\
+			status = CPU_STATUS_FETCH_FAULT;						\
+			goto stop;												\
+		}															\
+																	\
+		DEBUGGER_FETCH();											\
+		d 		= &decoded[index];									\
+		imm 	= (uint32_t)d->imm;									\
+		next_pc = pc + 4;											\
+		JOURNAL_SNAPSHOT();											\
+	} while (0)
+
+// Writes to x0 are discarded after each instruction
+#define RETIRE() do { JOURNAL_RETIRE(); PROFILE_RETIRE(); TRACE_RETIRE(); regs[0] = 0; pc = next_pc; executed++; } while (0)
+
+#if INTERPRETER_THREADED
+
+	static const void *const dispatch_table[HANDLER_COUNT] = {
+		[HANDLER_ILLEGAL]   = &&target_ILLEGAL,
+		[HANDLER_UNDECODED] = &&target_UNDECODED,
+		[HANDLER_ADD]       = &&target_ADD,
+		[HANDLER_SUB]       = &&target_SUB,
+		[HANDLER_SLL]       = &&target_SLL,
+		[HANDLER_SLT]       = &&target_SLT,
+		[HANDLER_SLTU]      = &&target_SLTU,
+		[HANDLER_XOR]       = &&target_XOR,
+		[HANDLER_SRL]       = &&target_SRL,
+		[HANDLER_SRA]       = &&target_SRA,
+		[HANDLER_OR]        = &&target_OR,
+		[HANDLER_AND]       = &&target_AND,
+		[HANDLER_ADDI]      = &&target_ADDI,
+		[HANDLER_SLTI]      = &&target_SLTI,
+		[HANDLER_SLTIU]     = &&target_SLTIU,
+		[HANDLER_XORI]      = &&target_XORI,
+		[HANDLER_ORI]       = &&target_ORI,
+		[HANDLER_ANDI]      = &&target_ANDI,
+		[HANDLER_SLLI]      = &&target_SLLI,
+		[HANDLER_SRLI]      = &&target_SRLI,
+		[HANDLER_SRAI]      = &&target_SRAI,
+		[HANDLER_LB]        = &&target_LB,
+		[HANDLER_LH]        = &&target_LH,
+		[HANDLER_LW]        = &&target_LW,
+		[HANDLER_LBU]       = &&target_LBU,
+		[HANDLER_LHU]       = &&target_LHU,
+		[HANDLER_SB]        = &&target_SB,
+		[HANDLER_SH]        = &&target_SH,
+		[HANDLER_SW]        = &&target_SW,
+		[HANDLER_JAL]       = &&target_JAL,
+		[HANDLER_JALR]      = &&target_JALR,
+		[HANDLER_BEQ]       = &&target_BEQ,
+		[HANDLER_BNE]       = &&target_BNE,
+		[HANDLER_BLT]       = &&target_BLT,
+		[HANDLER_BGE]       = &&target_BGE,
+		[HANDLER_BLTU]      = &&target_BLTU,
+		[HANDLER_BGEU]      = &&target_BGEU,
+		[HANDLER_LUI]       = &&target_LUI,
+		[HANDLER_AUIPC]     = &&target_AUIPC,
+		[HANDLER_ECALL]     = &&target_ECALL,
+		[HANDLER_EBREAK]    = &&target_EBREAK
+	};
+
+#define TARGET(name) case HANDLER_##name: target_##name
+#define DISPATCH()   goto *dispatch_table[d->handler]
+#define NEXT()       do { RETIRE(); FETCH(); DISPATCH(); } while (0)
+
+#else
+
+#define TARGET(name) case HANDLER_##name
+#define DISPATCH()   do { } while (0)
+#define NEXT()       do { RETIRE(); goto fetch; } while (0)
+
+#endif
+
+fetch:
+	FETCH();
+	DISPATCH();
+
+	switch ((handler_id_t)d->handler) {
+
+		// MARK: R-Type
+		TARGET(ADD):  regs[d->rd] = regs[d->rs1] + regs[d->rs2];                                   NEXT();
+		TARGET(SUB):  regs[d->rd] = regs[d->rs1] - regs[d->rs2];                                   NEXT();
+		TARGET(SLL):  regs[d->rd] = regs[d->rs1] << (regs[d->rs2] & 0x1F);                         NEXT();
+		TARGET(SLT):  regs[d->rd] = (int32_t)regs[d->rs1] < (int32_t)regs[d->rs2];                 NEXT();
+		TARGET(SLTU): regs[d->rd] = regs[d->rs1] < regs[d->rs2];                                   NEXT();
+		TARGET(XOR):  regs[d->rd] = regs[d->rs1] ^ regs[d->rs2];                                   NEXT();
+		TARGET(SRL):  regs[d->rd] = regs[d->rs1] >> (regs[d->rs2] & 0x1F);                         NEXT();
+		TARGET(SRA):  regs[d->rd] = (uint32_t)((int32_t)regs[d->rs1] >> (regs[d->rs2] & 0x1F));    NEXT();
+		TARGET(OR):   regs[d->rd] = regs[d->rs1] | regs[d->rs2];                                   NEXT();
+		TARGET(AND):  regs[d->rd] = regs[d->rs1] & regs[d->rs2];                                   NEXT();
+
+		// MARK: I-Type arithmetic
+		TARGET(ADDI):  regs[d->rd] = regs[d->rs1] + imm;                                           NEXT();
+		TARGET(SLTI):  regs[d->rd] = (int32_t)regs[d->rs1] < d->imm;                               NEXT();
+		TARGET(SLTIU): regs[d->rd] = regs[d->rs1] < imm;                                           NEXT();
+		TARGET(XORI):  regs[d->rd] = regs[d->rs1] ^ imm;                                           NEXT();
+		TARGET(ORI):   regs[d->rd] = regs[d->rs1] | imm;                                           NEXT();
+		TARGET(ANDI):  regs[d->rd] = regs[d->rs1] & imm;                                           NEXT();
+		TARGET(SLLI):  regs[d->rd] = regs[d->rs1] << imm;                                          NEXT();
+		TARGET(SRLI):  regs[d->rd] = regs[d->rs1] >> imm;                                          NEXT();
+		TARGET(SRAI):  regs[d->rd] = (uint32_t)((int32_t)regs[d->rs1] >> imm);                     NEXT();
+
+		// MARK: Load
+#define LOAD_TARGET(name, load, width) 										\
+		TARGET(name): { 													\
+			const uint32_t address = regs[d->rs1] + imm; 					\
+			uint32_t value; 												\
+			const ram_access_t access = load(ram, address, &value); 		\
+			if (access != RAM_ACCESS_OK) { 									\
+				machine->fault_address = address; 							\
+				machine->fault_access  = access; 							\
+				status = CPU_STATUS_LOAD_FAULT; 							\
+				goto stop; 													\
+			} 																\
+																			\
+			PROFILE_LOAD(address, width); 									\
+			TRACE_LOAD(address, value); 									\
+			regs[d->rd] = value; 											\
+			NEXT(); 														\
+		}
+
+		LOAD_TARGET(LB,  ram_load8,   1)
+		LOAD_TARGET(LH,  ram_load16,  2)
+		LOAD_TARGET(LW,  ram_load32,  4)
+		LOAD_TARGET(LBU, ram_load8u,  1)
+		LOAD_TARGET(LHU, ram_load16u, 2)
+
+		// MARK: Store
+#define STORE_TARGET(name, store, width) 									\
+		TARGET(name): { 													\
+			const uint32_t address = regs[d->rs1] + imm; 					\
+			JOURNAL_STORE(address); 										\
+																			\
+			const ram_access_t access = store(ram, address, regs[d->rs2]); 	\
+			if (access != RAM_ACCESS_OK) { 									\
+				machine->fault_address = address; 							\
+				machine->fault_access  = access; 							\
+				status = CPU_STATUS_STORE_FAULT; 							\
+				goto stop; 													\
+			} 																\
+																			\
+			PROFILE_STORE(address, width); 									\
+			TRACE_STORE(address, width); 									\
+																			\
+			/* Self-modifying code, decode the word again on fetch */ 		\
+			if (address - ram->text_base < ram->text_size) { 				\
+				PROFILE_SPLIT(); 											\
+				invalidate_decoded_text(machine, address, width); 			\
+			} 																\
+																			\
+			DEBUGGER_STORE(address, width); 								\
+			NEXT(); 														\
+		}
+
+		STORE_TARGET(SB, ram_store8,  1)
+		STORE_TARGET(SH, ram_store16, 2)
+		STORE_TARGET(SW, ram_store32, 4)
+
+#undef LOAD_TARGET
+#undef STORE_TARGET
+
+		// MARK: Control transfer
+		TARGET(JAL):
+			regs[d->rd] = next_pc;
+			next_pc 	= pc + imm;
+
+			PREDICT_JUMP();
+			DEBUGGER_JUMP();
+			NEXT();
+
+		TARGET(JALR): {
+			const uint32_t target = (regs[d->rs1] + imm) & ~1u;
+
+			regs[d->rd] = next_pc;
+			next_pc 	= target;
+
+			PREDICT_JUMP();
+			DEBUGGER_JUMP();
+			NEXT();
+		}
+
+		// A misaligned taken target faults on the next fetch
+#define BRANCH_TARGET(name, condition) 										\
+		TARGET(name): { 													\
+			const bool taken = condition; 									\
+			if (taken) next_pc = pc + imm; 									\
+																			\
+			PREDICT_BRANCH(taken); 											\
+			NEXT(); 														\
+		}
+
+		BRANCH_TARGET(BEQ,  regs[d->rs1] == regs[d->rs2])
+		BRANCH_TARGET(BNE,  regs[d->rs1] != regs[d->rs2])
+		BRANCH_TARGET(BLT,  (int32_t)regs[d->rs1] <  (int32_t)regs[d->rs2])
+		BRANCH_TARGET(BGE,  (int32_t)regs[d->rs1] >= (int32_t)regs[d->rs2])
+		BRANCH_TARGET(BLTU, regs[d->rs1] <  regs[d->rs2])
+		BRANCH_TARGET(BGEU, regs[d->rs1] >= regs[d->rs2])
+
+#undef BRANCH_TARGET
+
+		// MARK: Upper immediates
+		TARGET(LUI):   regs[d->rd] = imm;                                                          NEXT();
+		TARGET(AUIPC): regs[d->rd] = pc + imm;                                                     NEXT();
+
+		// MARK: System
+		TARGET(ECALL):
+			status = CPU_STATUS_ECALL;
+			RETIRE();
+			goto stop;
+
+		TARGET(EBREAK):
+			status = CPU_STATUS_EBREAK;
+			RETIRE();
+			goto stop;
+
+		// Entry invalidated by a store, decode it again and retry
+		TARGET(UNDECODED): {
+			const uint8_t *p = machine_translate(ram, pc, 4);
+			if (!p) {
+				machine->fault_address = pc;
+				status = CPU_STATUS_FETCH_FAULT;
+				goto stop;
+			}
+
+			uint32_t instruction;
+			memcpy(&instruction, p, sizeof(instruction));
+
+			decoded[index] = decode_instruction(instruction);
+			d = &decoded[index];
+			imm = (uint32_t)d->imm;
+			JOURNAL_SNAPSHOT();
+
+			DISPATCH();
+			goto fetch;
+		}
+
+		TARGET(ILLEGAL):
+		default:
+			machine->fault_address = pc;
+			status = CPU_STATUS_ILLEGAL_INSTRUCTION;
+			goto stop;
+	}
+
+stop:
+	PROFILE_STOP();
+
+	regs[0] 		  = 0;
+	machine->pc 	  = pc;
+	machine->instret += executed;
+
+	return status;
+
+#undef FETCH
+#undef RETIRE
+#undef TARGET
+#undef DISPATCH
+#undef NEXT
+#undef JOURNAL_SNAPSHOT
+#undef JOURNAL_STORE
+#undef JOURNAL_RETIRE
+#undef PROFILE_RETIRE
+#undef PROFILE_LOAD
+#undef PROFILE_STORE
+#undef PROFILE_SPLIT
+#undef PREDICT_BRANCH
+#undef PREDICT_JUMP
+#undef PROFILE_STOP
+#undef TRACE_RETIRE
+#undef TRACE_LOAD
+#undef TRACE_STORE
+#undef DEBUGGER_FETCH
+#undef DEBUGGER_STORE
+#undef DEBUGGER_JUMP
+}
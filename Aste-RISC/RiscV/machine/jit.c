@@ -0,0 +1,929 @@
+/**
+ * @file jit.c
+ * @brief Basic-block translator from RV32I to x86-64 host code.
+ *
+ * A block starts at a hot pc and runs until the first control transfer or
+ * system instruction. Guest registers stay in the machine struct, the
+ * generated code keeps the machine pointer in rbx and reads/writes the
+ * registers with rbx-relative operands. Loads and stores call back into C
+ * so they follow the same bounds rules as the interpreter.
+ *
+ * Generated block layout:
+ *
+ *   push rbx; mov rbx, rdi          entry, called from jit_run
+ *   cmp  budget, n; jb exit         body, target of chained jumps
+ *   sub  budget, n
+ *   inc  hits[block]                only when the machine is profiled
+ *   ...translated instructions...
+ *   jmp  next block | exit to C
+ *   ...out of line fault exits...
+ *
+ * A profiled block counts its entries, jit_fold_profile spreads them over
+ * its words. Exits in the middle of a block record where the block ends,
+ * jit_run then takes back the words that did not retire.
+ */
+
+#include "jit.h"
+#include "profile.h"
+
+#if defined(__x86_64__) && defined(__linux__)
+
+#include <stddef.h>
+#include <sys/mman.h>
+
+#define JIT_BUFFER_SIZE   (16u << 20) // executable buffer, 16 MiB
+#define JIT_HOT_THRESHOLD 16          // cold executions before translating
+#define JIT_MAX_BLOCK     64          // guest instructions per block
+#define JIT_NEVER         0xFFFF      // block start that can not be translated
+#define JIT_ENTRY_SIZE    4           // bytes of push rbx; mov rbx, rdi
+#define JIT_EXIT_CONTINUE 0xFFu       // block exit code: pc updated, keep running
+
+// Host registers used by the generated code
+#define EAX 0
+#define ECX 1
+#define EDX 2
+#define ESI 6
+
+typedef uint32_t (*jit_block_t)(MACHINE machine);
+
+/**
+ * @brief Jump waiting for the block at target_index to be translated.
+ */
+typedef struct {
+	uint32_t  target_index;
+	uint8_t  *site;
+
+} jit_patch_t;
+
+/**
+ * @brief Translator state.
+ *
+ * buffer Executable memory holding the generated code.
+ * used Bytes of buffer already used.
+ * entries Start of the translated block for each .text word, or NULL.
+ * heat Cold executions of each block start.
+ * lengths Guest instructions of the block translated at each start.
+ * hits Entries of each profiled block not folded into the profile yet.
+ * cut_end Word after the last block left before its end, 0 for none.
+ * patches Chained jumps whose target is not translated yet.
+ * count Number of .text words covered by the tables.
+ * flush_pending Translations are stale, drop them at the next exit to C.
+ */
+struct jit {
+	uint8_t  *buffer;
+	size_t    used;
+
+	uint8_t  **entries;
+	uint16_t  *heat;
+	uint8_t   *lengths;
+	uint64_t  *hits;
+	uint32_t   cut_end;
+
+	jit_patch_t *patches;
+	size_t       patch_count;
+	size_t       patch_capacity;
+
+	uint32_t count;
+	bool     flush_pending;
+};
+
+/**
+ * @brief Out of line exit emitted after the block body.
+ */
+typedef enum {
+	STUB_BUDGET,
+	STUB_LOAD_FAULT,
+	STUB_STORE
+
+} stub_kind_t;
+
+typedef struct {
+	stub_kind_t kind;
+	uint32_t    position; // instruction index inside the block
+	uint8_t    *site;     // rel32 of the jump to patch
+
+} jit_stub_t;
+
+// MARK: - Emitter
+
+typedef struct {
+	uint8_t *cursor;
+	uint8_t *end;
+	bool     overflow;
+
+} emitter_t;
+
+static inline void emit8(emitter_t *e, uint8_t byte) {
+	if (e->cursor < e->end) *e->cursor++ = byte;
+	else e->overflow = true;
+}
+
+static inline void emit32(emitter_t *e, uint32_t value) {
+	for (int i = 0; i < 4; i++) emit8(e, (uint8_t)(value >> (i * 8)));
+}
+
+static inline void emit64(emitter_t *e, uint64_t value) {
+	emit32(e, (uint32_t)value);
+	emit32(e, (uint32_t)(value >> 32));
+}
+
+static inline void patch_rel32(uint8_t *site, const uint8_t *target) {
+	const int32_t rel = (int32_t)(target - (site + 4));
+	memcpy(site, &rel, sizeof(rel));
+}
+
+static inline uint32_t register_offset(uint32_t index) {
+	return (uint32_t)(offsetof(struct machine, registers) + index * 4);
+}
+
+/// ModRM for [rbx + disp32] with the given reg field
+static inline void emit_rbx_operand(emitter_t *e, uint32_t reg, uint32_t displacement) {
+	emit8(e, (uint8_t)(0x80 | reg << 3 | 3));
+	emit32(e, displacement);
+}
+
+/// mov host, guest register (x0 reads as zero)
+static void emit_load_guest(emitter_t *e, uint32_t host, uint32_t guest) {
+	if (guest == 0) {
+		emit8(e, 0x31);
+		emit8(e, (uint8_t)(0xC0 | host << 3 | host));
+		return;
+	}
+
+	emit8(e, 0x8B);
+	emit_rbx_operand(e, host, register_offset(guest));
+}
+
+/// mov guest register, host (writes to x0 are dropped)
+static void emit_store_guest(emitter_t *e, uint32_t guest, uint32_t host) {
+	if (guest == 0) return;
+
+	emit8(e, 0x89);
+	emit_rbx_operand(e, host, register_offset(guest));
+}
+
+/// mov dword [rbx + displacement], imm32
+static void emit_store_imm(emitter_t *e, uint32_t displacement, uint32_t value) {
+	emit8(e, 0xC7);
+	emit_rbx_operand(e, 0, displacement);
+	emit32(e, value);
+}
+
+/// op eax, ecx
+static void emit_alu_rr(emitter_t *e, uint8_t opcode) {
+	emit8(e, opcode);
+	emit8(e, 0xC8);
+}
+
+/// op eax, imm32 with the group 1 extension
+static void emit_alu_ri(emitter_t *e, uint32_t extension, uint32_t imm) {
+	emit8(e, 0x81);
+	emit8(e, (uint8_t)(0xC0 | extension << 3));
+	emit32(e, imm);
+}
+
+/// shift eax by cl, or by an immediate with the group 2 extension
+static void emit_shift(emitter_t *e, uint32_t extension, bool by_immediate, uint8_t amount) {
+	emit8(e, by_immediate ? 0xC1 : 0xD3);
+	emit8(e, (uint8_t)(0xC0 | extension << 3));
+	if (by_immediate) emit8(e, amount);
+}
+
+/// setcc al; movzx eax, al
+static void emit_set_condition(emitter_t *e, uint8_t condition) {
+	emit8(e, 0x0F); emit8(e, condition); emit8(e, 0xC0);
+	emit8(e, 0x0F); emit8(e, 0xB6); emit8(e, 0xC0);
+}
+
+/// op qword [rbx + jit_budget], imm32 with the group 1 extension
+static void emit_budget(emitter_t *e, uint32_t extension, uint32_t value) {
+	emit8(e, 0x48);
+	emit8(e, 0x81);
+	emit_rbx_operand(e, extension, (uint32_t)offsetof(struct machine, jit_budget));
+	emit32(e, value);
+}
+
+/// jcc rel32, returns the displacement to patch
+static uint8_t *emit_jcc(emitter_t *e, uint8_t condition) {
+	emit8(e, 0x0F);
+	emit8(e, condition);
+
+	uint8_t *site = e->cursor;
+	emit32(e, 0);
+
+	return site;
+}
+
+/// jmp rel32 to the next instruction, returns the displacement to patch
+static uint8_t *emit_jmp(emitter_t *e) {
+	emit8(e, 0xE9);
+
+	uint8_t *site = e->cursor;
+	emit32(e, 0);
+
+	return site;
+}
+
+/// mov eax, code; pop rbx; ret
+static void emit_return(emitter_t *e, uint32_t code) {
+	emit8(e, 0xB8);
+	emit32(e, code);
+	emit8(e, 0x5B);
+	emit8(e, 0xC3);
+}
+
+/// Leave the block with pc set to a constant
+static void emit_exit(emitter_t *e, uint32_t pc, uint32_t code) {
+	emit_store_imm(e, (uint32_t)offsetof(struct machine, pc), pc);
+	emit_return(e, code);
+}
+
+/// Call a C helper with the machine as first argument
+static void emit_call(emitter_t *e, const void *function) {
+	uint64_t address;
+	memcpy(&address, &function, sizeof(address));
+
+	emit8(e, 0x48); emit8(e, 0x89); emit8(e, 0xDF); // mov rdi, rbx
+	emit8(e, 0x48); emit8(e, 0xB8); emit64(e, address); // mov rax, imm64
+	emit8(e, 0xFF); emit8(e, 0xD0); // call rax
+}
+
+/// mov rcx, imm64 with the host address of a counter
+static void emit_counter_address(emitter_t *e, const void *counter) {
+	uint64_t address;
+	memcpy(&address, &counter, sizeof(address));
+
+	emit8(e, 0x48); emit8(e, 0xB9); emit64(e, address);
+}
+
+// MARK: - Memory helpers
+
+/**
+ * @brief Load called by translated code.
+ * @param handler One of HANDLER_LB ... HANDLER_LHU.
+ *
+ * @return The extended value as 32 bits, or -1 when the access faults.
+ */
+static int64_t jit_helper_load(
+	MACHINE  machine,
+	uint32_t address,
+	uint32_t handler
+) {
+	const RAM ram = machine->ram;
+
+	uint32_t value = 0;
+	ram_access_t access;
+
+	switch (handler) {
+		case HANDLER_LB:  access = ram_load8(ram, address, &value);   break;
+		case HANDLER_LH:  access = ram_load16(ram, address, &value);  break;
+		case HANDLER_LBU: access = ram_load8u(ram, address, &value);  break;
+		case HANDLER_LHU: access = ram_load16u(ram, address, &value); break;
+		default: 		  access = ram_load32(ram, address, &value);  break;
+	}
+
+	if (access != RAM_ACCESS_OK) {
+		machine->fault_address = address;
+		machine->fault_access  = access;
+		return -1;
+	}
+
+	if (machine->profile) profile_load(machine->profile, ram, address);
+
+	return value;
+}
+
+/**
+ * @brief Store called by translated code.
+ *
+ * @return 0 on success, 1 when the access faults, 2 when .text was
+ * modified and the running translations must be left.
+ */
+static uint32_t jit_helper_store(
+	MACHINE  machine,
+	uint32_t address,
+	uint32_t value,
+	uint32_t width
+) {
+	const RAM ram = machine->ram;
+
+	const ram_access_t access = ram_store(ram, address, width, value);
+	if (access != RAM_ACCESS_OK) {
+		machine->fault_address = address;
+		machine->fault_access  = access;
+		return 1;
+	}
+
+	if (machine->profile) profile_store(machine->profile, ram, address);
+
+	if (address - ram->text_base < ram->text_size) {
+		invalidate_decoded_text(machine, address, width);
+		return 2;
+	}
+
+	return 0;
+}
+
+// MARK: - Translation
+
+static bool is_translatable(handler_id_t handler) {
+	return handler >= HANDLER_ADD && handler < HANDLER_COUNT;
+}
+
+static bool ends_block(handler_id_t handler) {
+	return (handler >= HANDLER_JAL && handler <= HANDLER_BGEU) ||
+		   handler == HANDLER_ECALL || handler == HANDLER_EBREAK;
+}
+
+static void add_patch(
+	struct jit *jit,
+	uint32_t 	target_index,
+	uint8_t    *site
+) {
+	if (jit->patch_count == jit->patch_capacity) {
+		const size_t capacity = jit->patch_capacity ? jit->patch_capacity * 2 : 64;
+
+		jit_patch_t *patches = realloc(jit->patches, capacity * sizeof(jit_patch_t));
+		if (!patches) return; // the jump keeps exiting to C
+
+		jit->patches 		= patches;
+		jit->patch_capacity = capacity;
+	}
+
+	jit->patches[jit->patch_count++] = (jit_patch_t){ target_index, site };
+}
+
+/**
+ * @brief Jump to the block at target, or exit to C and remember the jump
+ * so it is chained once the target is translated.
+ */
+static void emit_chain(
+	struct jit 	  *jit,
+	MACHINE 	   machine,
+	emitter_t 	  *e,
+	uint32_t 	   target
+) {
+	const uint32_t target_index = (target - machine->decoded_base) >> 2;
+	const bool 	   chainable 	= !(target & 0x3) && target_index < jit->count;
+
+	uint8_t *site = emit_jmp(e);
+
+	if (chainable && jit->entries[target_index]) {
+		patch_rel32(site, jit->entries[target_index] + JIT_ENTRY_SIZE);
+
+	} else if (chainable) {
+		add_patch(jit, target_index, site);
+	}
+
+	emit_exit(e, target, JIT_EXIT_CONTINUE);
+}
+
+/**
+ * @brief Translate the block starting at index.
+ *
+ * @return Entry of the generated code, NULL if the first instruction can
+ * not be translated or the buffer is full (flush_pending is then set).
+ */
+static uint8_t *translate_block(
+	struct jit *jit,
+	MACHINE 	machine,
+	uint32_t 	index
+) {
+	const decoded_instruction_t *decoded = machine->decoded;
+
+	// Collect the block
+	uint32_t length = 0;
+	while (length < JIT_MAX_BLOCK && index + length < jit->count) {
+		const handler_id_t handler = decoded[index + length].handler;
+		if (!is_translatable(handler)) break;
+
+		length++;
+		if (ends_block(handler)) break;
+	}
+
+	if (length == 0) return NULL;
+
+	emitter_t e = {
+		.cursor   = jit->buffer + jit->used,
+		.end      = jit->buffer + JIT_BUFFER_SIZE,
+		.overflow = false
+	};
+
+	jit_stub_t stubs[JIT_MAX_BLOCK + 1];
+	uint32_t   stub_count = 0;
+
+	const uint32_t block_pc = machine->decoded_base + index * 4;
+	uint8_t *entry = e.cursor;
+
+	// Entry, called from C
+	emit8(&e, 0x53);                               // push rbx
+	emit8(&e, 0x48); emit8(&e, 0x89); emit8(&e, 0xFB); // mov rbx, rdi
+
+	// Body, chained jumps land here
+	emit_budget(&e, 7, length);                    // cmp budget, length
+	stubs[stub_count++] = (jit_stub_t){ STUB_BUDGET, 0, emit_jcc(&e, 0x82) }; // jb
+	emit_budget(&e, 5, length);                    // sub budget, length
+
+	const bool profiled = machine->profile != NULL;
+
+	if (profiled) {
+		emit_counter_address(&e, &jit->hits[index]);
+		emit8(&e, 0x48); emit8(&e, 0xFF); emit8(&e, 0x01); // inc qword [rcx]
+	}
+
+	bool terminated = false;
+
+	for (uint32_t i = 0; i < length; i++) {
+		const decoded_instruction_t *d = &decoded[index + i];
+		const uint32_t pc  = block_pc + i * 4;
+		const uint32_t imm = (uint32_t)d->imm;
+
+		switch ((handler_id_t)d->handler) {
+
+			// MARK: R-Type
+			case HANDLER_ADD: case HANDLER_SUB: case HANDLER_XOR:
+			case HANDLER_OR:  case HANDLER_AND: case HANDLER_SLT:
+			case HANDLER_SLTU: {
+				if (d->rd == 0) break;
+
+				emit_load_guest(&e, EAX, d->rs1);
+				emit_load_guest(&e, ECX, d->rs2);
+
+				switch (d->handler) {
+					case HANDLER_ADD: emit_alu_rr(&e, 0x01); break;
+					case HANDLER_SUB: emit_alu_rr(&e, 0x29); break;
+					case HANDLER_XOR: emit_alu_rr(&e, 0x31); break;
+					case HANDLER_OR:  emit_alu_rr(&e, 0x09); break;
+					case HANDLER_AND: emit_alu_rr(&e, 0x21); break;
+					case HANDLER_SLT:  emit_alu_rr(&e, 0x39); emit_set_condition(&e, 0x9C); break;
+					default:           emit_alu_rr(&e, 0x39); emit_set_condition(&e, 0x92); break;
+				}
+
+				emit_store_guest(&e, d->rd, EAX);
+				break;
+			}
+
+			// x86 masks the shift count to 5 bits like RV32I
+			case HANDLER_SLL: case HANDLER_SRL: case HANDLER_SRA:
+				if (d->rd == 0) break;
+
+				emit_load_guest(&e, EAX, d->rs1);
+				emit_load_guest(&e, ECX, d->rs2);
+				emit_shift(&e, d->handler == HANDLER_SLL ? 4 : d->handler == HANDLER_SRL ? 5 : 7, false, 0);
+				emit_store_guest(&e, d->rd, EAX);
+
+				break;
+
+			// MARK: I-Type arithmetic
+			case HANDLER_ADDI: case HANDLER_XORI: case HANDLER_ORI:
+			case HANDLER_ANDI: case HANDLER_SLTI: case HANDLER_SLTIU:
+				if (d->rd == 0) break;
+
+				emit_load_guest(&e, EAX, d->rs1);
+
+				switch (d->handler) {
+					case HANDLER_ADDI: emit_alu_ri(&e, 0, imm); break;
+					case HANDLER_XORI: emit_alu_ri(&e, 6, imm); break;
+					case HANDLER_ORI:  emit_alu_ri(&e, 1, imm); break;
+					case HANDLER_ANDI: emit_alu_ri(&e, 4, imm); break;
+					case HANDLER_SLTI: emit_alu_ri(&e, 7, imm); emit_set_condition(&e, 0x9C); break;
+					default:           emit_alu_ri(&e, 7, imm); emit_set_condition(&e, 0x92); break;
+				}
+
+				emit_store_guest(&e, d->rd, EAX);
+				break;
+
+			case HANDLER_SLLI: case HANDLER_SRLI: case HANDLER_SRAI:
+				if (d->rd == 0) break;
+
+				emit_load_guest(&e, EAX, d->rs1);
+				emit_shift(&e, d->handler == HANDLER_SLLI ? 4 : d->handler == HANDLER_SRLI ? 5 : 7, true, (uint8_t)imm);
+				emit_store_guest(&e, d->rd, EAX);
+
+				break;
+
+			// MARK: Upper immediates
+			case HANDLER_LUI:
+				if (d->rd) emit_store_imm(&e, register_offset(d->rd), imm);
+				break;
+
+			case HANDLER_AUIPC:
+				if (d->rd) emit_store_imm(&e, register_offset(d->rd), pc + imm);
+				break;
+
+			// MARK: Memory
+			case HANDLER_LB: case HANDLER_LH: case HANDLER_LW:
+			case HANDLER_LBU: case HANDLER_LHU:
+				emit_load_guest(&e, EAX, d->rs1);
+				emit_alu_ri(&e, 0, imm);
+				emit8(&e, 0x89); emit8(&e, 0xC6);        // mov esi, eax
+				emit8(&e, 0xBA); emit32(&e, d->handler); // mov edx, handler
+				emit_call(&e, (const void *)jit_helper_load);
+				emit8(&e, 0x48); emit8(&e, 0x85); emit8(&e, 0xC0); // test rax, rax
+				stubs[stub_count++] = (jit_stub_t){ STUB_LOAD_FAULT, i, emit_jcc(&e, 0x88) }; // js
+				emit_store_guest(&e, d->rd, EAX);
+
+				break;
+
+			case HANDLER_SB: case HANDLER_SH: case HANDLER_SW:
+				emit_load_guest(&e, EAX, d->rs1);
+				emit_alu_ri(&e, 0, imm);
+				emit8(&e, 0x89); emit8(&e, 0xC6);        // mov esi, eax
+				emit_load_guest(&e, EDX, d->rs2);
+				emit8(&e, 0xB9); emit32(&e, 1u << (d->handler - HANDLER_SB)); // mov ecx, width
+				emit_call(&e, (const void *)jit_helper_store);
+				emit8(&e, 0x85); emit8(&e, 0xC0);        // test eax, eax
+				stubs[stub_count++] = (jit_stub_t){ STUB_STORE, i, emit_jcc(&e, 0x85) }; // jne
+
+				break;
+
+			// MARK: Control transfer
+			case HANDLER_JAL:
+				if (d->rd) emit_store_imm(&e, register_offset(d->rd), pc + 4);
+				emit_chain(jit, machine, &e, pc + imm);
+				terminated = true;
+
+				break;
+
+			case HANDLER_JALR:
+				emit_load_guest(&e, EAX, d->rs1);
+				emit_alu_ri(&e, 0, imm);
+				emit_alu_ri(&e, 4, ~1u);
+				if (d->rd) emit_store_imm(&e, register_offset(d->rd), pc + 4);
+				emit8(&e, 0x89);                         // mov [rbx + pc], eax
+				emit_rbx_operand(&e, EAX, (uint32_t)offsetof(struct machine, pc));
+				emit_return(&e, JIT_EXIT_CONTINUE);
+				terminated = true;
+
+				break;
+
+			// Both successors are chained, the jcc skips the taken one
+			case HANDLER_BEQ: case HANDLER_BNE:  case HANDLER_BLT:
+			case HANDLER_BGE: case HANDLER_BLTU: case HANDLER_BGEU: {
+				static const uint8_t not_taken[6] = { 0x85, 0x84, 0x8D, 0x8C, 0x83, 0x82 }; // jne je jge jl jae jb
+
+				emit_load_guest(&e, EAX, d->rs1);
+				emit_load_guest(&e, ECX, d->rs2);
+				emit_alu_rr(&e, 0x39);                   // cmp eax, ecx
+
+				uint8_t *skip = emit_jcc(&e, not_taken[d->handler - HANDLER_BEQ]);
+				emit_chain(jit, machine, &e, pc + imm);
+				if (!e.overflow) patch_rel32(skip, e.cursor);
+
+				emit_chain(jit, machine, &e, pc + 4);
+				terminated = true;
+
+				break;
+			}
+
+			// MARK: System
+			case HANDLER_ECALL:
+			case HANDLER_EBREAK:
+				emit_exit(&e, pc + 4, d->handler == HANDLER_ECALL ? CPU_STATUS_ECALL : CPU_STATUS_EBREAK);
+				terminated = true;
+
+				break;
+
+			default:
+				break;
+		}
+	}
+
+	// Block cut by its size or by an untranslatable instruction
+	if (!terminated) emit_chain(jit, machine, &e, block_pc + length * 4);
+
+	// MARK: Out of line exits
+	for (uint32_t s = 0; s < stub_count; s++) {
+		const jit_stub_t stub = stubs[s];
+		const uint32_t   pc   = block_pc + stub.position * 4;
+
+		if (e.overflow) break;
+		patch_rel32(stub.site, e.cursor);
+
+		// The words after the exit did not retire, eax is still live
+		if (profiled && stub.kind != STUB_BUDGET) {
+			emit_counter_address(&e, &jit->cut_end);
+			emit8(&e, 0xC7); emit8(&e, 0x01); emit32(&e, index + length); // mov dword [rcx], end
+		}
+
+		switch (stub.kind) {
+
+			// Not enough budget for the whole block, nothing ran yet
+			case STUB_BUDGET:
+				emit_exit(&e, block_pc, JIT_EXIT_CONTINUE);
+				break;
+
+			// Refund the instructions that did not retire
+			case STUB_LOAD_FAULT:
+				emit_budget(&e, 0, length - stub.position);
+				emit_exit(&e, pc, CPU_STATUS_LOAD_FAULT);
+				break;
+
+			case STUB_STORE: {
+				emit8(&e, 0x83); emit8(&e, 0xF8); emit8(&e, 0x01); // cmp eax, 1
+				emit8(&e, 0x75);                                     // jne modified
+				uint8_t *skip = e.cursor;
+				emit8(&e, 0);
+
+				emit_budget(&e, 0, length - stub.position);
+				emit_exit(&e, pc, CPU_STATUS_STORE_FAULT);
+				*skip = (uint8_t)(e.cursor - (skip + 1));
+
+				// Store retired but .text changed, leave the translations
+				emit_budget(&e, 0, length - stub.position - 1);
+				emit_exit(&e, pc + 4, JIT_EXIT_CONTINUE);
+				break;
+			}
+		}
+	}
+
+	if (e.overflow) {
+		jit->flush_pending = true;
+		return NULL;
+	}
+
+	jit->used = (size_t)(e.cursor - jit->buffer);
+	jit->entries[index] = entry;
+	jit->lengths[index] = (uint8_t)length;
+
+	// Chain the jumps that were waiting for this block
+	for (size_t p = 0; p < jit->patch_count;) {
+		if (jit->patches[p].target_index == index) {
+			patch_rel32(jit->patches[p].site, entry + JIT_ENTRY_SIZE);
+			jit->patches[p] = jit->patches[--jit->patch_count];
+
+		} else { p++; }
+	}
+
+	return entry;
+}
+
+// MARK: - Lifecycle
+
+/**
+ * @brief Drop every translation and size the tables for count words.
+ */
+static bool jit_reset(
+	struct jit *jit,
+	uint32_t 	count
+) {
+	const size_t words = count ? count : 1;
+
+	if (count != jit->count) {
+		uint8_t  **entries = calloc(words, sizeof(uint8_t *));
+		uint16_t  *heat    = calloc(words, sizeof(uint16_t));
+		uint8_t   *lengths = calloc(words, sizeof(uint8_t));
+		uint64_t  *hits    = calloc(words, sizeof(uint64_t));
+
+		if (!entries || !heat || !lengths || !hits) {
+			free(entries);
+			free(heat);
+			free(lengths);
+			free(hits);
+			return false;
+		}
+
+		free(jit->entries);
+		free(jit->heat);
+		free(jit->lengths);
+		free(jit->hits);
+
+		jit->entries = entries;
+		jit->heat 	 = heat;
+		jit->lengths = lengths;
+		jit->hits 	 = hits;
+		jit->count 	 = count;
+
+	} else {
+		memset(jit->entries, 0, words * sizeof(uint8_t *));
+		memset(jit->heat, 0, words * sizeof(uint16_t));
+		memset(jit->lengths, 0, words * sizeof(uint8_t));
+		memset(jit->hits, 0, words * sizeof(uint64_t));
+	}
+
+	jit->used 		   = 0;
+	jit->cut_end 	   = 0;
+	jit->patch_count   = 0;
+	jit->flush_pending = false;
+
+	return true;
+}
+
+bool jit_available(void) {
+	return true;
+}
+
+bool enable_jit(MACHINE machine) {
+	if (!machine || !machine->ram) return false;
+	if (machine->jit) return true;
+
+	const RAM ram = machine->ram;
+	if (!machine->decoded && !load_decoded_text(machine, NULL, ram->text_size, ram->text_base)) {
+		return false;
+	}
+
+	struct jit *jit = calloc(1, sizeof(struct jit));
+	if (!jit) return false;
+
+	jit->buffer = mmap(
+		NULL,
+		JIT_BUFFER_SIZE,
+		PROT_READ | PROT_WRITE | PROT_EXEC,
+		MAP_PRIVATE | MAP_ANONYMOUS,
+		-1,
+		0
+	);
+
+	if (jit->buffer == MAP_FAILED) {
+		free(jit);
+		return false;
+	}
+
+	jit->count = UINT32_MAX; // force the allocation of the tables
+	if (!jit_reset(jit, machine->decoded_count)) {
+		jit->count = 0;
+		destroy_jit(jit);
+		return false;
+	}
+
+	machine->jit = jit;
+
+	return true;
+}
+
+void destroy_jit(struct jit *jit) {
+	if (!jit) return;
+
+	if (jit->buffer && jit->buffer != MAP_FAILED) munmap(jit->buffer, JIT_BUFFER_SIZE);
+
+	free(jit->entries);
+	free(jit->heat);
+	free(jit->lengths);
+	free(jit->hits);
+	free(jit->patches);
+	free(jit);
+}
+
+void jit_invalidate(struct jit *jit) {
+	if (jit) jit->flush_pending = true;
+}
+
+void jit_fold_profile(MACHINE machine) {
+	struct jit *jit = machine ? machine->jit : NULL;
+	if (!jit || !jit->hits) return;
+
+	PROFILE profile = machine->profile;
+	const bool counted = profile && profile->counts && profile->count == jit->count;
+
+	for (uint32_t i = 0; i < jit->count; i++) {
+		const uint64_t hits = jit->hits[i];
+		if (!hits) continue;
+
+		if (counted) {
+			for (uint32_t k = 0; k < jit->lengths[i]; k++) profile->counts[i + k] += hits;
+		}
+
+		jit->hits[i] = 0;
+	}
+}
+
+// MARK: - Run loop
+
+/**
+ * @brief Number of instructions the interpreter runs for a cold block,
+ * up to and including its terminator.
+ */
+static uint64_t cold_block_length(
+	MACHINE  machine,
+	uint32_t index
+) {
+	uint64_t length = 0;
+
+	while (index + length < machine->decoded_count && length < JIT_MAX_BLOCK) {
+		const handler_id_t handler = machine->decoded[index + length].handler;
+		length++;
+
+		if (ends_block(handler) || !is_translatable(handler)) break;
+	}
+
+	return length ? length : 1;
+}
+
+cpu_status_t jit_run(
+	MACHINE  machine,
+	uint64_t max_instructions
+) {
+	struct jit *jit = machine ? machine->jit : NULL;
+	if (!jit) return cpu_interpret(machine, max_instructions);
+
+	if (jit->count != machine->decoded_count && !jit_reset(jit, machine->decoded_count)) {
+		return cpu_interpret(machine, max_instructions);
+	}
+
+	// Words of translated code are counted in the same layout
+	PROFILE profile = machine->profile;
+	if (profile && !profile_prepare(machine)) profile = NULL;
+
+	uint64_t 	 executed = 0;
+	cpu_status_t status   = CPU_STATUS_BUDGET_EXHAUSTED;
+
+	while (executed < max_instructions) {
+
+		// Never recycle the buffer while translated code is running
+		if (jit->flush_pending) {
+			jit_fold_profile(machine);
+			jit_reset(jit, machine->decoded_count);
+		}
+
+		const uint32_t pc 	 = machine->pc;
+		const uint32_t index = (pc - machine->decoded_base) >> 2;
+
+		uint8_t *entry = NULL;
+
+		if (index < jit->count && !(pc & 0x3)) {
+			entry = jit->entries[index];
+
+			if (!entry && jit->heat[index] != JIT_NEVER && ++jit->heat[index] >= JIT_HOT_THRESHOLD) {
+				entry = translate_block(jit, machine, index);
+				if (!entry && !jit->flush_pending) jit->heat[index] = JIT_NEVER;
+			}
+		}
+
+		// MARK: Hot path, translated code
+		if (entry) {
+			jit_block_t block;
+			memcpy(&block, &entry, sizeof(block));
+
+			const uint64_t budget = max_instructions - executed;
+			machine->jit_budget = budget;
+
+			const uint32_t code = block(machine);
+			const uint64_t done = budget - machine->jit_budget;
+
+			executed 		 += done;
+			machine->instret += done;
+
+			// The block was counted whole, take back the words after the exit
+			if (jit->cut_end) {
+				const uint32_t from = (machine->pc - machine->decoded_base) >> 2;
+				if (profile) for (uint32_t i = from; i < jit->cut_end; i++) profile->counts[i]--;
+
+				jit->cut_end = 0;
+			}
+
+			if (code != JIT_EXIT_CONTINUE) {
+				status = (cpu_status_t)code;
+				break;
+			}
+
+			// No progress means the budget is smaller than the block
+			if (done > 0) continue;
+		}
+
+		// MARK: Cold path, interpret one block
+		uint64_t length = cold_block_length(machine, index);
+		if (length > max_instructions - executed) length = max_instructions - executed;
+
+		const uint64_t before = machine->instret;
+		status = cpu_interpret(machine, length);
+		executed += machine->instret - before;
+
+		if (status != CPU_STATUS_BUDGET_EXHAUSTED) break;
+	}
+
+	return status;
+}
+
+#else
+
+// MARK: - Unsupported hosts
+
+bool jit_available(void) {
+	return false;
+}
+
+bool enable_jit(MACHINE machine) {
+	(void)machine;
+	return false;
+}
+
+void destroy_jit(struct jit *jit) {
+	(void)jit;
+}
+
+void jit_invalidate(struct jit *jit) {
+	(void)jit;
+}
+
+void jit_fold_profile(MACHINE machine) {
+	(void)machine;
+}
+
+cpu_status_t jit_run(
+	MACHINE  machine,
+	uint64_t max_instructions
+) {
+	return cpu_interpret(machine, max_instructions);
+}
+
+#endif
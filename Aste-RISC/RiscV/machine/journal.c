@@ -0,0 +1,166 @@
+/**
+ * @file journal.c
+ * @brief Bounded reverse-execution journal.
+ */
+
+#include "journal.h"
+
+JOURNAL new_journal(size_t max_bytes) {
+	size_t capacity = max_bytes / sizeof(journal_record_t);
+	if (capacity == 0) capacity = 1;
+	if (capacity > UINT32_MAX) capacity = UINT32_MAX;
+
+	JOURNAL journal = calloc(1, sizeof(struct journal));
+	if (!journal) return NULL;
+
+	journal->records = malloc(capacity * sizeof(journal_record_t));
+	if (!journal->records) {
+		free(journal);
+		return NULL;
+	}
+
+	journal->capacity = (uint32_t)capacity;
+
+	return journal;
+}
+
+bool destroy_journal(JOURNAL journal) {
+	if (!journal) return false;
+
+	free(journal->records);
+	free(journal);
+
+	return true;
+}
+
+void journal_clear(JOURNAL journal) {
+	if (!journal) return;
+
+	journal->head 	   = 0;
+	journal->count 	   = 0;
+	journal->steps 	   = 0;
+	journal->step_open = false;
+}
+
+bool enable_journal(
+	MACHINE machine,
+	size_t 	max_bytes
+) {
+	if (!machine) return false;
+
+	JOURNAL journal = new_journal(max_bytes);
+	if (!journal) return false;
+
+	destroy_journal(machine->journal);
+	machine->journal = journal;
+
+	return true;
+}
+
+// MARK: - Recording
+
+void journal_begin_step(
+	JOURNAL  journal,
+	uint32_t pc
+) {
+	if (!journal) return;
+
+	journal->step_open = true;
+	journal->step_pc   = pc & ~JOURNAL_FLAGS;
+}
+
+/**
+ * @brief Push a record of the current step, the first one opens the step.
+ */
+static void journal_record(
+	JOURNAL  journal,
+	uint32_t flags,
+	uint32_t location,
+	uint32_t old_value
+) {
+	if (!journal) return;
+
+	if (journal->step_open) {
+		flags |= JOURNAL_STEP_START;
+		journal->step_open = false;
+	}
+
+	journal_push(journal, journal->step_pc | flags, location, old_value);
+}
+
+void journal_record_register(
+	JOURNAL  journal,
+	uint32_t index,
+	uint32_t old_value
+) {
+	journal_record(journal, 0, index & 0x1F, old_value);
+}
+
+void journal_record_memory(
+	JOURNAL  journal,
+	uint32_t address,
+	uint32_t old_value
+) {
+	journal_record(journal, JOURNAL_MEMORY, address & ~0x3u, old_value);
+}
+
+void journal_end_step(JOURNAL journal) {
+	if (!journal || !journal->step_open) return;
+
+	// Writing x0 back to zero is a no-op, it only carries the pc
+	journal_record(journal, 0, 0, 0);
+}
+
+// MARK: - Rewinding
+
+uint64_t journal_rewind(
+	MACHINE  machine,
+	uint64_t steps
+) {
+	if (!machine || !machine->journal) return 0;
+
+	JOURNAL journal = machine->journal;
+	const RAM ram 	= machine->ram;
+
+	uint64_t undone = 0;
+	journal->step_open = false;
+
+	while (undone < steps && journal->count > 0) {
+		journal->head = journal->head ? journal->head - 1 : journal->capacity - 1;
+		journal->count--;
+
+		const journal_record_t record = journal->records[journal->head];
+
+		if (record.tag & JOURNAL_MEMORY) {
+			uint8_t *p = machine_translate_store(ram, record.location, 4);
+			if (p) {
+				memcpy(p, &record.old_value, sizeof(record.old_value));
+
+				if (record.location - ram->text_base < ram->text_size) {
+					invalidate_decoded_text(machine, record.location, 4);
+				}
+			}
+
+		} else if (record.location == JOURNAL_HEAP_BREAK) {
+			ram_brk(ram, record.old_value);
+
+		} else {
+			machine->registers[record.location] = record.old_value;
+		}
+
+		if (record.tag & JOURNAL_STEP_START) {
+			machine->pc = record.tag & ~JOURNAL_FLAGS;
+			undone++;
+		}
+	}
+
+	machine->registers[0] = 0;
+	journal->steps -= undone < journal->steps ? undone : journal->steps;
+	machine->instret -= undone < machine->instret ? undone : machine->instret;
+
+	return undone;
+}
+
+uint64_t journal_steps(const JOURNAL journal) {
+	return journal ? journal->steps : 0;
+}
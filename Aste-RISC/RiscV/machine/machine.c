@@ -0,0 +1,374 @@
+/**
+ * @file machine.c
+ * @brief Native execution engine, fetch/decode/execute loop over RAM.
+ *
+ * The loop keeps the whole hart state in C and only returns to the caller
+ * at batch boundaries, the Swift side copies registers out afterwards.
+ */
+
+#include "machine.h"
+#include "jit.h"
+#include "journal.h"
+#include "timeline.h"
+#include "syscalls.h"
+#include "profile.h"
+#include "pipeline.h"
+#include "cache.h"
+#include "predictor.h"
+#include "trace.h"
+#include "debugger.h"
+
+MACHINE new_machine(
+	RAM      ram,
+	uint32_t entry_point
+) {
+	if (!ram) return NULL;
+
+	MACHINE machine = calloc(1, sizeof(struct machine));
+	if (!machine) return NULL;
+
+	machine->ram 	  = ram;
+	machine->pc  	  = entry_point;
+	machine->dispatch = MACHINE_HAS_COMPUTED_GOTO ? DISPATCH_THREADED : DISPATCH_SWITCH;
+
+	return machine;
+}
+
+bool destroy_machine(MACHINE machine) {
+	if (!machine) return false;
+
+	destroy_jit(machine->jit);
+	destroy_journal(machine->journal);
+	destroy_timeline(machine->timeline);
+	destroy_syscalls(machine->syscalls);
+	destroy_profile(machine->profile);
+	destroy_pipeline(machine->pipeline);
+	destroy_cache(machine->cache);
+	destroy_predictor(machine->predictor);
+	destroy_trace(machine->trace);
+	destroy_debugger(machine->debugger);
+	free(machine->decoded);
+	free(machine);
+
+	return true;
+}
+
+bool load_decoded_text(
+		  MACHINE  machine,
+	const uint8_t *text_data,
+		  size_t   text_size,
+		  uint32_t text_vaddr
+) {
+	if (!machine) return false;
+
+	uint32_t count = 0;
+	decoded_instruction_t *decoded = predecode_section(text_data, text_size, &count);
+	if (!decoded && count > 0) return false;
+
+	free(machine->decoded);
+
+	machine->decoded 	   = decoded;
+	machine->decoded_base  = text_vaddr;
+	machine->decoded_count = count;
+
+	if (machine->jit) jit_invalidate(machine->jit);
+	pipeline_invalidate(machine->pipeline);
+
+	return true;
+}
+
+void invalidate_decoded_text(
+	MACHINE  machine,
+	uint32_t address,
+	uint32_t width
+) {
+	const uint32_t first = (address - machine->decoded_base) >> 2;
+	const uint32_t last  = (address + width - 1 - machine->decoded_base) >> 2;
+
+	for (uint32_t index = first; index <= last; index++) {
+		if (index < machine->decoded_count) {
+			machine->decoded[index].handler = HANDLER_UNDECODED;
+		}
+	}
+
+	// Translated blocks and scheduled runs may embed the old instruction
+	if (machine->jit) jit_invalidate(machine->jit);
+	pipeline_invalidate(machine->pipeline);
+}
+
+// MARK: - Run loops
+
+#define INTERPRETER_NAME      interpret_switch
+#define INTERPRETER_THREADED  0
+#define INTERPRETER_JOURNAL   0
+#define INTERPRETER_PROFILE   0
+#define INTERPRETER_PREDICTOR 0
+#define INTERPRETER_TRACE     0
+#define INTERPRETER_DEBUGGER  0
+#include "interpreter_loop.h"
+#undef INTERPRETER_NAME
+#undef INTERPRETER_THREADED
+#undef INTERPRETER_JOURNAL
+#undef INTERPRETER_PROFILE
+#undef INTERPRETER_PREDICTOR
+#undef INTERPRETER_TRACE
+#undef INTERPRETER_DEBUGGER
+
+#if MACHINE_HAS_COMPUTED_GOTO
+#define INTERPRETER_NAME      interpret_threaded
+#define INTERPRETER_THREADED  1
+#define INTERPRETER_JOURNAL   0
+#define INTERPRETER_PROFILE   0
+#define INTERPRETER_PREDICTOR 0
+#define INTERPRETER_TRACE     0
+#define INTERPRETER_DEBUGGER  0
+#include "interpreter_loop.h"
+#undef INTERPRETER_NAME
+#undef INTERPRETER_THREADED
+#undef INTERPRETER_JOURNAL
+#undef INTERPRETER_PROFILE
+#undef INTERPRETER_PREDICTOR
+#undef INTERPRETER_TRACE
+#undef INTERPRETER_DEBUGGER
+#endif
+
+// Counting, timing, cache, trace and debugger loop, kept apart so the plain loops pay nothing for it
+#define INTERPRETER_NAME      interpret_profile
+#define INTERPRETER_THREADED  MACHINE_HAS_COMPUTED_GOTO
+#define INTERPRETER_JOURNAL   0
+#define INTERPRETER_PROFILE   1
+#define INTERPRETER_PREDICTOR 1
+#define INTERPRETER_TRACE     1
+#define INTERPRETER_DEBUGGER  1
+#include "interpreter_loop.h"
+#undef INTERPRETER_NAME
+#undef INTERPRETER_THREADED
+#undef INTERPRETER_JOURNAL
+#undef INTERPRETER_PROFILE
+#undef INTERPRETER_PREDICTOR
+#undef INTERPRETER_TRACE
+#undef INTERPRETER_DEBUGGER
+
+// Prediction loop, only the control transfers pay for it
+#define INTERPRETER_NAME      interpret_predictor
+#define INTERPRETER_THREADED  MACHINE_HAS_COMPUTED_GOTO
+#define INTERPRETER_JOURNAL   0
+#define INTERPRETER_PROFILE   0
+#define INTERPRETER_PREDICTOR 1
+#define INTERPRETER_TRACE     0
+#define INTERPRETER_DEBUGGER  0
+#include "interpreter_loop.h"
+#undef INTERPRETER_NAME
+#undef INTERPRETER_THREADED
+#undef INTERPRETER_JOURNAL
+#undef INTERPRETER_PROFILE
+#undef INTERPRETER_PREDICTOR
+#undef INTERPRETER_TRACE
+#undef INTERPRETER_DEBUGGER
+
+// Debugging loop, it stops on the breakpoints and the watchpoints of a
+// debugger command
+#define INTERPRETER_NAME      interpret_debugger
+#define INTERPRETER_THREADED  MACHINE_HAS_COMPUTED_GOTO
+#define INTERPRETER_JOURNAL   0
+#define INTERPRETER_PROFILE   0
+#define INTERPRETER_PREDICTOR 0
+#define INTERPRETER_TRACE     0
+#define INTERPRETER_DEBUGGER  1
+#include "interpreter_loop.h"
+#undef INTERPRETER_NAME
+#undef INTERPRETER_THREADED
+#undef INTERPRETER_JOURNAL
+#undef INTERPRETER_PROFILE
+#undef INTERPRETER_PREDICTOR
+#undef INTERPRETER_TRACE
+#undef INTERPRETER_DEBUGGER
+
+// Recording loop, it also counts, times, simulates caches and branch
+// prediction, traces and debugs when they are attached
+#define INTERPRETER_NAME      interpret_journal
+#define INTERPRETER_THREADED  MACHINE_HAS_COMPUTED_GOTO
+#define INTERPRETER_JOURNAL   1
+#define INTERPRETER_PROFILE   1
+#define INTERPRETER_PREDICTOR 1
+#define INTERPRETER_TRACE     1
+#define INTERPRETER_DEBUGGER  1
+#include "interpreter_loop.h"
+#undef INTERPRETER_NAME
+#undef INTERPRETER_THREADED
+#undef INTERPRETER_JOURNAL
+#undef INTERPRETER_PROFILE
+#undef INTERPRETER_PREDICTOR
+#undef INTERPRETER_TRACE
+#undef INTERPRETER_DEBUGGER
+
+bool set_dispatch_mode(
+	MACHINE 		machine,
+	dispatch_mode_t mode
+) {
+	if (!machine) return false;
+	if (mode == DISPATCH_THREADED && !MACHINE_HAS_COMPUTED_GOTO) return false;
+
+	machine->dispatch = mode;
+
+	return true;
+}
+
+uint32_t machine_sync_registers(
+	const MACHINE   machine,
+		  uint32_t  copy[32]
+) {
+	if (!machine || !copy) return 0;
+
+	uint32_t mask = 0;
+
+	for (uint32_t i = 0; i < 32; i++) {
+		if (copy[i] == machine->registers[i]) continue;
+
+		copy[i] = machine->registers[i];
+		mask   |= 1u << i;
+	}
+
+	return mask;
+}
+
+cpu_status_t cpu_interpret(
+	MACHINE  machine,
+	uint64_t max_instructions
+) {
+	if (!machine || !machine->ram) return CPU_STATUS_FETCH_FAULT;
+
+	const RAM ram = machine->ram;
+
+	// Programs loaded without a predecode pass are decoded lazily
+	if (!machine->decoded && !load_decoded_text(machine, NULL, ram->text_size, ram->text_base)) {
+		return CPU_STATUS_FETCH_FAULT;
+	}
+
+	const bool debugging = machine->debugger && machine->debugger->active;
+
+	// A command run with a predictor takes the loop that has both
+	if (machine->journal) return interpret_journal(machine, max_instructions);
+	if (machine->profile || machine->pipeline || machine->cache || machine->trace || (debugging && machine->predictor)) {
+		return interpret_profile(machine, max_instructions);
+	}
+
+	if (debugging) return interpret_debugger(machine, max_instructions);
+	if (machine->predictor) return interpret_predictor(machine, max_instructions);
+
+#if MACHINE_HAS_COMPUTED_GOTO
+	if (machine->dispatch == DISPATCH_THREADED) {
+		return interpret_threaded(machine, max_instructions);
+	}
+#endif
+
+	return interpret_switch(machine, max_instructions);
+}
+
+/**
+ * @brief Run on the translator or the interpreter, between checkpoints.
+ * Known ecalls are serviced here, the loop only stops for the unknown ones.
+ */
+static cpu_status_t run_engine(
+	MACHINE  machine,
+	uint64_t max_instructions
+) {
+	SYSCALLS  syscalls  = machine->syscalls;
+	PROFILE   profile   = machine->profile;
+	PIPELINE  pipeline  = machine->pipeline;
+	CACHE     cache     = machine->cache;
+	PREDICTOR predictor = machine->predictor;
+	TRACE     trace     = machine->trace;
+
+	if (syscalls && syscalls->exit_step && machine->instret >= syscalls->exit_step) return CPU_STATUS_EXIT;
+
+	const uint64_t end = machine->instret + max_instructions;
+	cpu_status_t status;
+
+	for (;;) {
+		uint64_t budget = end - machine->instret;
+
+		// Steps run again after an undo or a seek were already counted, they
+		// are interpreted with the profile, the pipeline, the caches, the
+		// predictor and the trace detached up to the horizon
+		uint64_t horizon = 0;
+		if (profile   && profile->horizon   > horizon) horizon = profile->horizon;
+		if (pipeline  && pipeline->horizon  > horizon) horizon = pipeline->horizon;
+		if (cache     && cache->horizon     > horizon) horizon = cache->horizon;
+		if (predictor && predictor->horizon > horizon) horizon = predictor->horizon;
+		if (trace     && trace->horizon     > horizon) horizon = trace->horizon;
+
+		const bool replay = machine->instret < horizon;
+
+		if (replay) {
+			if (budget > horizon - machine->instret) budget = horizon - machine->instret;
+			machine->profile   = NULL;
+			machine->pipeline  = NULL;
+			machine->cache     = NULL;
+			machine->predictor = NULL;
+			machine->trace     = NULL;
+		}
+
+		// Translated code does not record undo history nor retire and fetch
+		// one instruction at a time
+		const bool debugging = machine->debugger && machine->debugger->active;
+		const bool translate = machine->jit && !machine->journal && !machine->pipeline && !machine->cache &&
+							   !machine->predictor && !machine->trace && !debugging && !replay;
+
+		if (translate) status = jit_run(machine, budget);
+		else status = cpu_interpret(machine, budget);
+
+		if (replay) {
+			machine->profile   = profile;
+			machine->pipeline  = pipeline;
+			machine->cache     = cache;
+			machine->predictor = predictor;
+			machine->trace     = trace;
+
+		} else {
+			if (profile   && machine->instret > profile->horizon)   profile->horizon   = machine->instret;
+			if (pipeline  && machine->instret > pipeline->horizon)  pipeline->horizon  = machine->instret;
+			if (cache     && machine->instret > cache->horizon)     cache->horizon     = machine->instret;
+			if (predictor && machine->instret > predictor->horizon) predictor->horizon = machine->instret;
+			if (trace     && machine->instret > trace->horizon)     trace->horizon     = machine->instret;
+		}
+
+		if (replay && status == CPU_STATUS_BUDGET_EXHAUSTED && machine->instret < end) continue;
+
+		if (status != CPU_STATUS_ECALL || !syscalls) break;
+
+		status = syscall_handle(machine);
+		if (!replay) trace_syscall(trace, machine->registers);
+		if (status != CPU_STATUS_BUDGET_EXHAUSTED || machine->instret >= end) break;
+	}
+
+	return status;
+}
+
+cpu_status_t cpu_run(
+	MACHINE  machine,
+	uint64_t max_instructions
+) {
+	if (!machine) return CPU_STATUS_FETCH_FAULT;
+	if (!machine->timeline) return run_engine(machine, max_instructions);
+
+	uint64_t 	 executed = 0;
+	cpu_status_t status   = CPU_STATUS_BUDGET_EXHAUSTED;
+
+	// Stop at every checkpoint boundary, a failed checkpoint is retried later
+	while (executed < max_instructions) {
+		const uint64_t due = timeline_due(machine);
+
+		uint64_t chunk = max_instructions - executed;
+		if (due > 0 && due < chunk) chunk = due;
+
+		const uint64_t before = machine->instret;
+		status = run_engine(machine, chunk);
+		executed += machine->instret - before;
+
+		if (timeline_due(machine) == 0) timeline_checkpoint(machine);
+		if (status != CPU_STATUS_BUDGET_EXHAUSTED) break;
+	}
+
+	return status;
+}
@@ -0,0 +1,337 @@
+/**
+ * @file pipeline.c
+ * @brief Scoreboard of the five-stage timing model.
+ */
+
+#include "pipeline.h"
+
+/**
+ * @brief Major opcode a handler is decoded from, 0 for the invalid ones.
+ */
+static uint8_t handler_opcode(handler_id_t handler) {
+	if (handler >= HANDLER_ADD  && handler <= HANDLER_AND)  return 0x33;
+	if (handler >= HANDLER_ADDI && handler <= HANDLER_SRAI) return 0x13;
+	if (handler >= HANDLER_LB   && handler <= HANDLER_LHU)  return 0x03;
+	if (handler >= HANDLER_SB   && handler <= HANDLER_SW)   return 0x23;
+	if (handler >= HANDLER_BEQ  && handler <= HANDLER_BGEU) return 0x63;
+
+	switch (handler) {
+		case HANDLER_JAL:    return 0x6F;
+		case HANDLER_JALR:   return 0x67;
+		case HANDLER_LUI:    return 0x37;
+		case HANDLER_AUIPC:  return 0x17;
+		case HANDLER_ECALL:
+		case HANDLER_EBREAK: return 0x73;
+		default:             return 0;
+	}
+}
+
+/**
+ * @brief Scheduling of a handler, read off the datapath signals the
+ * control unit sets for its opcode.
+ */
+static pipeline_signals_t handler_signals(
+		  handler_id_t       handler,
+	const pipeline_config_t *config
+) {
+	pipeline_signals_t scheduling = { 0 };
+
+	const uint8_t opcode = handler_opcode(handler);
+	if (!opcode) return scheduling;
+
+	const ControlSignals signals = getControlSignals(opcode);
+
+	// lui and auipc use the ALU with zero and the pc, jal with the pc
+	const bool reads_rs1 =
+		signals.type == R_TYPE || signals.type == S_TYPE || signals.type == I_SAVE_TYPE ||
+		signals.type == B_TYPE || (signals.type == I_TYPE && signals.operation == 0x13);
+
+	// Stores read the data in rs2 too, branches compare it with rs1
+	const bool reads_rs2 = (signals.type == R_TYPE && !signals.alu_src) || signals.mem_write || signals.branch;
+
+	scheduling.rs1_mask  = reads_rs1 ? 0x1F : 0;
+	scheduling.rs2_mask  = reads_rs2 ? 0x1F : 0;
+	scheduling.writes_rd = signals.reg_write;
+
+	// Without forwarding a consumer reads the register file in the WB cycle
+	if (!config->forwarding) scheduling.latency = 3;
+	else 					 scheduling.latency = signals.mem_read ? 2 : 1;
+
+	if (signals.branch) {
+		scheduling.penalty = config->branch_penalty;
+		scheduling.control = PIPELINE_BRANCH;
+
+	} else if (opcode == 0x6F) {
+		scheduling.penalty = config->jump_penalty;
+		scheduling.control = PIPELINE_JAL;
+
+	} else if (opcode == 0x67) {
+		scheduling.penalty = config->branch_penalty;
+		scheduling.control = PIPELINE_JALR;
+	}
+
+	return scheduling;
+}
+
+// MARK: - Lifecycle
+
+pipeline_config_t pipeline_default_config(void) {
+	return (pipeline_config_t){
+		.forwarding     = true,
+		.branch_penalty = 2,
+		.jump_penalty   = 1
+	};
+}
+
+/**
+ * @brief Pack an instruction in flight into a hazard of a run state.
+ * @param rd Destination, 32 when it writes nothing.
+ * @param age Cycles from its EX to the issue slot.
+ * @param latency Cycles from its EX to the first consumer.
+ *
+ * @return rd, age and latency in 9 bits, 0 when it cannot delay a consumer
+ * or be forwarded any more.
+ */
+static uint32_t pack_hazard(
+	uint32_t rd,
+	uint64_t age,
+	uint32_t latency
+) {
+	if (rd == 32 || age > 2) return 0;
+
+	return rd | (uint32_t)age << 5 | latency << 7;
+}
+
+/**
+ * @brief Add the executions of a run to totals.
+ * @param stats Totals.
+ * @param slot Issue slot reached by the totals.
+ * @param run Memoized run.
+ */
+static void accumulate_run(
+		  pipeline_stats_t *stats,
+		  uint64_t         *slot,
+	const pipeline_run_t   *run
+) {
+	const uint64_t hits = run->hits;
+	if (!hits) return;
+
+	*slot 				   += hits * run->cycles;
+	stats->instructions    += hits * run->length;
+	stats->branch_flushes  += hits * run->branch_flushes;
+	stats->jump_flushes    += hits * run->jump_flushes;
+	stats->forwards_ex_mem += hits * run->forwards_ex_mem;
+	stats->forwards_mem_wb += hits * run->forwards_mem_wb;
+	stats->branches 	   += hits * run->branches;
+	stats->taken_branches  += hits * run->taken_branches;
+	stats->jumps 		   += hits * run->jumps;
+}
+
+/**
+ * @brief Empty the scoreboard, the next instruction enters EX in cycle 3.
+ */
+static void pipeline_reset(PIPELINE pipeline) {
+	memset(pipeline->runs, 0, sizeof(pipeline->runs));
+	memset(&pipeline->stats, 0, sizeof(pipeline->stats));
+
+	pipeline->state = 0;
+	pipeline->tail 	= 1;
+	pipeline->slot 	= 3;
+}
+
+PIPELINE new_pipeline(const pipeline_config_t *config) {
+	PIPELINE pipeline = calloc(1, sizeof(struct pipeline));
+	if (!pipeline) return NULL;
+
+	pipeline->config = config ? *config : pipeline_default_config();
+
+	for (uint32_t handler = 0; handler < HANDLER_COUNT; handler++) {
+		pipeline->signals[handler] = handler_signals((handler_id_t)handler, &pipeline->config);
+	}
+
+	pipeline_reset(pipeline);
+
+	return pipeline;
+}
+
+bool destroy_pipeline(PIPELINE pipeline) {
+	if (!pipeline) return false;
+
+	free(pipeline);
+
+	return true;
+}
+
+bool enable_pipeline(
+		  MACHINE            machine,
+	const pipeline_config_t *config
+) {
+	if (!machine) return false;
+
+	PIPELINE pipeline = new_pipeline(config);
+	if (!pipeline) return false;
+
+	destroy_pipeline(machine->pipeline);
+
+	pipeline->horizon = machine->instret;
+	machine->pipeline = pipeline;
+
+	return true;
+}
+
+void disable_pipeline(MACHINE machine) {
+	if (!machine) return;
+
+	destroy_pipeline(machine->pipeline);
+	machine->pipeline = NULL;
+}
+
+void pipeline_clear(MACHINE machine) {
+	if (!machine || !machine->pipeline) return;
+
+	pipeline_reset(machine->pipeline);
+	machine->pipeline->horizon = machine->instret;
+}
+
+void pipeline_invalidate(PIPELINE pipeline) {
+	if (!pipeline) return;
+
+	for (uint32_t i = 0; i < PIPELINE_RUNS; i++) {
+		accumulate_run(&pipeline->stats, &pipeline->slot, &pipeline->runs[i]);
+	}
+
+	memset(pipeline->runs, 0, sizeof(pipeline->runs));
+}
+
+// MARK: - Scheduling
+
+void pipeline_schedule(
+		  PIPELINE               pipeline,
+	const decoded_instruction_t *decoded,
+		  pipeline_run_t        *run,
+		  uint32_t               start,
+		  uint32_t               length,
+		  uint32_t               state
+) {
+	accumulate_run(&pipeline->stats, &pipeline->slot, run);
+
+	// Cycles relative to the run, it starts issuing in cycle 4 so that the
+	// instructions in flight keep positive EX cycles. Registers written long
+	// ago are ready in cycle 0 and too far to be forwarded.
+	uint64_t produced[33] = { 0 };
+	uint64_t ready[33] 	  = { 0 };
+
+	// The last two instructions, newest first
+	uint32_t recent_rd[2];
+	uint64_t recent_ex[2];
+	uint32_t recent_latency[2];
+
+	for (int32_t i = 1; i >= 0; i--) {
+		const uint32_t hazard = state >> (9 * i) & 0x1FF;
+		const uint32_t rd 	  = hazard ? (hazard & 0x1F) : 32;
+
+		recent_rd[i] 	  = rd;
+		recent_ex[i] 	  = 4 - (hazard >> 5 & 0x3);
+		recent_latency[i] = hazard >> 7 & 0x3;
+
+		produced[rd] = recent_ex[i];
+		ready[rd] 	 = recent_ex[i] + recent_latency[i];
+	}
+
+	uint64_t slot  = 4;
+	uint64_t issue = 0;
+
+	*run = (pipeline_run_t){ .start = start, .length = length, .state = state };
+
+	for (uint32_t i = 0; i < length; i++) {
+		const decoded_instruction_t d 		   = decoded[start + i];
+		const pipeline_signals_t    scheduling = pipeline->signals[d.handler];
+
+		// Unused operands read x0, which is never produced
+		const uint32_t rs1 = d.rs1 & scheduling.rs1_mask;
+		const uint32_t rs2 = d.rs2 & scheduling.rs2_mask;
+		const uint32_t rd  = scheduling.writes_rd && d.rd ? d.rd : 32;
+
+		issue = slot;
+		if (ready[rs1] > issue) issue = ready[rs1];
+		if (ready[rs2] > issue) issue = ready[rs2];
+
+		run->forwards_ex_mem += (issue - produced[rs1] == 1) + (issue - produced[rs2] == 1);
+		run->forwards_mem_wb += (issue - produced[rs1] == 2) + (issue - produced[rs2] == 2);
+
+		produced[rd] = issue;
+		ready[rd] 	 = issue + scheduling.latency;
+
+		recent_rd[1] 	  = recent_rd[0];
+		recent_ex[1] 	  = recent_ex[0];
+		recent_latency[1] = recent_latency[0];
+		recent_rd[0] 	  = rd;
+		recent_ex[0] 	  = issue;
+		recent_latency[0] = scheduling.latency;
+
+		slot = issue + 1;
+
+		run->branches += scheduling.control == PIPELINE_BRANCH;
+		run->jumps 	  += scheduling.control >= PIPELINE_JAL;
+	}
+
+	// Only the last word of a run can redirect the fetch
+	if (state & PIPELINE_REDIRECTED) {
+		const pipeline_signals_t last = pipeline->signals[decoded[start + length - 1].handler];
+		slot += last.penalty;
+
+		if (last.control == PIPELINE_JAL) run->jump_flushes   = last.penalty;
+		else 							  run->branch_flushes = last.penalty;
+
+		run->taken_branches = last.control == PIPELINE_BRANCH;
+	}
+
+	// A newer write of the same register hides the older one
+	if (recent_rd[1] == recent_rd[0]) recent_rd[1] = 32;
+
+	run->cycles 	= (uint32_t)(slot - 4);
+	run->tail 		= (uint32_t)(slot - issue);
+	run->next_state = pack_hazard(recent_rd[0], slot - recent_ex[0], recent_latency[0]) |
+					  pack_hazard(recent_rd[1], slot - recent_ex[1], recent_latency[1]) << 9;
+}
+
+// MARK: - Reports
+
+bool pipeline_stats(
+	const MACHINE           machine,
+		  pipeline_stats_t *stats
+) {
+	if (!machine || !machine->pipeline || !stats) return false;
+
+	const PIPELINE pipeline = machine->pipeline;
+	uint64_t 	   slot 	= pipeline->slot;
+
+	*stats = pipeline->stats;
+	for (uint32_t i = 0; i < PIPELINE_RUNS; i++) {
+		accumulate_run(stats, &slot, &pipeline->runs[i]);
+	}
+
+	if (!stats->instructions) return true;
+
+	// The last instruction leaves WB two cycles after its EX
+	const uint64_t issue = slot - pipeline->tail;
+	stats->cycles = issue + 2;
+
+	// The cycles past the pipeline fill that are neither an instruction nor
+	// a bubble of a flush are stalls, the flush of a redirect by the last
+	// instruction is still ahead
+	const uint64_t trailing = pipeline->tail - 1;
+	const uint64_t stalls 	= stats->cycles - 4 - stats->instructions - stats->branch_flushes - stats->jump_flushes + trailing;
+
+	// With forwarding only a load result can arrive late
+	if (pipeline->config.forwarding) stats->load_use_stalls = stalls;
+	else 							 stats->data_stalls 	= stalls;
+
+	return true;
+}
+
+double pipeline_cpi(const pipeline_stats_t *stats) {
+	if (!stats || !stats->instructions) return 0.0;
+
+	return (double)stats->cycles / (double)stats->instructions;
+}
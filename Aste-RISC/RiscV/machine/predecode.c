@@ -0,0 +1,257 @@
+/**
+ * @file predecode.c
+ * @brief Decode RV32I words into compact handler records.
+ */
+
+#include <stdlib.h>
+
+#include "predecode.h"
+
+static inline int32_t sign_extend(
+	const uint32_t value,
+	const uint32_t bits
+) {
+	const uint32_t shift = 32 - bits;
+	return (int32_t)(value << shift) >> shift;
+}
+
+/**
+ * @brief Decode a raw 32-bit instruction into its record.
+ * @param instruction Raw instruction word.
+ *
+ * @return Decoded record, handler is HANDLER_ILLEGAL for unsupported words.
+ */
+decoded_instruction_t decode_instruction(uint32_t instruction) {
+	const uint32_t opcode = instruction & 0x7F;
+	const uint32_t funct3 = (instruction >> 12) & 0x07;
+	const uint32_t funct7 = instruction >> 25;
+
+	decoded_instruction_t decoded = {
+		.handler = HANDLER_ILLEGAL,
+		.rd      = (instruction >> 7)  & 0x1F,
+		.rs1     = (instruction >> 15) & 0x1F,
+		.rs2     = (instruction >> 20) & 0x1F,
+		.imm     = 0
+	};
+
+	switch (opcode) {
+
+		// R-Type: ADD, SUB, AND, OR, etc.
+		case 0x33: {
+			static const uint8_t base[8] = {
+				HANDLER_ADD, HANDLER_SLL, HANDLER_SLT, HANDLER_SLTU,
+				HANDLER_XOR, HANDLER_SRL, HANDLER_OR,  HANDLER_AND
+			};
+
+			if (funct7 == 0x00) {
+				decoded.handler = base[funct3];
+
+			} else if (funct7 == 0x20 && funct3 == 0x0) {
+				decoded.handler = HANDLER_SUB;
+
+			} else if (funct7 == 0x20 && funct3 == 0x5) {
+				decoded.handler = HANDLER_SRA;
+			}
+
+			break;
+		}
+
+		// I-Type Arithmetic: ADDI, ANDI, SRAI, etc.
+		case 0x13: {
+			static const uint8_t base[8] = {
+				HANDLER_ADDI, HANDLER_SLLI, HANDLER_SLTI, HANDLER_SLTIU,
+				HANDLER_XORI, HANDLER_SRLI, HANDLER_ORI,  HANDLER_ANDI
+			};
+
+			decoded.imm = sign_extend(instruction >> 20, 12);
+
+			if (funct3 == 0x1 || funct3 == 0x5) {
+				decoded.imm &= 0x1F;
+
+				if (funct7 == 0x00) {
+					decoded.handler = base[funct3];
+
+				} else if (funct7 == 0x20 && funct3 == 0x5) {
+					decoded.handler = HANDLER_SRAI;
+				}
+
+			} else {
+				decoded.handler = base[funct3];
+			}
+
+			break;
+		}
+
+		// I-Type Load: LB, LH, LW, LBU, LHU
+		case 0x03: {
+			static const uint8_t loads[8] = {
+				HANDLER_LB,  HANDLER_LH,  HANDLER_LW,      HANDLER_ILLEGAL,
+				HANDLER_LBU, HANDLER_LHU, HANDLER_ILLEGAL, HANDLER_ILLEGAL
+			};
+
+			decoded.imm 	= sign_extend(instruction >> 20, 12);
+			decoded.handler = loads[funct3];
+
+			break;
+		}
+
+		// Store: SB, SH, SW
+		case 0x23:
+			decoded.imm = sign_extend((funct7 << 5) | decoded.rd, 12);
+
+			if (funct3 == 0x0) decoded.handler = HANDLER_SB;
+			if (funct3 == 0x1) decoded.handler = HANDLER_SH;
+			if (funct3 == 0x2) decoded.handler = HANDLER_SW;
+
+			break;
+
+		// UJ-Type: JAL
+		case 0x6F:
+			decoded.handler = HANDLER_JAL;
+			decoded.imm     = sign_extend(
+				((instruction >> 31) & 0x1)   << 20 |
+				((instruction >> 12) & 0xFF)  << 12 |
+				((instruction >> 20) & 0x1)   << 11 |
+				((instruction >> 21) & 0x3FF) << 1,
+				21
+			);
+
+			break;
+
+		// I-Type: JALR
+		case 0x67:
+			if (funct3 != 0x0) break;
+
+			decoded.handler = HANDLER_JALR;
+			decoded.imm     = sign_extend(instruction >> 20, 12);
+
+			break;
+
+		// B-Type: BEQ, BNE, BLT, BGE, BLTU, BGEU
+		case 0x63: {
+			static const uint8_t branches[8] = {
+				HANDLER_BEQ, HANDLER_BNE,  HANDLER_ILLEGAL, HANDLER_ILLEGAL,
+				HANDLER_BLT, HANDLER_BGE,  HANDLER_BLTU,    HANDLER_BGEU
+			};
+
+			decoded.handler = branches[funct3];
+			decoded.rd      = 0; // the field holds offset bits
+			decoded.imm     = sign_extend(
+				((instruction >> 31) & 0x1)  << 12 |
+				((instruction >> 7)  & 0x1)  << 11 |
+				((instruction >> 25) & 0x3F) << 5  |
+				((instruction >> 8)  & 0xF)  << 1,
+				13
+			);
+
+			break;
+		}
+
+		// LUI / AUIPC
+		case 0x37:
+		case 0x17:
+			decoded.handler = opcode == 0x37 ? HANDLER_LUI : HANDLER_AUIPC;
+			decoded.imm     = (int32_t)(instruction & 0xFFFFF000);
+
+			break;
+
+		// ECALL / EBREAK
+		case 0x73:
+			if (instruction == 0x00000073) decoded.handler = HANDLER_ECALL;
+			if (instruction == 0x00100073) decoded.handler = HANDLER_EBREAK;
+
+			break;
+
+		default:
+			break;
+	}
+
+	return decoded;
+}
+
+/**
+ * @brief Get the instruction class of a handler.
+ * @param handler Handler id.
+ *
+ * @return Instruction type as classified by the control unit.
+ */
+TypeInstruction handler_type(handler_id_t handler) {
+	if (handler >= HANDLER_ADD  && handler <= HANDLER_AND)   return R_TYPE;
+	if (handler >= HANDLER_ADDI && handler <= HANDLER_SRAI)  return I_TYPE;
+	if (handler >= HANDLER_LB   && handler <= HANDLER_LHU)   return I_SAVE_TYPE;
+	if (handler >= HANDLER_SB   && handler <= HANDLER_SW)    return S_TYPE;
+	if (handler == HANDLER_JAL  || handler == HANDLER_JALR)  return UJ_TYPE;
+	if (handler >= HANDLER_BEQ  && handler <= HANDLER_BGEU)  return B_TYPE;
+	if (handler == HANDLER_LUI  || handler == HANDLER_AUIPC) return I_TYPE;
+
+	return ECALL;
+}
+
+/**
+ * @brief Get the mnemonic of a handler.
+ * @param handler Handler id.
+ *
+ * @return Lowercase mnemonic, e.g. "addi", "?" for invalid ids.
+ */
+const char *handler_name(handler_id_t handler) {
+	static const char *const names[HANDLER_COUNT] = {
+		[HANDLER_ILLEGAL] = "illegal", [HANDLER_UNDECODED] = "undecoded",
+		[HANDLER_ADD]  = "add",  [HANDLER_SUB]   = "sub",   [HANDLER_SLL]  = "sll",
+		[HANDLER_SLT]  = "slt",  [HANDLER_SLTU]  = "sltu",  [HANDLER_XOR]  = "xor",
+		[HANDLER_SRL]  = "srl",  [HANDLER_SRA]   = "sra",   [HANDLER_OR]   = "or",
+		[HANDLER_AND]  = "and",  [HANDLER_ADDI]  = "addi",  [HANDLER_SLTI] = "slti",
+		[HANDLER_SLTIU] = "sltiu", [HANDLER_XORI] = "xori", [HANDLER_ORI]  = "ori",
+		[HANDLER_ANDI] = "andi", [HANDLER_SLLI]  = "slli",  [HANDLER_SRLI] = "srli",
+		[HANDLER_SRAI] = "srai", [HANDLER_LB]    = "lb",    [HANDLER_LH]   = "lh",
+		[HANDLER_LW]   = "lw",   [HANDLER_LBU]   = "lbu",   [HANDLER_LHU]  = "lhu",
+		[HANDLER_SB]   = "sb",   [HANDLER_SH]    = "sh",    [HANDLER_SW]   = "sw",
+		[HANDLER_JAL]  = "jal",  [HANDLER_JALR]  = "jalr",  [HANDLER_BEQ]  = "beq",
+		[HANDLER_BNE]  = "bne",  [HANDLER_BLT]   = "blt",   [HANDLER_BGE]  = "bge",
+		[HANDLER_BLTU] = "bltu", [HANDLER_BGEU]  = "bgeu",  [HANDLER_LUI]  = "lui",
+		[HANDLER_AUIPC] = "auipc", [HANDLER_ECALL] = "ecall", [HANDLER_EBREAK] = "ebreak"
+	};
+
+	return handler < HANDLER_COUNT ? names[handler] : "?";
+}
+
+/**
+ * @brief Decode a whole section into a freshly allocated array.
+ * @param text_data Raw section bytes.
+ * @param text_size Section size in bytes.
+ * @param count Filled with the number of records.
+ *
+ * @return Array indexed by (pc - text_vaddr) >> 2, or NULL if allocation fails.
+ */
+decoded_instruction_t *predecode_section(
+	const uint8_t  *text_data,
+		  size_t    text_size,
+		  uint32_t *count
+) {
+	if (!count) return NULL;
+
+	*count = (uint32_t)(text_size / 4);
+	if (*count == 0) return NULL;
+
+	decoded_instruction_t *decoded = malloc(sizeof(decoded_instruction_t) * *count);
+	if (!decoded) return NULL;
+
+	for (uint32_t i = 0; i < *count; i++) {
+
+		// Without the section bytes the entries are decoded on first fetch
+		if (!text_data) {
+			decoded[i] = (decoded_instruction_t){ .handler = HANDLER_UNDECODED };
+			continue;
+		}
+
+		const uint8_t *p = text_data + (size_t)i * 4;
+
+		const uint32_t instruction = (uint32_t)p[0]
+								   | (uint32_t)p[1] << 8
+								   | (uint32_t)p[2] << 16
+								   | (uint32_t)p[3] << 24;
+
+		decoded[i] = decode_instruction(instruction);
+	}
+
+	return decoded;
+}
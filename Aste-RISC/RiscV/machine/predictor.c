@@ -0,0 +1,255 @@
+/**
+ * @file predictor.c
+ * @brief Tables of the branch predictors and the reports built on them.
+ */
+
+#include "predictor.h"
+
+// Four weakly not-taken counters
+#define PREDICTOR_WEAKLY_NOT_TAKEN 0x55
+
+static bool is_power_of_two(uint32_t value) {
+	return value && !(value & (value - 1));
+}
+
+static bool has_counters(predictor_kind_t kind) {
+	return kind == PREDICTOR_BIMODAL || kind == PREDICTOR_GSHARE;
+}
+
+/**
+ * @brief Bytes of the packed counter table, at least one.
+ */
+static uint32_t counter_bytes(const predictor_config_t *config) {
+	return config->table_bits > 2 ? 1u << (config->table_bits - 2) : 1;
+}
+
+// MARK: - Lifecycle
+
+predictor_config_t predictor_default_config(void) {
+	return (predictor_config_t){
+		.kind         = PREDICTOR_BIMODAL,
+		.table_bits   = 12,
+		.history_bits = 8,
+		.btb_entries  = 0
+	};
+}
+
+bool predictor_config_valid(const predictor_config_t *config) {
+	if (!config || config->kind >= PREDICTOR_KIND_COUNT) return false;
+
+	if (has_counters(config->kind)) {
+		if (!config->table_bits || config->table_bits > PREDICTOR_MAX_TABLE_BITS) return false;
+		if (config->kind == PREDICTOR_GSHARE && config->history_bits > config->table_bits) return false;
+	}
+
+	if (config->btb_entries && !is_power_of_two(config->btb_entries)) return false;
+
+	return config->btb_entries <= 1u << PREDICTOR_MAX_BTB_BITS;
+}
+
+/**
+ * @brief Weakly not-taken counters, empty history and BTB.
+ */
+static void reset_tables(PREDICTOR predictor) {
+	const predictor_config_t *config = &predictor->config;
+
+	if (predictor->counters) memset(predictor->counters, PREDICTOR_WEAKLY_NOT_TAKEN, counter_bytes(config));
+
+	if (predictor->btb_tags) {
+		memset(predictor->btb_tags, 0, config->btb_entries * sizeof(uint32_t));
+		memset(predictor->btb_targets, 0, config->btb_entries * sizeof(uint32_t));
+	}
+
+	predictor->history = 0;
+}
+
+PREDICTOR new_predictor(const predictor_config_t *config) {
+	const predictor_config_t shape = config ? *config : predictor_default_config();
+	if (!predictor_config_valid(&shape)) return NULL;
+
+	PREDICTOR predictor = calloc(1, sizeof(struct predictor));
+	if (!predictor) return NULL;
+
+	predictor->config = shape;
+
+	if (has_counters(shape.kind)) {
+		predictor->counters   = malloc(counter_bytes(&shape));
+		predictor->table_mask = (1u << shape.table_bits) - 1;
+
+		// Bimodal indexes with the address alone
+		if (shape.kind == PREDICTOR_GSHARE) predictor->history_mask = (1u << shape.history_bits) - 1;
+	}
+
+	if (shape.btb_entries) {
+		predictor->btb_tags    = malloc(shape.btb_entries * sizeof(uint32_t));
+		predictor->btb_targets = malloc(shape.btb_entries * sizeof(uint32_t));
+		predictor->btb_mask    = shape.btb_entries - 1;
+	}
+
+	if ((has_counters(shape.kind) && !predictor->counters) ||
+		(shape.btb_entries && (!predictor->btb_tags || !predictor->btb_targets))) {
+		destroy_predictor(predictor);
+		return NULL;
+	}
+
+	reset_tables(predictor);
+
+	return predictor;
+}
+
+bool destroy_predictor(PREDICTOR predictor) {
+	if (!predictor) return false;
+
+	free(predictor->counters);
+	free(predictor->btb_tags);
+	free(predictor->btb_targets);
+	free(predictor->sites);
+	free(predictor);
+
+	return true;
+}
+
+bool enable_predictor(
+		  MACHINE             machine,
+	const predictor_config_t *config
+) {
+	if (!machine) return false;
+
+	PREDICTOR predictor = new_predictor(config);
+	if (!predictor) return false;
+
+	destroy_predictor(machine->predictor);
+
+	predictor->horizon = machine->instret;
+	machine->predictor = predictor;
+
+	return true;
+}
+
+void disable_predictor(MACHINE machine) {
+	if (!machine) return;
+
+	destroy_predictor(machine->predictor);
+	machine->predictor = NULL;
+}
+
+void predictor_clear(MACHINE machine) {
+	if (!machine || !machine->predictor) return;
+
+	PREDICTOR predictor = machine->predictor;
+
+	reset_tables(predictor);
+	if (predictor->sites) memset(predictor->sites, 0, predictor->site_count * sizeof(predictor_site_t));
+
+	predictor->target_misses = 0;
+	predictor->jumps 		 = 0;
+	predictor->jump_misses 	 = 0;
+	predictor->horizon 		 = machine->instret;
+}
+
+bool predictor_prepare(MACHINE machine) {
+	PREDICTOR predictor = machine->predictor;
+	if (predictor->sites && predictor->site_count == machine->decoded_count) return true;
+
+	// Zeroed on demand by the system, only the pages holding branches use memory
+	predictor_site_t *sites = calloc(machine->decoded_count ? machine->decoded_count : 1, sizeof(predictor_site_t));
+	if (!sites) return false;
+
+	free(predictor->sites);
+	predictor->sites 	  = sites;
+	predictor->site_count = machine->decoded_count;
+
+	return true;
+}
+
+// MARK: - Reports
+
+bool predictor_stats(
+	const MACHINE            machine,
+		  predictor_stats_t *stats
+) {
+	if (!machine || !machine->predictor || !stats) return false;
+
+	const PREDICTOR predictor = machine->predictor;
+
+	memset(stats, 0, sizeof(*stats));
+
+	stats->config 		 = predictor->config;
+	stats->target_misses = predictor->target_misses;
+	stats->jumps 		 = predictor->jumps;
+	stats->jump_misses 	 = predictor->jump_misses;
+
+	for (uint32_t i = 0; predictor->sites && i < predictor->site_count; i++) {
+		const predictor_site_t *site = &predictor->sites[i];
+
+		stats->branches 	+= site->executed;
+		stats->taken 		+= site->taken;
+		stats->mispredicted += site->mispredicted;
+	}
+
+	stats->direction_misses = stats->mispredicted - stats->target_misses;
+
+	return true;
+}
+
+static int compare_entries(const void *a, const void *b) {
+	const predictor_entry_t *x = a, *y = b;
+
+	if (x->site.mispredicted != y->site.mispredicted) return x->site.mispredicted < y->site.mispredicted ? 1 : -1;
+	if (x->site.executed != y->site.executed) return x->site.executed < y->site.executed ? 1 : -1;
+
+	return (x->pc > y->pc) - (x->pc < y->pc);
+}
+
+uint32_t predictor_branches(
+	const MACHINE            machine,
+		  predictor_entry_t *entries,
+		  uint32_t           max
+) {
+	if (!machine || !machine->predictor || !entries || !max) return 0;
+
+	const PREDICTOR predictor = machine->predictor;
+	if (!predictor->sites || predictor->site_count != machine->decoded_count) return 0;
+
+	// Keep the max worst branches sorted, the table is small
+	uint32_t found = 0;
+
+	for (uint32_t i = 0; i < predictor->site_count; i++) {
+		if (!predictor->sites[i].executed) continue;
+
+		const predictor_entry_t entry = {
+			.pc   = machine->decoded_base + i * 4,
+			.site = predictor->sites[i]
+		};
+
+		if (found == max && compare_entries(&entry, &entries[max - 1]) >= 0) continue;
+
+		uint32_t slot = found < max ? found++ : max - 1;
+		while (slot > 0 && compare_entries(&entry, &entries[slot - 1]) < 0) {
+			entries[slot] = entries[slot - 1];
+			slot--;
+		}
+
+		entries[slot] = entry;
+	}
+
+	return found;
+}
+
+double predictor_accuracy(
+	uint64_t mispredicted,
+	uint64_t branches
+) {
+	return branches ? 1.0 - (double)mispredicted / (double)branches : 1.0;
+}
+
+const char *predictor_kind_name(predictor_kind_t kind) {
+	static const char *const names[PREDICTOR_KIND_COUNT] = {
+		[PREDICTOR_NOT_TAKEN] = "not-taken",
+		[PREDICTOR_BTFN]      = "BTFN",
+		[PREDICTOR_BIMODAL]   = "bimodal",
+		[PREDICTOR_GSHARE]    = "gshare"
+	};
+
+	return kind < PREDICTOR_KIND_COUNT ? names[kind] : "?";
+}
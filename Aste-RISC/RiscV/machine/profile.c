@@ -0,0 +1,291 @@
+/**
+ * @file profile.c
+ * @brief Execution counters of a machine and the reports built on them.
+ */
+
+#include "profile.h"
+#include "jit.h"
+
+// Opcode group of each handler, the invalid entries are never retired
+static const uint8_t handler_classes[HANDLER_COUNT] = {
+	[HANDLER_ADD]   = PROFILE_CLASS_OP,     [HANDLER_SUB]   = PROFILE_CLASS_OP,
+	[HANDLER_SLL]   = PROFILE_CLASS_OP,     [HANDLER_SLT]   = PROFILE_CLASS_OP,
+	[HANDLER_SLTU]  = PROFILE_CLASS_OP,     [HANDLER_XOR]   = PROFILE_CLASS_OP,
+	[HANDLER_SRL]   = PROFILE_CLASS_OP,     [HANDLER_SRA]   = PROFILE_CLASS_OP,
+	[HANDLER_OR]    = PROFILE_CLASS_OP,     [HANDLER_AND]   = PROFILE_CLASS_OP,
+	[HANDLER_ADDI]  = PROFILE_CLASS_OP_IMM, [HANDLER_SLTI]  = PROFILE_CLASS_OP_IMM,
+	[HANDLER_SLTIU] = PROFILE_CLASS_OP_IMM, [HANDLER_XORI]  = PROFILE_CLASS_OP_IMM,
+	[HANDLER_ORI]   = PROFILE_CLASS_OP_IMM, [HANDLER_ANDI]  = PROFILE_CLASS_OP_IMM,
+	[HANDLER_SLLI]  = PROFILE_CLASS_OP_IMM, [HANDLER_SRLI]  = PROFILE_CLASS_OP_IMM,
+	[HANDLER_SRAI]  = PROFILE_CLASS_OP_IMM,
+	[HANDLER_LB]    = PROFILE_CLASS_LOAD,   [HANDLER_LH]    = PROFILE_CLASS_LOAD,
+	[HANDLER_LW]    = PROFILE_CLASS_LOAD,   [HANDLER_LBU]   = PROFILE_CLASS_LOAD,
+	[HANDLER_LHU]   = PROFILE_CLASS_LOAD,
+	[HANDLER_SB]    = PROFILE_CLASS_STORE,  [HANDLER_SH]    = PROFILE_CLASS_STORE,
+	[HANDLER_SW]    = PROFILE_CLASS_STORE,
+	[HANDLER_JAL]   = PROFILE_CLASS_JAL,    [HANDLER_JALR]  = PROFILE_CLASS_JALR,
+	[HANDLER_BEQ]   = PROFILE_CLASS_BRANCH, [HANDLER_BNE]   = PROFILE_CLASS_BRANCH,
+	[HANDLER_BLT]   = PROFILE_CLASS_BRANCH, [HANDLER_BGE]   = PROFILE_CLASS_BRANCH,
+	[HANDLER_BLTU]  = PROFILE_CLASS_BRANCH, [HANDLER_BGEU]  = PROFILE_CLASS_BRANCH,
+	[HANDLER_LUI]   = PROFILE_CLASS_LUI,    [HANDLER_AUIPC] = PROFILE_CLASS_AUIPC,
+	[HANDLER_ECALL] = PROFILE_CLASS_SYSTEM, [HANDLER_EBREAK] = PROFILE_CLASS_SYSTEM
+};
+
+// ALU operation of each arithmetic handler plus one, 0 for the others
+static const uint8_t handler_alu[HANDLER_COUNT] = {
+	[HANDLER_ADD]  = PROFILE_ALU_ADD + 1,  [HANDLER_ADDI]  = PROFILE_ALU_ADD + 1,
+	[HANDLER_SUB]  = PROFILE_ALU_SUB + 1,
+	[HANDLER_SLL]  = PROFILE_ALU_SLL + 1,  [HANDLER_SLLI]  = PROFILE_ALU_SLL + 1,
+	[HANDLER_SLT]  = PROFILE_ALU_SLT + 1,  [HANDLER_SLTI]  = PROFILE_ALU_SLT + 1,
+	[HANDLER_SLTU] = PROFILE_ALU_SLTU + 1, [HANDLER_SLTIU] = PROFILE_ALU_SLTU + 1,
+	[HANDLER_XOR]  = PROFILE_ALU_XOR + 1,  [HANDLER_XORI]  = PROFILE_ALU_XOR + 1,
+	[HANDLER_SRL]  = PROFILE_ALU_SRL + 1,  [HANDLER_SRLI]  = PROFILE_ALU_SRL + 1,
+	[HANDLER_SRA]  = PROFILE_ALU_SRA + 1,  [HANDLER_SRAI]  = PROFILE_ALU_SRA + 1,
+	[HANDLER_OR]   = PROFILE_ALU_OR + 1,   [HANDLER_ORI]   = PROFILE_ALU_OR + 1,
+	[HANDLER_AND]  = PROFILE_ALU_AND + 1,  [HANDLER_ANDI]  = PROFILE_ALU_AND + 1
+};
+
+// MARK: - Lifecycle
+
+PROFILE new_profile(const RAM ram) {
+	if (!ram) return NULL;
+
+	PROFILE profile = calloc(1, sizeof(struct profile));
+	if (!profile) return NULL;
+
+	// Zeroed on demand by the system, only touched pages use memory
+	profile->page_count  = (uint32_t)((ram->size + RAM_PAGE_MASK) >> RAM_PAGE_SHIFT);
+	profile->page_loads  = calloc(profile->page_count ? profile->page_count : 1, sizeof(uint64_t));
+	profile->page_stores = calloc(profile->page_count ? profile->page_count : 1, sizeof(uint64_t));
+
+	if (!profile->page_loads || !profile->page_stores) {
+		destroy_profile(profile);
+		return NULL;
+	}
+
+	return profile;
+}
+
+bool destroy_profile(PROFILE profile) {
+	if (!profile) return false;
+
+	free(profile->counts);
+	free(profile->page_loads);
+	free(profile->page_stores);
+	free(profile);
+
+	return true;
+}
+
+bool enable_profile(MACHINE machine) {
+	if (!machine || !machine->ram) return false;
+
+	PROFILE profile = new_profile(machine->ram);
+	if (!profile) return false;
+
+	// Block counters of the old profile must not reach the new one
+	jit_fold_profile(machine);
+	destroy_profile(machine->profile);
+
+	profile->horizon = machine->instret;
+	machine->profile = profile;
+
+	// Translated code counts blocks only when it was generated for a profile
+	if (machine->jit) jit_invalidate(machine->jit);
+
+	return true;
+}
+
+void disable_profile(MACHINE machine) {
+	if (!machine || !machine->profile) return;
+
+	// Block counters pending in translated code belong to this profile
+	jit_fold_profile(machine);
+	destroy_profile(machine->profile);
+	machine->profile = NULL;
+
+	if (machine->jit) jit_invalidate(machine->jit);
+}
+
+void profile_clear(MACHINE machine) {
+	if (!machine || !machine->profile) return;
+
+	PROFILE profile = machine->profile;
+	jit_fold_profile(machine);
+
+	if (profile->counts) memset(profile->counts, 0, profile->count * sizeof(uint64_t));
+	memset(profile->page_loads, 0, profile->page_count * sizeof(uint64_t));
+	memset(profile->page_stores, 0, profile->page_count * sizeof(uint64_t));
+
+	profile->horizon = machine->instret;
+}
+
+bool profile_prepare(MACHINE machine) {
+	PROFILE profile = machine->profile;
+	if (profile->counts && profile->count == machine->decoded_count) return true;
+
+	uint64_t *counts = calloc(machine->decoded_count ? machine->decoded_count : 1, sizeof(uint64_t));
+	if (!counts) return false;
+
+	free(profile->counts);
+	profile->counts = counts;
+	profile->count  = machine->decoded_count;
+
+	return true;
+}
+
+// MARK: - Reports
+
+const uint64_t *profile_counts(
+	MACHINE   machine,
+	uint32_t *count
+) {
+	if (!machine || !machine->profile || !machine->profile->counts) return NULL;
+
+	jit_fold_profile(machine);
+	if (count) *count = machine->profile->count;
+
+	return machine->profile->counts;
+}
+
+bool profile_snapshot(
+	MACHINE             machine,
+	profile_snapshot_t *snapshot
+) {
+	if (!machine || !machine->profile || !snapshot) return false;
+
+	const PROFILE profile = machine->profile;
+	const RAM     ram     = machine->ram;
+
+	memset(snapshot, 0, sizeof(*snapshot));
+	jit_fold_profile(machine);
+
+	// Handlers of the current records, a word rewritten by the program
+	// counts as its latest instruction
+	if (profile->counts && profile->count == machine->decoded_count) {
+		for (uint32_t i = 0; i < profile->count; i++) {
+			const uint64_t count = profile->counts[i];
+			if (!count) continue;
+
+			const handler_id_t handler = (handler_id_t)machine->decoded[i].handler;
+
+			snapshot->instructions 		+= count;
+			snapshot->handlers[handler] += count;
+		}
+	}
+
+	for (uint32_t handler = HANDLER_ADD; handler < HANDLER_COUNT; handler++) {
+		const uint64_t count = snapshot->handlers[handler];
+
+		snapshot->classes[handler_classes[handler]] += count;
+		if (handler_alu[handler]) snapshot->alu[handler_alu[handler] - 1] += count;
+	}
+
+	// Without a permission map the whole window is one region
+	if (ram->region_count == 0) {
+		snapshot->regions[0] = (profile_region_t){ "memory", ram->base_vaddr, (uint32_t)ram->size, 0, 0 };
+		snapshot->region_count = 1;
+
+	} else {
+		for (uint32_t i = 0; i < ram->region_count; i++) {
+			const ram_region_t *region = &ram->regions[i];
+			snapshot->regions[i] = (profile_region_t){ region->name, region->start, region->size, 0, 0 };
+		}
+
+		snapshot->region_count = ram->region_count;
+	}
+
+	for (uint32_t page = 0; page < profile->page_count; page++) {
+		const uint64_t loads  = profile->page_loads[page];
+		const uint64_t stores = profile->page_stores[page];
+		if (!loads && !stores) continue;
+
+		snapshot->loads  += loads;
+		snapshot->stores += stores;
+
+		const uint64_t page_start = (uint64_t)ram->base_vaddr + ((uint64_t)page << RAM_PAGE_SHIFT);
+		const int      region 	  = ram->region_count ? ram_page_region(ram, page_start) : 0;
+
+		if (region < 0) continue;
+
+		snapshot->regions[region].loads  += loads;
+		snapshot->regions[region].stores += stores;
+	}
+
+	return true;
+}
+
+static int compare_entries(const void *a, const void *b) {
+	const profile_entry_t *x = a, *y = b;
+
+	if (x->count != y->count) return x->count < y->count ? 1 : -1;
+
+	return (x->pc > y->pc) - (x->pc < y->pc);
+}
+
+uint32_t profile_hot(
+	MACHINE          machine,
+	profile_entry_t *entries,
+	uint32_t         max
+) {
+	uint32_t count;
+	const uint64_t *counts = profile_counts(machine, &count);
+	if (!counts || !entries || !max || count != machine->decoded_count) return 0;
+
+	// Keep the max hottest words sorted, the table is small
+	uint32_t found = 0;
+
+	for (uint32_t i = 0; i < count; i++) {
+		if (!counts[i] || (found == max && counts[i] <= entries[max - 1].count)) continue;
+
+		const profile_entry_t entry = {
+			.pc 	 = machine->decoded_base + i * 4,
+			.count 	 = counts[i],
+			.handler = (handler_id_t)machine->decoded[i].handler
+		};
+
+		uint32_t slot = found < max ? found++ : max - 1;
+		while (slot > 0 && compare_entries(&entry, &entries[slot - 1]) < 0) {
+			entries[slot] = entries[slot - 1];
+			slot--;
+		}
+
+		entries[slot] = entry;
+	}
+
+	return found;
+}
+
+const char *profile_class_name(profile_class_t group) {
+	static const char *const names[PROFILE_CLASS_COUNT] = {
+		[PROFILE_CLASS_OP]     = "OP",
+		[PROFILE_CLASS_OP_IMM] = "OP-IMM",
+		[PROFILE_CLASS_LOAD]   = "LOAD",
+		[PROFILE_CLASS_STORE]  = "STORE",
+		[PROFILE_CLASS_BRANCH] = "BRANCH",
+		[PROFILE_CLASS_JAL]    = "JAL",
+		[PROFILE_CLASS_JALR]   = "JALR",
+		[PROFILE_CLASS_LUI]    = "LUI",
+		[PROFILE_CLASS_AUIPC]  = "AUIPC",
+		[PROFILE_CLASS_SYSTEM] = "SYSTEM"
+	};
+
+	return group < PROFILE_CLASS_COUNT ? names[group] : "?";
+}
+
+const char *profile_alu_name(profile_alu_t operation) {
+	static const char *const names[PROFILE_ALU_COUNT] = {
+		[PROFILE_ALU_ADD]  = "add",
+		[PROFILE_ALU_SUB]  = "sub",
+		[PROFILE_ALU_SLL]  = "sll",
+		[PROFILE_ALU_SLT]  = "slt",
+		[PROFILE_ALU_SLTU] = "sltu",
+		[PROFILE_ALU_XOR]  = "xor",
+		[PROFILE_ALU_SRL]  = "srl",
+		[PROFILE_ALU_SRA]  = "sra",
+		[PROFILE_ALU_OR]   = "or",
+		[PROFILE_ALU_AND]  = "and"
+	};
+
+	return operation < PROFILE_ALU_COUNT ? names[operation] : "?";
+}
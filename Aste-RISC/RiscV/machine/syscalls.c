@@ -0,0 +1,295 @@
+/**
+ * @file syscalls.c
+ * @brief Environment calls of the guest and its buffered output.
+ */
+
+#include "syscalls.h"
+#include "journal.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+#define OUTPUT_MASK (SYSCALL_OUTPUT_SIZE - 1)
+
+// MARK: - Output
+
+/**
+ * @brief Send the buffered output as one message per line, or as it is
+ * when its stream is redirected.
+ * @param syscalls State holding the output.
+ * @param all Also send the last line when it has no newline yet.
+ */
+static void send_output(
+	SYSCALLS syscalls,
+	bool     all
+) {
+	const int file = syscalls->files[syscalls->stream];
+
+	// Redirected output is copied as it is, the ring is at most two runs
+	if (file >= 0) {
+		while (syscalls->count) {
+			uint32_t run = SYSCALL_OUTPUT_SIZE - syscalls->head;
+			if (run > syscalls->count) run = syscalls->count;
+
+			const ssize_t written = write(file, syscalls->output + syscalls->head, run);
+			if (written < 0 && errno == EINTR) continue;
+
+			// A closed or failing descriptor drops the output
+			const uint32_t sent = written > 0 ? (uint32_t)written : run;
+
+			syscalls->head   = (syscalls->head + sent) & OUTPUT_MASK;
+			syscalls->count -= sent;
+		}
+
+		return;
+	}
+
+	const message_type_t type = syscalls->stream == 2 ? MESSAGE_ERROR : MESSAGE_INFO;
+
+	char     line[SYSCALL_LINE_MAX];
+	size_t   length   = 0;
+	uint32_t consumed = 0;
+	bool     split    = false;
+
+	for (uint32_t i = 0; i < syscalls->count; i++) {
+		const char byte = syscalls->output[(syscalls->head + i) & OUTPUT_MASK];
+
+		if (byte == '\n') {
+			// The newline ending a split line does not add an empty one
+			if (length || !split) log_batch_add_text(&syscalls->batch, type, line, length);
+
+			length   = 0;
+			consumed = i + 1;
+			split    = false;
+
+			continue;
+		}
+
+		line[length++] = byte;
+
+		if (length == SYSCALL_LINE_MAX) {
+			log_batch_add_text(&syscalls->batch, type, line, length);
+
+			length   = 0;
+			consumed = i + 1;
+			split    = true;
+		}
+	}
+
+	if (all && length) {
+		log_batch_add_text(&syscalls->batch, type, line, length);
+		consumed = syscalls->count;
+	}
+
+	log_batch_flush(&syscalls->batch);
+
+	syscalls->head   = (syscalls->head + consumed) & OUTPUT_MASK;
+	syscalls->count -= consumed;
+}
+
+void syscall_flush(SYSCALLS syscalls) {
+	if (!syscalls || !syscalls->count) return;
+
+	send_output(syscalls, syscalls->count == SYSCALL_OUTPUT_SIZE);
+}
+
+// MARK: - Lifecycle
+
+SYSCALLS new_syscalls(LogCallback callback) {
+	SYSCALLS syscalls = calloc(1, sizeof(struct syscalls));
+	if (!syscalls) return NULL;
+
+	syscalls->callback = callback;
+	syscalls->stream   = 1;
+	log_batch_init(&syscalls->batch, callback);
+
+	for (int fd = 0; fd < 3; fd++) syscalls->files[fd] = -1;
+
+	return syscalls;
+}
+
+bool syscall_redirect(
+	SYSCALLS syscalls,
+	uint32_t fd,
+	int      host_fd
+) {
+	if (!syscalls || fd > 2) return false;
+
+	// Pending output still goes where it was written to
+	if (syscalls->count && syscalls->stream == fd) send_output(syscalls, true);
+
+	syscalls->files[fd] = host_fd;
+
+	return true;
+}
+
+bool destroy_syscalls(SYSCALLS syscalls) {
+	if (!syscalls) return false;
+
+	if (syscalls->count) send_output(syscalls, true);
+	free(syscalls);
+
+	return true;
+}
+
+bool enable_syscalls(
+	MACHINE     machine,
+	LogCallback callback
+) {
+	if (!machine) return false;
+
+	SYSCALLS syscalls = new_syscalls(callback);
+	if (!syscalls) return false;
+
+	destroy_syscalls(machine->syscalls);
+	machine->syscalls = syscalls;
+
+	return true;
+}
+
+// MARK: - Calls
+
+/**
+ * @brief write(fd, buffer, length), standard output and error only.
+ * @return Bytes written, or a negated errno.
+ */
+static int32_t syscall_write(
+	MACHINE  machine,
+	uint32_t fd,
+	uint32_t address,
+	uint32_t length
+) {
+	if (fd != 1 && fd != 2) return -SYSCALL_EBADF;
+
+	SYSCALLS syscalls = machine->syscalls;
+
+	// Output of a step run again by a seek or after an undo was already sent
+	const bool sent = machine->instret <= syscalls->horizon;
+
+	if (!sent) {
+		if (syscalls->count && syscalls->stream != fd) send_output(syscalls, true);
+
+		syscalls->stream  = fd;
+		syscalls->horizon = machine->instret;
+	}
+
+	for (uint32_t i = 0; i < length; i++) {
+		uint32_t byte;
+		if (ram_load8u(machine->ram, address + i, &byte) != RAM_ACCESS_OK) return i ? (int32_t)i : -SYSCALL_EFAULT;
+
+		if (sent) continue;
+
+		// A full ring is sent whole, even in the middle of a line
+		if (syscalls->count == SYSCALL_OUTPUT_SIZE) send_output(syscalls, true);
+
+		syscalls->output[(syscalls->head + syscalls->count++) & OUTPUT_MASK] = (char)byte;
+	}
+
+	return (int32_t)length;
+}
+
+/**
+ * @brief read(fd, buffer, length), standard input only.
+ * @return Bytes read, 0 at the end of the input, or a negated errno.
+ */
+static int32_t syscall_read(
+	MACHINE  machine,
+	uint32_t fd,
+	uint32_t address,
+	uint32_t length
+) {
+	if (fd != 0) return -SYSCALL_EBADF;
+
+	SYSCALLS syscalls = machine->syscalls;
+
+	// Without an input, standard input is always at its end
+	if (syscalls->files[0] < 0) return 0;
+
+	// A prompt is shown before the program waits for the answer
+	if (syscalls->count) send_output(syscalls, true);
+
+	char    buffer[4096];
+	ssize_t count;
+
+	do {
+		count = read(syscalls->files[0], buffer, length < sizeof(buffer) ? length : sizeof(buffer));
+	} while (count < 0 && errno == EINTR);
+
+	if (count < 0) return -SYSCALL_EIO;
+
+	RAM ram = machine->ram;
+
+	// The overwritten words join the undo record of the ecall, so stepping
+	// back over it restores the buffer
+	if (machine->journal) {
+		const uint32_t first = address & ~0x3u;
+		const uint32_t words = (uint32_t)(((address & 0x3u) + (uint64_t)count + 3) / 4);
+
+		for (uint32_t i = 0; i < words; i++) {
+			uint32_t old;
+			if (ram_load32(ram, first + 4 * i, &old) != RAM_ACCESS_OK) continue;
+
+			journal_push(machine->journal, (machine->pc - 4) | JOURNAL_MEMORY, first + 4 * i, old);
+		}
+	}
+
+	uint32_t written = 0;
+	while (written < (uint32_t)count && ram_store8(ram, address + written, (uint8_t)buffer[written]) == RAM_ACCESS_OK) {
+		written++;
+	}
+
+	// Instructions read into .text are decoded again
+	const uint64_t start = address > ram->text_base ? address : ram->text_base;
+	const uint64_t end   = (uint64_t)address + written < (uint64_t)ram->text_base + ram->text_size ?
+						   (uint64_t)address + written : (uint64_t)ram->text_base + ram->text_size;
+
+	if (start < end) invalidate_decoded_text(machine, (uint32_t)start, (uint32_t)(end - start));
+
+	return written == (uint32_t)count ? (int32_t)count : -SYSCALL_EFAULT;
+}
+
+cpu_status_t syscall_handle(MACHINE machine) {
+	if (!machine || !machine->syscalls) return CPU_STATUS_ECALL;
+
+	SYSCALLS  syscalls = machine->syscalls;
+	uint32_t *regs 	   = machine->registers;
+	uint32_t  result;
+
+	switch (regs[17]) {
+		case SYSCALL_WRITE:
+			result = (uint32_t)syscall_write(machine, regs[10], regs[11], regs[12]);
+			break;
+
+		case SYSCALL_READ:
+			result = (uint32_t)syscall_read(machine, regs[10], regs[11], regs[12]);
+			break;
+
+		case SYSCALL_BRK:
+			// The old break is restored with the registers of the step
+			if (machine->journal) {
+				journal_push(machine->journal, machine->pc - 4, JOURNAL_HEAP_BREAK, machine->ram->heap_break);
+			}
+
+			result = ram_brk(machine->ram, regs[10]);
+			break;
+
+		case SYSCALL_EXIT:
+		case SYSCALL_EXIT_GROUP:
+			syscalls->exit_step = machine->instret;
+			syscalls->exit_code = (int32_t)regs[10];
+
+			if (syscalls->count) send_output(syscalls, true);
+
+			return CPU_STATUS_EXIT;
+
+		default:
+			return CPU_STATUS_ECALL;
+	}
+
+	// The result joins the undo record of the ecall, pc is already past it
+	if (machine->journal) journal_push(machine->journal, machine->pc - 4, 10, regs[10]);
+
+	regs[10] = result;
+
+	return CPU_STATUS_BUDGET_EXHAUSTED;
+}
@@ -0,0 +1,333 @@
+/**
+ * @file timeline.c
+ * @brief Periodic copy-on-write checkpoints for random access in time.
+ *
+ * A page is stored by a checkpoint only when it was written since the
+ * previous one. Each stored page links to the checkpoint holding its older
+ * version, so the content of a page at checkpoint c is found by walking
+ * back from the latest version until one at or before c.
+ */
+
+#include "timeline.h"
+#include "journal.h"
+
+// MARK: - Helpers
+
+// Versions in latest and previous are checkpoint index + 1, 0 means the
+// page was never stored and reads as zero
+#define VERSION_OF(index) ((index) + 1)
+#define INDEX_OF(version) ((version) - 1)
+
+static bool page_is_zero(const uint8_t *page) {
+	for (size_t i = 0; i < RAM_PAGE_SIZE; i++) {
+		if (page[i]) return false;
+	}
+
+	return true;
+}
+
+/// Position of a page stored by the checkpoint, pages are sorted
+static uint32_t page_slot(
+	const checkpoint_t *checkpoint,
+	const uint32_t 		page
+) {
+	uint32_t low  = 0;
+	uint32_t high = checkpoint->page_count;
+
+	while (low < high) {
+		const uint32_t middle = low + (high - low) / 2;
+
+		if (checkpoint->pages[middle] < page) low = middle + 1;
+		else high = middle;
+	}
+
+	return low;
+}
+
+/// A dirty page is stored unless it is a never stored zero page
+static bool page_needs_store(
+	const TIMELINE timeline,
+	const RAM 	   ram,
+	const uint32_t page
+) {
+	if (timeline->latest[page] != TIMELINE_NONE) return true;
+
+	return ram_page_mapped(ram, page) &&
+		   !page_is_zero(ram_read_pointer(ram, page << RAM_PAGE_SHIFT));
+}
+
+static void free_checkpoint(checkpoint_t *checkpoint) {
+	free(checkpoint->pages);
+	free(checkpoint->previous);
+	free(checkpoint->data);
+}
+
+/// First dirty page at or after from, RAM_PAGE_COUNT when there is none
+static uint32_t next_dirty_page(
+	const RAM 	   ram,
+	const uint64_t from
+) {
+	uint32_t word = (uint32_t)(from >> 6);
+	if (word >= RAM_PAGE_COUNT / 64) return RAM_PAGE_COUNT;
+
+	uint64_t bits = ram->dirty_pages[word] & ~0ull << (from & 63);
+
+	while (!bits) {
+		if (++word == RAM_PAGE_COUNT / 64) return RAM_PAGE_COUNT;
+		bits = ram->dirty_pages[word];
+	}
+
+	return word * 64 + (uint32_t)__builtin_ctzll(bits);
+}
+
+// Visit every dirty page in ascending order
+#define FOR_EACH_DIRTY_PAGE(ram, page) \
+	for (uint32_t page = next_dirty_page(ram, 0); page < RAM_PAGE_COUNT; page = next_dirty_page(ram, (uint64_t)page + 1))
+
+// MARK: - Lifecycle
+
+bool enable_timeline(
+	MACHINE  machine,
+	uint64_t interval
+) {
+	if (!machine || !machine->ram) return false;
+
+	TIMELINE timeline = calloc(1, sizeof(struct timeline));
+	if (!timeline) return false;
+
+	// Zeroed on demand by the system, only touched entries use memory
+	timeline->interval = interval ? interval : 1;
+	timeline->latest   = calloc(RAM_PAGE_COUNT, sizeof(uint32_t));
+
+	if (!timeline->latest) {
+		free(timeline);
+		return false;
+	}
+
+	destroy_timeline(machine->timeline);
+	machine->timeline = timeline;
+
+	// The first checkpoint holds the whole image, zero pages are implicit
+	ram_mark_mapped_dirty(machine->ram);
+
+	if (!timeline_checkpoint(machine)) {
+		destroy_timeline(timeline);
+		machine->timeline = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+void disable_timeline(MACHINE machine) {
+	if (!machine) return;
+
+	destroy_timeline(machine->timeline);
+	machine->timeline = NULL;
+}
+
+void destroy_timeline(struct timeline *timeline) {
+	if (!timeline) return;
+
+	for (uint32_t i = 0; i < timeline->count; i++) {
+		free_checkpoint(&timeline->checkpoints[i]);
+	}
+
+	free(timeline->checkpoints);
+	free(timeline->latest);
+	free(timeline);
+}
+
+// MARK: - Recording
+
+uint64_t timeline_due(const MACHINE machine) {
+	const TIMELINE timeline = machine->timeline;
+	if (!timeline || timeline->count == 0) return 0;
+
+	const uint64_t next = timeline->checkpoints[timeline->count - 1].instret + timeline->interval;
+
+	return machine->instret < next ? next - machine->instret : 0;
+}
+
+bool timeline_checkpoint(MACHINE machine) {
+	if (!machine || !machine->timeline) return false;
+
+	const RAM ram 	  = machine->ram;
+	TIMELINE timeline = machine->timeline;
+
+	if (timeline->count == timeline->capacity) {
+		const uint32_t capacity = timeline->capacity ? timeline->capacity * 2 : 64;
+
+		checkpoint_t *checkpoints = realloc(timeline->checkpoints, capacity * sizeof(checkpoint_t));
+		if (!checkpoints) return false;
+
+		timeline->checkpoints = checkpoints;
+		timeline->capacity 	  = capacity;
+	}
+
+	uint32_t count = 0;
+	FOR_EACH_DIRTY_PAGE(ram, page) {
+		if (page_needs_store(timeline, ram, page)) count++;
+	}
+
+	checkpoint_t checkpoint = {
+		.instret 	= machine->instret,
+		.pc 		= machine->pc,
+		.heap_break = ram->heap_break,
+		.page_count = count
+	};
+
+	memcpy(checkpoint.registers, machine->registers, sizeof(checkpoint.registers));
+
+	if (count) {
+		checkpoint.pages 	= malloc(count * sizeof(uint32_t));
+		checkpoint.previous = malloc(count * sizeof(uint32_t));
+		checkpoint.data 	= malloc((size_t)count * RAM_PAGE_SIZE);
+
+		if (!checkpoint.pages || !checkpoint.previous || !checkpoint.data) {
+			free_checkpoint(&checkpoint);
+			return false;
+		}
+	}
+
+	const uint32_t version = VERSION_OF(timeline->count);
+	uint32_t stored = 0;
+
+	FOR_EACH_DIRTY_PAGE(ram, page) {
+		if (!page_needs_store(timeline, ram, page)) continue;
+
+		memcpy(
+			checkpoint.data + (size_t)stored * RAM_PAGE_SIZE,
+			ram_read_pointer(ram, page << RAM_PAGE_SHIFT),
+			RAM_PAGE_SIZE
+		);
+
+		checkpoint.pages[stored] 	= page;
+		checkpoint.previous[stored] = timeline->latest[page];
+		timeline->latest[page] 		= version;
+
+		stored++;
+	}
+
+	timeline->checkpoints[timeline->count++] = checkpoint;
+	timeline->stored_bytes += (size_t)count * RAM_PAGE_SIZE;
+
+	ram_clear_dirty(ram);
+
+	return true;
+}
+
+// MARK: - Seeking
+
+/**
+ * @brief Bring RAM and registers back to checkpoint index and drop the
+ * checkpoints after it.
+ */
+static void restore_checkpoint(
+	MACHINE  machine,
+	uint32_t index
+) {
+	const RAM ram 	  = machine->ram;
+	TIMELINE timeline = machine->timeline;
+
+	// Pages that may differ from the checkpoint: dirty now or stored later
+	for (uint32_t later = index + 1; later < timeline->count; later++) {
+		const checkpoint_t *checkpoint = &timeline->checkpoints[later];
+
+		for (uint32_t i = 0; i < checkpoint->page_count; i++) {
+			ram_mark_dirty(ram, checkpoint->pages[i] << RAM_PAGE_SHIFT);
+		}
+	}
+
+	const uint64_t text_end = (uint64_t)ram->text_base + ram->text_size;
+
+	FOR_EACH_DIRTY_PAGE(ram, page) {
+		uint32_t version = timeline->latest[page];
+		while (version != TIMELINE_NONE && INDEX_OF(version) > index) {
+			const checkpoint_t *newer = &timeline->checkpoints[INDEX_OF(version)];
+			version = newer->previous[page_slot(newer, page)];
+		}
+
+		timeline->latest[page] = version;
+
+		const uint32_t start = page << RAM_PAGE_SHIFT;
+
+		if (version != TIMELINE_NONE) {
+			const checkpoint_t *checkpoint = &timeline->checkpoints[INDEX_OF(version)];
+			const uint32_t 		slot 	   = page_slot(checkpoint, page);
+
+			uint8_t *data = ram_write_pointer(ram, start);
+			if (data) memcpy(data, checkpoint->data + (size_t)slot * RAM_PAGE_SIZE, RAM_PAGE_SIZE);
+
+		} else if (ram_page_mapped(ram, page)) {
+			memset(ram_write_pointer(ram, start), 0, RAM_PAGE_SIZE);
+		}
+
+		// Restored code must be decoded again
+		const uint64_t end = (uint64_t)start + RAM_PAGE_SIZE;
+
+		if (start < text_end && ram->text_base < end) {
+			const uint32_t first = start > ram->text_base ? start : ram->text_base;
+			const uint32_t last  = (uint32_t)(end < text_end ? end : text_end);
+
+			invalidate_decoded_text(machine, first, last - first);
+		}
+	}
+
+	for (uint32_t later = index + 1; later < timeline->count; later++) {
+		timeline->stored_bytes -= (size_t)timeline->checkpoints[later].page_count * RAM_PAGE_SIZE;
+		free_checkpoint(&timeline->checkpoints[later]);
+	}
+
+	timeline->count = index + 1;
+	ram_clear_dirty(ram);
+
+	const checkpoint_t *checkpoint = &timeline->checkpoints[index];
+
+	memcpy(machine->registers, checkpoint->registers, sizeof(machine->registers));
+	machine->pc 	 = checkpoint->pc;
+	machine->instret = checkpoint->instret;
+
+	ram_brk(ram, checkpoint->heap_break);
+}
+
+cpu_status_t timeline_seek(
+	MACHINE  machine,
+	uint64_t step
+) {
+	if (!machine || !machine->timeline || machine->timeline->count == 0) return CPU_STATUS_FETCH_FAULT;
+
+	TIMELINE timeline = machine->timeline;
+
+	// Last checkpoint at or before step
+	uint32_t low  = 0;
+	uint32_t high = timeline->count;
+
+	while (low < high) {
+		const uint32_t middle = low + (high - low) / 2;
+
+		if (timeline->checkpoints[middle].instret <= step) low = middle + 1;
+		else high = middle;
+	}
+
+	const uint32_t index = low ? low - 1 : 0;
+
+	// Running forward from the current state is cheaper than a restore
+	const bool ahead = index == timeline->count - 1 &&
+					   machine->instret >= timeline->checkpoints[index].instret &&
+					   machine->instret <= step;
+
+	if (!ahead) {
+		restore_checkpoint(machine, index);
+		journal_clear(machine->journal);
+	}
+
+	while (machine->instret < step) {
+		const cpu_status_t status = cpu_run(machine, step - machine->instret);
+
+		if (status == CPU_STATUS_ECALL || status == CPU_STATUS_EBREAK) continue;
+		if (status != CPU_STATUS_BUDGET_EXHAUSTED) return status;
+	}
+
+	return CPU_STATUS_BUDGET_EXHAUSTED;
+}
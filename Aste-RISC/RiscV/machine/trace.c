@@ -0,0 +1,677 @@
+/**
+ * @file trace.c
+ * @brief Encoder and writer of the execution trace, and its mmap reader.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "trace.h"
+
+#define TRACE_ECALL      0x00000073u
+#define TRACE_RING_MASK  (TRACE_RING_BYTES - 1)
+#define TRACE_POLL_NS    1000000L // writer sleep when the ring is empty
+
+// MARK: - Encoding
+
+static uint32_t zigzag(uint32_t delta) {
+	return (delta << 1) ^ (uint32_t)((int32_t)delta >> 31);
+}
+
+static uint32_t unzigzag(uint32_t value) {
+	return (value >> 1) ^ (0u - (value & 1));
+}
+
+static uint8_t *put_varint(
+	uint8_t  *out,
+	uint32_t  value
+) {
+	while (value >= 0x80) {
+		*out++ = (uint8_t)(value | 0x80);
+		value >>= 7;
+	}
+
+	*out++ = (uint8_t)value;
+
+	return out;
+}
+
+/**
+ * @brief Read a varint, NULL when it runs past end or over 32 bits.
+ */
+static const uint8_t *get_varint(
+	const uint8_t  *in,
+	const uint8_t  *end,
+		  uint32_t *value
+) {
+	uint32_t result = 0;
+
+	for (uint32_t shift = 0; shift < 35; shift += 7) {
+		if (in >= end) return NULL;
+
+		const uint8_t byte = *in++;
+		result |= (uint32_t)(byte & 0x7F) << shift;
+
+		if (!(byte & 0x80)) {
+			*value = result;
+			return in;
+		}
+	}
+
+	return NULL;
+}
+
+static void reset_state(trace_state_t *state) {
+	memset(state, 0, sizeof(*state));
+}
+
+/**
+ * @brief Register an instruction writes, 0 when it writes none.
+ */
+static uint32_t written_register(uint32_t word) {
+	if (word == TRACE_ECALL) return 10;
+
+	switch (word & 0x7F) {
+		case 0x23: // store
+		case 0x63: // branch
+		case 0x73: // system
+			return 0;
+
+		default:
+			return (word >> 7) & 0x1F;
+	}
+}
+
+static bool is_load(uint32_t word) {
+	return (word & 0x7F) == 0x03;
+}
+
+// MARK: - Ring
+
+/**
+ * @brief Copy the open block into the ring.
+ * @param wait Wait for the writer to make room instead of dropping the block.
+ *
+ * @return false when the block was dropped.
+ */
+static bool push_block(
+	TRACE trace,
+	bool  wait
+) {
+	const uint32_t length = (uint32_t)sizeof(trace_block_header_t) + trace->block_bytes;
+	const uint64_t head   = atomic_load_explicit(&trace->head, memory_order_relaxed);
+
+	for (;;) {
+		const uint64_t tail = atomic_load_explicit(&trace->tail, memory_order_acquire);
+		if (TRACE_RING_BYTES - (head - tail) >= length) break;
+		if (!wait) return false;
+
+		const struct timespec pause = { 0, TRACE_POLL_NS };
+		nanosleep(&pause, NULL);
+	}
+
+	const uint32_t offset = (uint32_t)(head & TRACE_RING_MASK);
+	const uint32_t first  = length < TRACE_RING_BYTES - offset ? length : TRACE_RING_BYTES - offset;
+
+	memcpy(trace->ring + offset, trace->block, first);
+	memcpy(trace->ring, trace->block + first, length - first);
+
+	atomic_store_explicit(&trace->head, head + length, memory_order_release);
+
+	return true;
+}
+
+/**
+ * @brief Push the open block, if it holds records, and start an empty one.
+ */
+static void end_block(
+	TRACE trace,
+	bool  wait
+) {
+	if (!trace->block_count) return;
+
+	const trace_block_header_t header = {
+		.magic 		= TRACE_BLOCK_MAGIC,
+		.bytes 		= trace->block_bytes,
+		.count 		= trace->block_count,
+		.first_step = trace->next_step - trace->block_count
+	};
+
+	memcpy(trace->block, &header, sizeof(header));
+
+	if (push_block(trace, wait)) {
+		trace->records += trace->block_count;
+		trace->blocks++;
+
+	} else {
+		trace->dropped_records += trace->block_count;
+		trace->dropped_blocks++;
+	}
+
+	trace->block_bytes = 0;
+	trace->block_count = 0;
+}
+
+static bool write_all(
+		  int      fd,
+	const uint8_t *data,
+		  size_t   length
+) {
+	while (length) {
+		const ssize_t written = write(fd, data, length);
+
+		if (written < 0) {
+			if (errno == EINTR) continue;
+			return false;
+		}
+
+		data   += written;
+		length -= (size_t)written;
+	}
+
+	return true;
+}
+
+/**
+ * @brief Drain the ring to the file until stopped, the run never waits on it.
+ */
+static void *trace_writer(void *argument) {
+	TRACE trace = argument;
+
+	for (;;) {
+		const uint64_t head = atomic_load_explicit(&trace->head, memory_order_acquire);
+		const uint64_t tail = atomic_load_explicit(&trace->tail, memory_order_relaxed);
+
+		if (head == tail) {
+			if (atomic_load_explicit(&trace->stop, memory_order_acquire)) break;
+
+			const struct timespec pause = { 0, TRACE_POLL_NS };
+			nanosleep(&pause, NULL);
+			continue;
+		}
+
+		// Up to the end of the ring, the rest on the next turn
+		const uint32_t offset = (uint32_t)(tail & TRACE_RING_MASK);
+		uint64_t       length = head - tail;
+		if (length > TRACE_RING_BYTES - offset) length = TRACE_RING_BYTES - offset;
+
+		// A failed write is recorded and the ring keeps draining
+		if (!atomic_load_explicit(&trace->failed, memory_order_relaxed) &&
+			!write_all(trace->fd, trace->ring + offset, (size_t)length)) {
+			atomic_store_explicit(&trace->failed, true, memory_order_relaxed);
+		}
+
+		atomic_store_explicit(&trace->tail, tail + length, memory_order_release);
+	}
+
+	return NULL;
+}
+
+// MARK: - Recording
+
+/**
+ * @brief Append a record to the open block.
+ * @param rd Register written, 0 for none.
+ * @param memory The access noted in trace belongs to the record.
+ */
+static void encode_record(
+	TRACE    trace,
+	uint64_t step,
+	uint32_t pc,
+	uint32_t word,
+	uint32_t rd,
+	uint32_t rd_value,
+	bool     memory
+) {
+	if (trace->block_count &&
+		(step != trace->next_step || trace->block_count == TRACE_BLOCK_RECORDS || trace->block_bytes >= TRACE_BLOCK_BYTES)) {
+		end_block(trace, false);
+	}
+
+	trace_state_t *state = &trace->state;
+	if (!trace->block_count) reset_state(state);
+
+	uint8_t *const start = trace->block + sizeof(trace_block_header_t) + trace->block_bytes;
+	uint8_t       *out 	 = start + 1;
+	uint32_t       flags = 0;
+
+	// The first record of a block always carries its pc
+	if (!trace->block_count || pc != state->pc + 4) {
+		flags |= TRACE_JUMP;
+		out = put_varint(out, zigzag(pc - (state->pc + 4)));
+	}
+
+	const uint32_t slot = (pc >> 2) & (TRACE_WORDS - 1);
+	if (state->word_tags[slot] != pc + 1 || state->words[slot] != word) {
+		flags |= TRACE_WORD;
+		memcpy(out, &word, sizeof(word));
+		out += sizeof(word);
+
+		state->word_tags[slot] = pc + 1;
+		state->words[slot] 	   = word;
+	}
+
+	if (rd) {
+		flags |= TRACE_RD;
+		out = put_varint(out, zigzag(rd_value - state->registers[rd]));
+		state->registers[rd] = rd_value;
+	}
+
+	if (memory) {
+		flags |= TRACE_MEMORY;
+		out = put_varint(out, zigzag(trace->address - state->address));
+		state->address = trace->address;
+
+		// A load into a register already left its value in rd
+		if (!(is_load(word) && rd)) {
+			flags |= TRACE_VALUE;
+			out = put_varint(out, trace->value);
+		}
+	}
+
+	*start = (uint8_t)flags;
+
+	state->pc 		   = pc;
+	trace->block_bytes += (uint32_t)(out - start);
+	trace->block_count++;
+	trace->next_step   = step + 1;
+}
+
+/**
+ * @brief Encode the ecall waiting for its result, with a0 when it has one.
+ */
+static void flush_ecall(
+		  TRACE     trace,
+	const uint32_t *registers
+) {
+	trace->ecall_pending = false;
+	encode_record(trace, trace->ecall_step, trace->ecall_pc, TRACE_ECALL, registers ? 10 : 0, registers ? registers[10] : 0, false);
+}
+
+void trace_retire(
+		  TRACE     trace,
+	const RAM       ram,
+		  uint32_t  pc,
+	const uint32_t *registers,
+		  uint64_t  step
+) {
+	// An ecall not serviced in C has no result to trace
+	if (trace->ecall_pending) flush_ecall(trace, NULL);
+
+	uint32_t word = 0;
+	const uint8_t *p = machine_translate(ram, pc, 4);
+	if (p) memcpy(&word, p, sizeof(word));
+
+	// The result of an ecall is known once it is serviced
+	if (word == TRACE_ECALL) {
+		trace->ecall_pending = true;
+		trace->ecall_pc 	 = pc;
+		trace->ecall_step 	 = step;
+		return;
+	}
+
+	const uint32_t rd = written_register(word);
+	encode_record(trace, step, pc, word, rd, registers[rd], trace->memory);
+
+	trace->memory = false;
+}
+
+void trace_syscall(
+		  TRACE     trace,
+	const uint32_t *registers
+) {
+	if (trace && trace->ecall_pending) flush_ecall(trace, registers);
+}
+
+// MARK: - Lifecycle
+
+TRACE new_trace(const char *path) {
+	if (!path) return NULL;
+
+	// The ring indices sit on their own cache lines, calloc does not
+	// guarantee that alignment
+	TRACE trace = aligned_alloc(_Alignof(struct trace), sizeof(struct trace));
+	if (!trace) return NULL;
+
+	memset(trace, 0, sizeof(struct trace));
+
+	trace->ring = malloc(TRACE_RING_BYTES);
+	trace->fd   = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+	trace_file_header_t header = { .version = TRACE_VERSION, .block_records = TRACE_BLOCK_RECORDS };
+	memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+
+	if (!trace->ring || trace->fd < 0 || !write_all(trace->fd, (const uint8_t *)&header, sizeof(header))) {
+		if (trace->fd >= 0) close(trace->fd);
+		free(trace->ring);
+		free(trace);
+		return NULL;
+	}
+
+	atomic_init(&trace->head, 0);
+	atomic_init(&trace->tail, 0);
+	atomic_init(&trace->stop, false);
+	atomic_init(&trace->failed, false);
+
+	if (pthread_create(&trace->writer, NULL, trace_writer, trace) != 0) {
+		close(trace->fd);
+		free(trace->ring);
+		free(trace);
+		return NULL;
+	}
+
+	return trace;
+}
+
+static void fill_stats(
+	const TRACE          trace,
+		  trace_stats_t *stats
+) {
+	stats->records 		   = trace->records;
+	stats->blocks 		   = trace->blocks;
+	stats->dropped_records = trace->dropped_records;
+	stats->dropped_blocks  = trace->dropped_blocks;
+	stats->bytes 		   = sizeof(trace_file_header_t) + atomic_load_explicit(&trace->tail, memory_order_acquire);
+	stats->failed 		   = atomic_load_explicit(&trace->failed, memory_order_relaxed);
+}
+
+/**
+ * @brief Write what is left, stop the writer, close the file and release
+ * the recorder.
+ * @param stats Filled with the final totals, NULL to ignore.
+ */
+static bool finish_trace(
+	TRACE          trace,
+	trace_stats_t *stats
+) {
+	if (trace->ecall_pending) flush_ecall(trace, NULL);
+
+	// The last block waits for room, then the writer drains the ring and ends
+	end_block(trace, true);
+	atomic_store_explicit(&trace->stop, true, memory_order_release);
+	pthread_join(trace->writer, NULL);
+
+	const bool closed = close(trace->fd) == 0;
+	const bool ok 	  = closed && !atomic_load(&trace->failed);
+
+	if (stats) {
+		fill_stats(trace, stats);
+		stats->failed = !ok;
+	}
+
+	free(trace->ring);
+	free(trace);
+
+	return ok;
+}
+
+bool destroy_trace(TRACE trace) {
+	if (!trace) return false;
+
+	return finish_trace(trace, NULL);
+}
+
+bool enable_trace(
+		  MACHINE  machine,
+	const char    *path
+) {
+	if (!machine) return false;
+
+	TRACE trace = new_trace(path);
+	if (!trace) return false;
+
+	destroy_trace(machine->trace);
+
+	trace->horizon = machine->instret;
+	machine->trace = trace;
+
+	return true;
+}
+
+bool disable_trace(
+	MACHINE        machine,
+	trace_stats_t *stats
+) {
+	if (!machine || !machine->trace) return false;
+
+	TRACE trace = machine->trace;
+	machine->trace = NULL;
+
+	return finish_trace(trace, stats);
+}
+
+bool trace_stats(
+	const MACHINE        machine,
+		  trace_stats_t *stats
+) {
+	if (!machine || !machine->trace || !stats) return false;
+
+	fill_stats(machine->trace, stats);
+
+	return true;
+}
+
+// MARK: - Reading
+
+TRACE_READER new_trace_reader(const char *path) {
+	if (!path) return NULL;
+
+	const int fd = open(path, O_RDONLY);
+	if (fd < 0) return NULL;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(trace_file_header_t)) {
+		close(fd);
+		return NULL;
+	}
+
+	const size_t size = (size_t)info.st_size;
+	void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (data == MAP_FAILED) return NULL;
+
+	TRACE_READER reader = calloc(1, sizeof(struct trace_reader));
+	if (!reader) {
+		munmap(data, size);
+		return NULL;
+	}
+
+	reader->data = data;
+	reader->size = size;
+
+	trace_file_header_t header;
+	memcpy(&header, data, sizeof(header));
+
+	if (memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0 || header.version != TRACE_VERSION) {
+		destroy_trace_reader(reader);
+		return NULL;
+	}
+
+	// Index the complete blocks, the capacity doubles as they are found
+	uint32_t capacity = 0;
+	size_t   offset   = sizeof(header);
+
+	while (size - offset >= sizeof(trace_block_header_t)) {
+		trace_block_header_t block;
+		memcpy(&block, reader->data + offset, sizeof(block));
+
+		if (block.magic != TRACE_BLOCK_MAGIC || block.bytes > size - offset - sizeof(block)) break;
+
+		if (reader->block_count == capacity) {
+			const uint32_t grown  = capacity ? capacity * 2 : 64;
+			trace_block_t *blocks = realloc(reader->blocks, grown * sizeof(trace_block_t));
+
+			if (!blocks) {
+				destroy_trace_reader(reader);
+				return NULL;
+			}
+
+			reader->blocks = blocks;
+			capacity 	   = grown;
+		}
+
+		reader->blocks[reader->block_count++] = (trace_block_t){
+			.offset 	= offset + sizeof(block),
+			.bytes 		= block.bytes,
+			.count 		= block.count,
+			.first_step = block.first_step
+		};
+
+		reader->records += block.count;
+		offset += sizeof(block) + block.bytes;
+	}
+
+	return reader;
+}
+
+bool destroy_trace_reader(TRACE_READER reader) {
+	if (!reader) return false;
+
+	munmap((void *)reader->data, reader->size);
+	free(reader->blocks);
+	free(reader);
+
+	return true;
+}
+
+static void open_block(
+	trace_cursor_t *cursor,
+	uint32_t        block
+) {
+	cursor->block  = block;
+	cursor->index  = 0;
+	cursor->cursor = block < cursor->reader->block_count
+		? cursor->reader->data + cursor->reader->blocks[block].offset
+		: NULL;
+
+	reset_state(&cursor->state);
+}
+
+bool trace_seek(
+	TRACE_READER    reader,
+	uint64_t        step,
+	trace_cursor_t *cursor
+) {
+	if (!reader || !cursor || !reader->block_count) return false;
+
+	// Last block starting at or before step
+	uint32_t low = 0, high = reader->block_count;
+	while (high - low > 1) {
+		const uint32_t middle = low + (high - low) / 2;
+
+		if (reader->blocks[middle].first_step <= step) low = middle;
+		else 										   high = middle;
+	}
+
+	const trace_block_t *block = &reader->blocks[low];
+
+	cursor->reader = reader;
+
+	// Before the trace or in the gap of a dropped block
+	if (step < block->first_step) {
+		open_block(cursor, low);
+		return true;
+	}
+
+	if (step - block->first_step >= block->count) {
+		if (low + 1 >= reader->block_count) return false;
+
+		open_block(cursor, low + 1);
+		return true;
+	}
+
+	open_block(cursor, low);
+
+	trace_record_t record;
+	for (uint64_t skip = step - block->first_step; skip > 0; skip--) {
+		if (!trace_next(cursor, &record)) return false;
+	}
+
+	return true;
+}
+
+bool trace_next(
+	trace_cursor_t *cursor,
+	trace_record_t *record
+) {
+	if (!cursor || !record || !cursor->reader) return false;
+
+	const TRACE_READER reader = cursor->reader;
+
+	while (cursor->block < reader->block_count && cursor->index == reader->blocks[cursor->block].count) {
+		open_block(cursor, cursor->block + 1);
+	}
+
+	if (cursor->block >= reader->block_count) return false;
+
+	const trace_block_t *block = &reader->blocks[cursor->block];
+	const uint8_t       *end   = reader->data + block->offset + block->bytes;
+	const uint8_t       *in    = cursor->cursor;
+	trace_state_t       *state = &cursor->state;
+
+	if (in >= end) return false;
+
+	const uint32_t flags = *in++;
+	uint32_t 	   value;
+
+	memset(record, 0, sizeof(*record));
+
+	record->step = block->first_step + cursor->index;
+	record->pc 	 = state->pc + 4;
+
+	if (flags & TRACE_JUMP) {
+		if (!(in = get_varint(in, end, &value))) return false;
+		record->pc = state->pc + 4 + unzigzag(value);
+	}
+
+	const uint32_t slot = (record->pc >> 2) & (TRACE_WORDS - 1);
+
+	if (flags & TRACE_WORD) {
+		if (end - in < (ptrdiff_t)sizeof(record->word)) return false;
+		memcpy(&record->word, in, sizeof(record->word));
+		in += sizeof(record->word);
+
+		state->word_tags[slot] = record->pc + 1;
+		state->words[slot] 	   = record->word;
+
+	} else {
+		if (state->word_tags[slot] != record->pc + 1) return false;
+		record->word = state->words[slot];
+	}
+
+	if (flags & TRACE_RD) {
+		if (!(in = get_varint(in, end, &value))) return false;
+
+		record->rd 		 = written_register(record->word);
+		record->rd_value = state->registers[record->rd] + unzigzag(value);
+
+		state->registers[record->rd] = record->rd_value;
+	}
+
+	if (flags & TRACE_MEMORY) {
+		if (!(in = get_varint(in, end, &value))) return false;
+
+		record->address = state->address + unzigzag(value);
+		state->address  = record->address;
+
+		if (flags & TRACE_VALUE) {
+			if (!(in = get_varint(in, end, &record->value))) return false;
+		} else {
+			record->value = record->rd_value;
+		}
+	}
+
+	record->flags = flags & (TRACE_RD | TRACE_MEMORY);
+	if (flags & TRACE_MEMORY) record->flags |= TRACE_VALUE;
+
+	state->pc 	   = record->pc;
+	cursor->cursor = in;
+	cursor->index++;
+
+	return true;
+}
@@ -132,6 +132,8 @@ struct BodyEditorView: View {
 			of: self.viewModel.fileSelected,
 			self.viewModel.handleFileSelectionChange
 		)
+		// Breakpoints belong to the program of the previous file
+		.onChange(of: self.viewModel.fileSelected) { self.cpu.clearBreakpoints() }
 		.frame(maxWidth: .infinity, maxHeight: .infinity)
 		.toolbar {
 				
@@ -33,6 +33,11 @@ class BodyEditorViewModel: ObservableObject {
 	@Published
 	var isOutputVisible: Bool
 	
+	/// Source line under the editor cursor, starting from 0,
+	/// the breakpoint and run to cursor actions act on it.
+	@Published
+	var cursorLine: Int?
+	
 	/// A wrapper for the C-pointer (`opts`) containing assembler and linker
 	/// options for the current file.
 	@Published
@@ -43,6 +48,7 @@ class BodyEditorViewModel: ObservableObject {
 		self.isSearchingFile = false
 		self.editorState     = .readyToBuild
 		self.isOutputVisible = false
+		self.cursorLine		 = nil
 		self.optionsWrapper  = OptionsAssemblerWrapper()
 	}
 		   
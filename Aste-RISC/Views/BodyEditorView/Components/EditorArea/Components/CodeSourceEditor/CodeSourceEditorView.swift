@@ -16,6 +16,7 @@ struct CodeSourceEditorView: View {
 	//@EnvironmentObject private var bodyEditorViewModel: BodyEditorViewModel
 
 	@Binding var document: CodeEditSourceEditorDocument
+	@Binding var cursorLine: Int?
 	
 	@State private var language: CodeLanguage = .default
 	@State private var theme   : EditorTheme = .dark
@@ -62,8 +63,12 @@ struct CodeSourceEditorView: View {
 		RISCVKeywordHighlightProvider()
 	]
 
-	init(document: Binding<CodeEditSourceEditorDocument>) {
-		self._document = document
+	init(
+		document  : Binding<CodeEditSourceEditorDocument>,
+		cursorLine: Binding<Int?>
+	) {
+		self._document   = document
+		self._cursorLine = cursorLine
 	}
 
 	var body: some View {
@@ -95,6 +100,15 @@ struct CodeSourceEditorView: View {
 			)
 			.frame(maxWidth: .infinity, maxHeight: .infinity)
 			.clipShape(RoundedRectangle(cornerRadius: 28))
+			// Positions count lines from 1
+			.onChange(of: self.editorState.cursorPositions) { _, positions in
+				guard let line = positions?.first?.start.line, line > 0 else {
+					self.cursorLine = nil
+					return
+				}
+				
+				self.cursorLine = line - 1
+			}
 			.onReceive(NotificationCenter.default.publisher(for: TreeSitterClient.Constants.longParse)) { _ in
 				withAnimation(.easeIn(duration: 0.1)) {
 					isInLongParse = true
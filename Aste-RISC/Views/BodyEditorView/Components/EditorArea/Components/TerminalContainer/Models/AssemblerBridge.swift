@@ -19,9 +19,14 @@ class AssemblerBridge {
 		return Int(parse_riscv_file(optionsAsembler, AssemblerBridge.cCallback))
 	}
 	
-	static let cCallback: @convention(c) (assembler_message_t) -> Void = { message in				
+	static let cCallback: @convention(c) (UnsafePointer<assembler_message_t>?, Int) -> Void = { messages, count in
+		guard let messages else { return }
+
+		// The texts belong to the C batch, copy them before it is reused
+		let batch = UnsafeBufferPointer(start: messages, count: count).map(TerminalMessage.init)
+
         Task { @MainActor in
-            AssemblerBridge.shared.terminal.append(message)            
+            AssemblerBridge.shared.terminal.append(contentsOf: batch)
         }
 	}
 }
@@ -9,12 +9,29 @@ import SwiftUI
 import Foundation
 internal import Combine
 
+/// Build message copied out of the C batch, which is reused after the callback
+struct TerminalMessage {
+	let type: message_type_t
+	let text: String
+	let file: String?
+	let line: Int
+	let column: Int
+
+	init(_ message: assembler_message_t) {
+		self.type   = message.type
+		self.text   = message.text.map { String(cString: $0) } ?? ""
+		self.file   = message.file.map { String(cString: $0) }
+		self.line   = Int(message.line)
+		self.column = Int(message.column)
+	}
+}
+
 final class TerminalOutputModel: ObservableObject {
 	@Published
-    var messages: [assembler_message_t] = []
+    var messages: [TerminalMessage] = []
 	
-	func append(_ message: assembler_message_t) {
-		Task { @MainActor in self.messages.append(message) }
+	func append(contentsOf batch: [TerminalMessage]) {
+		Task { @MainActor in self.messages.append(contentsOf: batch) }
 	}
 	
 	func clear() {
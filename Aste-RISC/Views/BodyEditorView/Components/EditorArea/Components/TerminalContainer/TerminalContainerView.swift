@@ -140,7 +140,7 @@ struct TerminalContainerView: View {
 			LazyVStack(alignment: .leading, spacing: 10) {
 				ForEach(terminal.messages.indices, id: \.self) { i in
 					let item = terminal.messages[i]
-					let text = String(cString: item.text).trimmingCharacters(in: .whitespacesAndNewlines)
+					let text = item.text.trimmingCharacters(in: .whitespacesAndNewlines)
 					
                     Group {
                         switch item.type {
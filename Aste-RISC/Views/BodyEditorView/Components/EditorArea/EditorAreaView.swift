@@ -30,7 +30,10 @@ struct EditorAreaView: View {
 				
 				switch editorUse {
 					case .native:
-						CodeSourceEditorView(document: $codeEditorDocument)
+						CodeSourceEditorView(
+							document  : $codeEditorDocument,
+							cursorLine: self.$bodyEditorViewModel.cursorLine
+						)
 							.frame(
 								maxWidth : .infinity,
 								maxHeight: topHeight(totalHeight: geo.size.height),
@@ -40,7 +43,10 @@ struct EditorAreaView: View {
 						
 					case .helix, .vim, .nvim:
 						if self.bodyEditorViewModel.editorState == .running {
-							CodeSourceEditorView(document: $codeEditorDocument)
+							CodeSourceEditorView(
+								document  : $codeEditorDocument,
+								cursorLine: self.$bodyEditorViewModel.cursorLine
+							)
 								.frame(
 									maxWidth : .infinity,
 									maxHeight: topHeight(totalHeight: geo.size.height),
@@ -0,0 +1,47 @@
+//
+//  CacheSectionView.swift
+//  Aste-RISC
+//
+
+import SwiftUI
+
+/// Accesses, misses and evictions of the L1 caches
+struct CacheSectionView: View {
+	@EnvironmentObject private var cpu: CPU
+	
+	var body: some View {
+		SimulatorSectionView(simulator: .cache) {
+			if let instruction = self.cpu.cacheStats(kind: CACHE_INSTRUCTION),
+			   let data		   = self.cpu.cacheStats(kind: CACHE_DATA),
+			   instruction.accesses > 0 {
+				
+				self.cacheRows("Instruction cache", instruction)
+				
+				Divider()
+				
+				self.cacheRows("Data cache", data)
+				
+			} else {
+				Text("Run the program to send its accesses through the caches")
+					.font(.caption)
+					.foregroundStyle(.secondary)
+			}
+		}
+	}
+	
+	/// Totals of one cache under its name
+	@ViewBuilder
+	private func cacheRows(_ name: String, _ stats: cache_stats_t) -> some View {
+		Text(name)
+			.font(.headline)
+			.fontDesign(.rounded)
+		
+		StatisticRowView(label: "Accesses", value: "\(stats.accesses)")
+		StatisticRowView(label: "Hits", value: "\(stats.hits)")
+		StatisticRowView(
+			label: "Misses",
+			value: "\(stats.misses)  " + String(format: "%.2f%%", 100 * cache_miss_rate(stats.misses, stats.accesses))
+		)
+		StatisticRowView(label: "Evictions", value: "\(stats.evictions)")
+	}
+}
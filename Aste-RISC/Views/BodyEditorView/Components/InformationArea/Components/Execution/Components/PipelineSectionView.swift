@@ -0,0 +1,44 @@
+//
+//  PipelineSectionView.swift
+//  Aste-RISC
+//
+
+import SwiftUI
+
+/// Cycles of the pipeline model and where they were lost
+struct PipelineSectionView: View {
+	@EnvironmentObject private var cpu: CPU
+	
+	var body: some View {
+		SimulatorSectionView(simulator: .pipeline) {
+			if var stats = self.cpu.pipelineStats(), stats.instructions > 0 {
+				StatisticRowView(label: "Cycles", value: "\(stats.cycles)")
+				StatisticRowView(label: "CPI", value: String(format: "%.3f", pipeline_cpi(&stats)))
+				
+				Divider()
+				
+				Text("Lost cycles")
+					.font(.headline)
+					.fontDesign(.rounded)
+				
+				self.lostRow("Load-use", stats.load_use_stalls, of: stats.cycles)
+				self.lostRow("Data", stats.data_stalls, of: stats.cycles)
+				self.lostRow("Branch", stats.branch_flushes, of: stats.cycles)
+				self.lostRow("Jump", stats.jump_flushes, of: stats.cycles)
+				
+			} else {
+				Text("Run the program to time it on the pipeline")
+					.font(.caption)
+					.foregroundStyle(.secondary)
+			}
+		}
+	}
+	
+	/// Cycles lost to one cause and their share of the run
+	private func lostRow(_ label: String, _ cycles: UInt64, of total: UInt64) -> some View {
+		StatisticRowView(
+			label: label,
+			value: "\(cycles)  \(StatisticRowView.percent(cycles, of: total))"
+		)
+	}
+}
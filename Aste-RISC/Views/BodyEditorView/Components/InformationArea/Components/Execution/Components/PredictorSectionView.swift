@@ -0,0 +1,63 @@
+//
+//  PredictorSectionView.swift
+//  Aste-RISC
+//
+
+import SwiftUI
+
+/// Accuracy of the branch predictor and its worst branches
+struct PredictorSectionView: View {
+	@EnvironmentObject private var cpu: CPU
+	
+	/// Rows of the mispredicted branches list
+	static private let branchLimit = 10
+	
+	var body: some View {
+		SimulatorSectionView(simulator: .predictor) {
+			if let stats = self.cpu.predictorStats(), stats.branches > 0 {
+				StatisticRowView(
+					label: "Branches",
+					value: "\(stats.branches)  " + StatisticRowView.percent(stats.taken, of: stats.branches) + " taken"
+				)
+				StatisticRowView(label: "Mispredicted", value: "\(stats.mispredicted)")
+				StatisticRowView(
+					label: "Accuracy",
+					value: String(format: "%.2f%%", 100 * predictor_accuracy(stats.mispredicted, stats.branches))
+				)
+				
+				let branches = self.cpu.mispredictedBranches(limit: Self.branchLimit)
+					.filter { $0.site.mispredicted > 0 }
+				
+				if !branches.isEmpty {
+					Divider()
+					
+					Text("Mispredicted branches")
+						.font(.headline)
+						.fontDesign(.rounded)
+					
+					ForEach(branches, id: \.pc) { entry in
+						HStack {
+							Text(String(format: "0x%08x", entry.pc))
+								.fontDesign(.monospaced)
+							
+							Spacer()
+							
+							Text("\(entry.site.mispredicted) of \(entry.site.executed)")
+								.fontDesign(.monospaced)
+							
+							Text(String(format: "%.1f%%", 100 * predictor_accuracy(entry.site.mispredicted, entry.site.executed)))
+								.fontDesign(.monospaced)
+								.foregroundStyle(.secondary)
+								.frame(width: 52, alignment: .trailing)
+						}
+					}
+				}
+				
+			} else {
+				Text("Run the program to predict its branches")
+					.font(.caption)
+					.foregroundStyle(.secondary)
+			}
+		}
+	}
+}
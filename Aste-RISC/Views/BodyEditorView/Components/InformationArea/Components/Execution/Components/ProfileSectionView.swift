@@ -0,0 +1,55 @@
+//
+//  ProfileSectionView.swift
+//  Aste-RISC
+//
+
+import SwiftUI
+
+/// Totals of the profile and the most executed instructions
+struct ProfileSectionView: View {
+	@EnvironmentObject private var cpu: CPU
+	
+	/// Rows of the hot instructions list
+	static private let hotLimit = 10
+	
+	var body: some View {
+		SimulatorSectionView(simulator: .profile) {
+			if let snapshot = self.cpu.profileSnapshot(), snapshot.instructions > 0 {
+				StatisticRowView(label: "Instructions", value: "\(snapshot.instructions)")
+				StatisticRowView(label: "Loads", value: "\(snapshot.loads)")
+				StatisticRowView(label: "Stores", value: "\(snapshot.stores)")
+				
+				Divider()
+				
+				Text("Hot instructions")
+					.font(.headline)
+					.fontDesign(.rounded)
+				
+				ForEach(self.cpu.hotInstructions(limit: Self.hotLimit), id: \.pc) { entry in
+					HStack {
+						Text(String(format: "0x%08x", entry.pc))
+							.fontDesign(.monospaced)
+						
+						Text(String(cString: handler_name(entry.handler)))
+							.foregroundStyle(.secondary)
+						
+						Spacer()
+						
+						Text("\(entry.count)")
+							.fontDesign(.monospaced)
+						
+						Text(StatisticRowView.percent(entry.count, of: snapshot.instructions))
+							.fontDesign(.monospaced)
+							.foregroundStyle(.secondary)
+							.frame(width: 52, alignment: .trailing)
+					}
+				}
+				
+			} else {
+				Text("Run the program to count its instructions")
+					.font(.caption)
+					.foregroundStyle(.secondary)
+			}
+		}
+	}
+}
@@ -0,0 +1,66 @@
+//
+//  SimulatorSectionView.swift
+//  Aste-RISC
+//
+
+import SwiftUI
+
+/// Card with the switch of a simulator, its content is shown
+/// only while the simulator is on and the program stopped
+struct SimulatorSectionView<Content: View>: View {
+	@EnvironmentObject private var cpu: CPU
+	
+	let simulator: Simulator
+	
+	@ViewBuilder
+	let content: () -> Content
+	
+	var body: some View {
+		VStack(alignment: .leading, spacing: 8) {
+			HStack {
+				
+				VStack(alignment: .leading) {
+					Text(self.simulator.rawValue)
+						.font(.title3)
+						.fontDesign(.rounded)
+						.bold()
+					
+					Text(self.simulator.detail)
+						.font(.caption)
+						.foregroundStyle(.secondary)
+				}
+				
+				Spacer()
+				
+				Toggle(self.simulator.rawValue, isOn: self.isEnabled)
+					.toggleStyle(.switch)
+					.labelsHidden()
+					.disabled(self.cpu.isRunning)
+			}
+			
+			if self.cpu.simulators.contains(self.simulator) {
+				Divider()
+				
+				// The engine thread owns the machine while it runs
+				if self.cpu.isRunning {
+					Text("Updated when the program stops")
+						.font(.caption)
+						.foregroundStyle(.secondary)
+					
+				} else { self.content() }
+			}
+		}
+		.padding()
+		.background(.ultraThickMaterial)
+		.clipShape(RoundedRectangle(cornerRadius: 15))
+		.padding(.horizontal)
+		.padding(.bottom)
+	}
+	
+	private var isEnabled: Binding<Bool> {
+		Binding(
+			get: { self.cpu.simulators.contains(self.simulator) },
+			set: { self.cpu.setSimulator(self.simulator, enabled: $0) }
+		)
+	}
+}
@@ -0,0 +1,32 @@
+//
+//  StatisticRowView.swift
+//  Aste-RISC
+//
+
+import SwiftUI
+
+/// Name and value of a simulator counter
+struct StatisticRowView: View {
+	let label: String
+	let value: String
+	
+	var body: some View {
+		HStack {
+			Text(self.label)
+				.font(.headline)
+				.fontDesign(.rounded)
+			
+			Spacer()
+			
+			Text(self.value)
+				.fontDesign(.monospaced)
+				.lineLimit(1)
+		}
+	}
+	
+	/// Share of `count` in `total`, as shown next to the counters
+	static func percent(_ count: UInt64, of total: UInt64) -> String {
+		guard total > 0 else { return "-" }
+		return String(format: "%.1f%%", Double(count) * 100 / Double(total))
+	}
+}
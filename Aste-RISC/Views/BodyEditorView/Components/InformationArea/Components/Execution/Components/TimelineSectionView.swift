@@ -0,0 +1,61 @@
+//
+//  TimelineSectionView.swift
+//  Aste-RISC
+//
+
+import SwiftUI
+
+/// Scrubber over the steps the program ran, releasing
+/// the thumb moves the program to the step under it
+struct TimelineSectionView: View {
+	@EnvironmentObject private var cpu: CPU
+	
+	/// Step under the thumb while it is dragged
+	@State private var target: Double? = nil
+	
+	var body: some View {
+		SimulatorSectionView(simulator: .timeline) {
+			if let start = self.cpu.timelineStart, self.cpu.furthestStep > start {
+				Slider(
+					value			 : self.position,
+					in				 : Double(start) ... Double(self.cpu.furthestStep),
+					onEditingChanged : self.seek
+				)
+				
+				HStack {
+					Text("Step \(UInt64(self.position.wrappedValue))")
+					
+					Spacer()
+					
+					Text("of \(self.cpu.furthestStep)")
+				}
+				.font(.caption)
+				.fontDesign(.monospaced)
+				.foregroundStyle(.secondary)
+				
+			} else {
+				Text("Run the program to record its steps")
+					.font(.caption)
+					.foregroundStyle(.secondary)
+			}
+		}
+	}
+	
+	/// The dragged step, otherwise the current one
+	private var position: Binding<Double> {
+		Binding(
+			get: { self.target ?? Double(self.cpu.currentStep) },
+			set: { self.target = $0.rounded() }
+		)
+	}
+	
+	/// Seek once the thumb is released
+	private func seek(isEditing: Bool) {
+		guard !isEditing, let target = self.target else { return }
+		
+		self.target = nil
+		
+		let result = self.cpu.seek(toStep: UInt64(target))
+		if result != .success { print(result.rawValue) }
+	}
+}
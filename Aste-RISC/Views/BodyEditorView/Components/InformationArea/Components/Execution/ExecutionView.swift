@@ -0,0 +1,18 @@
+//
+//  ExecutionView.swift
+//  Aste-RISC
+//
+
+import SwiftUI
+
+/// Simulators of the native engine, each section attaches
+/// its simulator and shows what it recorded
+struct ExecutionView: View {
+	var body: some View {
+		TimelineSectionView()
+		ProfileSectionView()
+		PipelineSectionView()
+		CacheSectionView()
+		PredictorSectionView()
+	}
+}
@@ -50,18 +50,27 @@ struct DataSectionView: View {
 			Divider()
             
             VStack {
-                if self.section.size > 0 {
-                    ForEach(0 ..< Int(section.size / 4), id: \.self) { index in
+                if self.section.size > 0, let ram = ram {
+                    let values = self.words(in: ram)
+                    
+                    ForEach(0 ..< values.count, id: \.self) { index in
                         let addr = section.startAddress + UInt32(index * 4)
-                        
-                        if let ram = ram {
-                            let value = read_ram32bit(ram, addr)
-                            MemoryWordRow(address: addr, value: value)
-                        }
+                        MemoryWordRow(address: addr, value: values[index])
                     }
                 }
             }
             .padding(.horizontal)
 		}
 	}
+	
+	/// The words of the section, read in a single call
+	private func words(in ram: RAM) -> [Int32] {
+		var values = [Int32](repeating: 0, count: Int(section.size / 4))
+		
+		_ = values.withUnsafeMutableBytes { buffer in
+			ram_read_range(ram, section.startAddress, buffer.baseAddress, buffer.count)
+		}
+		
+		return values
+	}
 }
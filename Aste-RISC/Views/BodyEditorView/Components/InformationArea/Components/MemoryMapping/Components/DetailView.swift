@@ -47,7 +47,8 @@ struct DetailView: View {
                 case .data:
                     DataSectionView(
                         section: section,
-                        ram       : self.cpu.ram
+                        // Read again once a background run stopped
+                        ram       : self.cpu.isRunning ? nil : self.cpu.ram
                     )
                         
                 case .heap:
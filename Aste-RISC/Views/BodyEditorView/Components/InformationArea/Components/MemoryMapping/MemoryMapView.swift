@@ -54,10 +54,11 @@ struct MemoryMapView: View {
             type: .data
         )
 		
-		// Heap (area tra .data e stack)
-		let heapStart = cpu.ram!.pointee.data_base + cpu.ram!.pointee.data_size
-		if sp > heapStart {
-			let heapSize = sp - heapStart
+		// Heap (da heap_start fino al break corrente)
+		let heapStart = cpu.ram!.pointee.heap_start
+		let heapBreak = cpu.ram!.pointee.heap_break
+		if heapBreak > heapStart {
+			let heapSize = heapBreak - heapStart
             
 			sections["heap"] = MemorySection(
                 name: "heap",
@@ -66,6 +66,11 @@ struct InformationAreaView: View {
 				.glassEffect()
 				.frame(height: 27)
                 
+			case .execution:
+				Text("Simulators but the profile slow the run down, turn on only the ones you need")
+					.font(.caption)
+					.foregroundStyle(.secondary)
+				
 		}
 		
 		Divider()
@@ -87,6 +92,9 @@ struct InformationAreaView: View {
 			case .stack:
 				MemoryMapView(contentFile: contentFile)
 					.environmentObject(self.informationAreaViewModel)
+				
+			case .execution:
+				ExecutionView()
 		}
 	}
 }
@@ -8,4 +8,5 @@
 enum InformationNavigation: String, CaseIterable, Equatable {
 	case tableRegisters = "tablecells"
 	case stack			= "square.stack.3d.up"
+	case execution		= "gauge.with.dots.needle.67percent"
 }
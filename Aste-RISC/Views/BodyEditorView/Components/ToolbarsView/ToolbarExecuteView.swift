@@ -25,6 +25,7 @@ struct ToolbarExecuteView: View {
 	@Binding
 	private var mapInstruction: MapInstructions
 	    
+	
 	/// Static regex, create when use the instance
 	/// to principal view (body view)
     static private let instructionRegex = try! NSRegularExpression(
@@ -61,7 +62,7 @@ struct ToolbarExecuteView: View {
 					
 				} else {
 					Color.clear
-						.frame(width: 80.0, height: 35.0)
+						.frame(width: 280.0, height: 35.0)
 						.allowsHitTesting(false)
 				}
 				
@@ -101,6 +102,16 @@ struct ToolbarExecuteView: View {
 			backwardButton
 
 			forwardButton
+			
+			stepOverButton
+			
+			stepOutButton
+			
+			continueButton
+			
+			breakpointButton
+			
+			runToCursorButton
 		}
 		.transition(.move(edge: .leading).combined(with: .opacity))
 	}
@@ -120,7 +131,7 @@ struct ToolbarExecuteView: View {
 		}
 		.keyboardShortcut("p", modifiers: .command)
 		.glassEffect(in: .circle)
-		.disabled(self.cpu.historyStack.isEmpty || self.cpu.resetFlag)
+		.disabled(!self.cpu.canStepBack || self.cpu.resetFlag || self.cpu.isRunning)
 	}
 	
 	/// Manage the forward button execution
@@ -140,7 +151,115 @@ struct ToolbarExecuteView: View {
 		}
 		.keyboardShortcut("n", modifiers: .command)
 		.glassEffect(in: .circle)
-		.disabled(self.cpu.resetFlag)
+		.disabled(self.cpu.resetFlag || self.cpu.isRunning)
+	}
+	
+	/// Manage the step over button, a call runs on the native
+	/// engine until it returns, any other instruction is a step
+	private var stepOverButton: some View {
+		Button {
+			// The result is printed once the call returned
+			self.cpu.stepOver()
+			
+		} label: {
+			Image(systemName: "arrow.turn.down.right")
+				.font(.caption)
+		}
+		.keyboardShortcut("n", modifiers: [.command, .option])
+		.glassEffect(in: .circle)
+		.disabled(self.cpu.resetFlag || self.cpu.machine == nil || self.cpu.isRunning)
+	}
+	
+	/// Manage the step out button, it runs on the native engine
+	/// until the current function returns
+	private var stepOutButton: some View {
+		Button {
+			// The result is printed once the function returned
+			self.cpu.stepOut()
+			
+		} label: {
+			Image(systemName: "arrow.turn.left.up")
+				.font(.caption)
+		}
+		.keyboardShortcut("u", modifiers: [.command, .option])
+		.glassEffect(in: .circle)
+		.disabled(self.cpu.resetFlag || self.cpu.machine == nil || self.cpu.isRunning)
+	}
+	
+	/// Manage the continue button execution, it runs the
+	/// program on the native engine until a breakpoint, a
+	/// watchpoint, exit, an unknown ecall, a fault or the
+	/// end of the text section. The program runs in the
+	/// background, meanwhile the button pauses it
+	private var continueButton: some View {
+		Button {
+			// The result is printed once the program stopped
+			if self.cpu.isRunning {
+				self.cpu.pause()
+				
+			} else {
+				self.cpu.continueExecution()
+			}
+			
+		} label: {
+			Image(systemName: self.cpu.isRunning ? "pause.fill" : "forward.end.fill")
+				.font(.caption)
+		}
+		.keyboardShortcut("n", modifiers: [.command, .shift])
+		.glassEffect(in: .circle)
+		.disabled(self.cpu.resetFlag || self.cpu.machine == nil)
+	}
+
+	/// Set or clear the breakpoint on the instruction
+	/// of the source line under the editor cursor
+	private var breakpointButton: some View {
+		let address = self.cursorAddress
+		let isSet   = address.map { self.cpu.breakpoints.contains($0) } ?? false
+		
+		return Button {
+			guard let address = address else { return }
+			
+			self.cpu.toggleBreakpoint(address: address)
+			
+		} label: {
+			Image(systemName: isSet ? "circle.fill" : "circle")
+				.font(.caption)
+		}
+		.keyboardShortcut("\\", modifiers: .command)
+		.glassEffect(in: .circle)
+		.disabled(address == nil || self.cpu.machine == nil || self.cpu.isRunning)
+	}
+	
+	/// Run the program on the native engine until it reaches
+	/// the instruction of the line under the editor cursor
+	private var runToCursorButton: some View {
+		let address = self.cursorAddress
+		
+		return Button {
+			// The result is printed once the program stopped
+			guard let address = address else { return }
+			
+			self.cpu.runToCursor(address: address)
+			
+		} label: {
+			Image(systemName: "arrow.right.to.line")
+				.font(.caption)
+		}
+		.keyboardShortcut("c", modifiers: [.command, .control])
+		.glassEffect(in: .circle)
+		.disabled(address == nil || self.cpu.resetFlag || self.cpu.machine == nil || self.cpu.isRunning)
+	}
+	
+	/// Address of the instruction on the line under the editor
+	/// cursor, nil when the line holds no instruction. The line
+	/// table of the assembler covers the pseudo-instructions
+	/// made of several words, a toolchain build has none
+	private var cursorAddress: UInt32? {
+		guard let line = self.viewModel.cursorLine,
+			  let opts = self.viewModel.optionsWrapper.opts else { return nil }
+		
+		var address: UInt32 = 0
+		return find_source_line(opts, UInt32(line + 1), &address) ? address : nil
 	}
 
 	// MARK: - Handlers
@@ -190,64 +309,19 @@ struct ToolbarExecuteView: View {
 			// Get options struct
 			let opt = self.viewModel.optionsWrapper.opts!.pointee
 		
-			// Calc all ram virtual address
-			let textStart = Int(opt.text_vaddr)
-			let textEnd   = textStart + opt.text_size
-			let dataStart = Int(opt.data_vaddr)
-			let dataEnd   = dataStart + opt.data_size
-
-			// Set a offset ram, this garanted the ram size
-			// to run the program
-			let stackSize = 0x10000 // 64KB stack
-			
-			// Set the top of stack
-			let stackTop = max(textEnd, dataEnd) + stackSize
-
-			// Set ram size
-			let ramBase = 0
-			let ramSize = stackTop
-
-			// Instance ram for program
-			self.cpu.ram = new_ram(ramSize, UInt32(ramBase))
-            
-//            print("Text Range: 0x\(String(opt.text_vaddr, radix: 16)) - 0x\(String(opt.text_vaddr + UInt32(opt.text_size), radix: 16))")
-//            print("Data Range: 0x\(String(opt.data_vaddr, radix: 16)) - 0x\(String(opt.data_vaddr + UInt32(opt.data_size), radix: 16))")
-//            print("Il codice sta accedendo a: 0x4220")
-			
-			// Load binary on ram, this is REQUIRED, because the program
-			// counter is a pointer to ram
-			load_binary_to_ram(
-				cpu.ram,
-				opt.data_data,
-				opt.data_size,
-				opt.data_vaddr
-			)
-			
-			load_binary_to_ram(
-				cpu.ram,
-				opt.text_data,
-				opt.text_size,
-				opt.text_vaddr
-			)
-			
-			load_text_information(
-				cpu.ram,
-				opt.text_vaddr,
-				UInt32(opt.text_size)
-			)
+			// Map the segments with their permissions and place the
+			// heap and the stack after the program
+			var layout = program_layout_t()
+			self.cpu.loadRam(new_program_ram(self.viewModel.optionsWrapper.opts, &layout))
 			
-			load_data_information(
-				cpu.ram,
-				opt.data_vaddr,
-				UInt32(opt.data_size)
-			)
-		
 			// Get program entry point
 			self.cpu.loadEntryPoint(value: opt.entry_point)
 
-			self.cpu.registers[2] = Int(stackTop - 4)
-            let globalPointer = Int(opt.data_vaddr) + 0x800
-            self.cpu.registers[3] = globalPointer
+			self.cpu.registers[2] = Int(layout.stack_pointer)
+			self.cpu.registers[3] = Int(layout.global_pointer)
+			
+			// Bind the native engine to the loaded program
+			self.cpu.attachMachine(optionsSource: opt)
 		}
 		
 		// Init map program counter to line index source code
@@ -6,6 +6,7 @@
 
 #include "args_handler.h"
 #include "asm_file_parser.h"
+#include "elf.h"
 
 
 /**
@@ -16,8 +17,7 @@ void free_options(options_t *opts) {
     if (!opts) return;
 
     if (opts->binary_file) free(opts->binary_file);
-    if (opts->text_data)   free(opts->text_data);
-    if (opts->data_data)   free(opts->data_data);
+    unload_elf_sections(opts);
 
     free(opts);
 }
@@ -30,6 +30,8 @@ void free_options(options_t *opts) {
 options_t* start_options(char *url) {
     options_t* opts = calloc(1, sizeof(options_t));
     if (!opts) { return NULL; }
+
+    opts->image_fd = -1;
 	
 	if (!url) {
 		fprintf(stderr, "Error: No binary file specified (URL is NULL)\n");
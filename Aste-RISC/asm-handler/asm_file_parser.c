@@ -4,6 +4,8 @@
 
 #include "asm_file_parser.h"
 #include "elf.h"
+#include "builtin_assembler.h"
+#include "build_cache.h"
 
 /**
  * @brief returns true if the file in the given path has .s extension
@@ -15,6 +17,61 @@ bool is_assembly_file(const char *filepath) {
 	return ext && strcmp(ext, ".s") == 0;
 }
 
+/**
+ * @brief Read the whole source file
+ * @param filepath path of the .s file
+ * @param length receives the length of the source
+ * @return the source, to free, NULL on error
+ */
+static char* read_source(const char *filepath, size_t *length) {
+    FILE *file = fopen(filepath, "rb");
+    if (!file) return NULL;
+
+    fseek(file, 0, SEEK_END);
+    const long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    // One spare byte, an empty source still gets a buffer
+    char *source = size >= 0 ? malloc((size_t)size + 1) : NULL;
+    *length = source ? fread(source, 1, (size_t)size, file) : 0;
+    fclose(file);
+
+    return source;
+}
+
+/**
+ * @brief Assemble a source in process, or with the toolchain when it uses
+ * features the built-in assembler does not support
+ * @return 0 on success, -1 on error
+ */
+static int assemble_source(
+	options_t *options_pointer,
+	const char *source,
+	size_t length,
+	LogCallback callback
+) {
+    const char *name = strrchr(options_pointer->binary_file, '/');
+
+    const assemble_result_t assembled = assemble_riscv_source(
+        source,
+        length,
+        name ? name + 1 : options_pointer->binary_file,
+        options_pointer,
+        callback
+    );
+
+    if (assembled != ASSEMBLE_UNSUPPORTED) return assembled == ASSEMBLE_OK ? 0 : -1;
+
+    char elf_path[512];
+    if (compile_assembly_with_log(options_pointer->binary_file, elf_path, callback) != 0) return -1;
+
+    // The assembled ELF is temporary, its mapping outlives the name
+    const int loaded = load_elf_sections(elf_path, options_pointer);
+    unlink(elf_path);
+
+    return loaded;
+}
+
 /**
  * @brief Check if the file has a .s extension
  * @param options_pointer options_t pointer to the options structure
@@ -31,10 +88,29 @@ int parse_riscv_file(
     }
 
     if (is_assembly_file(options_pointer->binary_file)) {
-        char elf_path[512];
-		if (compile_assembly_with_log(options_pointer->binary_file, elf_path, callback) != 0) return -1;
-        
-        return load_elf_sections(elf_path, options_pointer);
+        size_t length;
+        char *source = read_source(options_pointer->binary_file, &length);
+
+        if (!source) {
+            log_message(callback, MESSAGE_ERROR, "Cannot open the source file");
+
+            return -1;
+        }
+
+        // The same source is often run many times, its image is reused
+        const uint64_t key = build_cache_key(source, length);
+
+        if (build_cache_load(key, length, options_pointer) == 0) {
+            free(source);
+            return 0;
+        }
+
+        const int loaded = assemble_source(options_pointer, source, length, callback);
+        free(source);
+
+        if (loaded == 0) build_cache_store(key, length, options_pointer);
+
+        return loaded;
     }
 
     return load_elf_sections(options_pointer->binary_file, options_pointer);
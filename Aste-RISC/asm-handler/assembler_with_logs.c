@@ -7,50 +7,359 @@
 
 #include "assembler_with_logs.h"
 
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <stdbool.h>
+#include <strings.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+// Longest line kept whole, longer ones are split
+#define LOG_LINE_MAX 1024
+
+// Queued messages are sent at least this often while a program runs
+#define LOG_FLUSH_INTERVAL_MS 50
+
+// MARK: - Batches
+
+void log_batch_init(
+	log_batch_t *batch,
+	LogCallback callback
+) {
+	batch->callback = callback;
+	batch->count    = 0;
+	batch->used     = 0;
+}
+
+void log_batch_flush(log_batch_t *batch) {
+	if (batch->count && batch->callback) batch->callback(batch->messages, batch->count);
+
+	batch->count = 0;
+	batch->used  = 0;
+}
+
+/**
+ * @brief Copy a string in the text of the batch, NUL terminated
+ */
+static const char* batch_string(
+	log_batch_t *batch,
+	const char *string,
+	size_t length
+) {
+	char *copy = batch->text + batch->used;
+
+	memcpy(copy, string, length);
+	copy[length] = '\0';
+	batch->used += length + 1;
+
+	return copy;
+}
+
+/**
+ * @brief Length of a severity keyword at p, followed by ':', 0 if none
+ */
+static size_t severity_at(
+	const char *p,
+	const char *end,
+	message_type_t *type
+) {
+	static const struct { const char *word; message_type_t type; } severities[] = {
+		{ "fatal error", MESSAGE_ERROR },
+		{ "error", 		 MESSAGE_ERROR },
+		{ "warning", 	 MESSAGE_WARNING },
+		{ "note", 		 MESSAGE_INFO },
+		{ "info", 		 MESSAGE_INFO }
+	};
+
+	for (size_t i = 0; i < sizeof(severities) / sizeof(severities[0]); i++) {
+		const size_t length = strlen(severities[i].word);
+
+		if ((size_t)(end - p) > length && strncasecmp(p, severities[i].word, length) == 0 && p[length] == ':') {
+			*type = severities[i].type;
+			return length + 1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Read a decimal number, p is left unchanged when there is none
+ */
+static bool read_number(
+	const char **p,
+	const char *end,
+	uint32_t *value
+) {
+	const char *q = *p;
+	uint32_t number = 0;
+
+	while (q < end && isdigit((unsigned char)*q)) number = number * 10 + (uint32_t)(*q++ - '0');
+	if (q == *p) return false;
+
+	*value = number;
+	*p 	   = q;
+
+	return true;
+}
+
+message_type_t log_batch_add_line(
+	log_batch_t *batch,
+	const char *line,
+	size_t length
+) {
+	while (length && isspace((unsigned char)line[length - 1])) length--;
+	if (length > LOG_LINE_MAX) length = LOG_LINE_MAX;
+
+	const char *end = line + length;
+
+	assembler_message_t message = { MESSAGE_INFO, NULL, NULL, 0, 0, NULL };
+	size_t file_length = 0;
+	const char *rest   = line;
+
+	// Location: the first "name:line[:column]:" of the line
+	for (const char *colon = memchr(line, ':', length); colon; colon = memchr(colon + 1, ':', (size_t)(end - colon - 1))) {
+		const char *p = colon + 1;
+		uint32_t number;
+
+		if (colon == line || !read_number(&p, end, &number) || p == end || *p != ':') continue;
+
+		message.line = number;
+		p++;
+
+		const char *column = p;
+		if (read_number(&column, end, &number) && column < end && *column == ':') {
+			message.column = number;
+			p = column + 1;
+		}
+
+		file_length = (size_t)(colon - line);
+		rest 		= p;
+		break;
+	}
+
+	// Severity: right after the location, or after a "tool:" prefix
+	const char *text = rest;
+	while (text < end && *text == ' ') text++;
+
+	size_t severity = severity_at(text, end, &message.type);
+
+	if (!severity && !file_length) {
+		const char *colon = memchr(text, ':', (size_t)(end - text));
+
+		if (colon) {
+			const char *after = colon + 1;
+			while (after < end && *after == ' ') after++;
+
+			severity = severity_at(after, end, &message.type);
+			if (severity) text = after;
+		}
+	}
+
+	size_t message_offset = 0;
+	if (severity) {
+		text += severity;
+		while (text < end && *text == ' ') text++;
+
+		message_offset = (size_t)(text - line);
+	}
+
+	const size_t need = length + 1 + (file_length ? file_length + 1 : 0);
+	if (batch->count == LOG_BATCH_MESSAGES || batch->used + need > LOG_BATCH_TEXT) log_batch_flush(batch);
+
+	const char *copy = batch_string(batch, line, length);
+
+	message.text 	= copy;
+	message.message = copy + message_offset;
+	if (file_length) message.file = batch_string(batch, line, file_length);
+
+	batch->messages[batch->count++] = message;
+
+	return message.type;
+}
+
+void log_batch_add_text(
+	log_batch_t *batch,
+	message_type_t type,
+	const char *text,
+	size_t length
+) {
+	if (batch->count == LOG_BATCH_MESSAGES || batch->used + length + 1 > LOG_BATCH_TEXT) log_batch_flush(batch);
+
+	const char *copy = batch_string(batch, text, length);
+
+	batch->messages[batch->count++] = (assembler_message_t){ type, copy, NULL, 0, 0, copy };
+}
+
+void log_message(
+	LogCallback callback,
+	message_type_t type,
+	const char *text
+) {
+	if (!callback) return;
+
+	const assembler_message_t message = { type, text, NULL, 0, 0, text };
+	callback(&message, 1);
+}
+
+// MARK: - Processes
+
+// Output stream of a child, lines are collected until their newline
+typedef struct {
+	int    fd;
+	char   line[LOG_LINE_MAX];
+	size_t length;
+
+} log_stream_t;
+
 /**
- * @brief Execute command shell and send stdout/stderr to Swift using Callback function
- * @param cmd Pass command to execute
+ * @brief Queue the complete lines read from a stream
+ * @return false once the stream is closed
+ */
+static bool read_stream(
+	log_stream_t *stream,
+	log_batch_t *batch,
+	bool *failed
+) {
+	char buffer[4096];
+	ssize_t count;
+
+	while ((count = read(stream->fd, buffer, sizeof(buffer))) > 0) {
+		for (ssize_t i = 0; i < count; i++) {
+			const bool newline = buffer[i] == '\n';
+
+			if (!newline) stream->line[stream->length++] = buffer[i];
+
+			if (newline || stream->length == LOG_LINE_MAX) {
+				if (stream->length && log_batch_add_line(batch, stream->line, stream->length) == MESSAGE_ERROR) *failed = true;
+				stream->length = 0;
+			}
+		}
+	}
+
+	if (count < 0 && (errno == EAGAIN || errno == EINTR)) return true;
+
+	// End of the output, the last line may have no newline
+	if (stream->length && log_batch_add_line(batch, stream->line, stream->length) == MESSAGE_ERROR) *failed = true;
+	stream->length = 0;
+
+	close(stream->fd);
+	stream->fd = -1;
+
+	return false;
+}
+
+/**
+ * @brief Run a program and stream its stdout/stderr to Swift using Callback function
+ * @param argv Path of the program and its arguments, NULL terminated
  * @param callback Function to get std outputs
- * @return -1 for errors, else retuls
+ * @return -1 for errors, else the exit status
  */
 int run_command_with_log(
-	const char *cmd,
+	const char *const argv[],
 	LogCallback callback
 ) {
-	FILE *pipe = popen(cmd, "r");
-	
-	if (!pipe) {
-		const assembler_message_t message = { MESSAGE_ERROR, "Failed to open process pipe" };
-		callback(message);
-		
+	int out[2], err[2];
+
+	if (pipe(out) != 0) {
+		log_message(callback, MESSAGE_ERROR, "Failed to open process pipe");
+		return -1;
+	}
+
+	if (pipe(err) != 0) {
+		close(out[0]);
+		close(out[1]);
+
+		log_message(callback, MESSAGE_ERROR, "Failed to open process pipe");
+		return -1;
+	}
+
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_adddup2(&actions, out[1], STDOUT_FILENO);
+	posix_spawn_file_actions_adddup2(&actions, err[1], STDERR_FILENO);
+	posix_spawn_file_actions_addclose(&actions, out[0]);
+	posix_spawn_file_actions_addclose(&actions, err[0]);
+	posix_spawn_file_actions_addclose(&actions, out[1]);
+	posix_spawn_file_actions_addclose(&actions, err[1]);
+
+	pid_t pid;
+	const int spawned = posix_spawn(&pid, argv[0], &actions, NULL, (char *const *)argv, environ);
+
+	posix_spawn_file_actions_destroy(&actions);
+	close(out[1]);
+	close(err[1]);
+
+	if (spawned != 0) {
+		close(out[0]);
+		close(err[0]);
+
+		log_message(callback, MESSAGE_ERROR, "Failed to start the toolchain");
 		return -1;
 	}
 
-	char buffer[512];
-	while (fgets(buffer, sizeof(buffer), pipe)) {
-		assembler_message_t message;
-
-		if (strstr(buffer, "warning:") != NULL) {
-			message.type = MESSAGE_WARNING;
-			
-		} else if (strstr(buffer, "error:") != NULL) {
-			message.type = MESSAGE_ERROR;
-			message.text = strdup(buffer);
-			callback(message);
-			
-			return -1;
-			
-		} else {
-			message.type = MESSAGE_INFO;
-			
+	log_stream_t *streams = malloc(2 * sizeof(log_stream_t));
+	log_batch_t  *batch   = malloc(sizeof(log_batch_t));
+	bool failed = false;
+
+	if (streams && batch) {
+		streams[0].fd = out[0];
+		streams[1].fd = err[0];
+		streams[0].length = streams[1].length = 0;
+
+		log_batch_init(batch, callback);
+
+		fcntl(out[0], F_SETFL, fcntl(out[0], F_GETFL) | O_NONBLOCK);
+		fcntl(err[0], F_SETFL, fcntl(err[0], F_GETFL) | O_NONBLOCK);
+
+		// Poll both pipes, closed streams have a negative fd and are ignored
+		while (streams[0].fd >= 0 || streams[1].fd >= 0) {
+			struct pollfd fds[2] = {
+				{ .fd = streams[0].fd, .events = POLLIN },
+				{ .fd = streams[1].fd, .events = POLLIN }
+			};
+
+			const int ready = poll(fds, 2, LOG_FLUSH_INTERVAL_MS);
+
+			if (ready < 0 && errno != EINTR) break;
+
+			// Nothing new, the queued lines are sent while the program works
+			if (ready == 0) log_batch_flush(batch);
+
+			for (int i = 0; ready > 0 && i < 2; i++) {
+				if (fds[i].fd >= 0 && fds[i].revents) read_stream(&streams[i], batch, &failed);
+			}
 		}
 
-		message.text = strdup(buffer);
-		callback(message);
+		log_batch_flush(batch);
+
+	} else {
+		log_message(callback, MESSAGE_ERROR, "Out of memory while reading the toolchain output");
+		failed = true;
 	}
 
-	const int status = pclose(pipe);
-	
+	if (streams) {
+		for (int i = 0; i < 2; i++) if (streams[i].fd >= 0) close(streams[i].fd);
+	} else {
+		close(out[0]);
+		close(err[0]);
+	}
+
+	free(streams);
+	free(batch);
+
+	int status;
+	while (waitpid(pid, &status, 0) < 0) {
+		if (errno != EINTR) return -1;
+	}
+
+	if (!WIFEXITED(status)) return -1;
+	if (failed && WEXITSTATUS(status) == 0) return -1;
+
 	return WEXITSTATUS(status);
 }
 
@@ -65,82 +374,56 @@ int compile_assembly_with_log(
 	char *output_elf_path,
 	LogCallback callback
 ) {
-	
-	char cmd[512]; // Command to execute
-	char temp_obj[256];
+	char temp_obj[512];
 
-	sprintf(
+	snprintf(
 		temp_obj,
+		sizeof(temp_obj),
 		"%s.o",
 		filepath
 	);
-	
-	sprintf(
+
+	snprintf(
 		output_elf_path,
+		512,
 		"%s.elf",
 		filepath
 	);
-    
-    assembler_message_t message = { MESSAGE_INFO, "Assembling program..." };
-    
-    char* assembler_path = "/opt/homebrew/bin/riscv64-unknown-elf-as";
-    if (access(assembler_path, X_OK) != 0) {
-        fprintf(stderr, "Errore: Il binario '%s' non è stato trovato o non è eseguibile.\n", assembler_path);
-        
-        message.type = MESSAGE_ERROR;
-        message.text = "ERROR: Assembler binary not found";
-        callback(message);
-        
-        unlink(temp_obj);
-        
+
+    if (access(ASSEMBLER_PATH, X_OK) != 0) {
+        fprintf(stderr, "Errore: Il binario '%s' non è stato trovato o non è eseguibile.\n", ASSEMBLER_PATH);
+        log_message(callback, MESSAGE_ERROR, "ERROR: Assembler binary not found");
+
         return -1;
     }
 
 	// Compile (stdout + stderr)
-	sprintf(
-		cmd,
-		"/opt/homebrew/bin/riscv64-unknown-elf-as -march=rv32i -mabi=ilp32 \"%s\" -o \"%s\" 2>&1",
-		filepath,
-		temp_obj
-	);
-    
-    callback(message);
-	
-	if (run_command_with_log(cmd, callback) != 0) {
-		message.type = MESSAGE_ERROR;
-		message.text = "Error during assembling";
-		callback(message);
-		
+	const char *const assemble[] = { ASSEMBLER_PATH, ASSEMBLER_FLAGS, filepath, "-o", temp_obj, NULL };
+
+    log_message(callback, MESSAGE_INFO, "Assembling program...");
+
+	if (run_command_with_log(assemble, callback) != 0) {
+		log_message(callback, MESSAGE_ERROR, "Error during assembling");
 		unlink(temp_obj);
-		
+
 		return -1;
 	}
 
 	// Link program
-	sprintf(
-		cmd,
-		"/opt/homebrew/bin/riscv64-unknown-elf-ld -G 0 -m elf32lriscv \"%s\" -o \"%s\" 2>&1",
-		temp_obj,
-		output_elf_path
-	);
-		
-	message.type = MESSAGE_INFO;
-	message.text = "Linking program...";
-	callback(message);
-	
-	if (run_command_with_log(cmd, callback) != 0) {
-		message.type = MESSAGE_ERROR;
-		message.text = "Error during linking";
+	const char *const link[] = { LINKER_PATH, LINKER_FLAGS, temp_obj, "-o", output_elf_path, NULL };
+
+	log_message(callback, MESSAGE_INFO, "Linking program...");
+
+	if (run_command_with_log(link, callback) != 0) {
+		log_message(callback, MESSAGE_ERROR, "Error during linking");
 		unlink(temp_obj);
-		
+
 		return -1;
 	}
 
 	unlink(temp_obj);
-	
-	message.type = MESSAGE_INFO;
-	message.text = "Assembly complete!";
-	callback(message);
-	
+
+	log_message(callback, MESSAGE_INFO, "Assembly complete!");
+
 	return 0;
 }
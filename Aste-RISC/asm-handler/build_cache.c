@@ -0,0 +1,507 @@
+//
+//  build_cache.c
+//  RISKit
+//
+//  Content-addressed cache of assembled images.
+//
+//  An entry is one file named after the key of the source. It holds a
+//  header, the segments, the symbols, the source lines, the names of the
+//  symbols and the stored bytes of the segments, so a hit is a single mmap
+//  with no parsing or relocation.
+//  Entries are written to a temporary name and renamed, a reader never
+//  sees a partial one. The modification time of an entry is refreshed on
+//  every hit and drives the least recently used eviction.
+//
+
+#include "build_cache.h"
+#include "assembler_with_logs.h"
+#include "elf.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define CACHE_MAGIC     0x43425341u // "ASBC"
+#define CACHE_EXTENSION ".img"
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t key;
+	uint64_t source_size;
+
+	uint32_t entry_point;
+	uint32_t text_vaddr;
+	uint32_t text_size;
+	uint32_t data_vaddr;
+	uint32_t data_size;
+	uint32_t rodata_vaddr;
+	uint32_t rodata_size;
+
+	uint32_t segment_count;
+	uint32_t symbol_count;
+	uint32_t line_count;
+	uint32_t strtab_size;
+
+} cache_header_t;
+
+// Symbol as stored, the name is an offset in the string table
+typedef struct {
+	uint32_t address;
+	uint32_t size;
+	uint32_t name;
+
+} cache_symbol_t;
+
+typedef struct {
+	char   path[1200]; // directory and entry name
+	time_t used;
+	off_t  size;
+
+} cache_entry_t;
+
+// MARK: - Helpers
+
+static uint64_t fnv1a(
+	uint64_t    hash,
+	const void *bytes,
+	size_t      length
+) {
+	const uint8_t *p = bytes;
+
+	for (size_t i = 0; i < length; i++) {
+		hash ^= p[i];
+		hash *= 0x100000001b3ull;
+	}
+
+	return hash;
+}
+
+/**
+ * @brief Directory of the entries, created on demand
+ * @return false if no directory can be used
+ */
+static bool cache_directory(
+	char  *path,
+	size_t size
+) {
+	const char *custom = getenv(BUILD_CACHE_DIR_ENV);
+	const char *home   = getenv("HOME");
+	const char *xdg    = getenv("XDG_CACHE_HOME");
+	int written;
+
+	if (custom && *custom) {
+		written = snprintf(path, size, "%s", custom);
+
+	} else if (xdg && *xdg) {
+		written = snprintf(path, size, "%s/aste-risc", xdg);
+
+	} else if (home && *home) {
+#ifdef __APPLE__
+		written = snprintf(path, size, "%s/Library/Caches/aste-risc", home);
+#else
+		written = snprintf(path, size, "%s/.cache/aste-risc", home);
+#endif
+
+	} else {
+		written = snprintf(path, size, "/tmp/aste-risc-cache");
+	}
+
+	if (written <= 0 || (size_t)written >= size) return false;
+
+	// Create every missing parent, like mkdir -p
+	for (char *slash = strchr(path + 1, '/'); ; slash = strchr(slash + 1, '/')) {
+		if (slash) *slash = '\0';
+
+		const bool created = mkdir(path, 0755) == 0 || errno == EEXIST;
+
+		if (slash) *slash = '/';
+		if (!created) return false;
+		if (!slash) return true;
+	}
+}
+
+static bool entry_path(
+	uint64_t key,
+	char    *path,
+	size_t   size
+) {
+	char directory[900];
+	if (!cache_directory(directory, sizeof(directory))) return false;
+
+	const int written = snprintf(path, size, "%s/%016llx" CACHE_EXTENSION, directory, (unsigned long long)key);
+
+	return written > 0 && (size_t)written < size;
+}
+
+/**
+ * @brief Write the whole buffer, retrying short writes
+ */
+static bool write_all(
+	int         fd,
+	const void *bytes,
+	size_t      length
+) {
+	const uint8_t *p = bytes;
+
+	while (length > 0) {
+		const ssize_t written = write(fd, p, length);
+
+		if (written < 0) {
+			if (errno == EINTR) continue;
+			return false;
+		}
+
+		p      += written;
+		length -= (size_t)written;
+	}
+
+	return true;
+}
+
+/**
+ * @brief Pointer to the stored bytes of a range, NULL if any of them is
+ * not stored by a single segment
+ */
+static uint8_t* stored_range(
+	const options_t *opts,
+	uint32_t         address,
+	size_t           size
+) {
+	if (size == 0) return NULL;
+
+	for (uint32_t i = 0; i < opts->segment_count; i++) {
+		const elf_segment_t *segment = &opts->segments[i];
+
+		if (address >= segment->vaddr && (uint64_t)address + size <= (uint64_t)segment->vaddr + segment->file_size) {
+			return opts->image + segment->offset + (address - segment->vaddr);
+		}
+	}
+
+	return NULL;
+}
+
+static int compare_entries(const void *a, const void *b) {
+	const cache_entry_t *x = a;
+	const cache_entry_t *y = b;
+
+	return (x->used > y->used) - (x->used < y->used);
+}
+
+// MARK: - Keys
+
+uint64_t build_cache_key(
+	const char *source,
+	size_t      length
+) {
+	// The toolchain flags are part of the key, the built-in assembler is
+	// covered by BUILD_CACHE_VERSION
+	static const char *const configuration[] = { ASSEMBLER_FLAGS, LINKER_FLAGS };
+	const uint32_t version = BUILD_CACHE_VERSION;
+
+	uint64_t hash = 0xcbf29ce484222325ull;
+
+	hash = fnv1a(hash, &version, sizeof(version));
+
+	for (size_t i = 0; i < sizeof(configuration) / sizeof(configuration[0]); i++) {
+		hash = fnv1a(hash, configuration[i], strlen(configuration[i]) + 1);
+	}
+
+	hash = fnv1a(hash, source, length);
+
+	return hash;
+}
+
+// MARK: - Loading
+
+int build_cache_load(
+	uint64_t   key,
+	size_t     source_size,
+	options_t *opts
+) {
+	if (!opts) return -1;
+
+	char path[1024];
+	if (!entry_path(key, path, sizeof(path))) return -1;
+
+	const int fd = open(path, O_RDONLY);
+	if (fd < 0) return -1;
+
+	struct stat status;
+	if (fstat(fd, &status) != 0 || (size_t)status.st_size < sizeof(cache_header_t)) {
+		close(fd);
+		return -1;
+	}
+
+	const size_t size = (size_t)status.st_size;
+
+	uint8_t *image = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (image == MAP_FAILED) {
+		close(fd);
+		return -1;
+	}
+
+	cache_header_t header;
+	memcpy(&header, image, sizeof(header));
+
+	const uint64_t tables = sizeof(header) +
+		(uint64_t)header.segment_count * sizeof(elf_segment_t) +
+		(uint64_t)header.symbol_count * sizeof(cache_symbol_t) +
+		(uint64_t)header.line_count * sizeof(source_line_t);
+
+	const bool valid = header.magic == CACHE_MAGIC &&
+					   header.version == BUILD_CACHE_VERSION &&
+					   header.key == key &&
+					   header.source_size == source_size &&
+					   header.segment_count > 0 &&
+					   tables + header.strtab_size <= size &&
+					   (header.strtab_size == 0 || image[tables + header.strtab_size - 1] == '\0');
+
+	elf_segment_t *segments = valid ? malloc(header.segment_count * sizeof(elf_segment_t)) : NULL;
+	elf_symbol_t  *symbols  = valid && header.symbol_count ? malloc(header.symbol_count * sizeof(elf_symbol_t)) : NULL;
+	source_line_t *lines    = valid && header.line_count ? malloc(header.line_count * sizeof(source_line_t)) : NULL;
+
+	bool loaded = segments && (symbols || header.symbol_count == 0) && (lines || header.line_count == 0);
+
+	if (loaded) {
+		memcpy(segments, image + sizeof(header), header.segment_count * sizeof(elf_segment_t));
+
+		for (uint32_t i = 0; i < header.segment_count; i++) {
+			if ((uint64_t)segments[i].offset + segments[i].file_size > size ||
+				segments[i].file_size > segments[i].memory_size) loaded = false;
+		}
+	}
+
+	const uint8_t *stored_symbols = image + sizeof(header) + (size_t)header.segment_count * sizeof(elf_segment_t);
+	const uint8_t *stored_lines   = stored_symbols + (size_t)header.symbol_count * sizeof(cache_symbol_t);
+	const char    *strtab         = (const char *)image + tables;
+
+	if (loaded && lines) memcpy(lines, stored_lines, header.line_count * sizeof(source_line_t));
+
+	for (uint32_t i = 0; loaded && i < header.symbol_count; i++) {
+		cache_symbol_t symbol;
+		memcpy(&symbol, stored_symbols + (size_t)i * sizeof(symbol), sizeof(symbol));
+
+		if (symbol.name >= header.strtab_size) {
+			loaded = false;
+			break;
+		}
+
+		symbols[i] = (elf_symbol_t){ symbol.address, symbol.size, strtab + symbol.name };
+	}
+
+	if (!loaded) {
+		free(segments);
+		free(symbols);
+		free(lines);
+		munmap(image, size);
+		close(fd);
+
+		return -1;
+	}
+
+	unload_elf_sections(opts);
+
+	opts->image_fd   = fd;
+	opts->image      = image;
+	opts->image_size = size;
+
+	opts->segments      = segments;
+	opts->segment_count = header.segment_count;
+	opts->symbols       = symbols;
+	opts->symbol_count  = header.symbol_count;
+	opts->lines         = lines;
+	opts->line_count    = header.line_count;
+
+	opts->entry_point  = header.entry_point;
+	opts->text_vaddr   = header.text_vaddr;
+	opts->text_size    = header.text_size;
+	opts->data_vaddr   = header.data_vaddr;
+	opts->data_size    = header.data_size;
+	opts->rodata_vaddr = header.rodata_vaddr;
+	opts->rodata_size  = header.rodata_size;
+
+	opts->text_data   = stored_range(opts, opts->text_vaddr, opts->text_size);
+	opts->data_data   = stored_range(opts, opts->data_vaddr, opts->data_size);
+	opts->rodata_data = stored_range(opts, opts->rodata_vaddr, opts->rodata_size);
+
+	// Mark the entry as recently used
+	futimens(fd, NULL);
+
+	return 0;
+}
+
+// MARK: - Storing
+
+int build_cache_store(
+	uint64_t         key,
+	size_t           source_size,
+	const options_t *opts
+) {
+	if (!opts || !opts->image || opts->segment_count == 0) return -1;
+
+	char path[1024];
+	char temporary[1100];
+
+	if (!entry_path(key, path, sizeof(path))) return -1;
+	snprintf(temporary, sizeof(temporary), "%s.%ld.tmp", path, (long)getpid());
+
+	// Names are packed in a new string table, the source one may hold more
+	uint32_t strtab_size = 0;
+	for (uint32_t i = 0; i < opts->symbol_count; i++) {
+		strtab_size += (uint32_t)strlen(opts->symbols[i].name) + 1;
+	}
+
+	const size_t tables_size = sizeof(cache_header_t) +
+		opts->segment_count * sizeof(elf_segment_t) +
+		opts->symbol_count * sizeof(cache_symbol_t) +
+		opts->line_count * sizeof(source_line_t) +
+		strtab_size;
+
+	elf_segment_t  *segments = malloc(opts->segment_count * sizeof(elf_segment_t));
+	uint8_t        *tables   = malloc(tables_size);
+
+	if (!segments || !tables) {
+		free(segments);
+		free(tables);
+
+		return -1;
+	}
+
+	// Segment bytes follow the tables in segment order
+	uint64_t offset = tables_size;
+
+	for (uint32_t i = 0; i < opts->segment_count; i++) {
+		segments[i]        = opts->segments[i];
+		segments[i].offset = (uint32_t)offset;
+
+		offset += opts->segments[i].file_size;
+	}
+
+	const cache_header_t header = {
+		.magic         = CACHE_MAGIC,
+		.version       = BUILD_CACHE_VERSION,
+		.key           = key,
+		.source_size   = source_size,
+		.entry_point   = opts->entry_point,
+		.text_vaddr    = opts->text_vaddr,
+		.text_size     = (uint32_t)opts->text_size,
+		.data_vaddr    = opts->data_vaddr,
+		.data_size     = (uint32_t)opts->data_size,
+		.rodata_vaddr  = opts->rodata_vaddr,
+		.rodata_size   = (uint32_t)opts->rodata_size,
+		.segment_count = opts->segment_count,
+		.symbol_count  = opts->symbol_count,
+		.line_count    = opts->line_count,
+		.strtab_size   = strtab_size
+	};
+
+	uint8_t *p = tables;
+
+	memcpy(p, &header, sizeof(header));
+	p += sizeof(header);
+
+	memcpy(p, segments, opts->segment_count * sizeof(elf_segment_t));
+	p += opts->segment_count * sizeof(elf_segment_t);
+
+	// The lines sit between the symbols and their names
+	char *strtab = (char *)p + opts->symbol_count * sizeof(cache_symbol_t) + opts->line_count * sizeof(source_line_t);
+	uint32_t name = 0;
+
+	for (uint32_t i = 0; i < opts->symbol_count; i++) {
+		const cache_symbol_t symbol = { opts->symbols[i].address, opts->symbols[i].size, name };
+
+		memcpy(p, &symbol, sizeof(symbol));
+		p += sizeof(symbol);
+
+		const size_t length = strlen(opts->symbols[i].name) + 1;
+		memcpy(strtab + name, opts->symbols[i].name, length);
+		name += (uint32_t)length;
+	}
+
+	if (opts->line_count) memcpy(p, opts->lines, opts->line_count * sizeof(source_line_t));
+
+	free(segments);
+
+	const int fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	bool written = fd >= 0 && offset <= UINT32_MAX && write_all(fd, tables, tables_size);
+
+	for (uint32_t i = 0; written && i < opts->segment_count; i++) {
+		const elf_segment_t *segment = &opts->segments[i];
+
+		written = (uint64_t)segment->offset + segment->file_size <= opts->image_size &&
+				  write_all(fd, opts->image + segment->offset, segment->file_size);
+	}
+
+	free(tables);
+
+	if (fd >= 0 && close(fd) != 0) written = false;
+
+	if (!written || rename(temporary, path) != 0) {
+		unlink(temporary);
+		return -1;
+	}
+
+	build_cache_evict(BUILD_CACHE_MAX_BYTES);
+
+	return 0;
+}
+
+// MARK: - Eviction
+
+void build_cache_evict(size_t max_bytes) {
+	char directory[900];
+	if (!cache_directory(directory, sizeof(directory))) return;
+
+	DIR *dir = opendir(directory);
+	if (!dir) return;
+
+	cache_entry_t *entries = NULL;
+	size_t count    = 0;
+	size_t capacity = 0;
+	uint64_t total  = 0;
+
+	const size_t extension = strlen(CACHE_EXTENSION);
+	struct dirent *item;
+
+	while ((item = readdir(dir)) != NULL) {
+		const size_t length = strlen(item->d_name);
+		if (length <= extension || strcmp(item->d_name + length - extension, CACHE_EXTENSION) != 0) continue;
+
+		if (count == capacity) {
+			capacity = capacity ? capacity * 2 : 64;
+
+			cache_entry_t *grown = realloc(entries, capacity * sizeof(cache_entry_t));
+			if (!grown) break;
+
+			entries = grown;
+		}
+
+		cache_entry_t *entry = &entries[count];
+		snprintf(entry->path, sizeof(entry->path), "%s/%s", directory, item->d_name);
+
+		struct stat status;
+		if (stat(entry->path, &status) != 0) continue;
+
+		entry->used = status.st_mtime;
+		entry->size = status.st_size;
+		total += (uint64_t)status.st_size;
+		count++;
+	}
+
+	closedir(dir);
+
+	if (total > max_bytes) {
+		qsort(entries, count, sizeof(cache_entry_t), compare_entries);
+
+		// Oldest first, a mapped entry stays valid after its name is gone
+		for (size_t i = 0; i < count && total > max_bytes; i++) {
+			if (unlink(entries[i].path) == 0) total -= (uint64_t)entries[i].size;
+		}
+	}
+
+	free(entries);
+}
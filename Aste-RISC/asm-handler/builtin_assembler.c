@@ -0,0 +1,2123 @@
+//
+//  builtin_assembler.c
+//  RISKit
+//
+//  In-process RV32I assembler and linker.
+//
+//  The source is read once: instructions and data are emitted as they are
+//  parsed, every immediate goes through a fixup that is applied once the
+//  sections are laid out and every label has an address.
+//
+
+#include "builtin_assembler.h"
+#include "elf.h"
+
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <sys/mman.h>
+
+#define MAX_REPORTED_ERRORS 20
+
+// Symbol names of numeric local labels contain this byte, they are never exported
+#define LOCAL_LABEL_MARK '\x02'
+
+typedef enum {
+	SECTION_TEXT,
+	SECTION_RODATA,
+	SECTION_DATA,
+	SECTION_BSS,
+	SECTION_COUNT,
+
+	SECTION_ABSOLUTE = SECTION_COUNT // .equ constants
+} section_id_t;
+
+typedef enum {
+	FIXUP_I,          // signed 12-bit I-type immediate
+	FIXUP_S,          // signed 12-bit S-type immediate
+	FIXUP_SHAMT,      // 5-bit shift amount
+	FIXUP_U,          // raw 20-bit upper immediate
+	FIXUP_B,          // pc-relative branch target
+	FIXUP_J,          // pc-relative jal target
+	FIXUP_HI,         // %hi of an absolute address
+	FIXUP_LO_I,       // %lo of an absolute address, I-type
+	FIXUP_LO_S,       // %lo of an absolute address, S-type
+	FIXUP_PCREL_HI,   // auipc half of a pc-relative address
+	FIXUP_PCREL_LO_I, // low half, the auipc is the previous instruction
+	FIXUP_PCREL_LO_S,
+	FIXUP_WORD,
+	FIXUP_HALF,
+	FIXUP_BYTE
+} fixup_kind_t;
+
+typedef enum {
+	MODIFIER_NONE,
+	MODIFIER_HI,
+	MODIFIER_LO
+} modifier_t;
+
+typedef struct {
+	uint8_t *bytes;    // NULL for .bss
+	uint32_t size;
+	uint32_t capacity;
+	uint32_t alignment;
+	uint32_t base;     // address, set by the layout
+
+} asm_section_t;
+
+typedef struct {
+	char    *name;
+	uint32_t value;    // offset in the section, or the constant
+	uint8_t  section;
+	bool     defined;
+
+} asm_symbol_t;
+
+/**
+ * @brief Relocatable value: symbol + addend, symbol is -1 for a constant.
+ */
+typedef struct {
+	int32_t symbol;
+	int32_t addend;
+
+} asm_value_t;
+
+typedef struct {
+	asm_value_t value;
+	uint32_t    offset;
+	uint32_t    line;
+	uint8_t     section;
+	uint8_t     kind;
+
+} asm_fixup_t;
+
+// Instruction statement, offset of its first word in .text
+typedef struct {
+	uint32_t offset;
+	uint32_t line;
+
+} asm_line_t;
+
+typedef struct {
+	const char  *name;
+	log_batch_t *log; // NULL when nobody listens
+
+	asm_section_t sections[SECTION_COUNT];
+	uint8_t       current;
+
+	asm_symbol_t *symbols;
+	uint32_t      symbol_count;
+	uint32_t      symbol_capacity;
+
+	// Open addressing table of symbol indexes + 1, 0 is empty
+	uint32_t *table;
+	uint32_t  table_size;
+
+	asm_fixup_t *fixups;
+	uint32_t     fixup_count;
+	uint32_t     fixup_capacity;
+
+	asm_line_t *lines;
+	uint32_t    line_count;
+	uint32_t    line_capacity;
+
+	uint32_t local_labels[10];
+
+	uint32_t line;
+	uint32_t errors;
+	bool     unsupported;
+	bool     out_of_memory;
+
+} assembler_t;
+
+typedef struct {
+	const char *name;
+	uint8_t     format;
+	uint32_t    match;
+
+} instruction_t;
+
+typedef enum {
+	FORMAT_R,
+	FORMAT_I,
+	FORMAT_SHIFT,
+	FORMAT_LOAD,
+	FORMAT_STORE,
+	FORMAT_BRANCH,
+	FORMAT_U,
+	FORMAT_JAL,
+	FORMAT_JALR,
+	FORMAT_NONE
+} format_t;
+
+static const instruction_t instructions[] = {
+	{ "add",  FORMAT_R, 0x00000033 }, { "sub",  FORMAT_R, 0x40000033 },
+	{ "sll",  FORMAT_R, 0x00001033 }, { "slt",  FORMAT_R, 0x00002033 },
+	{ "sltu", FORMAT_R, 0x00003033 }, { "xor",  FORMAT_R, 0x00004033 },
+	{ "srl",  FORMAT_R, 0x00005033 }, { "sra",  FORMAT_R, 0x40005033 },
+	{ "or",   FORMAT_R, 0x00006033 }, { "and",  FORMAT_R, 0x00007033 },
+
+	{ "addi",  FORMAT_I, 0x00000013 }, { "slti", FORMAT_I, 0x00002013 },
+	{ "sltiu", FORMAT_I, 0x00003013 }, { "xori", FORMAT_I, 0x00004013 },
+	{ "ori",   FORMAT_I, 0x00006013 }, { "andi", FORMAT_I, 0x00007013 },
+
+	{ "slli", FORMAT_SHIFT, 0x00001013 }, { "srli", FORMAT_SHIFT, 0x00005013 },
+	{ "srai", FORMAT_SHIFT, 0x40005013 },
+
+	{ "lb",  FORMAT_LOAD, 0x00000003 }, { "lh",  FORMAT_LOAD, 0x00001003 },
+	{ "lw",  FORMAT_LOAD, 0x00002003 }, { "lbu", FORMAT_LOAD, 0x00004003 },
+	{ "lhu", FORMAT_LOAD, 0x00005003 },
+
+	{ "sb", FORMAT_STORE, 0x00000023 }, { "sh", FORMAT_STORE, 0x00001023 },
+	{ "sw", FORMAT_STORE, 0x00002023 },
+
+	{ "beq",  FORMAT_BRANCH, 0x00000063 }, { "bne",  FORMAT_BRANCH, 0x00001063 },
+	{ "blt",  FORMAT_BRANCH, 0x00004063 }, { "bge",  FORMAT_BRANCH, 0x00005063 },
+	{ "bltu", FORMAT_BRANCH, 0x00006063 }, { "bgeu", FORMAT_BRANCH, 0x00007063 },
+
+	{ "lui",  FORMAT_U,    0x00000037 }, { "auipc", FORMAT_U, 0x00000017 },
+	{ "jal",  FORMAT_JAL,  0x0000006F }, { "jalr",  FORMAT_JALR, 0x00000067 },
+
+	{ "ecall",  FORMAT_NONE, 0x00000073 }, { "ebreak", FORMAT_NONE, 0x00100073 },
+	{ "fence",  FORMAT_NONE, 0x0FF0000F }
+};
+
+static const char *const register_names[32] = {
+	"zero", "ra", "sp", "gp", "tp", "t0", "t1", "t2",
+	"s0",   "s1", "a0", "a1", "a2", "a3", "a4", "a5",
+	"a6",   "a7", "s2", "s3", "s4", "s5", "s6", "s7",
+	"s8",   "s9", "s10", "s11", "t3", "t4", "t5", "t6"
+};
+
+// Instructions used by the expansions
+#define MATCH_ADDI  0x00000013
+#define MATCH_XORI  0x00004013
+#define MATCH_SLTIU 0x00003013
+#define MATCH_SUB   0x40000033
+#define MATCH_SLT   0x00002033
+#define MATCH_SLTU  0x00003033
+#define MATCH_LUI   0x00000037
+#define MATCH_AUIPC 0x00000017
+#define MATCH_JAL   0x0000006F
+#define MATCH_JALR  0x00000067
+#define MATCH_BEQ   0x00000063
+#define MATCH_BNE   0x00001063
+#define MATCH_BLT   0x00004063
+#define MATCH_BGE   0x00005063
+#define MATCH_BLTU  0x00006063
+#define MATCH_BGEU  0x00007063
+
+// Registers used by the expansions
+#define REG_ZERO 0
+#define REG_RA   1
+#define REG_T1   6
+
+// MARK: - Diagnostics
+
+/**
+ * @brief Queue a diagnostic for the current line, sent when the batch fills
+ * or at the end of the source
+ */
+static void report(
+	assembler_t    *as,
+	message_type_t  type,
+	const char     *format,
+	...
+) {
+	if (type == MESSAGE_ERROR && as->errors++ >= MAX_REPORTED_ERRORS) return;
+	if (!as->log) return;
+
+	char text[512];
+	const int prefix = snprintf(text, sizeof(text), "%s:%u: %s: ", as->name, as->line,
+								type == MESSAGE_ERROR ? "error" : "warning");
+
+	va_list arguments;
+	va_start(arguments, format);
+	vsnprintf(text + prefix, sizeof(text) - (size_t)prefix, format, arguments);
+	va_end(arguments);
+
+	log_batch_add_line(as->log, text, strlen(text));
+}
+
+/**
+ * @brief Stop on a feature the built-in assembler does not handle
+ */
+static void unsupported(
+	assembler_t *as,
+	const char  *what
+) {
+	if (!as->unsupported) {
+		report(as, MESSAGE_WARNING, "%s is not supported by the built-in assembler", what);
+	}
+
+	as->unsupported = true;
+}
+
+// MARK: - Buffers
+
+static bool grow(
+	void     **buffer,
+	uint32_t  *capacity,
+	uint32_t   needed,
+	size_t     element
+) {
+	if (needed <= *capacity) return true;
+
+	uint32_t size = *capacity ? *capacity : 64;
+	while (size < needed) size *= 2;
+
+	void *grown = realloc(*buffer, size * element);
+	if (!grown) return false;
+
+	*buffer   = grown;
+	*capacity = size;
+
+	return true;
+}
+
+static asm_section_t *current_section(assembler_t *as) {
+	return &as->sections[as->current];
+}
+
+/**
+ * @brief Append bytes to the current section, NULL bytes append zeros
+ */
+static void emit_bytes(
+	assembler_t    *as,
+	const uint8_t  *bytes,
+	uint32_t        size
+) {
+	asm_section_t *section = current_section(as);
+
+	if (as->current == SECTION_BSS) {
+		bool nonzero = false;
+		for (uint32_t i = 0; bytes && i < size; i++) nonzero |= bytes[i] != 0;
+
+		if (nonzero) report(as, MESSAGE_ERROR, "non-zero data in .bss");
+
+		section->size += size;
+		return;
+	}
+
+	if (!grow((void **)&section->bytes, &section->capacity, section->size + size, 1)) {
+		as->out_of_memory = true;
+		return;
+	}
+
+	if (bytes) memcpy(section->bytes + section->size, bytes, size);
+	else memset(section->bytes + section->size, 0, size);
+
+	section->size += size;
+}
+
+static void emit_word(
+	assembler_t *as,
+	uint32_t     word
+) {
+	const uint8_t bytes[4] = { word & 0xFF, word >> 8 & 0xFF, word >> 16 & 0xFF, word >> 24 & 0xFF };
+	emit_bytes(as, bytes, 4);
+}
+
+static void add_fixup(
+	assembler_t  *as,
+	fixup_kind_t  kind,
+	asm_value_t   value,
+	uint32_t      offset
+) {
+	if (!grow((void **)&as->fixups, &as->fixup_capacity, as->fixup_count + 1, sizeof(asm_fixup_t))) {
+		as->out_of_memory = true;
+		return;
+	}
+
+	as->fixups[as->fixup_count++] = (asm_fixup_t){
+		.value   = value,
+		.offset  = offset,
+		.line    = as->line,
+		.section = as->current,
+		.kind    = kind
+	};
+}
+
+/**
+ * @brief Remember the source line of an instruction statement of .text
+ */
+static void add_line(
+	assembler_t *as,
+	uint32_t     offset
+) {
+	if (!grow((void **)&as->lines, &as->line_capacity, as->line_count + 1, sizeof(asm_line_t))) {
+		as->out_of_memory = true;
+		return;
+	}
+
+	as->lines[as->line_count++] = (asm_line_t){ .offset = offset, .line = as->line };
+}
+
+/**
+ * @brief Emit an instruction whose immediate is filled by a fixup
+ */
+static void emit_instruction(
+	assembler_t  *as,
+	uint32_t      word,
+	fixup_kind_t  kind,
+	asm_value_t   value
+) {
+	add_fixup(as, kind, value, current_section(as)->size);
+	emit_word(as, word);
+}
+
+// MARK: - Symbols
+
+static uint32_t hash_name(const char *name) {
+	uint32_t hash = 2166136261u;
+	while (*name) hash = (hash ^ (uint8_t)*name++) * 16777619u;
+
+	return hash;
+}
+
+static bool rehash(assembler_t *as) {
+	const uint32_t size = as->table_size ? as->table_size * 2 : 256;
+
+	uint32_t *table = calloc(size, sizeof(uint32_t));
+	if (!table) return false;
+
+	for (uint32_t i = 0; i < as->symbol_count; i++) {
+		uint32_t slot = hash_name(as->symbols[i].name) & (size - 1);
+		while (table[slot]) slot = (slot + 1) & (size - 1);
+
+		table[slot] = i + 1;
+	}
+
+	free(as->table);
+	as->table      = table;
+	as->table_size = size;
+
+	return true;
+}
+
+/**
+ * @brief Index of a symbol, created undefined on first use, -1 without memory
+ */
+static int32_t symbol_index(
+	assembler_t *as,
+	const char  *name
+) {
+	if (as->table_size) {
+		uint32_t slot = hash_name(name) & (as->table_size - 1);
+
+		while (as->table[slot]) {
+			const uint32_t index = as->table[slot] - 1;
+			if (strcmp(as->symbols[index].name, name) == 0) return (int32_t)index;
+
+			slot = (slot + 1) & (as->table_size - 1);
+		}
+	}
+
+	if ((as->symbol_count + 1) * 2 > as->table_size && !rehash(as)) goto failed;
+	if (!grow((void **)&as->symbols, &as->symbol_capacity, as->symbol_count + 1, sizeof(asm_symbol_t))) goto failed;
+
+	char *copy = strdup(name);
+	if (!copy) goto failed;
+
+	const uint32_t index = as->symbol_count++;
+	as->symbols[index]   = (asm_symbol_t){ .name = copy };
+
+	uint32_t slot = hash_name(name) & (as->table_size - 1);
+	while (as->table[slot]) slot = (slot + 1) & (as->table_size - 1);
+	as->table[slot] = index + 1;
+
+	return (int32_t)index;
+
+failed:
+	as->out_of_memory = true;
+	return -1;
+}
+
+static void define_symbol(
+	assembler_t *as,
+	const char  *name,
+	uint8_t      section,
+	uint32_t     value
+) {
+	const int32_t index = symbol_index(as, name);
+	if (index < 0) return;
+
+	asm_symbol_t *symbol = &as->symbols[index];
+
+	// .equ may be redefined, labels may not
+	if (symbol->defined && (section != SECTION_ABSOLUTE || symbol->section != SECTION_ABSOLUTE)) {
+		report(as, MESSAGE_ERROR, "symbol '%s' is already defined", name);
+		return;
+	}
+
+	symbol->defined = true;
+	symbol->section = section;
+	symbol->value   = value;
+}
+
+/**
+ * @brief Name of the numeric local label n, backward or forward
+ */
+static void local_label_name(
+	const assembler_t *as,
+	unsigned           digit,
+	bool               forward,
+	char               name[16]
+) {
+	const uint32_t instance = as->local_labels[digit] - (forward ? 0 : 1);
+	snprintf(name, 16, "%u%c%u", digit, LOCAL_LABEL_MARK, instance);
+}
+
+// MARK: - Lexing
+
+static const char *skip_spaces(const char *p) {
+	while (*p == ' ' || *p == '\t' || *p == '\r') p++;
+	return p;
+}
+
+static bool is_identifier_start(char c) {
+	return isalpha((unsigned char)c) || c == '_' || c == '.' || c == '$';
+}
+
+static bool is_identifier_char(char c) {
+	return isalnum((unsigned char)c) || c == '_' || c == '.' || c == '$';
+}
+
+/**
+ * @brief Copy the identifier at p into name
+ * @return end of the identifier, p when there is none
+ */
+static const char *read_identifier(
+	const char *p,
+	char       *name,
+	size_t      size
+) {
+	if (!is_identifier_start(*p)) return p;
+
+	size_t length = 0;
+	while (is_identifier_char(*p)) {
+		if (length + 1 < size) name[length++] = *p;
+		p++;
+	}
+
+	name[length] = '\0';
+
+	return p;
+}
+
+static bool expect(
+	assembler_t  *as,
+	const char  **p,
+	char          c
+) {
+	*p = skip_spaces(*p);
+
+	if (**p != c) {
+		report(as, MESSAGE_ERROR, "expected '%c'", c);
+		return false;
+	}
+
+	(*p)++;
+	return true;
+}
+
+/**
+ * @brief Read a register name at p, nothing is reported
+ * @return register number, -1 if p does not start with a register
+ */
+static int read_register(const char **p) {
+	char name[16];
+	const char *q   = skip_spaces(*p);
+	const char *end = read_identifier(q, name, sizeof(name));
+
+	if (end == q) return -1;
+
+	int index = -1;
+	for (int i = 0; i < 32 && index < 0; i++) {
+		if (strcmp(name, register_names[i]) == 0) index = i;
+	}
+
+	if (strcmp(name, "fp") == 0) index = 8;
+
+	if (name[0] == 'x' && isdigit((unsigned char)name[1])) {
+		char *digits_end;
+		const long number = strtol(name + 1, &digits_end, 10);
+
+		if (*digits_end == '\0' && number < 32) index = (int)number;
+	}
+
+	if (index >= 0) *p = end;
+	return index;
+}
+
+static int parse_register(
+	assembler_t  *as,
+	const char  **p
+) {
+	const int index = read_register(p);
+	if (index < 0) report(as, MESSAGE_ERROR, "expected a register");
+
+	return index;
+}
+
+/**
+ * @brief Decode one character of a quoted literal, escapes included
+ */
+static const char *read_character(
+	const char *p,
+	int        *value
+) {
+	if (*p != '\\') {
+		*value = (unsigned char)*p;
+		return p + 1;
+	}
+
+	p++;
+	switch (*p) {
+		case 'n':  *value = '\n'; return p + 1;
+		case 't':  *value = '\t'; return p + 1;
+		case 'r':  *value = '\r'; return p + 1;
+		case 'b':  *value = '\b'; return p + 1;
+		case 'f':  *value = '\f'; return p + 1;
+		case 'v':  *value = '\v'; return p + 1;
+		case 'a':  *value = '\a'; return p + 1;
+		case 'x': {
+			int result = 0;
+			p++;
+			while (isxdigit((unsigned char)*p)) {
+				result = result * 16 + (isdigit((unsigned char)*p) ? *p - '0' : tolower((unsigned char)*p) - 'a' + 10);
+				p++;
+			}
+
+			*value = result & 0xFF;
+			return p;
+		}
+
+		default:
+			if (*p >= '0' && *p <= '7') {
+				int result = 0;
+				for (int i = 0; i < 3 && *p >= '0' && *p <= '7'; i++) result = result * 8 + *p++ - '0';
+
+				*value = result & 0xFF;
+				return p;
+			}
+
+			*value = (unsigned char)*p;
+			return *p ? p + 1 : p;
+	}
+}
+
+// MARK: - Expressions
+
+static const asm_value_t invalid_value = { -2, 0 };
+
+static bool is_constant(asm_value_t value) {
+	return value.symbol == -1;
+}
+
+static asm_value_t parse_expression(assembler_t *as, const char **p);
+
+static asm_value_t parse_primary(
+	assembler_t  *as,
+	const char  **p
+) {
+	const char *q = skip_spaces(*p);
+
+	if (*q == '(') {
+		*p = q + 1;
+		asm_value_t value = parse_expression(as, p);
+
+		if (value.symbol == -2 || !expect(as, p, ')')) return invalid_value;
+		return value;
+	}
+
+	if (*q == '-' || *q == '~' || *q == '+') {
+		*p = q + 1;
+		asm_value_t value = parse_primary(as, p);
+
+		if (value.symbol == -2 || *q == '+') return value;
+		if (!is_constant(value)) {
+			report(as, MESSAGE_ERROR, "expression must be constant");
+			return invalid_value;
+		}
+
+		value.addend = *q == '-' ? -value.addend : ~value.addend;
+		return value;
+	}
+
+	if (*q == '\'') {
+		int character;
+		q = read_character(q + 1, &character);
+
+		if (*q != '\'') {
+			report(as, MESSAGE_ERROR, "unterminated character literal");
+			return invalid_value;
+		}
+
+		*p = q + 1;
+		return (asm_value_t){ -1, character };
+	}
+
+	if (isdigit((unsigned char)*q)) {
+
+		// 1b and 1f are numeric local labels, 0b1 is a binary number
+		if ((q[1] == 'b' || q[1] == 'f') && !is_identifier_char(q[2])) {
+			char name[16];
+			local_label_name(as, (unsigned)(*q - '0'), q[1] == 'f', name);
+
+			const int32_t index = symbol_index(as, name);
+			if (index < 0) return invalid_value;
+
+			*p = q + 2;
+			return (asm_value_t){ index, 0 };
+		}
+
+		char *end;
+		unsigned long long number;
+
+		if (q[0] == '0' && (q[1] == 'b' || q[1] == 'B')) number = strtoull(q + 2, &end, 2);
+		else number = strtoull(q, &end, 0);
+
+		if (is_identifier_char(*end)) {
+			report(as, MESSAGE_ERROR, "invalid number");
+			return invalid_value;
+		}
+
+		if (number > UINT32_MAX) {
+			report(as, MESSAGE_ERROR, "number does not fit in 32 bits");
+			return invalid_value;
+		}
+
+		*p = end;
+		return (asm_value_t){ -1, (int32_t)(uint32_t)number };
+	}
+
+	// Location counter
+	if (*q == '.' && !is_identifier_char(q[1])) {
+		*p = q + 1;
+
+		char name[32];
+		snprintf(name, sizeof(name), ".%c%u", LOCAL_LABEL_MARK, as->symbol_count);
+
+		define_symbol(as, name, as->current, current_section(as)->size);
+
+		const int32_t index = symbol_index(as, name);
+		return index < 0 ? invalid_value : (asm_value_t){ index, 0 };
+	}
+
+	char name[256];
+	const char *end = read_identifier(q, name, sizeof(name));
+
+	if (end == q) {
+		report(as, MESSAGE_ERROR, "expected an expression");
+		return invalid_value;
+	}
+
+	*p = end;
+
+	const int32_t index = symbol_index(as, name);
+	if (index < 0) return invalid_value;
+
+	const asm_symbol_t *symbol = &as->symbols[index];
+	if (symbol->defined && symbol->section == SECTION_ABSOLUTE) return (asm_value_t){ -1, (int32_t)symbol->value };
+
+	return (asm_value_t){ index, 0 };
+}
+
+static int binary_precedence(
+	const char *p,
+	int        *length
+) {
+	*length = 1;
+
+	switch (*p) {
+		case '|': return 1;
+		case '^': return 2;
+		case '&': return 3;
+		case '<': if (p[1] == '<') { *length = 2; return 4; } return 0;
+		case '>': if (p[1] == '>') { *length = 2; return 4; } return 0;
+		case '+': case '-': return 5;
+		case '*': case '/': case '%': return 6;
+		default:  return 0;
+	}
+}
+
+/**
+ * @brief Combine two operands, symbols only take part in + and -
+ */
+static asm_value_t combine(
+	assembler_t *as,
+	char         operation,
+	asm_value_t  left,
+	asm_value_t  right
+) {
+	if (left.symbol == -2 || right.symbol == -2) return invalid_value;
+
+	if (operation == '+' && (is_constant(left) || is_constant(right))) {
+		return (asm_value_t){ is_constant(left) ? right.symbol : left.symbol, (int32_t)((uint32_t)left.addend + (uint32_t)right.addend) };
+	}
+
+	if (operation == '-' && is_constant(right)) {
+		return (asm_value_t){ left.symbol, (int32_t)((uint32_t)left.addend - (uint32_t)right.addend) };
+	}
+
+	// Distance between two labels already placed in the same section
+	if (operation == '-' && !is_constant(left)) {
+		const asm_symbol_t *a = &as->symbols[left.symbol];
+		const asm_symbol_t *b = &as->symbols[right.symbol];
+
+		if (a->defined && b->defined && a->section == b->section) {
+			return (asm_value_t){ -1, (int32_t)(a->value - b->value + (uint32_t)left.addend - (uint32_t)right.addend) };
+		}
+
+		unsupported(as, "difference of symbols not yet placed");
+		return invalid_value;
+	}
+
+	if (!is_constant(left) || !is_constant(right)) {
+		report(as, MESSAGE_ERROR, "expression must be constant");
+		return invalid_value;
+	}
+
+	const uint32_t a = (uint32_t)left.addend;
+	const uint32_t b = (uint32_t)right.addend;
+
+	switch (operation) {
+		case '|': return (asm_value_t){ -1, (int32_t)(a | b) };
+		case '^': return (asm_value_t){ -1, (int32_t)(a ^ b) };
+		case '&': return (asm_value_t){ -1, (int32_t)(a & b) };
+		case '<': return (asm_value_t){ -1, (int32_t)(a << (b & 31)) };
+		case '>': return (asm_value_t){ -1, left.addend >> (b & 31) };
+		case '+': return (asm_value_t){ -1, (int32_t)(a + b) };
+		case '-': return (asm_value_t){ -1, (int32_t)(a - b) };
+		case '*': return (asm_value_t){ -1, (int32_t)(a * b) };
+		default:
+			if (b == 0) {
+				report(as, MESSAGE_ERROR, "division by zero");
+				return invalid_value;
+			}
+
+			if (operation == '/') return (asm_value_t){ -1, (int32_t)(a / b) };
+			return (asm_value_t){ -1, (int32_t)(a % b) };
+	}
+}
+
+static asm_value_t parse_binary(
+	assembler_t  *as,
+	const char  **p,
+	int           minimum
+) {
+	asm_value_t left = parse_primary(as, p);
+
+	for (;;) {
+		const char *q = skip_spaces(*p);
+
+		int length;
+		const int precedence = binary_precedence(q, &length);
+		if (precedence == 0 || precedence < minimum) return left;
+
+		*p = q + length;
+		const asm_value_t right = parse_binary(as, p, precedence + 1);
+
+		left = combine(as, *q, left, right);
+	}
+}
+
+static asm_value_t parse_expression(
+	assembler_t  *as,
+	const char  **p
+) {
+	return parse_binary(as, p, 1);
+}
+
+/**
+ * @brief Parse an immediate operand, with an optional %hi or %lo
+ */
+static asm_value_t parse_operand(
+	assembler_t  *as,
+	const char  **p,
+	modifier_t   *modifier
+) {
+	const char *q = skip_spaces(*p);
+	*modifier = MODIFIER_NONE;
+
+	if (*q == '%') {
+		char name[32];
+		const char *end = read_identifier(q + 1, name, sizeof(name));
+
+		if (strcmp(name, "hi") == 0) *modifier = MODIFIER_HI;
+		else if (strcmp(name, "lo") == 0) *modifier = MODIFIER_LO;
+		else {
+			unsupported(as, "relocation operator");
+			return invalid_value;
+		}
+
+		*p = end;
+		if (!expect(as, p, '(')) return invalid_value;
+
+		const asm_value_t value = parse_expression(as, p);
+		if (!expect(as, p, ')')) return invalid_value;
+
+		return value;
+	}
+
+	*p = q;
+	return parse_expression(as, p);
+}
+
+// MARK: - Encoding
+
+static uint32_t encode_r(uint32_t match, int rd, int rs1, int rs2) {
+	return match | (uint32_t)rd << 7 | (uint32_t)rs1 << 15 | (uint32_t)rs2 << 20;
+}
+
+static uint32_t encode_i(uint32_t match, int rd, int rs1) {
+	return match | (uint32_t)rd << 7 | (uint32_t)rs1 << 15;
+}
+
+static uint32_t encode_s(uint32_t match, int rs1, int rs2) {
+	return match | (uint32_t)rs1 << 15 | (uint32_t)rs2 << 20;
+}
+
+static const instruction_t *find_instruction(const char *name) {
+	for (size_t i = 0; i < sizeof(instructions) / sizeof(instructions[0]); i++) {
+		if (strcmp(instructions[i].name, name) == 0) return &instructions[i];
+	}
+
+	return NULL;
+}
+
+static asm_value_t constant(int32_t value) {
+	return (asm_value_t){ -1, value };
+}
+
+/**
+ * @brief Fixup of an I-type immediate written with an optional modifier
+ */
+static bool immediate_kind(
+	assembler_t  *as,
+	modifier_t    modifier,
+	bool          store,
+	fixup_kind_t *kind
+) {
+	if (modifier == MODIFIER_HI) {
+		report(as, MESSAGE_ERROR, "%%hi is only valid for lui and auipc");
+		return false;
+	}
+
+	if (store) *kind = modifier == MODIFIER_LO ? FIXUP_LO_S : FIXUP_S;
+	else *kind = modifier == MODIFIER_LO ? FIXUP_LO_I : FIXUP_I;
+
+	return true;
+}
+
+/**
+ * @brief Parse "offset(base)", "(base)" or a bare symbol
+ * @return false on error, base is -1 for a bare symbol
+ */
+static bool parse_memory(
+	assembler_t  *as,
+	const char  **p,
+	asm_value_t  *offset,
+	modifier_t   *modifier,
+	int          *base
+) {
+	const char *q = skip_spaces(*p);
+	*offset   = constant(0);
+	*modifier = MODIFIER_NONE;
+
+	// A register between parentheses is the base, anything else is the offset
+	if (*q == '(') {
+		const char *r = q + 1;
+		const int reg = read_register(&r);
+		r = skip_spaces(r);
+
+		if (reg >= 0 && *r == ')') {
+			*base = reg;
+			*p    = r + 1;
+			return true;
+		}
+	}
+
+	*p = q;
+	*offset = parse_operand(as, p, modifier);
+	if (offset->symbol == -2) return false;
+
+	q = skip_spaces(*p);
+	if (*q != '(') {
+		*base = -1;
+		return true;
+	}
+
+	*p = q + 1;
+	*base = parse_register(as, p);
+
+	return *base >= 0 && expect(as, p, ')');
+}
+
+// MARK: - Instructions
+
+static bool next_operand(
+	assembler_t  *as,
+	const char  **p
+) {
+	return expect(as, p, ',');
+}
+
+/**
+ * @brief Emit auipc + a low part for a pc-relative reference to a symbol
+ */
+static void emit_pcrel_pair(
+	assembler_t  *as,
+	int           temporary,
+	uint32_t      second,
+	fixup_kind_t  low_kind,
+	asm_value_t   target
+) {
+	emit_instruction(as, MATCH_AUIPC | (uint32_t)temporary << 7, FIXUP_PCREL_HI, target);
+	emit_instruction(as, second, low_kind, target);
+}
+
+/**
+ * @brief I-type form of an R-type instruction, "add" gives "addi"
+ * @return NULL when there is none, as for "sub"
+ */
+static const instruction_t *immediate_form(const instruction_t *instruction) {
+	char name[8];
+	snprintf(name, sizeof(name), "%si", instruction->name);
+
+	return find_instruction(name);
+}
+
+/**
+ * @brief Parse the immediate of an I-type or shift instruction, then emit it
+ */
+static void emit_immediate_operation(
+	assembler_t          *as,
+	const instruction_t  *instruction,
+	int                   rd,
+	int                   rs1,
+	const char          **p
+) {
+	modifier_t   modifier;
+	fixup_kind_t kind;
+
+	const asm_value_t value = parse_operand(as, p, &modifier);
+	if (value.symbol == -2) return;
+
+	if (instruction->format == FORMAT_SHIFT) {
+		if (modifier != MODIFIER_NONE) {
+			report(as, MESSAGE_ERROR, "invalid shift amount");
+			return;
+		}
+
+		kind = FIXUP_SHAMT;
+
+	} else if (!immediate_kind(as, modifier, false, &kind)) {
+		return;
+	}
+
+	emit_instruction(as, encode_i(instruction->match, rd, rs1), kind, value);
+}
+
+/**
+ * @brief Emit the shortest sequence loading a constant
+ */
+static void emit_load_immediate(
+	assembler_t *as,
+	int          rd,
+	asm_value_t  value
+) {
+	if (!is_constant(value)) {
+		emit_instruction(as, MATCH_LUI | (uint32_t)rd << 7, FIXUP_HI, value);
+		emit_instruction(as, encode_i(MATCH_ADDI, rd, rd), FIXUP_LO_I, value);
+		return;
+	}
+
+	const int32_t immediate = value.addend;
+
+	if (immediate >= -2048 && immediate <= 2047) {
+		emit_instruction(as, encode_i(MATCH_ADDI, rd, REG_ZERO), FIXUP_I, value);
+		return;
+	}
+
+	emit_instruction(as, MATCH_LUI | (uint32_t)rd << 7, FIXUP_HI, value);
+
+	if ((immediate & 0xFFF) != 0) {
+		emit_instruction(as, encode_i(MATCH_ADDI, rd, rd), FIXUP_LO_I, value);
+	}
+}
+
+static void assemble_base(
+	assembler_t         *as,
+	const instruction_t *instruction,
+	const char         **p
+) {
+	const uint32_t match = instruction->match;
+	modifier_t modifier;
+	fixup_kind_t kind;
+
+	switch (instruction->format) {
+
+		case FORMAT_R: {
+			const int rd  = parse_register(as, p);
+			if (rd < 0 || !next_operand(as, p)) return;
+			const int rs1 = parse_register(as, p);
+			if (rs1 < 0 || !next_operand(as, p)) return;
+
+			// "sra rd, rs1, 1" stands for srai, as for the GNU assembler
+			const char          *q         = *p;
+			const instruction_t *immediate = immediate_form(instruction);
+
+			if (immediate && read_register(&q) < 0) {
+				emit_immediate_operation(as, immediate, rd, rs1, p);
+				return;
+			}
+
+			const int rs2 = parse_register(as, p);
+			if (rs2 < 0) return;
+
+			emit_word(as, encode_r(match, rd, rs1, rs2));
+			return;
+		}
+
+		case FORMAT_I:
+		case FORMAT_SHIFT: {
+			const int rd  = parse_register(as, p);
+			if (rd < 0 || !next_operand(as, p)) return;
+			const int rs1 = parse_register(as, p);
+			if (rs1 < 0 || !next_operand(as, p)) return;
+
+			emit_immediate_operation(as, instruction, rd, rs1, p);
+			return;
+		}
+
+		case FORMAT_LOAD: {
+			const int rd = parse_register(as, p);
+			if (rd < 0 || !next_operand(as, p)) return;
+
+			asm_value_t offset;
+			int base;
+			if (!parse_memory(as, p, &offset, &modifier, &base)) return;
+
+			// lw rd, symbol loads through rd
+			if (base < 0 && !is_constant(offset) && modifier == MODIFIER_NONE) {
+				emit_pcrel_pair(as, rd, encode_i(match, rd, rd), FIXUP_PCREL_LO_I, offset);
+				return;
+			}
+
+			if (!immediate_kind(as, modifier, false, &kind)) return;
+
+			emit_instruction(as, encode_i(match, rd, base < 0 ? REG_ZERO : base), kind, offset);
+			return;
+		}
+
+		case FORMAT_STORE: {
+			const int rs2 = parse_register(as, p);
+			if (rs2 < 0 || !next_operand(as, p)) return;
+
+			asm_value_t offset;
+			int base;
+			if (!parse_memory(as, p, &offset, &modifier, &base)) return;
+
+			// sw rs, symbol, temporary
+			if (base < 0 && !is_constant(offset) && modifier == MODIFIER_NONE) {
+				if (!next_operand(as, p)) return;
+
+				const int temporary = parse_register(as, p);
+				if (temporary < 0) return;
+
+				emit_pcrel_pair(as, temporary, encode_s(match, temporary, rs2), FIXUP_PCREL_LO_S, offset);
+				return;
+			}
+
+			if (!immediate_kind(as, modifier, true, &kind)) return;
+
+			emit_instruction(as, encode_s(match, base < 0 ? REG_ZERO : base, rs2), kind, offset);
+			return;
+		}
+
+		case FORMAT_BRANCH: {
+			const int rs1 = parse_register(as, p);
+			if (rs1 < 0 || !next_operand(as, p)) return;
+			const int rs2 = parse_register(as, p);
+			if (rs2 < 0 || !next_operand(as, p)) return;
+
+			const asm_value_t target = parse_expression(as, p);
+			if (target.symbol == -2) return;
+
+			emit_instruction(as, encode_s(match, rs1, rs2), FIXUP_B, target);
+			return;
+		}
+
+		case FORMAT_U: {
+			const int rd = parse_register(as, p);
+			if (rd < 0 || !next_operand(as, p)) return;
+
+			const asm_value_t value = parse_operand(as, p, &modifier);
+			if (value.symbol == -2) return;
+
+			if (modifier == MODIFIER_LO) {
+				report(as, MESSAGE_ERROR, "%%lo is not valid for %s", instruction->name);
+				return;
+			}
+
+			emit_instruction(as, match | (uint32_t)rd << 7, modifier == MODIFIER_HI ? FIXUP_HI : FIXUP_U, value);
+			return;
+		}
+
+		case FORMAT_JAL: {
+
+			// jal target links ra
+			int rd = REG_RA;
+			const char *q = *p;
+			const int reg = read_register(&q);
+			if (reg >= 0 && *skip_spaces(q) == ',') {
+				rd = reg;
+				*p = skip_spaces(q) + 1;
+			}
+
+			const asm_value_t target = parse_expression(as, p);
+			if (target.symbol == -2) return;
+
+			emit_instruction(as, match | (uint32_t)rd << 7, FIXUP_J, target);
+			return;
+		}
+
+		case FORMAT_JALR: {
+			int rd = parse_register(as, p);
+			if (rd < 0) return;
+
+			// jalr rs links ra
+			const char *q = skip_spaces(*p);
+			if (*q != ',') {
+				emit_instruction(as, encode_i(match, REG_RA, rd), FIXUP_I, constant(0));
+				return;
+			}
+
+			*p = q + 1;
+
+			// jalr rd, rs, imm and jalr rd, rs
+			const char *r = *p;
+			const int rs1 = read_register(&r);
+
+			if (rs1 >= 0) {
+				*p = r;
+				asm_value_t value = constant(0);
+				modifier = MODIFIER_NONE;
+
+				if (*skip_spaces(*p) == ',') {
+					*p = skip_spaces(*p) + 1;
+					value = parse_operand(as, p, &modifier);
+					if (value.symbol == -2) return;
+				}
+
+				if (!immediate_kind(as, modifier, false, &kind)) return;
+
+				emit_instruction(as, encode_i(match, rd, rs1), kind, value);
+				return;
+			}
+
+			// jalr rd, offset(rs)
+			asm_value_t offset;
+			int base;
+			if (!parse_memory(as, p, &offset, &modifier, &base)) return;
+			if (!immediate_kind(as, modifier, false, &kind)) return;
+
+			emit_instruction(as, encode_i(match, rd, base < 0 ? REG_ZERO : base), kind, offset);
+			return;
+		}
+
+		default:
+			emit_word(as, match);
+			return;
+	}
+}
+
+/**
+ * @brief Expand a pseudo-instruction
+ * @return false if name is not a pseudo-instruction
+ */
+static bool assemble_pseudo(
+	assembler_t  *as,
+	const char   *name,
+	const char  **p
+) {
+	if (strcmp(name, "nop") == 0) {
+		emit_word(as, MATCH_ADDI);
+		return true;
+	}
+
+	if (strcmp(name, "ret") == 0) {
+		emit_word(as, encode_i(MATCH_JALR, REG_ZERO, REG_RA));
+		return true;
+	}
+
+	if (strcmp(name, "li") == 0 || strcmp(name, "la") == 0 || strcmp(name, "lla") == 0) {
+		const int rd = parse_register(as, p);
+		if (rd < 0 || !next_operand(as, p)) return true;
+
+		const asm_value_t value = parse_expression(as, p);
+		if (value.symbol == -2) return true;
+
+		if (name[1] == 'i' || is_constant(value)) emit_load_immediate(as, rd, value);
+		else emit_pcrel_pair(as, rd, encode_i(MATCH_ADDI, rd, rd), FIXUP_PCREL_LO_I, value);
+
+		return true;
+	}
+
+	if (strcmp(name, "call") == 0 || strcmp(name, "tail") == 0) {
+		const asm_value_t target = parse_expression(as, p);
+		if (target.symbol == -2) return true;
+
+		const int link      = name[0] == 'c' ? REG_RA : REG_ZERO;
+		const int temporary = name[0] == 'c' ? REG_RA : REG_T1;
+
+		emit_pcrel_pair(as, temporary, encode_i(MATCH_JALR, link, temporary), FIXUP_PCREL_LO_I, target);
+		return true;
+	}
+
+	if (strcmp(name, "j") == 0) {
+		const asm_value_t target = parse_expression(as, p);
+		if (target.symbol != -2) emit_instruction(as, MATCH_JAL, FIXUP_J, target);
+
+		return true;
+	}
+
+	if (strcmp(name, "jr") == 0) {
+		const int rs = parse_register(as, p);
+		if (rs >= 0) emit_word(as, encode_i(MATCH_JALR, REG_ZERO, rs));
+
+		return true;
+	}
+
+	// Two register forms
+	static const struct {
+		const char *name;
+		uint32_t    match;
+		bool        immediate; // I-type, the value goes in the immediate
+		bool        swap;      // R-type, rs goes in rs2
+		int32_t     value;
+	} unary[] = {
+		{ "mv",   MATCH_ADDI,  true,  false, 0  }, { "not",  MATCH_XORI, true,  false, -1 },
+		{ "neg",  MATCH_SUB,   false, true,  0  }, { "seqz", MATCH_SLTIU, true, false, 1  },
+		{ "snez", MATCH_SLTU,  false, true,  0  }, { "sltz", MATCH_SLT,  false, false, 0  },
+		{ "sgtz", MATCH_SLT,   false, true,  0  }
+	};
+
+	for (size_t i = 0; i < sizeof(unary) / sizeof(unary[0]); i++) {
+		if (strcmp(name, unary[i].name) != 0) continue;
+
+		const int rd = parse_register(as, p);
+		if (rd < 0 || !next_operand(as, p)) return true;
+		const int rs = parse_register(as, p);
+		if (rs < 0) return true;
+
+		if (unary[i].immediate) {
+			emit_word(as, encode_i(unary[i].match, rd, rs) | (uint32_t)unary[i].value << 20);
+		} else {
+			emit_word(as, unary[i].swap ? encode_r(unary[i].match, rd, REG_ZERO, rs)
+										: encode_r(unary[i].match, rd, rs, REG_ZERO));
+		}
+
+		return true;
+	}
+
+	// Branches against zero and with swapped operands
+	static const struct {
+		const char *name;
+		uint32_t    match;
+		int         zero;      // 1: rs vs zero, 2: zero vs rs, 0: swap two registers
+	} branches[] = {
+		{ "beqz", MATCH_BEQ,  1 }, { "bnez", MATCH_BNE,  1 },
+		{ "blez", MATCH_BGE,  2 }, { "bgez", MATCH_BGE,  1 },
+		{ "bltz", MATCH_BLT,  1 }, { "bgtz", MATCH_BLT,  2 },
+		{ "bgt",  MATCH_BLT,  0 }, { "ble",  MATCH_BGE,  0 },
+		{ "bgtu", MATCH_BLTU, 0 }, { "bleu", MATCH_BGEU, 0 }
+	};
+
+	for (size_t i = 0; i < sizeof(branches) / sizeof(branches[0]); i++) {
+		if (strcmp(name, branches[i].name) != 0) continue;
+
+		int rs1 = parse_register(as, p);
+		if (rs1 < 0 || !next_operand(as, p)) return true;
+
+		int rs2 = REG_ZERO;
+		if (branches[i].zero == 0) {
+			rs2 = parse_register(as, p);
+			if (rs2 < 0 || !next_operand(as, p)) return true;
+
+			const int swap = rs1;
+			rs1 = rs2;
+			rs2 = swap;
+
+		} else if (branches[i].zero == 2) {
+			rs2 = rs1;
+			rs1 = REG_ZERO;
+		}
+
+		const asm_value_t target = parse_expression(as, p);
+		if (target.symbol == -2) return true;
+
+		emit_instruction(as, encode_s(branches[i].match, rs1, rs2), FIXUP_B, target);
+		return true;
+	}
+
+	return false;
+}
+
+// MARK: - Directives
+
+static void align_section(
+	assembler_t *as,
+	uint32_t     alignment
+) {
+	if (alignment <= 1) return;
+
+	asm_section_t *section = current_section(as);
+	if (alignment > section->alignment) section->alignment = alignment;
+
+	const uint32_t padding = (alignment - section->size % alignment) % alignment;
+
+	// Code is padded with nops so falling through the padding is harmless
+	if (as->current == SECTION_TEXT && padding % 4 == 0) {
+		for (uint32_t i = 0; i < padding; i += 4) emit_word(as, MATCH_ADDI);
+		return;
+	}
+
+	emit_bytes(as, NULL, padding);
+}
+
+static bool select_section(
+	assembler_t *as,
+	const char  *name
+) {
+	static const struct {
+		const char *prefix;
+		uint8_t     section;
+	} names[] = {
+		{ ".text",    SECTION_TEXT   },
+		{ ".rodata",  SECTION_RODATA }, { ".srodata", SECTION_RODATA },
+		{ ".data",    SECTION_DATA   }, { ".sdata",   SECTION_DATA   },
+		{ ".bss",     SECTION_BSS    }, { ".sbss",    SECTION_BSS    }
+	};
+
+	for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+		const size_t length = strlen(names[i].prefix);
+
+		if (strncmp(name, names[i].prefix, length) == 0 && (name[length] == '\0' || name[length] == '.')) {
+			as->current = names[i].section;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void emit_data(
+	assembler_t  *as,
+	const char  **p,
+	uint32_t      size
+) {
+	const fixup_kind_t kind = size == 4 ? FIXUP_WORD : size == 2 ? FIXUP_HALF : FIXUP_BYTE;
+
+	do {
+		const asm_value_t value = parse_expression(as, p);
+		if (value.symbol == -2) return;
+
+		add_fixup(as, kind, value, current_section(as)->size);
+		emit_bytes(as, NULL, size);
+
+		*p = skip_spaces(*p);
+		if (**p != ',') return;
+
+		(*p)++;
+	} while (true);
+}
+
+static void emit_strings(
+	assembler_t  *as,
+	const char  **p,
+	bool          terminated
+) {
+	do {
+		const char *q = skip_spaces(*p);
+
+		if (*q != '"') {
+			report(as, MESSAGE_ERROR, "expected a string");
+			return;
+		}
+
+		q++;
+		while (*q && *q != '"' && *q != '\n') {
+			int character;
+			q = read_character(q, &character);
+
+			const uint8_t byte = (uint8_t)character;
+			emit_bytes(as, &byte, 1);
+		}
+
+		if (*q != '"') {
+			report(as, MESSAGE_ERROR, "unterminated string");
+			return;
+		}
+
+		if (terminated) emit_bytes(as, NULL, 1);
+
+		*p = skip_spaces(q + 1);
+		if (**p != ',') return;
+
+		(*p)++;
+	} while (true);
+}
+
+static void assemble_directive(
+	assembler_t  *as,
+	const char   *name,
+	const char  **p
+) {
+	if (select_section(as, name)) return;
+
+	if (strcmp(name, ".section") == 0) {
+		char section[64];
+		const char *q   = skip_spaces(*p);
+		const char *end = read_identifier(q, section, sizeof(section));
+
+		if (end == q || !select_section(as, section)) {
+			unsupported(as, "this section");
+			return;
+		}
+
+		// Flags and type are implied by the name
+		*p = q + strlen(q);
+		return;
+	}
+
+	if (strcmp(name, ".word") == 0 || strcmp(name, ".long") == 0 || strcmp(name, ".4byte") == 0) {
+		emit_data(as, p, 4);
+		return;
+	}
+
+	if (strcmp(name, ".half") == 0 || strcmp(name, ".short") == 0 || strcmp(name, ".2byte") == 0) {
+		emit_data(as, p, 2);
+		return;
+	}
+
+	if (strcmp(name, ".byte") == 0) {
+		emit_data(as, p, 1);
+		return;
+	}
+
+	if (strcmp(name, ".ascii") == 0) {
+		emit_strings(as, p, false);
+		return;
+	}
+
+	if (strcmp(name, ".asciz") == 0 || strcmp(name, ".string") == 0) {
+		emit_strings(as, p, true);
+		return;
+	}
+
+	if (strcmp(name, ".space") == 0 || strcmp(name, ".zero") == 0 || strcmp(name, ".skip") == 0) {
+		const asm_value_t size = parse_expression(as, p);
+		if (size.symbol == -2) return;
+
+		asm_value_t fill = constant(0);
+		if (*skip_spaces(*p) == ',') {
+			*p = skip_spaces(*p) + 1;
+			fill = parse_expression(as, p);
+		}
+
+		if (!is_constant(size) || !is_constant(fill) || size.addend < 0) {
+			report(as, MESSAGE_ERROR, "size must be a positive constant");
+			return;
+		}
+
+		if (fill.addend == 0) {
+			emit_bytes(as, NULL, (uint32_t)size.addend);
+			return;
+		}
+
+		const uint8_t byte = (uint8_t)fill.addend;
+		for (int32_t i = 0; i < size.addend; i++) emit_bytes(as, &byte, 1);
+		return;
+	}
+
+	if (strcmp(name, ".align") == 0 || strcmp(name, ".p2align") == 0 || strcmp(name, ".balign") == 0) {
+		const asm_value_t value = parse_expression(as, p);
+		if (value.symbol == -2) return;
+
+		// Optional fill and maximum are ignored
+		*p += strcspn(*p, "\n");
+
+		if (!is_constant(value) || value.addend < 0 || (name[1] != 'b' && value.addend > 16)) {
+			report(as, MESSAGE_ERROR, "invalid alignment");
+			return;
+		}
+
+		align_section(as, name[1] == 'b' ? (uint32_t)value.addend : 1u << value.addend);
+		return;
+	}
+
+	if (strcmp(name, ".equ") == 0 || strcmp(name, ".set") == 0) {
+		char symbol[256];
+		const char *q   = skip_spaces(*p);
+		const char *end = read_identifier(q, symbol, sizeof(symbol));
+
+		if (end == q) {
+			report(as, MESSAGE_ERROR, "expected a symbol name");
+			return;
+		}
+
+		*p = end;
+		if (!next_operand(as, p)) return;
+
+		const asm_value_t value = parse_expression(as, p);
+		if (value.symbol == -2) return;
+
+		if (!is_constant(value)) {
+			unsupported(as, ".equ of a label");
+			return;
+		}
+
+		define_symbol(as, symbol, SECTION_ABSOLUTE, (uint32_t)value.addend);
+		return;
+	}
+
+	// Accepted and ignored, every label is visible to the symbol index
+	static const char *const ignored[] = {
+		".globl", ".global", ".local", ".type", ".size", ".file", ".ident", ".option", ".attribute", ".weak"
+	};
+
+	for (size_t i = 0; i < sizeof(ignored) / sizeof(ignored[0]); i++) {
+		if (strcmp(name, ignored[i]) == 0) {
+			*p += strcspn(*p, "\n;");
+			return;
+		}
+	}
+
+	char what[300];
+	snprintf(what, sizeof(what), "directive '%s'", name);
+	unsupported(as, what);
+}
+
+// MARK: - Statements
+
+static void assemble_statement(
+	assembler_t  *as,
+	const char  **p
+) {
+	const uint32_t errors = as->errors;
+	char name[256];
+
+	for (;;) {
+		const char *q = skip_spaces(*p);
+
+		// Numeric local label
+		if (isdigit((unsigned char)q[0]) && *skip_spaces(q + 1) == ':') {
+			const unsigned digit = (unsigned)(q[0] - '0');
+
+			char label[16];
+			local_label_name(as, digit, true, label);
+			define_symbol(as, label, as->current, current_section(as)->size);
+
+			as->local_labels[digit]++;
+			*p = skip_spaces(q + 1) + 1;
+			continue;
+		}
+
+		const char *end = read_identifier(q, name, sizeof(name));
+		if (end == q) {
+			*p = q;
+			break;
+		}
+
+		const char *after = skip_spaces(end);
+
+		if (*after == ':') {
+			define_symbol(as, name, as->current, current_section(as)->size);
+			*p = after + 1;
+			continue;
+		}
+
+		*p = end;
+
+		if (name[0] == '.') {
+			assemble_directive(as, name, p);
+
+		} else {
+			for (char *c = name; *c; c++) *c = (char)tolower((unsigned char)*c);
+
+			const instruction_t *instruction = find_instruction(name);
+			const uint32_t       start       = current_section(as)->size;
+
+			if (instruction) assemble_base(as, instruction, p);
+			else if (!assemble_pseudo(as, name, p)) {
+				char what[300];
+				snprintf(what, sizeof(what), "instruction '%s'", name);
+				unsupported(as, what);
+			}
+
+			// A pseudo-instruction may span several words, they share the line
+			if (as->current == SECTION_TEXT && current_section(as)->size > start) add_line(as, start);
+		}
+
+		break;
+	}
+
+	const char *q = skip_spaces(*p);
+	if (*q != '\0' && *q != ';' && as->errors == errors && !as->unsupported) {
+		report(as, MESSAGE_ERROR, "unexpected text '%.20s'", q);
+	}
+}
+
+/**
+ * @brief Copy a source line without its comment
+ */
+static size_t strip_comment(
+	const char *line,
+	size_t      length,
+	char       *output
+) {
+	bool quoted = false;
+	size_t i = 0;
+
+	for (; i < length; i++) {
+		const char c = line[i];
+
+		if (quoted && c == '\\' && i + 1 < length) {
+			output[i] = c;
+			i++;
+			output[i] = line[i];
+			continue;
+		}
+
+		if (c == '"') quoted = !quoted;
+		if (!quoted && (c == '#' || (c == '/' && i + 1 < length && line[i + 1] == '/'))) break;
+
+		// A character literal may hold a comment or a quote character
+		if (!quoted && c == '\'' && i + 2 < length) {
+			const size_t literal = line[i + 1] == '\\' ? 3 : 2;
+
+			if (i + literal < length && line[i + literal] == '\'') {
+				memcpy(output + i, line + i, literal + 1);
+				i += literal;
+				continue;
+			}
+		}
+
+		output[i] = c;
+	}
+
+	output[i] = '\0';
+	return i;
+}
+
+// MARK: - Linking
+
+static void write_word(uint8_t *p, uint32_t value) {
+	p[0] = value & 0xFF;
+	p[1] = value >> 8 & 0xFF;
+	p[2] = value >> 16 & 0xFF;
+	p[3] = value >> 24 & 0xFF;
+}
+
+static uint32_t read_word(const uint8_t *p) {
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static bool fits_signed(int64_t value, unsigned bits) {
+	return value >= -((int64_t)1 << (bits - 1)) && value < ((int64_t)1 << (bits - 1));
+}
+
+static uint32_t align_up(uint32_t value, uint32_t alignment) {
+	return alignment > 1 ? (value + alignment - 1) / alignment * alignment : value;
+}
+
+static uint32_t section_end(const asm_section_t *section) {
+	return section->base + section->size;
+}
+
+/**
+ * @brief Place the sections: code, read-only data, data and .bss, each
+ * kind on its own pages so they map to separate segments
+ */
+static void layout_sections(assembler_t *as) {
+	uint32_t address = BUILTIN_TEXT_BASE;
+
+	for (int i = 0; i < SECTION_COUNT; i++) {
+		asm_section_t *section = &as->sections[i];
+
+		// .bss follows .data on the same pages
+		if (i != SECTION_BSS) address = align_up(address, BUILTIN_PAGE_SIZE);
+
+		section->base = align_up(address, section->alignment ? section->alignment : 1);
+		address = section_end(section);
+	}
+}
+
+static void apply_fixup(
+	assembler_t       *as,
+	const asm_fixup_t *fixup
+) {
+	as->line = fixup->line;
+
+	asm_section_t *section = &as->sections[fixup->section];
+	uint8_t *p = section->bytes ? section->bytes + fixup->offset : NULL;
+	if (!p) return;
+
+	int64_t value = fixup->value.addend;
+
+	if (fixup->value.symbol >= 0) {
+		const asm_symbol_t *symbol = &as->symbols[fixup->value.symbol];
+
+		if (!symbol->defined) {
+			if (strchr(symbol->name, LOCAL_LABEL_MARK)) report(as, MESSAGE_ERROR, "undefined local label '%c'", symbol->name[0]);
+			else report(as, MESSAGE_ERROR, "undefined symbol '%s'", symbol->name);
+
+			return;
+		}
+
+		const uint32_t base = symbol->section == SECTION_ABSOLUTE ? 0 : as->sections[symbol->section].base;
+		value = (int64_t)(int32_t)(base + symbol->value + (uint32_t)fixup->value.addend);
+	}
+
+	const uint32_t pc = section->base + fixup->offset;
+	uint32_t word = read_word(p);
+
+	switch (fixup->kind) {
+		case FIXUP_I:
+			if (!fits_signed(value, 12)) goto range;
+			word |= ((uint32_t)value & 0xFFF) << 20;
+			break;
+
+		case FIXUP_S:
+			if (!fits_signed(value, 12)) goto range;
+			word |= ((uint32_t)value & 0x1F) << 7 | ((uint32_t)value >> 5 & 0x7F) << 25;
+			break;
+
+		case FIXUP_SHAMT:
+			if (value < 0 || value > 31) goto range;
+			word |= (uint32_t)value << 20;
+			break;
+
+		case FIXUP_U:
+			if (value < 0 || value > 0xFFFFF) goto range;
+			word |= (uint32_t)value << 12;
+			break;
+
+		case FIXUP_HI:
+			word |= ((uint32_t)value + 0x800) & 0xFFFFF000;
+			break;
+
+		case FIXUP_LO_I:
+			word |= ((uint32_t)value & 0xFFF) << 20;
+			break;
+
+		case FIXUP_LO_S:
+			word |= ((uint32_t)value & 0x1F) << 7 | ((uint32_t)value >> 5 & 0x7F) << 25;
+			break;
+
+		case FIXUP_PCREL_HI:
+			word |= ((uint32_t)value - pc + 0x800) & 0xFFFFF000;
+			break;
+
+		case FIXUP_PCREL_LO_I:
+		case FIXUP_PCREL_LO_S: {
+
+			// Relative to the auipc just before
+			const uint32_t low = (uint32_t)value - (pc - 4);
+
+			if (fixup->kind == FIXUP_PCREL_LO_I) word |= (low & 0xFFF) << 20;
+			else word |= (low & 0x1F) << 7 | (low >> 5 & 0x7F) << 25;
+
+			break;
+		}
+
+		case FIXUP_B: {
+			const int64_t offset = (int64_t)(int32_t)((uint32_t)value - pc);
+			if (!fits_signed(offset, 13) || (offset & 1)) goto jump_range;
+
+			const uint32_t o = (uint32_t)offset;
+			word |= (o >> 12 & 1) << 31 | (o >> 5 & 0x3F) << 25 | (o >> 1 & 0xF) << 8 | (o >> 11 & 1) << 7;
+			break;
+		}
+
+		case FIXUP_J: {
+			const int64_t offset = (int64_t)(int32_t)((uint32_t)value - pc);
+			if (!fits_signed(offset, 21) || (offset & 1)) goto jump_range;
+
+			const uint32_t o = (uint32_t)offset;
+			word |= (o >> 20 & 1) << 31 | (o >> 1 & 0x3FF) << 21 | (o >> 11 & 1) << 20 | (o >> 12 & 0xFF) << 12;
+			break;
+		}
+
+		case FIXUP_WORD:
+			write_word(p, (uint32_t)value);
+			return;
+
+		case FIXUP_HALF:
+			if (value < -0x8000 || value > 0xFFFF) goto range;
+			p[0] = (uint32_t)value & 0xFF;
+			p[1] = (uint32_t)value >> 8 & 0xFF;
+			return;
+
+		case FIXUP_BYTE:
+			if (value < -0x80 || value > 0xFF) goto range;
+			p[0] = (uint32_t)value & 0xFF;
+			return;
+	}
+
+	write_word(p, word);
+	return;
+
+range:
+	report(as, MESSAGE_ERROR, "value %lld out of range", (long long)value);
+	return;
+
+jump_range:
+	report(as, MESSAGE_ERROR, "target 0x%08x out of range of the jump at 0x%08x", (uint32_t)value, pc);
+}
+
+static bool exported(const asm_symbol_t *symbol) {
+	return symbol->defined && symbol->section != SECTION_ABSOLUTE && !strchr(symbol->name, LOCAL_LABEL_MARK);
+}
+
+/**
+ * @brief Build the image in opts: code, read-only data, data, then the
+ * names of the symbols
+ */
+static bool build_image(
+	assembler_t *as,
+	options_t   *opts
+) {
+	const asm_section_t *text   = &as->sections[SECTION_TEXT];
+	const asm_section_t *rodata = &as->sections[SECTION_RODATA];
+	const asm_section_t *data   = &as->sections[SECTION_DATA];
+	const asm_section_t *bss    = &as->sections[SECTION_BSS];
+
+	size_t   names   = 0;
+	uint32_t symbols = 0;
+
+	for (uint32_t i = 0; i < as->symbol_count; i++) {
+		if (!exported(&as->symbols[i])) continue;
+
+		names += strlen(as->symbols[i].name) + 1;
+		symbols++;
+	}
+
+	const uint32_t stored = text->size + rodata->size + data->size;
+	const size_t   size   = stored + names ? stored + names : 1;
+
+	// Anonymous mapping, released like a mapped ELF file
+	uint8_t *image = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+	if (image == MAP_FAILED) return false;
+
+	opts->image      = image;
+	opts->image_size = size;
+	opts->segments   = calloc(3, sizeof(elf_segment_t));
+	opts->symbols    = malloc((symbols ? symbols : 1) * sizeof(elf_symbol_t));
+	opts->lines      = malloc((as->line_count ? as->line_count : 1) * sizeof(source_line_t));
+
+	if (!opts->segments || !opts->symbols || !opts->lines) return false;
+
+	uint32_t offset = 0;
+
+	const asm_section_t *stored_sections[3] = { text, rodata, data };
+	static const uint32_t flags[3] = { PF_R | PF_X, PF_R, PF_R | PF_W };
+
+	for (int i = 0; i < 3; i++) {
+		const asm_section_t *section = stored_sections[i];
+
+		uint32_t memory_size = section->size;
+		if (section == data && bss->size) memory_size = section_end(bss) - data->base;
+
+		if (memory_size == 0) continue;
+		if (section->size) memcpy(image + offset, section->bytes, section->size);
+
+		opts->segments[opts->segment_count++] = (elf_segment_t){
+			.vaddr       = section->size ? section->base : bss->base,
+			.offset      = offset,
+			.file_size   = section->size,
+			.memory_size = section->size ? memory_size : bss->size,
+			.flags       = flags[i]
+		};
+
+		offset += section->size;
+	}
+
+	// Labels are placed in order inside each section and the sections in
+	// address order, so the index comes out sorted
+	char *name = (char *)image + stored;
+
+	for (int s = 0; s < SECTION_COUNT; s++) {
+		for (uint32_t i = 0; i < as->symbol_count; i++) {
+			const asm_symbol_t *symbol = &as->symbols[i];
+			if (symbol->section != s || !exported(symbol)) continue;
+
+			const size_t length = strlen(symbol->name) + 1;
+			memcpy(name, symbol->name, length);
+
+			opts->symbols[opts->symbol_count++] = (elf_symbol_t){
+				.address = as->sections[s].base + symbol->value,
+				.size    = 0,
+				.name    = name
+			};
+
+			name += length;
+		}
+	}
+
+	// Statements are read in order, the index comes out sorted too
+	for (uint32_t i = 0; i < as->line_count; i++) {
+		opts->lines[i] = (source_line_t){ .address = text->base + as->lines[i].offset, .line = as->lines[i].line };
+	}
+
+	opts->line_count = as->line_count;
+
+	opts->text_vaddr   = text->base;
+	opts->text_size    = text->size;
+	opts->text_data    = text->size ? image : NULL;
+	opts->rodata_vaddr = rodata->base;
+	opts->rodata_size  = rodata->size;
+	opts->rodata_data  = rodata->size ? image + text->size : NULL;
+
+	opts->data_vaddr = data->size ? data->base : bss->base;
+	opts->data_size  = bss->size ? section_end(bss) - opts->data_vaddr : data->size;
+	opts->data_data  = data->size && !bss->size ? image + text->size + rodata->size : NULL;
+
+	const int32_t start = symbol_index(as, "_start");
+	opts->entry_point = start >= 0 && exported(&as->symbols[start])
+		? as->sections[as->symbols[start].section].base + as->symbols[start].value
+		: text->base;
+
+	return true;
+}
+
+static void destroy_assembler(assembler_t *as) {
+	for (int i = 0; i < SECTION_COUNT; i++) free(as->sections[i].bytes);
+	for (uint32_t i = 0; i < as->symbol_count; i++) free(as->symbols[i].name);
+
+	free(as->symbols);
+	free(as->table);
+	free(as->fixups);
+	free(as->lines);
+}
+
+// MARK: - Entry points
+
+assemble_result_t assemble_riscv_source(
+	const char  *source,
+	size_t       length,
+	const char  *name,
+	options_t   *opts,
+	LogCallback  callback
+) {
+	if (!source || !opts) return ASSEMBLE_ERROR;
+
+	unload_elf_sections(opts);
+
+	assembler_t as = {
+		.name    = name ? name : "<source>",
+		.log     = callback ? malloc(sizeof(log_batch_t)) : NULL,
+		.current = SECTION_TEXT
+	};
+
+	char *line = malloc(length + 1);
+	if (!line || (callback && !as.log)) {
+		free(line);
+		free(as.log);
+		log_message(callback, MESSAGE_ERROR, "out of memory");
+
+		return ASSEMBLE_ERROR;
+	}
+
+	if (as.log) log_batch_init(as.log, callback);
+
+	const char *cursor = source;
+	const char *end    = source + length;
+
+	while (cursor < end && !as.unsupported && !as.out_of_memory) {
+		const char *newline = memchr(cursor, '\n', (size_t)(end - cursor));
+		const size_t size   = newline ? (size_t)(newline - cursor) : (size_t)(end - cursor);
+
+		as.line++;
+		strip_comment(cursor, size, line);
+
+		// ';' separates statements on the same line
+		const char *p = line;
+		while (*p) {
+			const uint32_t errors = as.errors;
+			assemble_statement(&as, &p);
+
+			if (as.errors != errors || as.unsupported) break;
+
+			p = skip_spaces(p);
+			if (*p == ';') p++;
+			else break;
+		}
+
+		cursor += size + 1;
+	}
+
+	free(line);
+
+	assemble_result_t result = ASSEMBLE_OK;
+
+	if (as.unsupported) {
+		result = ASSEMBLE_UNSUPPORTED;
+
+	} else if (as.out_of_memory) {
+		report(&as, MESSAGE_ERROR, "out of memory");
+		result = ASSEMBLE_ERROR;
+
+	} else {
+		layout_sections(&as);
+		for (uint32_t i = 0; i < as.fixup_count; i++) apply_fixup(&as, &as.fixups[i]);
+
+		if (as.errors) result = ASSEMBLE_ERROR;
+		else if (!build_image(&as, opts)) {
+			report(&as, MESSAGE_ERROR, "out of memory");
+			result = ASSEMBLE_ERROR;
+		}
+	}
+
+	if (result != ASSEMBLE_OK) unload_elf_sections(opts);
+
+	if (as.log) {
+		log_batch_flush(as.log);
+		free(as.log);
+	}
+
+	destroy_assembler(&as);
+	return result;
+}
+
+assemble_result_t assemble_riscv_file(
+	const char  *filepath,
+	options_t   *opts,
+	LogCallback  callback
+) {
+	FILE *file = fopen(filepath, "rb");
+
+	if (!file) {
+		log_message(callback, MESSAGE_ERROR, "Cannot open the source file");
+
+		return ASSEMBLE_ERROR;
+	}
+
+	fseek(file, 0, SEEK_END);
+	const long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	char *source = size > 0 ? malloc((size_t)size) : NULL;
+	const size_t length = source ? fread(source, 1, (size_t)size, file) : 0;
+	fclose(file);
+
+	const char *name = strrchr(filepath, '/');
+
+	const assemble_result_t result = assemble_riscv_source(source ? source : "", length, name ? name + 1 : filepath, opts, callback);
+	free(source);
+
+	return result;
+}
@@ -7,158 +7,375 @@
 #include "args_handler.h"
 #include "elf.h"
 
+#include <fcntl.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+void unload_elf_sections(options_t* opts) {
+    if (!opts) return;
+
+    if (opts->image)         munmap(opts->image, opts->image_size);
+    if (opts->image_fd >= 0) close(opts->image_fd);
+
+    free(opts->segments);
+    free(opts->symbols);
+    free(opts->lines);
+
+    opts->image_fd   = -1;
+    opts->image      = NULL;
+    opts->image_size = 0;
+
+    opts->segments      = NULL;
+    opts->segment_count = 0;
+    opts->symbols       = NULL;
+    opts->symbol_count  = 0;
+    opts->lines         = NULL;
+    opts->line_count    = 0;
+
+    opts->text_data   = NULL;
+    opts->text_size   = 0;
+    opts->data_data   = NULL;
+    opts->data_size   = 0;
+    opts->rodata_data = NULL;
+    opts->rodata_size = 0;
+}
+
+// MARK: - Helpers
+
+/**
+ * @brief Check that a file range lies inside the image
+ */
+static int in_image(const options_t* opts, uint32_t offset, uint64_t size) {
+    return (uint64_t)offset + size <= opts->image_size;
+}
+
+/**
+ * @brief Copy out a section header, headers may be unaligned in the file
+ */
+static Elf32_Shdr section_at(const uint8_t* headers, uint32_t index) {
+    Elf32_Shdr section;
+    memcpy(&section, headers + (size_t)index * sizeof(Elf32_Shdr), sizeof(section));
+
+    return section;
+}
+
+/**
+ * @brief Grow an address range to cover another one
+ */
+static void extend_range(uint32_t* base, size_t* size, uint32_t address, uint32_t length) {
+    if (*size == 0) {
+        *base = address;
+        *size = length;
+
+        return;
+    }
+
+    const uint64_t start = address < *base ? address : *base;
+    const uint64_t end   = (uint64_t)address + length > (uint64_t)*base + *size
+        ? (uint64_t)address + length
+        : (uint64_t)*base + *size;
+
+    *base = (uint32_t)start;
+    *size = (size_t)(end - start);
+}
+
+/**
+ * @brief File bytes of an address range, NULL when a segment does not store all of it
+ */
+static uint8_t* file_pointer(const options_t* opts, uint32_t address, size_t size) {
+    for (uint32_t i = 0; i < opts->segment_count; i++) {
+        const elf_segment_t* segment = &opts->segments[i];
+
+        if (address >= segment->vaddr &&
+            (uint64_t)address + size <= (uint64_t)segment->vaddr + segment->file_size) {
+            return opts->image + segment->offset + (address - segment->vaddr);
+        }
+    }
+
+    return NULL;
+}
+
+static int compare_symbols(const void* a, const void* b) {
+    const elf_symbol_t* left  = a;
+    const elf_symbol_t* right = b;
+
+    if (left->address != right->address) return left->address < right->address ? -1 : 1;
+
+    return strcmp(left->name, right->name);
+}
+
+// MARK: - Segments
+
+/**
+ * @brief Collect the PT_LOAD segments
+ * @return number of segments, -1 on error
+ */
+static int load_program_segments(options_t* opts, const Elf32_Ehdr* ehdr) {
+    if (ehdr->e_phnum == 0) return 0;
+
+    if (ehdr->e_phentsize != sizeof(Elf32_Phdr) ||
+        !in_image(opts, ehdr->e_phoff, (uint64_t)ehdr->e_phnum * sizeof(Elf32_Phdr))) {
+        fprintf(stderr, "Errore lettura program headers\n");
+
+        return -1;
+    }
+
+    opts->segments = malloc(ehdr->e_phnum * sizeof(elf_segment_t));
+    if (!opts->segments) return -1;
+
+    for (uint32_t i = 0; i < ehdr->e_phnum; i++) {
+        Elf32_Phdr header;
+        memcpy(&header, opts->image + ehdr->e_phoff + (size_t)i * sizeof(Elf32_Phdr), sizeof(header));
+
+        if (header.p_type != PT_LOAD || header.p_memsz == 0) continue;
+
+        if (!in_image(opts, header.p_offset, header.p_filesz) || header.p_filesz > header.p_memsz) {
+            fprintf(stderr, "Segmento %u non valido\n", i);
+
+            return -1;
+        }
+
+        opts->segments[opts->segment_count++] = (elf_segment_t){
+            .vaddr       = header.p_vaddr,
+            .offset      = header.p_offset,
+            .file_size   = header.p_filesz,
+            .memory_size = header.p_memsz,
+            .flags       = header.p_flags
+        };
+    }
+
+    return (int)opts->segment_count;
+}
+
+/**
+ * @brief Build one segment for each allocated section, used when the
+ * file has no program headers
+ */
+static int load_section_segments(options_t* opts, const uint8_t* headers, uint32_t count) {
+    opts->segments = malloc(count * sizeof(elf_segment_t));
+    if (!opts->segments) return -1;
+
+    for (uint32_t i = 0; i < count; i++) {
+        const Elf32_Shdr section = section_at(headers, i);
+        if (!(section.sh_flags & SHF_ALLOC) || section.sh_size == 0) continue;
+
+        const uint32_t stored = section.sh_type == SHT_NOBITS ? 0 : section.sh_size;
+        if (!in_image(opts, section.sh_offset, stored)) continue;
+
+        opts->segments[opts->segment_count++] = (elf_segment_t){
+            .vaddr       = section.sh_addr,
+            .offset      = section.sh_offset,
+            .file_size   = stored,
+            .memory_size = section.sh_size,
+            .flags       = PF_R
+                         | (section.sh_flags & SHF_WRITE ? PF_W : 0)
+                         | (section.sh_flags & SHF_EXECINSTR ? PF_X : 0)
+        };
+    }
+
+    return (int)opts->segment_count;
+}
+
+// MARK: - Symbols
+
+/**
+ * @brief Index the named symbols of allocated sections, sorted by address
+ */
+static int load_symbols(options_t* opts, const uint8_t* headers, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        const Elf32_Shdr symtab = section_at(headers, i);
+        if (symtab.sh_type != SHT_SYMTAB || symtab.sh_link >= count) continue;
+
+        const Elf32_Shdr strtab = section_at(headers, symtab.sh_link);
+
+        if (symtab.sh_entsize != sizeof(Elf32_Sym) ||
+            !in_image(opts, symtab.sh_offset, symtab.sh_size) ||
+            !in_image(opts, strtab.sh_offset, strtab.sh_size)) {
+            return -1;
+        }
+
+        const uint32_t symbols = symtab.sh_size / sizeof(Elf32_Sym);
+        const char*    names   = (const char*)opts->image + strtab.sh_offset;
+
+        opts->symbols = malloc((symbols ? symbols : 1) * sizeof(elf_symbol_t));
+        if (!opts->symbols) return -1;
+
+        for (uint32_t j = 0; j < symbols; j++) {
+            Elf32_Sym symbol;
+            memcpy(&symbol, opts->image + symtab.sh_offset + (size_t)j * sizeof(Elf32_Sym), sizeof(symbol));
+
+            const unsigned type = ELF32_ST_TYPE(symbol.st_info);
+
+            if (type == STT_SECTION || type == STT_FILE ||
+                symbol.st_shndx == SHN_UNDEF || symbol.st_shndx >= SHN_LORESERVE ||
+                symbol.st_shndx >= count || symbol.st_name >= strtab.sh_size) {
+                continue;
+            }
+
+            // Symbols of sections not loaded in memory have no address
+            if (!(section_at(headers, symbol.st_shndx).sh_flags & SHF_ALLOC)) continue;
+
+            const char* name = names + symbol.st_name;
+            if (!memchr(name, '\0', strtab.sh_size - symbol.st_name)) continue;
+
+            // Assembler temporaries and mapping symbols are not labels
+            if (name[0] == '\0' || name[0] == '$' || strncmp(name, ".L", 2) == 0) continue;
+
+            opts->symbols[opts->symbol_count++] = (elf_symbol_t){
+                .address = symbol.st_value,
+                .size    = symbol.st_size,
+                .name    = name
+            };
+        }
+
+        qsort(opts->symbols, opts->symbol_count, sizeof(elf_symbol_t), compare_symbols);
+
+        return 0;
+    }
+
+    return 0;
+}
+
+const elf_symbol_t* find_elf_symbol(const options_t* opts, uint32_t address) {
+    if (!opts || opts->symbol_count == 0) return NULL;
+
+    // First symbol after address
+    uint32_t low  = 0;
+    uint32_t high = opts->symbol_count;
+
+    while (low < high) {
+        const uint32_t middle = low + (high - low) / 2;
+
+        if (opts->symbols[middle].address <= address) low = middle + 1;
+        else high = middle;
+    }
+
+    return low ? &opts->symbols[low - 1] : NULL;
+}
+
+bool find_source_line(const options_t* opts, uint32_t line, uint32_t* address) {
+    if (!opts || opts->line_count == 0 || !address) return false;
+
+    // The source is assembled in order, the lines grow with the addresses
+    uint32_t low  = 0;
+    uint32_t high = opts->line_count;
+
+    while (low < high) {
+        const uint32_t middle = low + (high - low) / 2;
+
+        if (opts->lines[middle].line < line) low = middle + 1;
+        else high = middle;
+    }
+
+    if (low == opts->line_count || opts->lines[low].line != line) return false;
+
+    *address = opts->lines[low].address;
+    return true;
+}
+
+// MARK: - Loading
 
 int load_elf_sections(const char* filepath, options_t* opts) {
-    FILE* f = fopen(filepath, "rb");
-	
-    if (!f) {
-        perror("fopen");
-		
+    unload_elf_sections(opts);
+
+    const int fd = open(filepath, O_RDONLY);
+
+    if (fd < 0) {
+        perror("open");
+
         return -1;
     }
 
-    Elf32_Ehdr ehdr;
-    if (fread(&ehdr, sizeof(ehdr), 1, f) != 1) {
+    struct stat status;
+    if (fstat(fd, &status) != 0 || (size_t)status.st_size < sizeof(Elf32_Ehdr)) {
         fprintf(stderr, "Errore lettura ELF header\n");
-        fclose(f);
-		
+        close(fd);
+
         return -1;
     }
 
+    // The whole file is mapped once, headers, sections and symbols are
+    // used in place and nothing is read or copied here
+    uint8_t* image = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (image == MAP_FAILED) {
+        perror("mmap");
+        close(fd);
+
+        return -1;
+    }
+
+    opts->image_fd   = fd;
+    opts->image      = image;
+    opts->image_size = (size_t)status.st_size;
+
+    Elf32_Ehdr ehdr;
+    memcpy(&ehdr, image, sizeof(ehdr));
+
     if (ehdr.e_ident[0] != 0x7f || ehdr.e_ident[1] != 'E' ||
         ehdr.e_ident[2] != 'L' || ehdr.e_ident[3] != 'F') {
         fprintf(stderr, "File non è un ELF valido\n");
-        fclose(f);
-		
+        unload_elf_sections(opts);
+
         return -1;
 	}
 
     opts->entry_point = ehdr.e_entry;
 
-    if (fseek(f, ehdr.e_shoff, SEEK_SET) != 0) {
-        fprintf(stderr, "Errore seek section headers\n");
-        fclose(f);
-		
-        return -1;
-    }
+    if ((ehdr.e_shnum && ehdr.e_shentsize != sizeof(Elf32_Shdr)) ||
+        !in_image(opts, ehdr.e_shoff, (uint64_t)ehdr.e_shnum * sizeof(Elf32_Shdr))) {
+        fprintf(stderr, "Errore lettura section headers\n");
+        unload_elf_sections(opts);
 
-    Elf32_Shdr* sections = malloc(sizeof(Elf32_Shdr) * ehdr.e_shnum);
-    if (!sections) {
-        fprintf(stderr, "Errore allocazione memoria sections\n");
-        fclose(f);
-		
         return -1;
     }
 
-    if (fread(sections, sizeof(Elf32_Shdr), ehdr.e_shnum, f) != ehdr.e_shnum) {
-        fprintf(stderr, "Errore lettura section headers\n");
-        free(sections);
-        fclose(f);
-		
-        return -1;
-    }
+    const uint8_t* headers = image + ehdr.e_shoff;
 
-    // Controllo validità dell'indice string table
-    if (ehdr.e_shstrndx >= ehdr.e_shnum) {
-        fprintf(stderr, "Indice string table non valido\n");
-        free(sections);
-        fclose(f);
-		
-        return -1;
-    }
+    int segments = load_program_segments(opts, &ehdr);
+    if (segments == 0) {
+        free(opts->segments);
+        opts->segments = NULL;
 
-    const Elf32_Shdr strtab_hdr = sections[ehdr.e_shstrndx];
-    char* shstrtab = malloc(strtab_hdr.sh_size);
-    if (!shstrtab) {
-        fprintf(stderr, "Errore allocazione string table\n");
-        free(sections);
-        fclose(f);
-		
-        return -1;
+        segments = load_section_segments(opts, headers, ehdr.e_shnum);
     }
 
-    if (fseek(f, strtab_hdr.sh_offset, SEEK_SET) != 0) {
-        fprintf(stderr, "Errore seek string table\n");
-        free(sections);
-        free(shstrtab);
-        fclose(f);
-		
-        return -1;
-    }
+    if (segments <= 0 || load_symbols(opts, headers, ehdr.e_shnum) != 0) {
+        fprintf(stderr, "Nessun segmento caricabile\n");
+        unload_elf_sections(opts);
 
-    if (fread(shstrtab, 1, strtab_hdr.sh_size, f) != strtab_hdr.sh_size) {
-        fprintf(stderr, "Errore lettura string table\n");
-        free(sections);
-        free(shstrtab);
-        fclose(f);
-		
         return -1;
     }
 
-    for (int i = 0; i < ehdr.e_shnum; i++) {
-            
-        if (sections[i].sh_name >= strtab_hdr.sh_size) {
-            continue;
-        }
+    // Ranges of the sections by kind, for the memory views
+    uint32_t text_vaddr = 0, data_vaddr = 0, rodata_vaddr = 0;
+    size_t   text_size  = 0, data_size  = 0, rodata_size  = 0;
 
-        const char* name = shstrtab + sections[i].sh_name;
-      
-        if (strcmp(name, ".text") == 0) { // <--- AGGIUNTO == 0
-                
-            uint8_t* buf = malloc(sections[i].sh_size);
-            if (!buf) continue; // Gestione errore malloc
-
-            if (fseek(f, sections[i].sh_offset, SEEK_SET) == 0 &&
-                fread(buf, 1, sections[i].sh_size, f) == sections[i].sh_size) {
-                
-                opts->text_data = buf;
-                opts->text_size = sections[i].sh_size;
-                opts->text_vaddr = sections[i].sh_addr;
-                
-            } else {
-                free(buf);
-            }
+    for (uint32_t i = 0; i < ehdr.e_shnum; i++) {
+        const Elf32_Shdr section = section_at(headers, i);
+        if (!(section.sh_flags & SHF_ALLOC) || section.sh_size == 0) continue;
 
-        } else if (strcmp(name, ".data") == 0 || strcmp(name, ".sdata") == 0) {
-                
-            uint8_t* buf = malloc(sections[i].sh_size);
-            if (!buf) continue;
-
-            if (fseek(f, sections[i].sh_offset, SEEK_SET) == 0 &&
-                fread(buf, 1, sections[i].sh_size, f) == sections[i].sh_size) {
-                
-                opts->data_data = buf;
-                opts->data_size = sections[i].sh_size;
-                opts->data_vaddr = sections[i].sh_addr;
-                
-            } else {
-                free(buf);
-            }
-                
-        } else if (strcmp(name, ".rodata") == 0) {
-                
-            uint8_t* buf = malloc(sections[i].sh_size);
-            if (!buf) continue;
-
-            if (fseek(f, sections[i].sh_offset, SEEK_SET) == 0 &&
-                fread(buf, 1, sections[i].sh_size, f) == sections[i].sh_size) {
-                
-                opts->rodata_data = buf;
-                opts->rodata_size = sections[i].sh_size;
-                opts->rodata_vaddr = sections[i].sh_addr;
-                
-            } else {
-                free(buf);
-            }
+        if (section.sh_flags & SHF_EXECINSTR) {
+            extend_range(&text_vaddr, &text_size, section.sh_addr, section.sh_size);
+
+        } else if (section.sh_flags & SHF_WRITE) {
+            extend_range(&data_vaddr, &data_size, section.sh_addr, section.sh_size);
+
+        } else {
+            extend_range(&rodata_vaddr, &rodata_size, section.sh_addr, section.sh_size);
         }
     }
 
-    free(sections);
-    free(shstrtab);
-    unlink(filepath);
-    fclose(f);
+    opts->text_vaddr   = text_vaddr;
+    opts->text_size    = text_size;
+    opts->text_data    = file_pointer(opts, text_vaddr, text_size);
+    opts->data_vaddr   = data_vaddr;
+    opts->data_size    = data_size;
+    opts->data_data    = file_pointer(opts, data_vaddr, data_size);
+    opts->rodata_vaddr = rodata_vaddr;
+    opts->rodata_size  = rodata_size;
+    opts->rodata_data  = file_pointer(opts, rodata_vaddr, rodata_size);
 
     return 0;
 }
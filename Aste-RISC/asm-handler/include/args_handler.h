@@ -14,11 +14,43 @@ typedef struct {
     uint32_t instruction;   // machine code of the instruction (32-bit)
 } riscv_instruction_t;
 
+// Loadable segment of the binary (PT_LOAD)
+typedef struct {
+    uint32_t vaddr;           // virtual address of the first byte
+    uint32_t offset;          // file offset of the stored bytes
+    uint32_t file_size;       // bytes stored in the file
+    uint32_t memory_size;     // bytes in memory, the ones past file_size are zero
+    uint32_t flags;           // PF_R, PF_W, PF_X
+
+} elf_segment_t;
+
+// Symbol of the binary, the index is sorted by address
+typedef struct {
+    uint32_t    address;      // value of the symbol
+    uint32_t    size;         // 0 for plain labels
+    const char* name;         // inside the mapped string table
+
+} elf_symbol_t;
+
+// Instruction statement of the source, the index is sorted by address
+typedef struct {
+    uint32_t address;         // first word assembled from the statement
+    uint32_t line;            // source line, starting from 1
+
+} source_line_t;
+
 // struct with the options for the binary
 typedef struct {
     char *binary_file;                // path to asm riscv 32bit binary file
 
-    // Add options for load in memory the instructions
+    // ELF file mapped read-only, the section buffers point inside it
+    // and the descriptor stays open to map the sections into RAM
+    int      image_fd;
+    uint8_t* image;
+    size_t   image_size;
+
+    // Address ranges covered by the sections of each kind, the buffers
+    // are NULL when the range is not stored in the file
     // Instruction (.text)
     uint8_t* text_data;       // binary buffer.text
     size_t   text_size;         // byte
@@ -34,6 +66,19 @@ typedef struct {
     size_t   rodata_size;
     uint32_t rodata_vaddr;
 
+    // Segments to load, in file order
+    elf_segment_t* segments;
+    uint32_t       segment_count;
+
+    // Symbols sorted by address, for address to label lookups
+    elf_symbol_t* symbols;
+    uint32_t      symbol_count;
+
+    // Source lines of the .text instructions, only the built-in
+    // assembler fills them, pseudo-instructions span several words
+    source_line_t* lines;
+    uint32_t       line_count;
+
     // Entry point
     uint32_t entry_point;
 
@@ -9,6 +9,7 @@
 #define ASSEMBLER_H
 
 // assembler.c
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -20,22 +21,124 @@ typedef enum {
 	MESSAGE_ERROR
 } message_type_t;
 
+/**
+ * @brief Diagnostic or progress line of a build.
+ *
+ * text Line as shown in the terminal.
+ * file Source the diagnostic refers to, NULL for progress lines.
+ * line Line in the source, 0 when unknown.
+ * column Column in the line, 0 when unknown.
+ * message Text after the location and the severity.
+ */
 typedef struct {
 	message_type_t type;
 	const char *text;
+	const char *file;
+	uint32_t line;
+	uint32_t column;
+	const char *message;
 } assembler_message_t;
 
-// Define the type that swift call
-typedef void (*LogCallback)(assembler_message_t);
+// Toolchain used for the sources the built-in assembler does not support,
+// the flags are part of the build cache key
+#define ASSEMBLER_PATH  "/opt/homebrew/bin/riscv64-unknown-elf-as"
+#define ASSEMBLER_FLAGS "-march=rv32i", "-mabi=ilp32"
+#define LINKER_PATH     "/opt/homebrew/bin/riscv64-unknown-elf-ld"
+#define LINKER_FLAGS    "-G", "0", "-m", "elf32lriscv"
+
+// Define the type that swift call, the messages and their texts are only
+// valid during the call
+typedef void (*LogCallback)(const assembler_message_t *messages, size_t count);
+
+// Capacity of a batch of messages handed to the callback at once
+#define LOG_BATCH_MESSAGES 64
+#define LOG_BATCH_TEXT     16384
+
+/**
+ * @brief Messages waiting to be sent, their strings live in text.
+ *
+ * The batch is sent when it is full and on log_batch_flush, then reused.
+ */
+typedef struct {
+	LogCallback callback;
+
+	assembler_message_t messages[LOG_BATCH_MESSAGES];
+	size_t count;
+
+	char   text[LOG_BATCH_TEXT];
+	size_t used;
+
+} log_batch_t;
+
+/**
+ * @brief Prepare an empty batch
+ * @param batch Batch to initialize
+ * @param callback Function receiving the messages, may be NULL
+ */
+void log_batch_init(
+	log_batch_t *batch,
+	LogCallback callback
+);
+
+/**
+ * @brief Parse an output line of the toolchain and queue it
+ *
+ * Lines like "file:line[:column]: error: message" become diagnostics with
+ * their location, the other ones are queued as they are.
+ * @param batch Batch receiving the message
+ * @param line Output line, without the newline
+ * @param length Length of the line
+ * @return the type of the queued message
+ */
+message_type_t log_batch_add_line(
+	log_batch_t *batch,
+	const char *line,
+	size_t length
+);
+
+/**
+ * @brief Queue a line as it is, without looking for a location
+ * @param batch Batch receiving the message
+ * @param type Severity of the message
+ * @param text Text of the line, without the newline
+ * @param length Length of the text, at most LOG_BATCH_TEXT - 1
+ */
+void log_batch_add_text(
+	log_batch_t *batch,
+	message_type_t type,
+	const char *text,
+	size_t length
+);
+
+/**
+ * @brief Send the queued messages and empty the batch
+ * @param batch Batch to flush
+ */
+void log_batch_flush(log_batch_t *batch);
+
+/**
+ * @brief Send a single message
+ * @param callback Function receiving the message, may be NULL
+ * @param type Severity of the message
+ * @param text Text of the message
+ */
+void log_message(
+	LogCallback callback,
+	message_type_t type,
+	const char *text
+);
 
 /**
- * @brief Execute command shell and send stdout/stderr to Swift using Callback function
- * @param cmd Pass command to execute
+ * @brief Run a program and stream its stdout/stderr to Swift using Callback function
+ *
+ * The program is started with posix_spawn, no shell is involved. Both
+ * pipes are polled and the parsed lines are sent in batches.
+ * @param argv Path of the program and its arguments, NULL terminated
  * @param callback Function to get std outputs
- * @return -1 for errors, else retuls
+ * @return -1 for errors, else the exit status
  */
 int run_command_with_log(
-	const char *cmd,
+	const char *const argv[],
 	LogCallback callback
 );
 
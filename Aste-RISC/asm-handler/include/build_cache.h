@@ -0,0 +1,74 @@
+//
+//  build_cache.h
+//  RISKit
+//
+//  Content-addressed cache of assembled images.
+//
+
+#ifndef BUILD_CACHE_H
+#define BUILD_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "args_handler.h"
+
+// Bump when the entry layout or the way programs are assembled changes
+#define BUILD_CACHE_VERSION 2u
+
+// Least recently used entries are removed past this size
+#define BUILD_CACHE_MAX_BYTES (64u << 20)
+
+// Environment variable overriding the cache directory
+#define BUILD_CACHE_DIR_ENV "ASTE_RISC_CACHE_DIR"
+
+/**
+ * @brief Key of a source, hash of its bytes, the assembler and linker flags
+ * and the cache version
+ * @param source Source text
+ * @param length Length of the source in bytes
+ * @return the key
+ */
+uint64_t build_cache_key(
+	const char *source,
+	size_t      length
+);
+
+/**
+ * @brief Load the image stored for key into opts.
+ *
+ * The entry is mapped read-only and kept open, segments and symbols are
+ * used exactly as the ones of a loaded ELF file.
+ * @param key Key of the source
+ * @param source_size Length of the source, checked against the entry
+ * @param opts Options receiving the image, a previous image is released
+ * @return 0 on a hit, -1 when there is no valid entry
+ */
+int build_cache_load(
+	uint64_t   key,
+	size_t     source_size,
+	options_t *opts
+);
+
+/**
+ * @brief Store the loaded image of opts under key, then evict the least
+ * recently used entries past BUILD_CACHE_MAX_BYTES
+ * @param key Key of the source
+ * @param source_size Length of the source
+ * @param opts Options holding the image, its segments and its symbols
+ * @return 0 on success, -1 if the entry could not be written
+ */
+int build_cache_store(
+	uint64_t         key,
+	size_t           source_size,
+	const options_t *opts
+);
+
+/**
+ * @brief Remove the least recently used entries until the cache holds at
+ * most max_bytes
+ * @param max_bytes Size bound of the cache directory
+ */
+void build_cache_evict(size_t max_bytes);
+
+#endif //BUILD_CACHE_H
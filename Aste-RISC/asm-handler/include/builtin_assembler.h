@@ -0,0 +1,64 @@
+//
+//  builtin_assembler.h
+//  RISKit
+//
+//  In-process RV32I assembler and linker.
+//
+
+#ifndef BUILTIN_ASSEMBLER_H
+#define BUILTIN_ASSEMBLER_H
+
+#include <stddef.h>
+
+#include "args_handler.h"
+#include "assembler_with_logs.h"
+
+// Layout of the linked image, close to the one of the GNU linker
+#define BUILTIN_TEXT_BASE 0x00010000u
+#define BUILTIN_PAGE_SIZE 0x1000u
+
+typedef enum {
+	ASSEMBLE_OK          = 0,
+	ASSEMBLE_ERROR       = -1, // errors in the source, already reported
+	ASSEMBLE_UNSUPPORTED = 1   // uses a feature outside the built-in subset
+} assemble_result_t;
+
+/**
+ * @brief Assemble and link RV32I source into an in-memory image.
+ *
+ * Supports the RV32I instructions, the common pseudo-instructions (li, la,
+ * mv, j, call, ret, beqz, ...), the immediate operands of the register
+ * forms ("sra t2, t1, 1" is srai), labels, numeric local labels, %hi/%lo and
+ * the directives .text, .data, .rodata, .bss, .section, .word, .half,
+ * .byte, .ascii, .asciz, .string, .space, .align, .equ and .globl.
+ * On success opts holds the image, its segments and its symbols as if an
+ * ELF file had been loaded, with no file behind it.
+ * @param source Source text, it does not need to be NUL terminated
+ * @param length Length of the source in bytes
+ * @param name Name used in the diagnostics
+ * @param opts Options receiving the image, a previous image is released
+ * @param callback Function receiving the diagnostics, may be NULL
+ * @return ASSEMBLE_OK, ASSEMBLE_ERROR or ASSEMBLE_UNSUPPORTED
+ */
+assemble_result_t assemble_riscv_source(
+	const char  *source,
+	size_t       length,
+	const char  *name,
+	options_t   *opts,
+	LogCallback  callback
+);
+
+/**
+ * @brief Read a source file and assemble it with assemble_riscv_source
+ * @param filepath Path of the .s file
+ * @param opts Options receiving the image
+ * @param callback Function receiving the diagnostics, may be NULL
+ * @return ASSEMBLE_OK, ASSEMBLE_ERROR or ASSEMBLE_UNSUPPORTED
+ */
+assemble_result_t assemble_riscv_file(
+	const char  *filepath,
+	options_t   *opts,
+	LogCallback  callback
+);
+
+#endif //BUILTIN_ASSEMBLER_H
@@ -6,9 +6,37 @@
 #define ELF_H
 
 #include <stdint.h>
+#include <stdbool.h>
+
+#include "args_handler.h"
 
 #define EI_NIDENT 16
 
+// Program header types and flags
+#define PT_LOAD 1
+
+#define PF_X 0x1
+#define PF_W 0x2
+#define PF_R 0x4
+
+// Section header types and flags
+#define SHT_SYMTAB 2
+#define SHT_NOBITS 8
+
+#define SHF_WRITE     0x1
+#define SHF_ALLOC     0x2
+#define SHF_EXECINSTR 0x4
+
+// Symbol types and special section indexes
+#define STT_SECTION 3
+#define STT_FILE    4
+
+#define SHN_UNDEF     0
+#define SHN_LORESERVE 0xff00
+
+#define ELF32_ST_BIND(info) ((info) >> 4)
+#define ELF32_ST_TYPE(info) ((info) & 0xf)
+
 typedef struct {
     unsigned char e_ident[EI_NIDENT];
     uint16_t e_type;
@@ -39,6 +67,57 @@ typedef struct {
     uint32_t sh_entsize;
 } Elf32_Shdr;
 
+typedef struct {
+    uint32_t p_type;
+    uint32_t p_offset;
+    uint32_t p_vaddr;
+    uint32_t p_paddr;
+    uint32_t p_filesz;
+    uint32_t p_memsz;
+    uint32_t p_flags;
+    uint32_t p_align;
+} Elf32_Phdr;
+
+typedef struct {
+    uint32_t      st_name;
+    uint32_t      st_value;
+    uint32_t      st_size;
+    unsigned char st_info;
+    unsigned char st_other;
+    uint16_t      st_shndx;
+} Elf32_Sym;
+
+/**
+ * @brief Map an ELF file, collect its PT_LOAD segments and its symbols.
+ *
+ * Files without program headers are loaded from their allocated sections.
+ * @param filepath path of the ELF file
+ * @param opts options receiving the image, a previous image is released
+ * @return 0 on success, -1 on error
+ */
 int load_elf_sections(const char* filepath, options_t* opts);
 
+/**
+ * @brief Unmap the ELF image of opts and clear its section buffers
+ * @param opts options holding the image
+ */
+void unload_elf_sections(options_t* opts);
+
+/**
+ * @brief Find the symbol at or closest before an address, O(log n)
+ * @param opts options holding the symbol index
+ * @param address address to resolve
+ * @return the symbol, NULL if no symbol precedes address
+ */
+const elf_symbol_t* find_elf_symbol(const options_t* opts, uint32_t address);
+
+/**
+ * @brief Find the first instruction assembled from a source line, O(log n)
+ * @param opts options holding the line index
+ * @param line source line, starting from 1
+ * @param address receives the address of the instruction
+ * @return false when the line holds no instruction or there is no index
+ */
+bool find_source_line(const options_t* opts, uint32_t line, uint32_t* address);
+
 #endif //ELF_H
@@ -0,0 +1,51 @@
+//
+//  program_loader.h
+//  RISKit
+//
+//  Memory layout of a loaded program, shared by the editor and the runner.
+//
+
+#ifndef PROGRAM_LOADER_H
+#define PROGRAM_LOADER_H
+
+#include <stdint.h>
+
+#include "args_handler.h"
+#include "ram.h"
+
+#define PROGRAM_HEAP_SIZE  0x100000u // 1MB heap, grown by brk
+#define PROGRAM_STACK_SIZE 0x10000u  // 64KB stack
+
+/**
+ * @brief Addresses chosen for a program by new_program_ram.
+ *
+ * heap_start First address of the heap, the page after the program.
+ * stack_bottom Lowest address of the stack, also the heap limit.
+ * stack_top End of the stack and of the RAM window.
+ * stack_pointer Initial sp.
+ * global_pointer Initial gp.
+ */
+typedef struct {
+	uint32_t heap_start;
+	uint32_t stack_bottom;
+	uint32_t stack_top;
+	uint32_t stack_pointer;
+	uint32_t global_pointer;
+} program_layout_t;
+
+/**
+ * @brief Create the RAM of a loaded program.
+ *
+ * The segments are mapped from the image file, or copied when that is not
+ * possible, and each gets a region with its ELF permissions. The heap and
+ * the stack follow the highest segment.
+ * @param opts Options holding the loaded image
+ * @param layout Receives the chosen addresses, may be NULL
+ * @return the RAM, NULL if it could not be allocated
+ */
+RAM new_program_ram(
+	const options_t        *opts,
+		  program_layout_t *layout
+);
+
+#endif //PROGRAM_LOADER_H
@@ -0,0 +1,76 @@
+//
+//  program_loader.c
+//  RISKit
+//
+//  Memory layout of a loaded program, shared by the editor and the runner.
+//
+
+#include "program_loader.h"
+#include "elf.h"
+
+RAM new_program_ram(
+	const options_t        *opts,
+		  program_layout_t *layout
+) {
+	if (!opts) return NULL;
+
+	// End of the highest loaded segment, .bss included
+	uint64_t program_end = 0;
+	for (uint32_t i = 0; i < opts->segment_count; i++) {
+		const elf_segment_t *segment = &opts->segments[i];
+		const uint64_t end = (uint64_t)segment->vaddr + segment->memory_size;
+
+		if (end > program_end) program_end = end;
+	}
+
+	const uint64_t heap_start   = (program_end + RAM_PAGE_MASK) & ~(uint64_t)RAM_PAGE_MASK;
+	const uint64_t stack_bottom = heap_start + PROGRAM_HEAP_SIZE;
+	const uint64_t stack_top    = stack_bottom + PROGRAM_STACK_SIZE;
+
+	if (stack_top > UINT32_MAX) {
+		fprintf(stderr, "Errore: il programma non lascia spazio per heap e stack.\n");
+		return NULL;
+	}
+
+	RAM ram = new_ram((size_t)stack_top, 0);
+	if (!ram) return NULL;
+
+	for (uint32_t i = 0; i < opts->segment_count; i++) {
+		const elf_segment_t *segment = &opts->segments[i];
+
+		// The bytes past the file size stay zero
+		if (!map_file_to_ram(ram, opts->image_fd, segment->offset, segment->file_size, segment->vaddr)) {
+			load_binary_to_ram(ram, opts->image + segment->offset, segment->file_size, segment->vaddr);
+		}
+
+		// Each segment keeps its ELF permissions, stores
+		// into the code fault instead of corrupting it
+		uint32_t permissions = 0;
+		if (segment->flags & PF_R) permissions |= RAM_PERM_READ;
+		if (segment->flags & PF_W) permissions |= RAM_PERM_WRITE;
+		if (segment->flags & PF_X) permissions |= RAM_PERM_READ | RAM_PERM_EXEC;
+
+		const char *name = segment->flags & PF_X ? ".text"
+						 : segment->flags & PF_W ? ".data" : ".rodata";
+
+		ram_add_region(ram, segment->vaddr, segment->memory_size, permissions, name);
+	}
+
+	ram_set_heap(ram, (uint32_t)heap_start, (uint32_t)stack_bottom);
+	ram_add_region(ram, (uint32_t)stack_bottom, PROGRAM_STACK_SIZE, RAM_PERM_READ | RAM_PERM_WRITE, "stack");
+
+	load_text_information(ram, opts->text_vaddr, (uint32_t)opts->text_size);
+	load_data_information(ram, opts->data_vaddr, (uint32_t)opts->data_size);
+
+	if (layout) {
+		*layout = (program_layout_t){
+			.heap_start     = (uint32_t)heap_start,
+			.stack_bottom   = (uint32_t)stack_bottom,
+			.stack_top      = (uint32_t)stack_top,
+			.stack_pointer  = (uint32_t)(stack_top - 4),
+			.global_pointer = opts->data_vaddr + 0x800
+		};
+	}
+
+	return ram;
+}
@@ -0,0 +1,68 @@
+# Bitwise CRC-32 (IEEE, reflected) of a pseudo-random buffer.
+# Every round continues the CRC of the previous one over the same buffer, the
+# result is the zlib crc32 of the buffer repeated ROUNDS times. Exits with 0
+# when the CRC is the expected one.
+
+	.equ SIZE,     4096
+	.equ ROUNDS,   6
+	.equ EXPECTED, 0x63b87d6b
+
+	.bss
+buffer:	.space SIZE
+
+	.text
+_start:
+	li   s0, 0x12345678          # generator state
+	la   s3, buffer
+	li   t0, SIZE
+	add  s4, s3, t0              # end of the buffer
+
+	mv   t0, s3
+fill:
+	slli t1, s0, 13
+	xor  s0, s0, t1
+	srli t1, s0, 17
+	xor  s0, s0, t1
+	slli t1, s0, 5
+	xor  s0, s0, t1
+	sb   s0, 0(t0)
+	addi t0, t0, 1
+	bne  t0, s4, fill
+
+	li   s1, 0                   # crc
+	li   s2, ROUNDS
+round:
+	mv   a0, s1
+	mv   a1, s3
+	mv   a2, s4
+	call crc32
+	mv   s1, a0
+	addi s2, s2, -1
+	bnez s2, round
+
+	li   t0, EXPECTED
+	sub  a0, s1, t0
+	snez a0, a0
+	li   a7, 93
+	ecall
+
+# crc32(crc, start, end), continues crc over the bytes in [start, end)
+crc32:
+	not  a0, a0
+	li   t2, 0xEDB88320
+crc32_byte:
+	lbu  t0, 0(a1)
+	xor  a0, a0, t0
+	li   t3, 8
+crc32_bit:
+	andi t0, a0, 1
+	neg  t0, t0
+	and  t0, t0, t2
+	srli a0, a0, 1
+	xor  a0, a0, t0
+	addi t3, t3, -1
+	bnez t3, crc32_bit
+	addi a1, a1, 1
+	bne  a1, a2, crc32_byte
+	not  a0, a0
+	ret
@@ -0,0 +1,45 @@
+# Naive recursive Fibonacci, a call-heavy workload with a deep stack.
+# Adds fib(N) ROUNDS times and exits with 0 when the sum is the expected one.
+
+	.equ N,        24
+	.equ ROUNDS,   4
+	.equ EXPECTED, 185472        # 4 * fib(24)
+
+	.text
+_start:
+	li   s1, 0
+	li   s2, ROUNDS
+round:
+	li   a0, N
+	call fib
+	add  s1, s1, a0
+	addi s2, s2, -1
+	bnez s2, round
+
+	li   t0, EXPECTED
+	sub  a0, s1, t0
+	snez a0, a0
+	li   a7, 93
+	ecall
+
+# fib(n) = n < 2 ? n : fib(n - 1) + fib(n - 2)
+fib:
+	li   t0, 2
+	blt  a0, t0, fib_leaf
+	addi sp, sp, -16
+	sw   ra, 12(sp)
+	sw   s0, 8(sp)
+	sw   s1, 4(sp)
+	mv   s0, a0
+	addi a0, a0, -1
+	call fib
+	mv   s1, a0
+	addi a0, s0, -2
+	call fib
+	add  a0, a0, s1
+	lw   ra, 12(sp)
+	lw   s0, 8(sp)
+	lw   s1, 4(sp)
+	addi sp, sp, 16
+fib_leaf:
+	ret
@@ -0,0 +1,71 @@
+# Insertion sort of pseudo-random words, unsigned ascending.
+# Every round fills the array from a xorshift32 generator, sorts it and folds
+# it into a checksum. Exits with 0 when the checksum is the expected one.
+
+	.equ N,        256
+	.equ ROUNDS,   24
+	.equ EXPECTED, 0x4ea5005b
+
+	.bss
+	.align 2
+array:	.space N*4
+
+	.text
+_start:
+	li   s0, 0x12345678          # generator state
+	li   s1, 0                   # checksum
+	li   s2, ROUNDS
+	la   s3, array
+	li   t0, N*4
+	add  s4, s3, t0              # end of the array
+
+round:
+	# Fill
+	mv   t0, s3
+fill:
+	slli t1, s0, 13
+	xor  s0, s0, t1
+	srli t1, s0, 17
+	xor  s0, s0, t1
+	slli t1, s0, 5
+	xor  s0, s0, t1
+	sw   s0, 0(t0)
+	addi t0, t0, 4
+	bne  t0, s4, fill
+
+	# Sort, t0 walks the unsorted part, t2 shifts the bigger words up
+	addi t0, s3, 4
+outer:
+	lw   t1, 0(t0)               # key
+	addi t2, t0, -4
+inner:
+	bltu t2, s3, place
+	lw   t3, 0(t2)
+	bleu t3, t1, place
+	sw   t3, 4(t2)
+	addi t2, t2, -4
+	j    inner
+place:
+	sw   t1, 4(t2)
+	addi t0, t0, 4
+	bne  t0, s4, outer
+
+	# Fold, checksum = rotl(checksum, 1) ^ word
+	mv   t0, s3
+fold:
+	lw   t1, 0(t0)
+	slli t2, s1, 1
+	srli t3, s1, 31
+	or   s1, t2, t3
+	xor  s1, s1, t1
+	addi t0, t0, 4
+	bne  t0, s4, fold
+
+	addi s2, s2, -1
+	bnez s2, round
+
+	li   t0, EXPECTED
+	sub  a0, s1, t0
+	snez a0, a0
+	li   a7, 93
+	ecall
@@ -0,0 +1,93 @@
+# Square matrix multiply, C = A * B, with byte-sized elements.
+# RV32I has no multiply, products come from a shift-and-add routine like the
+# one a compiler calls. Every round refills A and B from a xorshift32
+# generator and folds C into a checksum. Exits with 0 when the checksum is the
+# expected one.
+
+	.equ N,        24
+	.equ ROUNDS,   4
+	.equ EXPECTED, 0xa6ce4313
+
+	.bss
+	.align 2
+matrix_a:	.space N*N*4
+matrix_b:	.space N*N*4
+
+	.text
+_start:
+	li   s0, 0x12345678          # generator state
+	li   s1, 0                   # checksum
+	li   s2, ROUNDS
+
+round:
+	# Fill A then B, they are contiguous
+	la   t0, matrix_a
+	li   t2, N*N*8
+	add  t2, t0, t2
+fill:
+	slli t1, s0, 13
+	xor  s0, s0, t1
+	srli t1, s0, 17
+	xor  s0, s0, t1
+	slli t1, s0, 5
+	xor  s0, s0, t1
+	andi t1, s0, 0xFF
+	sw   t1, 0(t0)
+	addi t0, t0, 4
+	bne  t0, t2, fill
+
+	# s3 row of A, s4 column of B, s5 sum, s6 k, s7 row end
+	la   s3, matrix_a
+	li   s8, N*N*4
+	add  s8, s3, s8              # end of A
+row:
+	addi s7, s3, N*4
+	la   s4, matrix_b
+	addi s9, s4, N*4             # end of the first row of B
+column:
+	li   s5, 0
+	mv   s6, s3
+	mv   s10, s4
+dot:
+	lw   a0, 0(s6)
+	lw   a1, 0(s10)
+	call multiply
+	add  s5, s5, a0
+	addi s6, s6, 4
+	addi s10, s10, N*4
+	bne  s6, s7, dot
+
+	# Fold, checksum = rotl(checksum, 1) ^ element
+	slli t2, s1, 1
+	srli t3, s1, 31
+	or   s1, t2, t3
+	xor  s1, s1, s5
+
+	addi s4, s4, 4
+	bne  s4, s9, column
+
+	mv   s3, s7
+	bne  s3, s8, row
+
+	addi s2, s2, -1
+	bnez s2, round
+
+	li   t0, EXPECTED
+	sub  a0, s1, t0
+	snez a0, a0
+	li   a7, 93
+	ecall
+
+# multiply(a, b), low 32 bits of a * b
+multiply:
+	li   t0, 0
+multiply_bit:
+	andi t1, a1, 1
+	beqz t1, multiply_next
+	add  t0, t0, a0
+multiply_next:
+	slli a0, a0, 1
+	srli a1, a1, 1
+	bnez a1, multiply_bit
+	mv   a0, t0
+	ret
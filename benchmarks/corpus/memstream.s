@@ -0,0 +1,103 @@
+# Memory streaming loops over three arrays larger than a typical L1 cache.
+# Every round runs an add, a scale-and-subtract and a second add pass, like
+# the kernels of the STREAM benchmark, then the first array is folded into a
+# checksum. Exits with 0 when the checksum is the expected one.
+
+	.equ N,        16384
+	.equ ROUNDS,   40
+	.equ EXPECTED, 0x8d06481d
+
+	.bss
+	.align 2
+array_a:	.space N*4
+array_b:	.space N*4
+array_c:	.space N*4
+
+	.text
+_start:
+	li   s0, 0x12345678          # generator state
+	la   s3, array_a
+	la   s4, array_b
+	la   s5, array_c
+	li   s6, N*4                 # bytes in an array
+
+	# a[i] = i, b[i] = random
+	li   t0, 0
+fill:
+	add  t4, s3, t0
+	srli t1, t0, 2
+	sw   t1, 0(t4)
+	slli t1, s0, 13
+	xor  s0, s0, t1
+	srli t1, s0, 17
+	xor  s0, s0, t1
+	slli t1, s0, 5
+	xor  s0, s0, t1
+	add  t4, s4, t0
+	sw   s0, 0(t4)
+	addi t0, t0, 4
+	bne  t0, s6, fill
+
+	li   s2, ROUNDS
+round:
+	# c[i] = a[i] + b[i]
+	li   t0, 0
+add_pass:
+	add  t4, s3, t0
+	lw   t1, 0(t4)
+	add  t4, s4, t0
+	lw   t2, 0(t4)
+	add  t3, t1, t2
+	add  t4, s5, t0
+	sw   t3, 0(t4)
+	addi t0, t0, 4
+	bne  t0, s6, add_pass
+
+	# b[i] = c[i] - (a[i] >> 1)
+	li   t0, 0
+scale_pass:
+	add  t4, s5, t0
+	lw   t1, 0(t4)
+	add  t4, s3, t0
+	lw   t2, 0(t4)
+	srli t2, t2, 1
+	sub  t3, t1, t2
+	add  t4, s4, t0
+	sw   t3, 0(t4)
+	addi t0, t0, 4
+	bne  t0, s6, scale_pass
+
+	# a[i] = b[i] + c[i]
+	li   t0, 0
+triad_pass:
+	add  t4, s4, t0
+	lw   t1, 0(t4)
+	add  t4, s5, t0
+	lw   t2, 0(t4)
+	add  t3, t1, t2
+	add  t4, s3, t0
+	sw   t3, 0(t4)
+	addi t0, t0, 4
+	bne  t0, s6, triad_pass
+
+	addi s2, s2, -1
+	bnez s2, round
+
+	# Fold, checksum = rotl(checksum, 1) ^ word
+	li   s1, 0
+	mv   t0, s3
+	add  t5, s3, s6
+fold:
+	lw   t1, 0(t0)
+	slli t2, s1, 1
+	srli t3, s1, 31
+	or   s1, t2, t3
+	xor  s1, s1, t1
+	addi t0, t0, 4
+	bne  t0, t5, fold
+
+	li   t0, EXPECTED
+	sub  a0, s1, t0
+	snez a0, a0
+	li   a7, 93
+	ecall
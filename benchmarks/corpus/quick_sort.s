@@ -0,0 +1,101 @@
+# Recursive quicksort (Lomuto partition) of pseudo-random words, unsigned
+# ascending. Every round fills the array from a xorshift32 generator, sorts
+# it and folds it into a checksum. Exits with 0 when the checksum is the
+# expected one.
+
+	.equ N,        4096
+	.equ ROUNDS,   6
+	.equ EXPECTED, 0x07eed39e
+
+	.bss
+	.align 2
+array:	.space N*4
+
+	.text
+_start:
+	li   s0, 0x12345678          # generator state
+	li   s1, 0                   # checksum
+	li   s2, ROUNDS
+	la   s3, array
+	li   t0, N*4
+	add  s4, s3, t0              # end of the array
+
+round:
+	# Fill
+	mv   t0, s3
+fill:
+	slli t1, s0, 13
+	xor  s0, s0, t1
+	srli t1, s0, 17
+	xor  s0, s0, t1
+	slli t1, s0, 5
+	xor  s0, s0, t1
+	sw   s0, 0(t0)
+	addi t0, t0, 4
+	bne  t0, s4, fill
+
+	mv   a0, s3
+	addi a1, s4, -4
+	call quicksort
+
+	# Fold, checksum = rotl(checksum, 1) ^ word
+	mv   t0, s3
+fold:
+	lw   t1, 0(t0)
+	slli t2, s1, 1
+	srli t3, s1, 31
+	or   s1, t2, t3
+	xor  s1, s1, t1
+	addi t0, t0, 4
+	bne  t0, s4, fold
+
+	addi s2, s2, -1
+	bnez s2, round
+
+	li   t0, EXPECTED
+	sub  a0, s1, t0
+	snez a0, a0
+	li   a7, 93
+	ecall
+
+# quicksort(first, last), a0 and a1 point to the first and the last word
+quicksort:
+	bgeu a0, a1, done
+	addi sp, sp, -16
+	sw   ra, 12(sp)
+	sw   s0, 8(sp)
+	sw   s1, 4(sp)
+
+	lw   t0, 0(a1)               # pivot
+	mv   t1, a0                  # next slot of the smaller words
+	mv   t2, a0
+partition:
+	beq  t2, a1, partitioned
+	lw   t3, 0(t2)
+	bgeu t3, t0, bigger
+	lw   t4, 0(t1)
+	sw   t3, 0(t1)
+	sw   t4, 0(t2)
+	addi t1, t1, 4
+bigger:
+	addi t2, t2, 4
+	j    partition
+partitioned:
+	lw   t4, 0(t1)
+	sw   t0, 0(t1)
+	sw   t4, 0(a1)
+
+	mv   s0, t1
+	mv   s1, a1
+	addi a1, t1, -4
+	call quicksort
+	addi a0, s0, 4
+	mv   a1, s1
+	call quicksort
+
+	lw   ra, 12(sp)
+	lw   s0, 8(sp)
+	lw   s1, 4(sp)
+	addi sp, sp, 16
+done:
+	ret
@@ -0,0 +1,95 @@
+# Byte-wise string copy and length of a long printable string.
+# Every round copies the string from a different offset, so the copies are
+# not all aligned, and folds the copied length into a checksum. The last
+# copy is folded word by word at the end. Exits with 0 when the checksum is
+# the expected one.
+
+	.equ SIZE,     4096
+	.equ ROUNDS,   256
+	.equ EXPECTED, 0x16647557
+
+	.bss
+source:	.space SIZE+1
+	.align 2
+target:	.space SIZE+4
+
+	.text
+_start:
+	li   s0, 0x12345678          # generator state
+	li   s1, 0                   # checksum
+	la   s3, source
+	li   t0, SIZE
+	add  s4, s3, t0              # terminator of the source
+
+	# Printable characters, the terminator is already zero
+	mv   t0, s3
+fill:
+	slli t1, s0, 13
+	xor  s0, s0, t1
+	srli t1, s0, 17
+	xor  s0, s0, t1
+	slli t1, s0, 5
+	xor  s0, s0, t1
+	andi t1, s0, 0x3F
+	addi t1, t1, 0x20
+	sb   t1, 0(t0)
+	addi t0, t0, 1
+	bne  t0, s4, fill
+
+	li   s2, 0                   # round
+	la   s5, target
+round:
+	andi t0, s2, 63
+	add  a1, s3, t0
+	mv   a0, s5
+	call strcpy
+	mv   a0, s5
+	call strlen
+
+	slli t2, s1, 1
+	srli t3, s1, 31
+	or   s1, t2, t3
+	xor  s1, s1, a0
+
+	addi s2, s2, 1
+	li   t0, ROUNDS
+	bne  s2, t0, round
+
+	# Fold the last copy
+	mv   t0, s5
+	li   t1, SIZE
+	add  t1, t0, t1
+fold:
+	lw   t4, 0(t0)
+	slli t2, s1, 1
+	srli t3, s1, 31
+	or   s1, t2, t3
+	xor  s1, s1, t4
+	addi t0, t0, 4
+	bne  t0, t1, fold
+
+	li   t0, EXPECTED
+	sub  a0, s1, t0
+	snez a0, a0
+	li   a7, 93
+	ecall
+
+# strcpy(target, source), terminator included
+strcpy:
+	lbu  t0, 0(a1)
+	sb   t0, 0(a0)
+	addi a0, a0, 1
+	addi a1, a1, 1
+	bnez t0, strcpy
+	ret
+
+# strlen(string)
+strlen:
+	mv   t1, a0
+strlen_byte:
+	lbu  t0, 0(t1)
+	addi t1, t1, 1
+	bnez t0, strlen_byte
+	sub  a0, t1, a0
+	addi a0, a0, -1
+	ret
@@ -0,0 +1,179 @@
+/**
+ * @file dispatch_bench.c
+ * @brief Microbenchmark comparing the run loop dispatch strategies.
+ *
+ * Runs the same RV32I workload with the switch loop, with the threaded
+ * (computed goto) loop and, on supported hosts, with the basic-block JIT and
+ * prints the instructions per second of each.
+ *
+ * Build from the repository root:
+ *
+ *   cc -O2 -IAste-RISC/RiscV/Memory/include -IAste-RISC/RiscV/machine/include \
+ *      -IAste-RISC/RiscV/control-unit/include -IAste-RISC/asm-handler/include \
+ *      benchmarks/dispatch_bench.c Aste-RISC/RiscV/machine/machine.c \
+ *      Aste-RISC/RiscV/machine/predecode.c Aste-RISC/RiscV/machine/jit.c \
+ *      Aste-RISC/RiscV/machine/journal.c Aste-RISC/RiscV/machine/timeline.c \
+ *      Aste-RISC/RiscV/machine/syscalls.c Aste-RISC/asm-handler/assembler_with_logs.c \
+ *      Aste-RISC/RiscV/Memory/ram.c -o dispatch_bench
+ *
+ *   ./dispatch_bench [instructions]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "machine.h"
+#include "jit.h"
+
+#define TEXT_VADDR 0x1000
+#define DATA_VADDR 0x8000
+#define RAM_SIZE   0x10000
+
+// MARK: - Encoders
+
+static uint32_t enc_r(uint32_t funct7, uint32_t rs2, uint32_t rs1, uint32_t funct3, uint32_t rd) {
+	return funct7 << 25 | rs2 << 20 | rs1 << 15 | funct3 << 12 | rd << 7 | 0x33;
+}
+
+static uint32_t enc_i(uint32_t opcode, int32_t imm, uint32_t rs1, uint32_t funct3, uint32_t rd) {
+	return ((uint32_t)imm & 0xFFF) << 20 | rs1 << 15 | funct3 << 12 | rd << 7 | opcode;
+}
+
+static uint32_t enc_s(int32_t imm, uint32_t rs2, uint32_t rs1, uint32_t funct3) {
+	const uint32_t u = (uint32_t)imm & 0xFFF;
+	return (u >> 5) << 25 | rs2 << 20 | rs1 << 15 | funct3 << 12 | (u & 0x1F) << 7 | 0x23;
+}
+
+static uint32_t enc_u(uint32_t opcode, uint32_t upper, uint32_t rd) {
+	return (upper & 0xFFFFF000) | rd << 7 | opcode;
+}
+
+static uint32_t enc_j(int32_t offset, uint32_t rd) {
+	const uint32_t u = (uint32_t)offset & 0x1FFFFF;
+	return ((u >> 20) & 0x1) << 31 | ((u >> 1) & 0x3FF) << 21 |
+		   ((u >> 11) & 0x1) << 20 | ((u >> 12) & 0xFF) << 12 | rd << 7 | 0x6F;
+}
+
+/**
+ * @brief Build the workload: an endless loop mixing ALU operations,
+ * loads/stores on a small array and a call to a leaf function.
+ */
+static size_t build_workload(uint32_t *text) {
+	size_t n = 0;
+
+	// Prologue: t0 = data pointer, t1 = counter, t2 = accumulator
+	text[n++] = enc_u(0x37, DATA_VADDR, 5);                 // lui  t0, %hi(data)
+	text[n++] = enc_i(0x13, 0, 0, 0, 6);                    // addi t1, zero, 0
+	text[n++] = enc_i(0x13, 1, 0, 0, 7);                    // addi t2, zero, 1
+
+	// Loop body
+	const size_t loop = n;
+	text[n++] = enc_i(0x13, 1, 6, 0, 6);                    // addi t1, t1, 1
+	text[n++] = enc_r(0x00, 6, 7, 0, 7);                    // add  t2, t2, t1
+	text[n++] = enc_i(0x13, 3, 7, 1, 28);                   // slli t3, t2, 3
+	text[n++] = enc_r(0x00, 28, 7, 4, 29);                  // xor  t4, t2, t3
+	text[n++] = enc_i(0x13, 60, 6, 7, 30);                  // andi t5, t1, 60
+	text[n++] = enc_r(0x00, 30, 5, 0, 31);                  // add  t6, t0, t5
+	text[n++] = enc_s(0, 29, 31, 2);                        // sw   t4, 0(t6)
+	text[n++] = enc_i(0x03, 0, 31, 2, 28);                  // lw   t3, 0(t6)
+	text[n++] = enc_r(0x20, 28, 7, 5, 29);                  // sra  t4, t2, t3
+	text[n++] = enc_r(0x00, 29, 28, 3, 30);                 // sltu t5, t3, t4
+	text[n++] = enc_r(0x00, 30, 7, 6, 7);                   // or   t2, t2, t5
+
+	const size_t call = n;
+	text[n++] = 0;                                          // jal  ra, leaf (patched)
+	text[n]   = enc_j((int32_t)((loop - n) * 4), 0);        // j    loop
+	n++;
+
+	// Leaf function
+	const size_t leaf = n;
+	text[n++] = enc_i(0x13, -16, 2, 0, 2);                  // addi sp, sp, -16
+	text[n++] = enc_s(12, 7, 2, 2);                         // sw   t2, 12(sp)
+	text[n++] = enc_i(0x03, 12, 2, 2, 10);                  // lw   a0, 12(sp)
+	text[n++] = enc_r(0x20, 6, 10, 0, 10);                  // sub  a0, a0, t1
+	text[n++] = enc_i(0x13, 16, 2, 0, 2);                   // addi sp, sp, 16
+	text[n++] = enc_i(0x67, 0, 1, 0, 0);                    // ret
+
+	text[call] = enc_j((int32_t)((leaf - call) * 4), 1);
+
+	return n;
+}
+
+static double now_seconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Run the workload with a dispatch strategy and return the MIPS.
+ */
+static double run_workload(
+		  dispatch_mode_t mode,
+		  bool 			  use_jit,
+	const uint32_t 		 *text,
+		  size_t 		  count,
+		  uint64_t 		  instructions,
+		  uint32_t 		 *checksum
+) {
+	RAM ram = new_ram(RAM_SIZE, 0);
+	if (!ram) return 0;
+
+	load_binary_to_ram(ram, (const uint8_t *)text, count * 4, TEXT_VADDR);
+	load_text_information(ram, TEXT_VADDR, (uint32_t)(count * 4));
+
+	MACHINE machine = new_machine(ram, TEXT_VADDR);
+	load_decoded_text(machine, (const uint8_t *)text, count * 4, TEXT_VADDR);
+	set_dispatch_mode(machine, mode);
+	if (use_jit) enable_jit(machine);
+
+	machine->registers[2] = RAM_SIZE - 16;
+
+	const double start = now_seconds();
+	cpu_run(machine, instructions);
+	const double elapsed = now_seconds() - start;
+
+	*checksum = machine->registers[7] ^ machine->registers[10];
+
+	destroy_machine(machine);
+	destroy_ram(ram);
+
+	return (double)instructions / elapsed / 1e6;
+}
+
+int main(int argc, char **argv) {
+	const uint64_t instructions = argc > 1 ? strtoull(argv[1], NULL, 10) : 200000000ull;
+
+	uint32_t text[64];
+	const size_t count = build_workload(text);
+
+	uint32_t switch_sum   = 0;
+	uint32_t threaded_sum = 0;
+
+	const double switch_mips = run_workload(DISPATCH_SWITCH, false, text, count, instructions, &switch_sum);
+	printf("switch    %8.1f MIPS (checksum 0x%08x)\n", switch_mips, switch_sum);
+
+#if MACHINE_HAS_COMPUTED_GOTO
+	const double threaded_mips = run_workload(DISPATCH_THREADED, false, text, count, instructions, &threaded_sum);
+	printf("threaded  %8.1f MIPS (checksum 0x%08x)\n", threaded_mips, threaded_sum);
+	printf("speedup   %8.2fx\n", threaded_mips / switch_mips);
+#else
+	(void)threaded_sum;
+	printf("threaded  unavailable, built without labels as values\n");
+#endif
+
+	if (jit_available()) {
+		uint32_t jit_sum = 0;
+
+		const double jit_mips = run_workload(DISPATCH_SWITCH, true, text, count, instructions, &jit_sum);
+		printf("jit       %8.1f MIPS (checksum 0x%08x)\n", jit_mips, jit_sum);
+		printf("speedup   %8.2fx\n", jit_mips / switch_mips);
+
+	} else {
+		printf("jit       unavailable on this host\n");
+	}
+
+	return 0;
+}
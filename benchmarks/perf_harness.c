@@ -0,0 +1,597 @@
+/**
+ * @file perf_harness.c
+ * @brief Phase timings of whole programs, written as JSON.
+ *
+ * Every program is loaded, given a RAM, predecoded, run to its exit on
+ * each engine, under the pipeline model, through the L1 caches, through
+ * the branch predictor, into a trace and under the debugger, and finally
+ * recorded and stepped back. Each phase is timed on its own so a change to
+ * the loader, to ram.c, to the decoder or to the run loop shows up in its
+ * own figure. Each phase is repeated after an untimed
+ * warm-up run, the minimum and the median of the repetitions are reported.
+ * The RAM setup and the decode are timed on every run, warm-up included.
+ *
+ * The workloads in benchmarks/corpus exit with 0 when their result is the
+ * expected one, a run that does not is reported as an error.
+ *
+ * Build with CMake (target perf_harness), then from the repository root:
+ *
+ *   ./build/perf_harness -l "$(git rev-parse --short HEAD)" benchmarks/corpus/<name>.s > perf.json
+ *
+ * The bench target runs every program of the corpus into build/perf.json.
+ *
+ *   perf_harness [-r repeat] [-n instructions] [-l label] program.s|program.elf...
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "args_handler.h"
+#include "builtin_assembler.h"
+#include "asm_file_parser.h"
+#include "elf.h"
+#include "program_loader.h"
+#include "machine.h"
+#include "jit.h"
+#include "journal.h"
+#include "pipeline.h"
+#include "cache.h"
+#include "predictor.h"
+#include "trace.h"
+#include "debugger.h"
+#include "syscalls.h"
+
+#define REPEAT_DEFAULT 5
+#define REPEAT_MAX     64
+
+// Default instruction limit of a run, stops programs that never exit
+#define RUN_LIMIT (1ull << 34)
+
+// Steps recorded and then undone one by one in the reverse phase
+#define REVERSE_STEPS (1u << 20)
+#define JOURNAL_BYTES (64u << 20)
+
+/// How a program is executed
+typedef enum {
+	ENGINE_INTERPRETER,
+	ENGINE_JIT,
+	ENGINE_PIPELINE,  // interpreted and timed by the five-stage model
+	ENGINE_CACHE,     // interpreted through the default L1 caches
+	ENGINE_PREDICTOR, // interpreted through the default branch predictor
+	ENGINE_TRACE,     // interpreted and traced to /dev/null, the disk is left out
+	ENGINE_DEBUGGER   // continued under the debugger, with a watchpoint that is never hit
+} engine_t;
+
+typedef struct {
+	uint32_t    repeat;
+	uint64_t    max_instructions;
+	const char *label; // NULL for none
+} harness_options_t;
+
+/// Durations of the repetitions of a phase, in nanoseconds
+typedef struct {
+	uint64_t samples[REPEAT_MAX];
+	uint32_t count;
+} phase_t;
+
+typedef struct {
+	const char *path;
+	const char *loader;       // "assembler" or "elf"
+	const char *error;        // NULL when every phase ran
+
+	uint64_t    instructions; // retired until the exit
+	int32_t     exit_code;
+
+	phase_t     load;
+	phase_t     ram_setup;
+	phase_t     decode;
+	phase_t     interpreter;
+	phase_t     jit;
+	phase_t     pipeline;
+	phase_t     cache;
+	phase_t     predictor;
+	phase_t     trace;
+	phase_t     debugger;
+
+	uint64_t    reverse_steps;
+	phase_t     record;
+	phase_t     rewind;
+} workload_t;
+
+/// A program ready to run
+typedef struct {
+	RAM     ram;
+	MACHINE machine;
+} instance_t;
+
+// MARK: - Time
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void phase_add(
+	phase_t  *phase,
+	uint64_t  ns
+) {
+	if (phase->count < REPEAT_MAX) phase->samples[phase->count++] = ns;
+}
+
+static int compare_samples(const void *a, const void *b) {
+	const uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+static uint64_t phase_min(const phase_t *phase) {
+	uint64_t min = UINT64_MAX;
+	for (uint32_t i = 0; i < phase->count; i++) if (phase->samples[i] < min) min = phase->samples[i];
+
+	return phase->count ? min : 0;
+}
+
+static uint64_t phase_median(const phase_t *phase) {
+	if (!phase->count) return 0;
+
+	uint64_t sorted[REPEAT_MAX];
+	memcpy(sorted, phase->samples, phase->count * sizeof(uint64_t));
+	qsort(sorted, phase->count, sizeof(uint64_t), compare_samples);
+
+	return phase->count & 1 ? sorted[phase->count / 2]
+							: (sorted[phase->count / 2 - 1] + sorted[phase->count / 2]) / 2;
+}
+
+// MARK: - Phases
+
+/**
+ * @brief Load a program without the build cache, so every repetition
+ * does the whole work.
+ * @return The options holding the image, NULL on error.
+ */
+static options_t *load_program(
+	const char *path,
+	uint64_t   *ns
+) {
+	options_t *opts = start_options((char *)path);
+	if (!opts) return NULL;
+
+	const uint64_t start = now_ns();
+	const int loaded = is_assembly_file(path) ? (assemble_riscv_file(path, opts, NULL) == ASSEMBLE_OK ? 0 : -1)
+											  : load_elf_sections(path, opts);
+	*ns = now_ns() - start;
+
+	if (loaded != 0) {
+		free_options(opts);
+		return NULL;
+	}
+
+	return opts;
+}
+
+static void destroy_instance(instance_t *instance) {
+	destroy_machine(instance->machine);
+	destroy_ram(instance->ram);
+
+	*instance = (instance_t){ 0 };
+}
+
+/**
+ * @brief Build the RAM and the machine of a loaded program, timing the two.
+ * @return false on allocation failure.
+ */
+static bool new_instance(
+	const options_t *opts,
+	instance_t      *instance,
+	workload_t      *workload
+) {
+	program_layout_t layout;
+
+	uint64_t start = now_ns();
+	instance->ram  = new_program_ram(opts, &layout);
+	phase_add(&workload->ram_setup, now_ns() - start);
+
+	if (!instance->ram) return false;
+
+	start = now_ns();
+	instance->machine = new_machine(instance->ram, opts->entry_point);
+	const bool decoded = instance->machine &&
+		load_decoded_text(instance->machine, opts->text_data, opts->text_size, opts->text_vaddr);
+	phase_add(&workload->decode, now_ns() - start);
+
+	// Guest output would mix with the JSON on stdout
+	if (!decoded || !enable_syscalls(instance->machine, NULL)) {
+		destroy_instance(instance);
+		return false;
+	}
+
+	syscall_redirect(instance->machine->syscalls, 1, STDERR_FILENO);
+	syscall_redirect(instance->machine->syscalls, 2, STDERR_FILENO);
+
+	instance->machine->registers[2] = layout.stack_pointer;
+	instance->machine->registers[3] = layout.global_pointer;
+
+	return true;
+}
+
+/**
+ * @brief Run every repetition of one engine to the exit of the program.
+ * @return false with workload->error set when a run fails or disagrees
+ * with the previous ones.
+ */
+static bool measure_execution(
+	const options_t         *opts,
+	const harness_options_t *options,
+	engine_t                 engine,
+	workload_t              *workload
+) {
+	phase_t *phase = engine == ENGINE_JIT 	    ? &workload->jit
+				   : engine == ENGINE_PIPELINE  ? &workload->pipeline
+				   : engine == ENGINE_CACHE     ? &workload->cache
+				   : engine == ENGINE_PREDICTOR ? &workload->predictor
+				   : engine == ENGINE_TRACE     ? &workload->trace
+				   : engine == ENGINE_DEBUGGER  ? &workload->debugger
+												: &workload->interpreter;
+
+	for (uint32_t run = 0; run <= options->repeat; run++) {
+		instance_t instance;
+		if (!new_instance(opts, &instance, workload)) {
+			workload->error = "out of memory";
+			return false;
+		}
+
+		if (engine == ENGINE_JIT && !enable_jit(instance.machine)) {
+			destroy_instance(&instance);
+			return true;
+		}
+
+		if (engine == ENGINE_PIPELINE && !enable_pipeline(instance.machine, NULL)) {
+			destroy_instance(&instance);
+			workload->error = "out of memory";
+			return false;
+		}
+
+		const cache_config_t config = cache_default_config();
+		if (engine == ENGINE_CACHE && !enable_cache(instance.machine, &config, &config)) {
+			destroy_instance(&instance);
+			workload->error = "out of memory";
+			return false;
+		}
+
+		if (engine == ENGINE_PREDICTOR && !enable_predictor(instance.machine, NULL)) {
+			destroy_instance(&instance);
+			workload->error = "out of memory";
+			return false;
+		}
+
+		if (engine == ENGINE_TRACE && !enable_trace(instance.machine, "/dev/null")) {
+			destroy_instance(&instance);
+			workload->error = "cannot start the trace";
+			return false;
+		}
+
+		// Every store is compared with the null page, no program writes it
+		if (engine == ENGINE_DEBUGGER && !add_watchpoint(instance.machine, 0, 4)) {
+			destroy_instance(&instance);
+			workload->error = "out of memory";
+			return false;
+		}
+
+		const uint64_t     start  = now_ns();
+		const cpu_status_t status = engine == ENGINE_DEBUGGER ? debug_continue(instance.machine, options->max_instructions)
+															  : cpu_run(instance.machine, options->max_instructions);
+		const uint64_t     ns     = now_ns() - start;
+
+		const uint64_t instructions = instance.machine->instret;
+		const int32_t  exit_code    = instance.machine->syscalls->exit_code;
+
+		destroy_instance(&instance);
+
+		if (status != CPU_STATUS_EXIT) {
+			workload->error = status == CPU_STATUS_BUDGET_EXHAUSTED ? "instruction limit reached"
+																	: "the program did not exit";
+			return false;
+		}
+
+		if (!workload->instructions) {
+			workload->instructions = instructions;
+			workload->exit_code    = exit_code;
+		} else if (instructions != workload->instructions || exit_code != workload->exit_code) {
+			workload->error = "the engines disagree";
+			return false;
+		}
+
+		// The first run warms the caches of the host
+		if (run) phase_add(phase, ns);
+	}
+
+	return true;
+}
+
+/**
+ * @brief Record the first steps of the program in a journal, then undo them
+ * one at a time like a user stepping back.
+ */
+static bool measure_reverse(
+	const options_t         *opts,
+	const harness_options_t *options,
+	workload_t              *workload
+) {
+	const uint64_t steps = workload->instructions < REVERSE_STEPS ? workload->instructions : REVERSE_STEPS;
+
+	for (uint32_t run = 0; run <= options->repeat; run++) {
+		instance_t instance;
+		if (!new_instance(opts, &instance, workload) || !enable_journal(instance.machine, JOURNAL_BYTES)) {
+			destroy_instance(&instance);
+			workload->error = "out of memory";
+
+			return false;
+		}
+
+		uint64_t start = now_ns();
+		cpu_run(instance.machine, steps);
+		const uint64_t record_ns = now_ns() - start;
+
+		const uint64_t recorded = journal_steps(instance.machine->journal);
+		uint64_t       undone   = 0;
+
+		start = now_ns();
+		while (journal_rewind(instance.machine, 1)) undone++;
+		const uint64_t rewind_ns = now_ns() - start;
+
+		const bool restored = instance.machine->pc == opts->entry_point && instance.machine->instret == 0;
+
+		destroy_instance(&instance);
+
+		if (undone != recorded || !restored) {
+			workload->error = "rewind did not restore the entry state";
+			return false;
+		}
+
+		workload->reverse_steps = recorded;
+
+		if (run) {
+			phase_add(&workload->record, record_ns);
+			phase_add(&workload->rewind, rewind_ns);
+		}
+	}
+
+	return true;
+}
+
+static void measure_workload(
+	const harness_options_t *options,
+	workload_t              *workload
+) {
+	workload->loader = is_assembly_file(workload->path) ? "assembler" : "elf";
+
+	options_t *opts = NULL;
+
+	for (uint32_t run = 0; run <= options->repeat; run++) {
+		uint64_t ns;
+
+		free_options(opts);
+		opts = load_program(workload->path, &ns);
+
+		if (!opts) {
+			workload->error = "cannot load the program";
+			return;
+		}
+
+		if (run) phase_add(&workload->load, ns);
+	}
+
+	if (measure_execution(opts, options, ENGINE_INTERPRETER, workload) &&
+		measure_execution(opts, options, ENGINE_JIT, workload) 		   &&
+		measure_execution(opts, options, ENGINE_PIPELINE, workload)    &&
+		measure_execution(opts, options, ENGINE_CACHE, workload) 	   &&
+		measure_execution(opts, options, ENGINE_PREDICTOR, workload)   &&
+		measure_execution(opts, options, ENGINE_TRACE, workload) 	   &&
+		measure_execution(opts, options, ENGINE_DEBUGGER, workload)    &&
+		measure_reverse(opts, options, workload)) {
+		if (workload->exit_code != 0) workload->error = "wrong result";
+	}
+
+	free_options(opts);
+}
+
+// MARK: - Report
+
+static void write_json_string(
+	FILE       *stream,
+	const char *text
+) {
+	fputc('"', stream);
+
+	for (const unsigned char *c = (const unsigned char *)text; *c; c++) {
+		if (*c == '"' || *c == '\\') fprintf(stream, "\\%c", *c);
+		else if (*c < 0x20) 	     fprintf(stream, "\\u%04x", *c);
+		else 					     fputc(*c, stream);
+	}
+
+	fputc('"', stream);
+}
+
+/// Name of the workload, the file name without its extension
+static void write_workload_name(
+	FILE       *stream,
+	const char *path
+) {
+	const char *slash = strrchr(path, '/');
+	const char *name  = slash ? slash + 1 : path;
+	const char *dot   = strrchr(name, '.');
+
+	char buffer[256];
+	snprintf(buffer, sizeof(buffer), "%.*s", dot ? (int)(dot - name) : (int)strlen(name), name);
+
+	write_json_string(stream, buffer);
+}
+
+/**
+ * @brief Write a phase as {"min_ns", "median_ns"}, with the speed of the
+ * fastest repetition when it retired instructions.
+ */
+static void write_phase(
+	FILE          *stream,
+	const char    *name,
+	const phase_t *phase,
+	uint64_t       instructions
+) {
+	fprintf(stream, ",\n      \"%s\": ", name);
+
+	if (!phase->count) {
+		fprintf(stream, "null");
+		return;
+	}
+
+	const uint64_t min = phase_min(phase);
+
+	fprintf(stream, "{ \"min_ns\": %llu, \"median_ns\": %llu", (unsigned long long)min, (unsigned long long)phase_median(phase));
+	if (instructions) fprintf(stream, ", \"mips\": %.1f", min ? (double)instructions * 1e3 / (double)min : 0.0);
+	fprintf(stream, " }");
+}
+
+static void write_report(
+	FILE                    *stream,
+	const harness_options_t *options,
+	const workload_t        *workloads,
+	int                      count
+) {
+	fprintf(stream, "{\n  \"label\": ");
+	if (options->label) write_json_string(stream, options->label);
+	else 				fprintf(stream, "null");
+
+	fprintf(stream, ",\n  \"timestamp\": %lld", (long long)time(NULL));
+	fprintf(stream, ",\n  \"repeat\": %u", options->repeat);
+	fprintf(stream, ",\n  \"workloads\": [");
+
+	for (int i = 0; i < count; i++) {
+		const workload_t *workload = &workloads[i];
+
+		fprintf(stream, "%s\n    {\n      \"name\": ", i ? "," : "");
+		write_workload_name(stream, workload->path);
+		fprintf(stream, ",\n      \"path\": ");
+		write_json_string(stream, workload->path);
+		fprintf(stream, ",\n      \"loader\": \"%s\"", workload->loader);
+		fprintf(stream, ",\n      \"error\": ");
+		if (workload->error) write_json_string(stream, workload->error);
+		else 				 fprintf(stream, "null");
+
+		fprintf(stream, ",\n      \"instructions\": %llu", (unsigned long long)workload->instructions);
+		fprintf(stream, ",\n      \"exit_code\": %d", workload->exit_code);
+
+		write_phase(stream, "load", 	   &workload->load, 	   0);
+		write_phase(stream, "ram_setup",   &workload->ram_setup,   0);
+		write_phase(stream, "decode", 	   &workload->decode, 	   0);
+		write_phase(stream, "interpreter", &workload->interpreter, workload->instructions);
+		write_phase(stream, "jit", 		   &workload->jit, 		   workload->instructions);
+		write_phase(stream, "pipeline",    &workload->pipeline,    workload->instructions);
+		write_phase(stream, "cache", 	   &workload->cache, 	   workload->instructions);
+		write_phase(stream, "predictor",   &workload->predictor,   workload->instructions);
+		write_phase(stream, "trace", 	   &workload->trace, 	   workload->instructions);
+		write_phase(stream, "debugger",    &workload->debugger,    workload->instructions);
+
+		fprintf(stream, ",\n      \"reverse_steps\": %llu", (unsigned long long)workload->reverse_steps);
+		write_phase(stream, "record", &workload->record, workload->reverse_steps);
+		write_phase(stream, "rewind", &workload->rewind, workload->reverse_steps);
+
+		fprintf(stream, "\n    }");
+	}
+
+	fprintf(stream, "\n  ]\n}\n");
+}
+
+// MARK: - Main
+
+static void usage(FILE *stream) {
+	fprintf(stream,
+		"usage: perf_harness [options] program.s|program.elf...\n"
+		"  -r, --repeat N            timed repetitions of each phase, default %d\n"
+		"  -n, --max-instructions N  fail a run after N instructions\n"
+		"  -l, --label TEXT          label of the report, e.g. the commit\n"
+		"  -h, --help                show this help\n", REPEAT_DEFAULT);
+}
+
+static bool parse_options(
+	int                argc,
+	char             **argv,
+	harness_options_t *options
+) {
+	static const struct option long_options[] = {
+		{ "repeat",           required_argument, NULL, 'r' },
+		{ "max-instructions", required_argument, NULL, 'n' },
+		{ "label",            required_argument, NULL, 'l' },
+		{ "help",             no_argument,       NULL, 'h' },
+		{ NULL, 0, NULL, 0 }
+	};
+
+	*options = (harness_options_t){ .repeat = REPEAT_DEFAULT, .max_instructions = RUN_LIMIT };
+
+	int option;
+	while ((option = getopt_long(argc, argv, "r:n:l:h", long_options, NULL)) != -1) {
+		char *end = NULL;
+
+		switch (option) {
+			case 'r':
+				options->repeat = (uint32_t)strtoul(optarg, &end, 10);
+				if (*end || !options->repeat || options->repeat > REPEAT_MAX) return false;
+				break;
+
+			case 'n':
+				options->max_instructions = strtoull(optarg, &end, 10);
+				if (*end || !options->max_instructions) return false;
+				break;
+
+			case 'l': options->label = optarg; break;
+
+			case 'h':
+				usage(stdout);
+				exit(0);
+
+			default:
+				return false;
+		}
+	}
+
+	return optind < argc;
+}
+
+int main(int argc, char **argv) {
+	harness_options_t options;
+
+	if (!parse_options(argc, argv, &options)) {
+		usage(stderr);
+		return 2;
+	}
+
+	const int   count     = argc - optind;
+	workload_t *workloads = calloc((size_t)count, sizeof(workload_t));
+	if (!workloads) return 1;
+
+	int failed = 0;
+
+	for (int i = 0; i < count; i++) {
+		workload_t *workload = &workloads[i];
+		workload->path = argv[optind + i];
+
+		measure_workload(&options, workload);
+
+		if (workload->error) {
+			fprintf(stderr, "%s: %s\n", workload->path, workload->error);
+			failed++;
+		} else {
+			fprintf(stderr, "%s: %llu instructions\n", workload->path, (unsigned long long)workload->instructions);
+		}
+	}
+
+	write_report(stdout, &options, workloads, count);
+	free(workloads);
+
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,866 @@
+/**
+ * @file aste_run.c
+ * @brief Headless runner, assembles or loads a program and runs it to exit.
+ *
+ * The program runs on the native engine (the translator when the host has
+ * one) without the editor, guest stdin/stdout/stderr are host descriptors.
+ * A report with the exit code, the retired instructions and the speed is
+ * printed on stderr at the end.
+ *
+ * With -p the run is profiled and the report ends with the hottest
+ * instructions, the opcode groups, the ALU operations and the memory
+ * accesses of each region.
+ *
+ * With -c the run is interpreted through a five-stage pipeline model and
+ * the report ends with the cycles, the CPI and the stall breakdown, -F
+ * models the same pipeline without forwarding.
+ *
+ * With -I and -D fetches, loads and stores go through simulated L1 caches
+ * and the report ends with their hits, misses and evictions in each region.
+ *
+ * With -b every branch goes through a simulated predictor, -B adds a BTB,
+ * and the report ends with the accuracy and the most mispredicted branches.
+ *
+ * With -T every retired instruction is recorded to a binary trace file,
+ * aste-trace prints it back.
+ *
+ * With -k and -w the run stops before the instruction of a breakpoint or
+ * after a store into a watched range, and the report tells where.
+ *
+ * Exit status: the guest exit code, 0 when the program runs off the end of
+ * .text, 124 when the instruction limit, the timeout, a breakpoint or a
+ * watchpoint stops it, 125 on a fault, 1 when the program cannot be loaded
+ * and 2 for a usage error.
+ *
+ *   aste-run [-n instructions] [-t seconds] [-i input] [-o output] [-p hot] [-c | -F] [-I cache] [-D cache]
+ *            [-b predictor] [-B entries] [-T trace] [-k address]... [-w address[,size]]... program.s|program.elf
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "args_handler.h"
+#include "asm_file_parser.h"
+#include "elf.h"
+#include "program_loader.h"
+#include "machine.h"
+#include "jit.h"
+#include "syscalls.h"
+#include "profile.h"
+#include "pipeline.h"
+#include "cache.h"
+#include "predictor.h"
+#include "trace.h"
+#include "debugger.h"
+
+// Instructions between two checks of the timeout and two output flushes
+#define RUN_CHUNK (1ull << 24)
+
+// Branches listed in the predictor report
+#define REPORT_BRANCHES 10
+
+// Breakpoints and watchpoints accepted on the command line
+#define RUN_BREAKPOINTS 64
+#define RUN_WATCHPOINTS DEBUGGER_WATCHPOINTS
+
+#define EXIT_LOAD_ERROR  1
+#define EXIT_USAGE       2
+#define EXIT_STOPPED     124
+#define EXIT_FAULT       125
+
+typedef struct {
+	uint64_t           max_instructions;                // 0 for no limit
+	double             timeout;                         // seconds, 0 for no limit
+	const char        *input;                           // guest stdin, NULL for the host one
+	const char        *output;                          // guest stdout, NULL for the host one
+	bool               quiet;                           // no final report
+	uint32_t           hot;                             // hot instructions to report, 0 without a profile
+	bool               cycles;                          // model the pipeline timing
+	bool               forwarding;                      // the modeled pipeline forwards results
+	bool               caches[CACHE_KIND_COUNT];        // simulate the instruction and the data cache
+	cache_config_t     cache_configs[CACHE_KIND_COUNT]; // their geometry
+	bool               predictor;                       // simulate a branch predictor
+	predictor_config_t predictor_config;                // its shape
+	const char        *trace;                           // trace file, NULL for no trace
+	const char        *breakpoints[RUN_BREAKPOINTS];    // -k addresses or symbols
+	uint32_t           breakpoint_count;
+	const char        *watchpoints[RUN_WATCHPOINTS];    // -w ranges
+	uint32_t           watchpoint_count;
+	const char        *program;
+} run_options_t;
+
+static void usage(FILE *stream) {
+	fprintf(stream,
+		"usage: aste-run [options] program.s|program.elf\n"
+		"  -n, --max-instructions N  stop after N instructions\n"
+		"  -t, --timeout SECONDS     stop after SECONDS of wall time\n"
+		"  -i, --stdin FILE          guest standard input, default the runner's\n"
+		"  -o, --stdout FILE         guest standard output, default the runner's\n"
+		"  -p, --profile N           report the N most executed instructions\n"
+		"  -c, --cycles              model a five-stage pipeline, report cycles and stalls\n"
+		"  -F, --no-forwarding       same as -c, without forwarding paths\n"
+		"  -I, --icache SPEC         simulate an L1 instruction cache\n"
+		"  -D, --dcache SPEC         simulate an L1 data cache\n"
+		"                            SPEC is SIZE[,LINE[,WAYS[,lru|fifo|random[,wb|wt]]]],\n"
+		"                            e.g. 32k,64,4,lru,wb (the default past SIZE)\n"
+		"  -b, --predictor SPEC      simulate a branch predictor, report its accuracy\n"
+		"                            SPEC is not-taken|btfn|bimodal[,BITS]|gshare[,BITS[,HISTORY]],\n"
+		"                            BITS is log2 of the 2-bit counters, default 12\n"
+		"  -B, --btb ENTRIES         add a direct-mapped BTB to the predictor\n"
+		"  -T, --trace FILE          record every retired instruction to FILE\n"
+		"  -k, --break ADDRESS       stop before the instruction at ADDRESS, a number or\n"
+		"                            a symbol, may be repeated\n"
+		"  -w, --watch ADDRESS[,N]   stop after a store into the N bytes at ADDRESS,\n"
+		"                            default 4, may be repeated\n"
+		"  -q, --quiet               do not print the final report\n"
+		"  -h, --help                show this help\n");
+}
+
+/**
+ * @brief Read a cache geometry like "32k,64,4,lru,wb", the fields left out
+ * keep the default.
+ * @return false when a field is malformed or the geometry is invalid.
+ */
+static bool parse_cache(
+	const char     *spec,
+	cache_config_t *config
+) {
+	*config = cache_default_config();
+
+	char *end = NULL;
+	unsigned long size = strtoul(spec, &end, 10);
+
+	if (*end == 'k' || *end == 'K') {
+		size *= 1024;
+		end++;
+	}
+
+	if (end == spec || size > UINT32_MAX) return false;
+	config->size = (uint32_t)size;
+
+	for (uint32_t field = 0; *end; field++) {
+		if (*end != ',') return false;
+
+		const char *value = end + 1;
+		const size_t length = strcspn(value, ",");
+
+		if (field == 0 || field == 1) {
+			const unsigned long number = strtoul(value, &end, 10);
+			if (end != value + length || !number || number > UINT32_MAX) return false;
+
+			if (field == 0) config->line_size = (uint32_t)number;
+			else 			config->ways 	  = (uint32_t)number;
+
+		} else if (field == 2) {
+			if 		(!strncmp(value, "lru", length)    && length == 3) config->replacement = CACHE_LRU;
+			else if (!strncmp(value, "fifo", length)   && length == 4) config->replacement = CACHE_FIFO;
+			else if (!strncmp(value, "random", length) && length == 6) config->replacement = CACHE_RANDOM;
+			else return false;
+
+			end = (char *)value + length;
+
+		} else if (field == 3) {
+			if 		(!strncmp(value, "wb", length) && length == 2) config->write_policy = CACHE_WRITE_BACK;
+			else if (!strncmp(value, "wt", length) && length == 2) config->write_policy = CACHE_WRITE_THROUGH;
+			else return false;
+
+			end = (char *)value + length;
+
+		} else {
+			return false;
+		}
+	}
+
+	return cache_config_valid(config);
+}
+
+/**
+ * @brief Read a predictor like "gshare,12,8", the fields left out keep the
+ * default.
+ * @return false when a field is malformed or the shape is invalid.
+ */
+static bool parse_predictor(
+	const char         *spec,
+	predictor_config_t *config
+) {
+	static const char *const kinds[PREDICTOR_KIND_COUNT] = {
+		[PREDICTOR_NOT_TAKEN] = "not-taken",
+		[PREDICTOR_BTFN]      = "btfn",
+		[PREDICTOR_BIMODAL]   = "bimodal",
+		[PREDICTOR_GSHARE]    = "gshare"
+	};
+
+	const uint32_t btb_entries = config->btb_entries;
+	*config = predictor_default_config();
+	config->btb_entries = btb_entries;
+
+	const size_t length = strcspn(spec, ",");
+	uint32_t kind = 0;
+
+	while (kind < PREDICTOR_KIND_COUNT && (strncmp(spec, kinds[kind], length) || kinds[kind][length])) kind++;
+	if (kind == PREDICTOR_KIND_COUNT) return false;
+
+	config->kind = (predictor_kind_t)kind;
+
+	const char *end = spec + length;
+
+	for (uint32_t field = 0; *end; field++) {
+		if (*end != ',' || field > 1 || kind < PREDICTOR_BIMODAL || (field == 1 && kind != PREDICTOR_GSHARE)) return false;
+
+		const char *value = end + 1;
+		char *number_end = NULL;
+		const unsigned long number = strtoul(value, &number_end, 10);
+
+		if (number_end == value || (*number_end && *number_end != ',') || number > PREDICTOR_MAX_TABLE_BITS) return false;
+
+		if (field == 0) config->table_bits 	 = (uint32_t)number;
+		else 			config->history_bits = (uint32_t)number;
+
+		end = number_end;
+	}
+
+	// A shorter table keeps the default history inside it
+	if (config->history_bits > config->table_bits) config->history_bits = config->table_bits;
+
+	return predictor_config_valid(config);
+}
+
+static bool parse_options(
+	int            argc,
+	char         **argv,
+	run_options_t *options
+) {
+	static const struct option long_options[] = {
+		{ "max-instructions", required_argument, NULL, 'n' },
+		{ "timeout",          required_argument, NULL, 't' },
+		{ "stdin",            required_argument, NULL, 'i' },
+		{ "stdout",           required_argument, NULL, 'o' },
+		{ "profile",          required_argument, NULL, 'p' },
+		{ "cycles",           no_argument,       NULL, 'c' },
+		{ "no-forwarding",    no_argument,       NULL, 'F' },
+		{ "icache",           required_argument, NULL, 'I' },
+		{ "dcache",           required_argument, NULL, 'D' },
+		{ "predictor",        required_argument, NULL, 'b' },
+		{ "btb",              required_argument, NULL, 'B' },
+		{ "trace",            required_argument, NULL, 'T' },
+		{ "break",            required_argument, NULL, 'k' },
+		{ "watch",            required_argument, NULL, 'w' },
+		{ "quiet",            no_argument,       NULL, 'q' },
+		{ "help",             no_argument,       NULL, 'h' },
+		{ NULL, 0, NULL, 0 }
+	};
+
+	*options = (run_options_t){ .forwarding = true, .predictor_config = predictor_default_config() };
+
+	int option;
+	while ((option = getopt_long(argc, argv, "n:t:i:o:p:cFI:D:b:B:T:k:w:qh", long_options, NULL)) != -1) {
+		char *end = NULL;
+
+		switch (option) {
+			case 'n':
+				options->max_instructions = strtoull(optarg, &end, 10);
+				if (*end || !options->max_instructions) return false;
+				break;
+
+			case 't':
+				options->timeout = strtod(optarg, &end);
+				if (*end || options->timeout <= 0) return false;
+				break;
+
+			case 'p':
+				options->hot = (uint32_t)strtoul(optarg, &end, 10);
+				if (*end || !options->hot) return false;
+				break;
+
+			case 'c':
+				options->cycles = true;
+				break;
+
+			case 'F':
+				options->cycles 	= true;
+				options->forwarding = false;
+				break;
+
+			case 'I':
+			case 'D': {
+				const cache_kind_t kind = option == 'I' ? CACHE_INSTRUCTION : CACHE_DATA;
+
+				options->caches[kind] = true;
+				if (!parse_cache(optarg, &options->cache_configs[kind])) return false;
+				break;
+			}
+
+			case 'b':
+				options->predictor = true;
+				if (!parse_predictor(optarg, &options->predictor_config)) return false;
+				break;
+
+			case 'B': {
+				const unsigned long entries = strtoul(optarg, &end, 10);
+				if (*end || !entries || entries > UINT32_MAX) return false;
+
+				options->predictor 					  = true;
+				options->predictor_config.btb_entries = (uint32_t)entries;
+				if (!predictor_config_valid(&options->predictor_config)) return false;
+				break;
+			}
+
+			case 'k':
+				if (options->breakpoint_count == RUN_BREAKPOINTS) return false;
+				options->breakpoints[options->breakpoint_count++] = optarg;
+				break;
+
+			case 'w':
+				if (options->watchpoint_count == RUN_WATCHPOINTS) return false;
+				options->watchpoints[options->watchpoint_count++] = optarg;
+				break;
+
+			case 'i': options->input  = optarg; break;
+			case 'o': options->output = optarg; break;
+			case 'T': options->trace  = optarg; break;
+			case 'q': options->quiet  = true;   break;
+
+			case 'h':
+				usage(stdout);
+				exit(0);
+
+			default:
+				return false;
+		}
+	}
+
+	if (optind != argc - 1) return false;
+
+	options->program = argv[optind];
+
+	return true;
+}
+
+/// Assembler diagnostics go to stderr
+static void print_messages(
+	const assembler_message_t *messages,
+	size_t count
+) {
+	for (size_t i = 0; i < count; i++) fprintf(stderr, "%s\n", messages[i].text);
+}
+
+static double now_seconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Run until exit, a fault or a limit.
+ * @return The final status of the engine.
+ */
+static cpu_status_t run_program(
+	MACHINE              machine,
+	const run_options_t *options,
+	const double         start
+) {
+	const uint64_t limit = options->max_instructions ? options->max_instructions : UINT64_MAX;
+
+	// The stops are only checked under a debugger command. It is resumed
+	// for every chunk, so the breakpoint at pc is not passed, neither on
+	// the entry point nor where the previous chunk was cut
+	const bool debugging = options->breakpoint_count || options->watchpoint_count;
+
+	for (;;) {
+		const uint64_t left  = limit - machine->instret;
+		const uint64_t chunk = left < RUN_CHUNK ? left : RUN_CHUNK;
+		if (left == 0) return CPU_STATUS_BUDGET_EXHAUSTED;
+
+		const cpu_status_t status = debugging ? debug_resume(machine, chunk) : cpu_run(machine, chunk);
+		syscall_flush(machine->syscalls);
+
+		switch (status) {
+			case CPU_STATUS_BUDGET_EXHAUSTED:
+				if (options->timeout && now_seconds() - start >= options->timeout) return status;
+				break;
+
+			// Unknown syscalls and breakpoints are skipped
+			case CPU_STATUS_ECALL:
+				fprintf(stderr, "aste-run: unsupported syscall %u at 0x%08x\n", machine->registers[17], machine->pc - 4);
+				break;
+
+			case CPU_STATUS_EBREAK:
+				break;
+
+			default:
+				return status;
+		}
+	}
+}
+
+static const char *status_description(cpu_status_t status) {
+	switch (status) {
+		case CPU_STATUS_EXIT:                return "exit";
+		case CPU_STATUS_OUT_OF_TEXT:         return "end of .text";
+		case CPU_STATUS_BUDGET_EXHAUSTED:    return "instruction limit or timeout";
+		case CPU_STATUS_FETCH_FAULT:         return "instruction fetch fault";
+		case CPU_STATUS_ILLEGAL_INSTRUCTION: return "illegal instruction";
+		case CPU_STATUS_LOAD_FAULT:          return "load fault";
+		case CPU_STATUS_STORE_FAULT:         return "store fault";
+		case CPU_STATUS_BREAKPOINT:          return "breakpoint";
+		case CPU_STATUS_WATCHPOINT:          return "watchpoint";
+		default:                             return "stopped";
+	}
+}
+
+static double percent(
+	uint64_t part,
+	uint64_t total
+) {
+	return total ? 100.0 * (double)part / (double)total : 0.0;
+}
+
+/**
+ * @brief Print the hottest instructions and the histograms of the run.
+ * @param opts Loaded program, its symbols name the instructions.
+ */
+static void print_profile(
+	MACHINE          machine,
+	const options_t *opts,
+	uint32_t         hot
+) {
+	profile_snapshot_t snapshot;
+	if (!profile_snapshot(machine, &snapshot)) return;
+
+	profile_entry_t *entries = calloc(hot, sizeof(profile_entry_t));
+	const uint32_t   count   = entries ? profile_hot(machine, entries, hot) : 0;
+
+	fprintf(stderr, "\nhot instructions\n");
+
+	for (uint32_t i = 0; i < count; i++) {
+		const profile_entry_t *entry  = &entries[i];
+		const elf_symbol_t    *symbol = find_elf_symbol(opts, entry->pc);
+
+		char location[64] = "";
+		if (symbol) snprintf(location, sizeof(location), "%s+0x%x", symbol->name, entry->pc - symbol->address);
+
+		fprintf(stderr, "  0x%08x  %12llu  %5.1f%%  %-24s %s\n", entry->pc, (unsigned long long)entry->count,
+				percent(entry->count, snapshot.instructions), location, handler_name(entry->handler));
+	}
+
+	free(entries);
+
+	fprintf(stderr, "\nopcode groups\n");
+	for (uint32_t group = 0; group < PROFILE_CLASS_COUNT; group++) {
+		if (!snapshot.classes[group]) continue;
+
+		fprintf(stderr, "  %-8s %12llu  %5.1f%%\n", profile_class_name((profile_class_t)group),
+				(unsigned long long)snapshot.classes[group], percent(snapshot.classes[group], snapshot.instructions));
+	}
+
+	fprintf(stderr, "\nALU operations\n");
+	for (uint32_t operation = 0; operation < PROFILE_ALU_COUNT; operation++) {
+		if (!snapshot.alu[operation]) continue;
+
+		fprintf(stderr, "  %-8s %12llu  %5.1f%%\n", profile_alu_name((profile_alu_t)operation),
+				(unsigned long long)snapshot.alu[operation], percent(snapshot.alu[operation], snapshot.instructions));
+	}
+
+	fprintf(stderr, "\nmemory        %12s %12s\n", "loads", "stores");
+	for (uint32_t i = 0; i < snapshot.region_count; i++) {
+		const profile_region_t *region = &snapshot.regions[i];
+		if (!region->loads && !region->stores) continue;
+
+		fprintf(stderr, "  %-11s %12llu %12llu\n", region->name,
+				(unsigned long long)region->loads, (unsigned long long)region->stores);
+	}
+}
+
+/**
+ * @brief Print the modeled cycles and where they were lost.
+ */
+static void print_pipeline(const MACHINE machine) {
+	pipeline_stats_t stats;
+	if (!pipeline_stats(machine, &stats)) return;
+
+	const uint64_t stalls  = stats.load_use_stalls + stats.data_stalls;
+	const uint64_t flushes = stats.branch_flushes + stats.jump_flushes;
+
+	fprintf(stderr, "\npipeline      %s\n", machine->pipeline->config.forwarding ? "5 stages, forwarding" : "5 stages, no forwarding");
+	fprintf(stderr, "cycles        %llu\n", (unsigned long long)stats.cycles);
+	fprintf(stderr, "CPI           %.3f\n", pipeline_cpi(&stats));
+
+	const struct { const char *name; uint64_t cycles; } lost[] = {
+		{ "load-use", stats.load_use_stalls },
+		{ "data",     stats.data_stalls },
+		{ "branch",   stats.branch_flushes },
+		{ "jump",     stats.jump_flushes },
+		{ "total",    stalls + flushes }
+	};
+
+	fprintf(stderr, "\nlost cycles\n");
+	for (size_t i = 0; i < sizeof(lost) / sizeof(lost[0]); i++) {
+		fprintf(stderr, "  %-8s %12llu  %5.1f%%\n", lost[i].name, (unsigned long long)lost[i].cycles, percent(lost[i].cycles, stats.cycles));
+	}
+
+	fprintf(stderr, "\nforwarded\n");
+	fprintf(stderr, "  EX/MEM   %12llu\n", (unsigned long long)stats.forwards_ex_mem);
+	fprintf(stderr, "  MEM/WB   %12llu\n", (unsigned long long)stats.forwards_mem_wb);
+
+	fprintf(stderr, "\ncontrol transfers\n");
+	fprintf(stderr, "  branches %12llu  %5.1f%% taken\n", (unsigned long long)stats.branches, percent(stats.taken_branches, stats.branches));
+	fprintf(stderr, "  jumps    %12llu\n", (unsigned long long)stats.jumps);
+}
+
+/**
+ * @brief Print the totals of a simulated cache and its accesses by region.
+ */
+static void print_cache(
+	const MACHINE machine,
+	cache_kind_t  kind
+) {
+	cache_stats_t stats;
+	if (!cache_stats(machine, kind, &stats)) return;
+
+	const cache_config_t *config = &stats.config;
+
+	fprintf(stderr, "\n%s cache  %u KiB, %u-byte lines, %u-way, %s%s\n",
+			kind == CACHE_INSTRUCTION ? "instruction" : "data",
+			config->size / 1024, config->line_size, config->ways, cache_replacement_name(config->replacement),
+			kind == CACHE_INSTRUCTION ? "" : config->write_policy == CACHE_WRITE_BACK ? ", write-back" : ", write-through");
+
+	fprintf(stderr, "  accesses %12llu\n", (unsigned long long)stats.accesses);
+	fprintf(stderr, "  hits     %12llu\n", (unsigned long long)stats.hits);
+	fprintf(stderr, "  misses   %12llu  %5.2f%%\n", (unsigned long long)stats.misses, 100.0 * cache_miss_rate(stats.misses, stats.accesses));
+	fprintf(stderr, "  evicted  %12llu\n", (unsigned long long)stats.evictions);
+
+	if (kind == CACHE_DATA && config->write_policy == CACHE_WRITE_BACK) {
+		fprintf(stderr, "  written  %12llu  back on eviction\n", (unsigned long long)stats.writebacks);
+
+	} else if (kind == CACHE_DATA) {
+		fprintf(stderr, "  written  %12llu  through\n", (unsigned long long)stats.write_throughs);
+	}
+
+	fprintf(stderr, "\n  %-11s %12s %12s %8s %12s\n", "region", "accesses", "misses", "rate", "evicted");
+	for (uint32_t i = 0; i < stats.region_count; i++) {
+		const cache_region_t *region = &stats.regions[i];
+		if (!region->accesses && !region->evictions) continue;
+
+		fprintf(stderr, "  %-11s %12llu %12llu %7.2f%% %12llu\n", region->name,
+				(unsigned long long)region->accesses, (unsigned long long)region->misses,
+				100.0 * cache_miss_rate(region->misses, region->accesses), (unsigned long long)region->evictions);
+	}
+}
+
+/**
+ * @brief Print the accuracy of the simulated predictor and its worst branches.
+ * @param opts Loaded program, its symbols name the branches.
+ */
+static void print_predictor(
+	const MACHINE    machine,
+	const options_t *opts
+) {
+	predictor_stats_t stats;
+	if (!predictor_stats(machine, &stats)) return;
+
+	const predictor_config_t *config = &stats.config;
+
+	fprintf(stderr, "\nbranch predictor  %s", predictor_kind_name(config->kind));
+	if (config->kind == PREDICTOR_BIMODAL) fprintf(stderr, ", %u counters", 1u << config->table_bits);
+	if (config->kind == PREDICTOR_GSHARE) fprintf(stderr, ", %u counters, %u history bits", 1u << config->table_bits, config->history_bits);
+	if (config->btb_entries) fprintf(stderr, ", %u-entry BTB", config->btb_entries);
+	fprintf(stderr, "\n");
+
+	fprintf(stderr, "  branches     %12llu  %5.1f%% taken\n", (unsigned long long)stats.branches, percent(stats.taken, stats.branches));
+	fprintf(stderr, "  mispredicted %12llu  %5.2f%%\n", (unsigned long long)stats.mispredicted, percent(stats.mispredicted, stats.branches));
+	fprintf(stderr, "  accuracy     %11.2f%%\n", 100.0 * predictor_accuracy(stats.mispredicted, stats.branches));
+	fprintf(stderr, "  MPKI         %12.2f\n", machine->instret ? 1000.0 * (double)stats.mispredicted / (double)machine->instret : 0.0);
+
+	if (config->btb_entries) {
+		fprintf(stderr, "  direction    %12llu\n", (unsigned long long)stats.direction_misses);
+		fprintf(stderr, "  target       %12llu\n", (unsigned long long)stats.target_misses);
+		fprintf(stderr, "  jumps        %12llu  %5.2f%% missed in the BTB\n", (unsigned long long)stats.jumps, percent(stats.jump_misses, stats.jumps));
+	}
+
+	predictor_entry_t entries[REPORT_BRANCHES];
+	const uint32_t    count = predictor_branches(machine, entries, REPORT_BRANCHES);
+	if (!count) return;
+
+	fprintf(stderr, "\n  %-10s  %12s %7s %12s %8s\n", "branch", "executed", "taken", "mispredicted", "accuracy");
+
+	for (uint32_t i = 0; i < count; i++) {
+		const predictor_entry_t *entry  = &entries[i];
+		const elf_symbol_t      *symbol = find_elf_symbol(opts, entry->pc);
+
+		char location[64] = "";
+		if (symbol) snprintf(location, sizeof(location), "%s+0x%x", symbol->name, entry->pc - symbol->address);
+
+		fprintf(stderr, "  0x%08x  %12llu %6.1f%% %12llu %7.2f%%  %s\n", entry->pc,
+				(unsigned long long)entry->site.executed, percent(entry->site.taken, entry->site.executed),
+				(unsigned long long)entry->site.mispredicted,
+				100.0 * predictor_accuracy(entry->site.mispredicted, entry->site.executed), location);
+	}
+}
+
+/**
+ * @brief Print the size of the trace and the records the writer could not
+ * keep up with.
+ */
+static void print_trace(const trace_stats_t *stats) {
+	fprintf(stderr, "\ntrace\n");
+	fprintf(stderr, "  records  %12llu\n", (unsigned long long)stats->records);
+	fprintf(stderr, "  blocks   %12llu\n", (unsigned long long)stats->blocks);
+	fprintf(stderr, "  bytes    %12llu  %.2f per record\n", (unsigned long long)stats->bytes,
+			stats->records ? (double)stats->bytes / (double)stats->records : 0.0);
+
+	if (stats->dropped_blocks) {
+		fprintf(stderr, "  dropped  %12llu  records in %llu blocks, the disk fell behind\n",
+				(unsigned long long)stats->dropped_records, (unsigned long long)stats->dropped_blocks);
+	}
+}
+
+/**
+ * @brief Read an address, a number in any base or the name of a symbol.
+ * @return false when it is neither.
+ */
+static bool parse_address(
+	const options_t *opts,
+	const char      *text,
+	size_t           length,
+	uint32_t        *address
+) {
+	char *end = NULL;
+	const unsigned long number = strtoul(text, &end, 0);
+
+	if (end == text + length && length && number <= UINT32_MAX) {
+		*address = (uint32_t)number;
+		return true;
+	}
+
+	for (uint32_t i = 0; i < opts->symbol_count; i++) {
+		if (strncmp(opts->symbols[i].name, text, length) || opts->symbols[i].name[length]) continue;
+
+		*address = opts->symbols[i].address;
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * @brief Set the breakpoints and the watchpoints of the command line.
+ * @return false with a message when one cannot be resolved or set.
+ */
+static bool set_stops(
+	MACHINE              machine,
+	const options_t     *opts,
+	const run_options_t *options
+) {
+	for (uint32_t i = 0; i < options->breakpoint_count; i++) {
+		const char *text = options->breakpoints[i];
+		uint32_t address;
+
+		if (!parse_address(opts, text, strlen(text), &address) || !set_breakpoint(machine, address, true)) {
+			fprintf(stderr, "aste-run: %s: not an instruction of .text\n", text);
+			return false;
+		}
+	}
+
+	for (uint32_t i = 0; i < options->watchpoint_count; i++) {
+		const char  *text   = options->watchpoints[i];
+		const size_t length = strcspn(text, ",");
+
+		uint32_t address;
+		unsigned long size = 4;
+		char *end = NULL;
+
+		if (text[length]) size = strtoul(text + length + 1, &end, 0);
+
+		if (!parse_address(opts, text, length, &address) || (end && *end) || !size || size > UINT32_MAX ||
+			!add_watchpoint(machine, address, (uint32_t)size)) {
+			fprintf(stderr, "aste-run: %s: not a range of addresses\n", text);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * @brief Print where a breakpoint or a watchpoint stopped the run.
+ * @param opts Loaded program, its symbols name the instructions.
+ */
+static void print_stop(
+	const MACHINE    machine,
+	const options_t *opts,
+	cpu_status_t     status
+) {
+	// A watchpoint stops after the store
+	const uint32_t      pc     = status == CPU_STATUS_WATCHPOINT ? machine->pc - 4 : machine->pc;
+	const elf_symbol_t *symbol = find_elf_symbol(opts, pc);
+
+	char location[64] = "";
+	if (symbol) snprintf(location, sizeof(location), " (%s+0x%x)", symbol->name, pc - symbol->address);
+
+	if (status == CPU_STATUS_WATCHPOINT) {
+		fprintf(stderr, "store         0x%08x by 0x%08x%s\n", machine->debugger->stop_address, pc, location);
+	} else {
+		fprintf(stderr, "pc            0x%08x%s\n", pc, location);
+	}
+}
+
+/// Open a redirection, -1 with a message when it fails
+static int open_file(
+	const char *path,
+	int         flags
+) {
+	const int fd = open(path, flags, 0644);
+	if (fd < 0) fprintf(stderr, "aste-run: %s: %s\n", path, strerror(errno));
+
+	return fd;
+}
+
+int main(int argc, char **argv) {
+	run_options_t options;
+
+	if (!parse_options(argc, argv, &options)) {
+		usage(stderr);
+		return EXIT_USAGE;
+	}
+
+	options_t *opts = start_options((char *)options.program);
+	if (!opts) return EXIT_LOAD_ERROR;
+
+	if (parse_riscv_file(opts, print_messages) != 0) {
+		fprintf(stderr, "aste-run: cannot load %s\n", options.program);
+		free_options(opts);
+
+		return EXIT_LOAD_ERROR;
+	}
+
+	program_layout_t layout;
+	RAM     ram     = new_program_ram(opts, &layout);
+	MACHINE machine = ram ? new_machine(ram, opts->entry_point) : NULL;
+
+	if (!machine || !load_decoded_text(machine, opts->text_data, opts->text_size, opts->text_vaddr) ||
+		!enable_syscalls(machine, print_messages)) {
+		fprintf(stderr, "aste-run: out of memory\n");
+		destroy_machine(machine);
+		destroy_ram(ram);
+		free_options(opts);
+
+		return EXIT_LOAD_ERROR;
+	}
+
+	machine->registers[2] = layout.stack_pointer;
+	machine->registers[3] = layout.global_pointer;
+
+	// Interpreted when the host has no translator
+	enable_jit(machine);
+
+	if (options.hot && !enable_profile(machine)) {
+		fprintf(stderr, "aste-run: out of memory\n");
+		options.hot = 0;
+	}
+
+	pipeline_config_t pipeline = pipeline_default_config();
+	pipeline.forwarding = options.forwarding;
+
+	if (options.cycles && !enable_pipeline(machine, &pipeline)) {
+		fprintf(stderr, "aste-run: out of memory\n");
+		options.cycles = false;
+	}
+
+	const bool caches = options.caches[CACHE_INSTRUCTION] || options.caches[CACHE_DATA];
+
+	if (caches && !enable_cache(machine,
+								options.caches[CACHE_INSTRUCTION] ? &options.cache_configs[CACHE_INSTRUCTION] : NULL,
+								options.caches[CACHE_DATA] 		  ? &options.cache_configs[CACHE_DATA] 		  : NULL)) {
+		fprintf(stderr, "aste-run: out of memory\n");
+		options.caches[CACHE_INSTRUCTION] = options.caches[CACHE_DATA] = false;
+	}
+
+	if (options.predictor && !enable_predictor(machine, &options.predictor_config)) {
+		fprintf(stderr, "aste-run: out of memory\n");
+		options.predictor = false;
+	}
+
+	if (options.trace && !enable_trace(machine, options.trace)) {
+		fprintf(stderr, "aste-run: %s: cannot create the trace\n", options.trace);
+		options.trace = NULL;
+	}
+
+	if (!set_stops(machine, opts, &options)) {
+		destroy_machine(machine);
+		destroy_ram(ram);
+		free_options(opts);
+
+		return EXIT_USAGE;
+	}
+
+	const int input  = options.input  ? open_file(options.input, O_RDONLY) : STDIN_FILENO;
+	const int output = options.output ? open_file(options.output, O_WRONLY | O_CREAT | O_TRUNC) : STDOUT_FILENO;
+
+	int exit_status = EXIT_LOAD_ERROR;
+
+	if (input >= 0 && output >= 0) {
+		syscall_redirect(machine->syscalls, 0, input);
+		syscall_redirect(machine->syscalls, 1, output);
+		syscall_redirect(machine->syscalls, 2, STDERR_FILENO);
+
+		const double 	   start   = now_seconds();
+		const cpu_status_t status  = run_program(machine, &options, start);
+		const double 	   elapsed = now_seconds() - start;
+
+		// Complete the file before reporting on it
+		trace_stats_t trace;
+		if (options.trace && !disable_trace(machine, &trace)) {
+			fprintf(stderr, "aste-run: %s: cannot write the trace\n", options.trace);
+		}
+
+		switch (status) {
+			case CPU_STATUS_EXIT:             exit_status = machine->syscalls->exit_code & 0xFF; break;
+			case CPU_STATUS_OUT_OF_TEXT:      exit_status = 0; break;
+			case CPU_STATUS_BUDGET_EXHAUSTED:
+			case CPU_STATUS_BREAKPOINT:
+			case CPU_STATUS_WATCHPOINT:       exit_status = EXIT_STOPPED; break;
+			default:                          exit_status = EXIT_FAULT; break;
+		}
+
+		if (!options.quiet) {
+			fprintf(stderr, "\n--- %s\n", status_description(status));
+
+			if (status == CPU_STATUS_LOAD_FAULT || status == CPU_STATUS_STORE_FAULT) {
+				const ram_region_t *region = ram_find_region(ram, machine->fault_address);
+
+				fprintf(stderr, "fault         0x%08x (%s): %s\n", machine->fault_address,
+						region ? region->name : "no region", ram_access_description(machine->fault_access));
+			}
+
+			if (status == CPU_STATUS_BREAKPOINT || status == CPU_STATUS_WATCHPOINT) print_stop(machine, opts, status);
+			if (status == CPU_STATUS_EXIT) fprintf(stderr, "exit code     %d\n", machine->syscalls->exit_code);
+
+			fprintf(stderr, "instructions  %llu\n", (unsigned long long)machine->instret);
+			fprintf(stderr, "time          %.3f s\n", elapsed);
+			fprintf(stderr, "MIPS          %.1f\n", elapsed > 0 ? (double)machine->instret / elapsed / 1e6 : 0.0);
+
+			if (options.hot) print_profile(machine, opts, options.hot);
+			if (options.cycles) print_pipeline(machine);
+			if (options.caches[CACHE_INSTRUCTION]) print_cache(machine, CACHE_INSTRUCTION);
+			if (options.caches[CACHE_DATA]) print_cache(machine, CACHE_DATA);
+			if (options.predictor) print_predictor(machine, opts);
+			if (options.trace) print_trace(&trace);
+		}
+	}
+
+	if (options.input  && input  >= 0) close(input);
+	if (options.output && output >= 0) close(output);
+
+	destroy_machine(machine);
+	destroy_ram(ram);
+	free_options(opts);
+
+	return exit_status;
+}
@@ -0,0 +1,127 @@
+/**
+ * @file aste_trace.c
+ * @brief Prints an execution trace written by aste-run -T.
+ *
+ * Without a step the size of the trace and its gaps are printed. With a
+ * step the records from that step are printed one per line: the step, the
+ * pc, the raw word and its operation, the register written and the memory
+ * access. Only the block holding the step is decoded, a step deep in a
+ * large trace is reached at once.
+ *
+ * Exit status: 0, 1 when the file is not a trace or the step is past its
+ * end and 2 for a usage error.
+ *
+ *   aste-trace trace [step [count]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "predecode.h"
+#include "trace.h"
+
+#define DEFAULT_COUNT 20
+
+#define EXIT_NOT_FOUND 1
+#define EXIT_USAGE     2
+
+static void usage(FILE *stream) {
+	fprintf(stream,
+		"usage: aste-trace trace [step [count]]\n"
+		"  without a step, print the size of the trace\n"
+		"  with a step, print count records from it, default %d\n", DEFAULT_COUNT);
+}
+
+/**
+ * @brief Read a decimal number, false when it is malformed.
+ */
+static bool parse_number(
+	const char     *text,
+		  uint64_t *value
+) {
+	char *end = NULL;
+	*value = strtoull(text, &end, 10);
+
+	return end != text && !*end;
+}
+
+/**
+ * @brief Print the blocks, the records and the steps lost to dropped blocks.
+ */
+static void print_summary(const TRACE_READER reader) {
+	uint64_t missing = 0;
+
+	for (uint32_t i = 1; i < reader->block_count; i++) {
+		const trace_block_t *previous = &reader->blocks[i - 1];
+		missing += reader->blocks[i].first_step - (previous->first_step + previous->count);
+	}
+
+	printf("blocks   %12u\n", reader->block_count);
+	printf("records  %12llu\n", (unsigned long long)reader->records);
+	printf("bytes    %12llu  %.2f per record\n", (unsigned long long)reader->size,
+		   reader->records ? (double)reader->size / (double)reader->records : 0.0);
+
+	if (reader->block_count) {
+		const trace_block_t *last = &reader->blocks[reader->block_count - 1];
+
+		printf("steps    %12llu to %llu\n", (unsigned long long)reader->blocks[0].first_step,
+			   (unsigned long long)(last->first_step + last->count - 1));
+	}
+
+	if (missing) printf("missing  %12llu  steps in dropped blocks\n", (unsigned long long)missing);
+}
+
+static void print_record(const trace_record_t *record) {
+	printf("%10llu  0x%08x  %08x  %-7s", (unsigned long long)record->step, record->pc, record->word,
+		   handler_name((handler_id_t)decode_instruction(record->word).handler));
+
+	// Accesses line up whether a register was written or not
+	if (record->flags & TRACE_RD) 			printf("  x%-2u = 0x%08x", record->rd, record->rd_value);
+	else if (record->flags & TRACE_MEMORY) 	printf("  %16s", "");
+
+	if (record->flags & TRACE_MEMORY) printf("  [0x%08x] 0x%08x", record->address, record->value);
+
+	printf("\n");
+}
+
+int main(int argc, char **argv) {
+	if (argc < 2 || argc > 4) {
+		usage(stderr);
+		return EXIT_USAGE;
+	}
+
+	uint64_t step  = 0;
+	uint64_t count = DEFAULT_COUNT;
+
+	if ((argc > 2 && !parse_number(argv[2], &step)) || (argc > 3 && !parse_number(argv[3], &count))) {
+		usage(stderr);
+		return EXIT_USAGE;
+	}
+
+	TRACE_READER reader = new_trace_reader(argv[1]);
+	if (!reader) {
+		fprintf(stderr, "aste-trace: %s: not a trace\n", argv[1]);
+		return EXIT_NOT_FOUND;
+	}
+
+	int exit_status = 0;
+
+	if (argc == 2) {
+		print_summary(reader);
+
+	} else {
+		trace_cursor_t cursor;
+		trace_record_t record;
+
+		if (!trace_seek(reader, step, &cursor)) {
+			fprintf(stderr, "aste-trace: no step %llu in %s\n", (unsigned long long)step, argv[1]);
+			exit_status = EXIT_NOT_FOUND;
+		}
+
+		for (uint64_t i = 0; !exit_status && i < count && trace_next(&cursor, &record); i++) print_record(&record);
+	}
+
+	destroy_trace_reader(reader);
+
+	return exit_status;
+}